@@ -1,441 +1,6512 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "esp_config_db.h"
 #include "esp_config.h"
+#include "esp_config_port.h"
 
 static const char* tag = "config";
 
+#define ESP_CONFIG_NVS_NAMESPACE "esp_config" // Namespace for the library's own records
+#define ESP_CONFIG_DUMP_BUFFER 128 // Stack buffer of the summary and the JSON export, larger overrides are reported by size
+
+/*
+ * A database generated by tools/esp_config_gen.py brings its own index,
+ * sorted at build time and searched in flash, so the hash index is not
+ * built in RAM.
+ */
+#ifdef ESP_CONFIG_DB_SORTED
+#define ESP_CONFIG_RAM_INDEX 0
+#else
+#define ESP_CONFIG_RAM_INDEX CONFIG_ESP_CONFIG_INDEX
+#endif
+
+/*
+ * Entries of the compiled database. A compact database, generated by
+ * tools/esp_config_gen.py --compact, holds no esp_config_entry_t, so
+ * entries are decoded into a view given by the caller and valid as long as
+ * it is. Other databases return their own entries and leave the view alone.
+ */
+#ifdef ESP_CONFIG_DB_COMPACT
+
+static const char* esp_config_db_key(int ns, int entry) {
+    return &database_keys[database_key[database[ns].first + entry]];
+}
+
+static esp_config_encoding_t esp_config_db_encoding(int ns, int entry) {
+    return (esp_config_encoding_t)(database_type[database[ns].first + entry] & ((1 << ESP_CONFIG_DB_FLAGS_SHIFT) - 1));
+}
+
+static uint32_t esp_config_db_flags(int ns, int entry) {
+    return database_type[database[ns].first + entry] >> ESP_CONFIG_DB_FLAGS_SHIFT;
+}
+
+static const esp_config_entry_t* esp_config_db_entry(int ns, int entry, esp_config_entry_t *view) {
+
+    int id = database[ns].first + entry;
+    esp_config_encoding_t encoding = esp_config_db_encoding(ns, entry);
+    uint32_t flags = esp_config_db_flags(ns, entry);
+    uint32_t value = database_value[id];
+    const uint8_t *payload = NULL;
+    int64_t scalar = 0;
+    size_t size = 0;
+    int shift = 0;
+
+    // The members of an entry are const, so it is built on the stack and copied
+    if (encoding == STRING || encoding == BLOB) {
+        payload = (const uint8_t*)database_payload + value;
+        do {
+            size |= (size_t)(*payload & 0x7f) << shift;
+            shift += 7;
+        } while (*payload++ & 0x80);
+        esp_config_entry_t decoded = {
+            .key = esp_config_db_key(ns, entry),
+            .encoding = encoding,
+            .value = {.blob = payload},
+            .value_size = size,
+            .flags = flags
+        };
+        memcpy(view, &decoded, sizeof(decoded));
+    } else {
+        if (encoding == UINT64 || encoding == INT64) {
+            memcpy(&scalar, database_payload + value, sizeof(scalar)); // Stored little endian and unaligned
+        } else {
+            memcpy(&scalar, &value, sizeof(value)); // Every integer member starts the union
+        }
+        esp_config_entry_t decoded = {
+            .key = esp_config_db_key(ns, entry),
+            .encoding = encoding,
+            .value = {.int64 = scalar},
+            .flags = flags
+        };
+        memcpy(view, &decoded, sizeof(decoded));
+    }
+
+    return view;
+}
+
+#else
+
+static const char* esp_config_db_key(int ns, int entry) {
+    return database[ns].entries[entry].key;
+}
+
+static esp_config_encoding_t esp_config_db_encoding(int ns, int entry) {
+    return database[ns].entries[entry].encoding;
+}
+
+static uint32_t esp_config_db_flags(int ns, int entry) {
+    return database[ns].entries[entry].flags;
+}
+
+static const esp_config_entry_t* esp_config_db_entry(int ns, int entry, esp_config_entry_t *view) {
+    (void)view;
+    return &database[ns].entries[entry];
+}
+
+#endif /* ESP_CONFIG_DB_COMPACT */
+
+/*
+ * ESP_CONFIG_DB_KEYS sizes every table indexed by the position of a key
+ * across the whole database, so a database with another number of keys is
+ * refused rather than overrun them: esp_config_init() fails, and so do
+ * lookups and walks over all keys. The keys are counted once, threads
+ * racing to count them storing the same result, along with the position
+ * of the first key of each namespace when the database does not hold it.
+ */
+static int db_keys = -1;
+#ifndef ESP_CONFIG_DB_COMPACT
+static int db_first[ESP_CONFIG_DB_ENTRIES];
+#endif
+
+static bool esp_config_db_checked() {
+
+    int nkeys = __atomic_load_n(&db_keys, __ATOMIC_ACQUIRE);
+
+    if (nkeys < 0) {
+        nkeys = 0;
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+#ifndef ESP_CONFIG_DB_COMPACT
+            __atomic_store_n(&db_first[i], nkeys, __ATOMIC_RELAXED);
+#endif
+            nkeys += database[i].nentries;
+        }
+        if (nkeys != ESP_CONFIG_DB_KEYS) {
+            ESP_LOGE(tag,"ESP_CONFIG_DB_KEYS is %d but the database has %d keys.", ESP_CONFIG_DB_KEYS, nkeys);
+        }
+        __atomic_store_n(&db_keys, nkeys, __ATOMIC_RELEASE);
+    }
+
+    return nkeys == ESP_CONFIG_DB_KEYS;
+}
+
+/*
+ * Position of the first key of a namespace across the whole database,
+ * once esp_config_db_checked() returned true.
+ */
+static int esp_config_db_first(int ns) {
+#ifdef ESP_CONFIG_DB_COMPACT
+    return database[ns].first;
+#else
+    return __atomic_load_n(&db_first[ns], __ATOMIC_RELAXED);
+#endif
+}
+
+#if ESP_CONFIG_RAM_INDEX || defined(ESP_CONFIG_DB_SORTED)
+
+static uint32_t esp_config_index_hash(const char *ns, const char *key) {
+
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (const char *c = ns; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    hash = (hash ^ 0xff) * 16777619u; // Separator, so that "ab"/"c" and "a"/"bc" differ
+    for (const char *c = key; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+
+    return hash;
+}
+
+#endif
+
+#if ESP_CONFIG_RAM_INDEX
+
+/*
+ * Hash index over all (namespace, key) pairs of the defaults database.
+ *
+ * The table is sized at compile time from ESP_CONFIG_DB_KEYS and filled by
+ * esp_config_init() or the first lookup, whichever comes first, once,
+ * under the library lock. Collisions are resolved by linear probing, and each slot
+ * keeps the full 32-bit hash so that a string comparison only happens on the
+ * candidate that actually matches.
+ */
+#define ESP_CONFIG_INDEX_SLOTS (2 * ESP_CONFIG_DB_KEYS + 1)
+#define ESP_CONFIG_INDEX_EMPTY UINT16_MAX
+
+#define ESP_CONFIG_INDEX_UNBUILT 0
+#define ESP_CONFIG_INDEX_READY 1
+
+typedef struct {
+    uint32_t hash;      /**< Hash of namespace and key */
+    uint16_t ns;        /**< Index in database[], ESP_CONFIG_INDEX_EMPTY if the slot is free */
+    uint16_t entry;     /**< Index in the namespace entries[] */
+    uint16_t id;        /**< Position of the entry across the whole database */
+} esp_config_index_slot_t;
+
+static esp_config_index_slot_t index_slots[ESP_CONFIG_INDEX_SLOTS];
+static int index_state = ESP_CONFIG_INDEX_UNBUILT;
+
+/*
+ * Fills the table. Only called by esp_config_index_ready() under the
+ * library lock, as a second builder would clear slots readers already use,
+ * and once the number of keys is checked, see esp_config_db_checked().
+ */
+static void esp_config_index_build() {
+
+    uint32_t hash = 0;
+    uint32_t slot = 0;
+    uint16_t id = 0;
+
+    for (int i = 0; i < ESP_CONFIG_INDEX_SLOTS; i++) {
+        index_slots[i].ns = ESP_CONFIG_INDEX_EMPTY;
+    }
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++) {
+            hash = esp_config_index_hash(database[i].name, esp_config_db_key(i, j));
+            slot = hash % ESP_CONFIG_INDEX_SLOTS;
+            while (index_slots[slot].ns != ESP_CONFIG_INDEX_EMPTY) {
+                slot = (slot + 1) % ESP_CONFIG_INDEX_SLOTS;
+            }
+            index_slots[slot].hash = hash;
+            index_slots[slot].ns = i;
+            index_slots[slot].entry = j;
+            index_slots[slot].id = id++;
+        }
+    }
+}
+
+/*
+ * Builds the index on first use, threads racing for it waiting for the one
+ * building it. The state is published with a release store, so that
+ * lookups reading it ready also see the slots filled.
+ */
+static void esp_config_index_ready() {
+
+    if (__atomic_load_n(&index_state, __ATOMIC_ACQUIRE) == ESP_CONFIG_INDEX_UNBUILT) {
+        esp_config_port_lock();
+        if (__atomic_load_n(&index_state, __ATOMIC_ACQUIRE) == ESP_CONFIG_INDEX_UNBUILT) {
+            esp_config_index_build();
+            __atomic_store_n(&index_state, ESP_CONFIG_INDEX_READY, __ATOMIC_RELEASE);
+        }
+        esp_config_port_unlock();
+    }
+}
+
+static bool esp_config_index_find(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token) {
+
+    uint32_t hash = esp_config_index_hash(ns, key);
+    uint32_t slot = hash % ESP_CONFIG_INDEX_SLOTS;
+    const esp_config_index_slot_t *found = NULL;
+
+    while (index_slots[slot].ns != ESP_CONFIG_INDEX_EMPTY) {
+        if (index_slots[slot].hash == hash) {
+            found = &index_slots[slot];
+            if (esp_config_db_encoding(found->ns, found->entry) == encoding && strcmp(key, esp_config_db_key(found->ns, found->entry)) == 0
+                    && strcmp(ns, database[found->ns].name) == 0) {
+                token->id = found->id;
+                token->ns = found->ns;
+                token->entry = found->entry;
+                token->encoding = encoding;
+                return true;
+            }
+        }
+        slot = (slot + 1) % ESP_CONFIG_INDEX_SLOTS;
+    }
+
+    return false;
+}
+
+#endif /* ESP_CONFIG_RAM_INDEX */
+
+#ifdef ESP_CONFIG_DB_SORTED
+
+/*
+ * Binary searches the generated index for the first entry of the hash,
+ * then checks the entries sharing it.
+ */
+static bool esp_config_sorted_find(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token) {
+
+    uint32_t hash = esp_config_index_hash(ns, key);
+    size_t low = 0;
+    size_t high = ESP_CONFIG_DB_KEYS;
+    size_t middle = 0;
+    const esp_config_db_index_t *slot = NULL;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (database_index[middle].hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (slot = &database_index[low]; slot < &database_index[ESP_CONFIG_DB_KEYS] && slot->hash == hash; slot++) {
+        if (esp_config_db_encoding(slot->ns, slot->entry) == encoding && strcmp(key, esp_config_db_key(slot->ns, slot->entry)) == 0
+                && strcmp(ns, database[slot->ns].name) == 0) {
+            token->id = slot->id;
+            token->ns = slot->ns;
+            token->entry = slot->entry;
+            token->encoding = encoding;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif /* ESP_CONFIG_DB_SORTED */
+
+#ifndef ESP_CONFIG_DB_SORTED
+
+/*
+ * Locates a key among the entries of namespace dbns of the compiled
+ * defaults database by a linear scan, base being the position of its first
+ * entry across the whole database.
+ *
+ * @return true and token set if found, false otherwise.
+ */
+static bool esp_config_locate_in(int dbns, int base, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token) {
+
+    for (unsigned int j=0; j<database[dbns].nentries; j++) {
+        if (strcmp(key,esp_config_db_key(dbns, j)) == 0 && esp_config_db_encoding(dbns, j) == encoding) {
+            token->id = base + j;
+            token->ns = dbns;
+            token->entry = j;
+            token->encoding = encoding;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+/*
+ * Locates a key of the compiled defaults database, through the generated
+ * index or the hash index when there is one and by a linear scan
+ * otherwise, without reading its entry.
+ *
+ * @return true and token set if found, false otherwise or if the database
+ * is refused, see esp_config_db_checked().
+ */
+static bool esp_config_locate(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token) {
+
+    if (!esp_config_db_checked()) {
+        return false;
+    }
+
+#ifdef ESP_CONFIG_DB_SORTED
+    return esp_config_sorted_find(ns, key, encoding, token);
+#elif ESP_CONFIG_RAM_INDEX
+    esp_config_index_ready();
+    return esp_config_index_find(ns, key, encoding, token);
+#else
+    int base = 0;
+
+    for (int i=0; i<ESP_CONFIG_DB_ENTRIES; i++) {
+        if (strcmp(ns,database[i].name) == 0 && esp_config_locate_in(i, base, key, encoding, token)) {
+            return true;
+        }
+        base += database[i].nentries;
+    }
+
+    return false;
+#endif
+}
+
+/*
+ * Looks up an entry of the compiled defaults database, see
+ * esp_config_locate(). If token is not NULL it is set to locate the entry,
+ * which may be decoded into view, see esp_config_db_entry().
+ */
+static const esp_config_entry_t* esp_config_find_compiled(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token, esp_config_entry_t *view) {
+
+    esp_config_token_t found;
+
+    if (!esp_config_locate(ns, key, encoding, &found)) {
+        return NULL;
+    }
+    if (token != NULL) {
+        *token = found;
+    }
+    return esp_config_db_entry(found.ns, found.entry, view);
+}
+
+#if CONFIG_ESP_CONFIG_LAYERS
+
+/*
+ * Layered overrides.
+ *
+ * Each layer is an NVS partition, layers[0] being the lowest. The merged
+ * view holds, for every key of the database, the entry of the highest
+ * layer that has a value for it, or NULL for the compiled entry if none
+ * has, as compact databases have no entries to point to. It is
+ * built by esp_config_layers_load() and updated key by key by
+ * esp_config_layer_set(), so that the lower layers are just the defaults
+ * for the rest of the library. Entries of the view are never modified,
+ * a new value is published as a new entry, and replaced entries are only
+ * freed by esp_config_deinit() so that readers and string references can
+ * keep using them.
+ */
+typedef struct esp_config_layered {
+    struct esp_config_layered *next;    /**< Every entry allocated, freed by esp_config_deinit() */
+    esp_config_entry_t entry;
+    uint8_t value[];                    /**< String or blob value of the entry */
+} esp_config_layered_t;
+
+static const char *layers[CONFIG_ESP_CONFIG_MAX_LAYERS];
+static int nlayers = 0;
+static const esp_config_entry_t *layered[ESP_CONFIG_DB_KEYS];  // NULL for compiled entries
+static int8_t layered_from[ESP_CONFIG_DB_KEYS];                 // Layer of each entry, -1 for compiled ones
+static esp_config_layered_t *layered_allocated = NULL;
+static esp_config_port_mutex_t layers_write_lock = NULL;
+
+#endif /* CONFIG_ESP_CONFIG_LAYERS */
+
+/*
+ * Entry of the defaults database located by a token, from the merged view
+ * of the layers when they are loaded. The compiled entry may be decoded
+ * into view.
+ */
+static const esp_config_entry_t* esp_config_token_entry(const esp_config_token_t *token, esp_config_entry_t *view) {
+
+#if CONFIG_ESP_CONFIG_LAYERS
+    const esp_config_entry_t *entry = __atomic_load_n(&layered[token->id], __ATOMIC_ACQUIRE);
+
+    if (entry != NULL) {
+        return entry;
+    }
+#endif
+
+    return esp_config_db_entry(token->ns, token->entry, view);
+}
+
+/*
+ * @return true if the token locates an entry of the database with the
+ *         same encoding, as set by esp_config_token_resolve().
+ */
+static bool esp_config_token_valid(const esp_config_token_t *token) {
+    return esp_config_db_checked() && token->ns < ESP_CONFIG_DB_ENTRIES && token->entry < database[token->ns].nentries
+            && token->id == esp_config_db_first(token->ns) + token->entry && token->encoding == esp_config_db_encoding(token->ns, token->entry);
+}
+
+/*
+ * Looks up an entry of the defaults database, see
+ * esp_config_find_compiled() and esp_config_token_entry().
+ */
+static const esp_config_entry_t* esp_config_find_default(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token, esp_config_entry_t *view) {
+
+#if CONFIG_ESP_CONFIG_LAYERS
+    esp_config_token_t found;
+
+    if (!esp_config_locate(ns, key, encoding, &found)) {
+        return NULL;
+    }
+    if (token != NULL) {
+        *token = found;
+    }
+    return esp_config_token_entry(&found, view);
+#else
+    return esp_config_find_compiled(ns, key, encoding, token, view);
+#endif
+}
+
+/*
+ * @return The length of the default of an uncompressed string entry, from
+ * its size when the database holds it, e.g. as generated by
+ * tools/esp_config_gen.py.
+ */
+static size_t esp_config_string_length(const esp_config_entry_t *entry) {
+    return (entry->value_size > 0) ? entry->value_size - 1 : strlen(entry->value.string);
+}
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+
+/*
+ * Compressed values.
+ *
+ * A compressed value starts with a 32-bit little-endian header holding its
+ * size once decompressed, with the top bit set if the rest is an LZSS
+ * stream rather than the value itself. The stream is made of groups of a
+ * flag byte followed by eight items, least significant bit first: a set
+ * bit is a literal byte, a clear bit a match of two little-endian bytes,
+ * the distance back minus one in the low 12 bits and the length minus
+ * three in the high 4 bits. tools/esp_config_compress.py writes the same
+ * format for the defaults database.
+ */
+#define ESP_CONFIG_PACKED_HEADER 4
+#define ESP_CONFIG_PACKED_LZSS 0x80
+#define ESP_CONFIG_LZSS_WINDOW 4096
+#define ESP_CONFIG_LZSS_MIN 3
+#define ESP_CONFIG_LZSS_MAX 18
+#define ESP_CONFIG_LZSS_CHAIN 32 // Earlier positions tried per match by the compressor
+
+/*
+ * Decompressed default kept in RAM, see
+ * CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE. Kept defaults are only freed by
+ * esp_config_deinit(), so that readers and string references can keep
+ * using them.
+ */
+typedef struct esp_config_inflated {
+    struct esp_config_inflated *next;
+    const void *packed;                 /**< Compressed default it was decompressed from */
+    size_t size;
+    uint8_t value[];
+} esp_config_inflated_t;
+
+static esp_config_inflated_t *inflated = NULL;
+static size_t inflated_used = 0;
+
+#define esp_config_compressed(entry) (((entry)->flags & ESP_CONFIG_FLAG_COMPRESSED) != 0)
+
+/*
+ * @return The size of a compressed value once decompressed.
+ */
+static size_t esp_config_packed_size(const void *packed, size_t packedsize) {
+
+    const uint8_t *header = packed;
+
+    if (packedsize < ESP_CONFIG_PACKED_HEADER) {
+        return 0;
+    }
+    return header[0] | (size_t)header[1] << 8 | (size_t)header[2] << 16 | (size_t)(header[3] & ~ESP_CONFIG_PACKED_LZSS) << 24;
+}
+
+/*
+ * Decompresses a value into size bytes, its size once decompressed.
+ *
+ * @return ESP_OK if success, ESP_ERR_INVALID_SIZE if the value is corrupted.
+ */
+static esp_err_t esp_config_inflate(const void *packed, size_t packedsize, void *value, size_t size) {
+
+    const uint8_t *in = (const uint8_t*)packed + ESP_CONFIG_PACKED_HEADER;
+    const uint8_t *end = (const uint8_t*)packed + packedsize;
+    uint8_t *out = value;
+    size_t done = 0;
+    size_t distance = 0;
+    size_t length = 0;
+    unsigned flags = 0;
+    int items = 0;
+
+    if (packedsize < ESP_CONFIG_PACKED_HEADER || esp_config_packed_size(packed, packedsize) != size) {
+        return ESP_ERR_INVALID_SIZE;
+    } else if (!(((const uint8_t*)packed)[3] & ESP_CONFIG_PACKED_LZSS)) { // Stored as is
+        if ((size_t)(end - in) != size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(value, in, size);
+        return ESP_OK;
+    }
+
+    while (done < size) {
+        if (items == 0) {
+            if (in == end) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            flags = *in++;
+            items = 8;
+        }
+        if (flags & 1) {
+            if (in == end) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            out[done++] = *in++;
+        } else {
+            if (end - in < 2) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            distance = ((in[0] | (size_t)in[1] << 8) & 0xfff) + 1;
+            length = (in[1] >> 4) + ESP_CONFIG_LZSS_MIN;
+            in += 2;
+            if (distance > done || length > size - done) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            for (; length > 0; length--, done++) {
+                out[done] = out[done - distance]; // Byte by byte, as a match may overlap itself
+            }
+        }
+        flags >>= 1;
+        items--;
+    }
+
+    return ESP_OK;
+}
+
+static uint8_t esp_config_lzss_hash(const uint8_t *data) {
+    return (uint8_t)((data[0] << 5) ^ (data[1] << 2) ^ data[2] ^ (data[0] >> 3));
+}
+
+/*
+ * Compresses a value with a greedy LZSS. Matches are found through hash
+ * chains of 3-byte prefixes over the window, each chain link being the
+ * distance to the previous position with the same hash. Values that do
+ * not shrink are stored as they are.
+ *
+ * @return The compressed value, to be freed, or NULL if out of memory.
+ */
+static uint8_t* esp_config_deflate(const void *value, size_t size, size_t *packedsize) {
+
+    const uint8_t *in = value;
+    size_t window = (size < ESP_CONFIG_LZSS_WINDOW) ? size : ESP_CONFIG_LZSS_WINDOW;
+    uint8_t *packed = malloc(ESP_CONFIG_PACKED_HEADER + size + (size + 7) / 8); // Every item a literal at worst
+    uint32_t *head = calloc(256 + (window + 1) / 2, sizeof(uint32_t)); // Last position + 1 per hash, then the chain links
+    uint16_t *chain = (head != NULL) ? (uint16_t*)(head + 256) : NULL;
+    size_t out = ESP_CONFIG_PACKED_HEADER;
+    size_t flagpos = 0;
+    size_t best = 0;
+    size_t bestdistance = 0;
+    size_t candidate = 0;
+    size_t length = 0;
+    size_t limit = 0;
+    uint8_t hash = 0;
+    int items = 0;
+
+    if (packed == NULL || head == NULL) {
+        free(packed);
+        free(head);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < size; ) {
+        best = 0;
+        if (i + ESP_CONFIG_LZSS_MIN <= size) {
+            limit = (size - i < ESP_CONFIG_LZSS_MAX) ? size - i : ESP_CONFIG_LZSS_MAX;
+            candidate = head[esp_config_lzss_hash(in + i)];
+            for (int tries = 0; candidate > 0 && i - (candidate - 1) <= ESP_CONFIG_LZSS_WINDOW && tries < ESP_CONFIG_LZSS_CHAIN; tries++) {
+                for (length = 0; length < limit && in[candidate - 1 + length] == in[i + length]; length++);
+                if (length > best) {
+                    best = length;
+                    bestdistance = i - (candidate - 1);
+                    if (best == limit) {
+                        break;
+                    }
+                }
+                length = chain[(candidate - 1) % ESP_CONFIG_LZSS_WINDOW];
+                candidate = (length > 0) ? candidate - length : 0;
+            }
+        }
+
+        if (items == 0) {
+            flagpos = out++;
+            packed[flagpos] = 0;
+            items = 8;
+        }
+        if (best >= ESP_CONFIG_LZSS_MIN) {
+            packed[out++] = (bestdistance - 1) & 0xff;
+            packed[out++] = ((bestdistance - 1) >> 8) | (best - ESP_CONFIG_LZSS_MIN) << 4;
+        } else {
+            packed[flagpos] |= 1 << (8 - items);
+            packed[out++] = in[i];
+            best = 1;
+        }
+        items--;
+
+        for (; best > 0; best--, i++) {
+            if (i + ESP_CONFIG_LZSS_MIN <= size) {
+                hash = esp_config_lzss_hash(in + i);
+                chain[i % ESP_CONFIG_LZSS_WINDOW] = (head[hash] > 0 && i + 1 - head[hash] <= ESP_CONFIG_LZSS_WINDOW) ? i + 1 - head[hash] : 0;
+                head[hash] = i + 1;
+            }
+        }
+    }
+    free(head);
+
+    if (out >= ESP_CONFIG_PACKED_HEADER + size) {
+        memcpy(packed + ESP_CONFIG_PACKED_HEADER, in, size);
+        out = ESP_CONFIG_PACKED_HEADER + size;
+    }
+    packed[0] = size & 0xff;
+    packed[1] = (size >> 8) & 0xff;
+    packed[2] = (size >> 16) & 0xff;
+    packed[3] = ((size >> 24) & 0x7f) | ((out < ESP_CONFIG_PACKED_HEADER + size) ? ESP_CONFIG_PACKED_LZSS : 0);
+    *packedsize = out;
+
+    return packed;
+}
+
+/*
+ * Finds the decompressed copy of a default kept in RAM.
+ */
+static const esp_config_inflated_t* esp_config_inflated_find(const esp_config_entry_t *entry) {
+
+    for (esp_config_inflated_t *kept = __atomic_load_n(&inflated, __ATOMIC_ACQUIRE); kept != NULL; kept = kept->next) {
+        if (kept->packed == entry->value.blob) {
+            return kept;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Frees the decompressed defaults kept in RAM.
+ */
+static void esp_config_inflated_drop() {
+
+    esp_config_inflated_t *next = NULL;
+
+    esp_config_port_lock();
+    for (esp_config_inflated_t *kept = inflated; kept != NULL; kept = next) {
+        next = kept->next;
+        free(kept);
+    }
+    inflated = NULL;
+    inflated_used = 0;
+    esp_config_port_unlock();
+}
+
+#endif /* CONFIG_ESP_CONFIG_COMPRESSION */
+
+/*
+ * @return The size of the default of a string or blob entry, terminator
+ * included.
+ */
+static size_t esp_config_default_size(const esp_config_entry_t *entry) {
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    if (esp_config_compressed(entry)) {
+        return esp_config_packed_size(entry->value.blob, entry->value_size);
+    }
+#endif
+
+    return (entry->encoding == STRING) ? esp_config_string_length(entry) + 1 : entry->value_size;
+}
+
+/*
+ * Points to the default of a string or blob entry, terminator included.
+ * Compressed defaults are decompressed, and kept in RAM if
+ * CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE allows. Otherwise the copy is
+ * returned in *allocated, to be freed by the caller once done.
+ *
+ * @return The value, or NULL if out of memory.
+ */
+static const void* esp_config_default_data(const esp_config_entry_t *entry, size_t *size, void **allocated) {
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    const esp_config_inflated_t *kept = NULL;
+    esp_config_inflated_t *created = NULL;
+#endif
+
+    *allocated = NULL;
+    *size = esp_config_default_size(entry);
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    if (esp_config_compressed(entry)) {
+        if ((kept = esp_config_inflated_find(entry)) != NULL) {
+            return kept->value;
+        }
+        created = malloc(sizeof(esp_config_inflated_t) + *size);
+        if (created == NULL) {
+            return NULL;
+        } else if (esp_config_inflate(entry->value.blob, entry->value_size, created->value, *size) != ESP_OK) {
+            ESP_LOGE(tag,"Default of %s is corrupted.", entry->key);
+            free(created);
+            return NULL;
+        }
+        created->packed = entry->value.blob;
+        created->size = *size;
+
+        esp_config_port_lock();
+        if ((kept = esp_config_inflated_find(entry)) == NULL && inflated_used + *size <= CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE) {
+            inflated_used += *size;
+            created->next = inflated;
+            __atomic_store_n(&inflated, created, __ATOMIC_RELEASE);
+            kept = created;
+            created = NULL;
+        }
+        esp_config_port_unlock();
+
+        if (kept != NULL) {
+            free(created);
+            return kept->value;
+        }
+        *allocated = created;
+        return created->value;
+    }
+#endif
+
+    return (entry->encoding == STRING) ? (const void*)entry->value.string : entry->value.blob;
+}
+
+/*
+ * Copies a value out of a defaults database entry, following the
+ * conventions of the esp_config_get_*_default functions.
+ *
+ * @return 0 if only *valuesize is set, 1 if *value is set.
+ */
+static int esp_config_copy_default(const esp_config_entry_t *entry, void *value, size_t *valuesize) {
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    const void *data = NULL;
+    void *allocated = NULL;
+    size_t size = 0;
+
+    if (esp_config_compressed(entry)) {
+        if (value == NULL) {
+            *valuesize = esp_config_default_size(entry) - (entry->encoding == STRING);
+            return 0;
+        } else if ((data = esp_config_default_data(entry, &size, &allocated)) == NULL) {
+            return -1;
+        }
+        if (entry->encoding == STRING) {
+            strncpy(value, data, *valuesize);
+        } else {
+            memcpy(value, data, (*valuesize < size) ? *valuesize : size);
+        }
+        free(allocated);
+        return 1;
+    }
+#endif
+
+    switch (entry->encoding) {
+        case UINT8:
+            *(uint8_t*)value = entry->value.uint8;
+            return 1;
+        case INT8:
+            *(int8_t*)value = entry->value.int8;
+            return 1;
+        case UINT16:
+            *(uint16_t*)value = entry->value.uint16;
+            return 1;
+        case INT16:
+            *(int16_t*)value = entry->value.int16;
+            return 1;
+        case UINT32:
+            *(uint32_t*)value = entry->value.uint32;
+            return 1;
+        case INT32:
+            *(int32_t*)value = entry->value.int32;
+            return 1;
+        case UINT64:
+            *(uint64_t*)value = entry->value.uint64;
+            return 1;
+        case INT64:
+            *(int64_t*)value = entry->value.int64;
+            return 1;
+        case STRING:
+            if (value == NULL) {
+                *valuesize = esp_config_string_length(entry);
+                return 0;
+            }
+            strncpy(value, entry->value.string, *valuesize);
+            return 1;
+        case BLOB:
+            if (value == NULL) {
+                *valuesize = entry->value_size;
+                return 0;
+            }
+            memcpy(value, entry->value.blob, *valuesize);
+            return 1;
+        default:
+            assert(false);
+            return -1;
+    }
+}
+
+/*
+ * Copies a default string or blob only if the whole value fits in
+ * *valuesize bytes, terminator included, and reports the size needed
+ * otherwise. Used by the single-call getters.
+ *
+ * @return 0 if only *valuesize is set, 1 if *value is set.
+ */
+static int esp_config_copy_default_sized(const esp_config_entry_t *entry, void *value, size_t *valuesize) {
+
+    const void *data = NULL;
+    void *allocated = NULL;
+    size_t size = esp_config_default_size(entry);
+
+    if (value == NULL || *valuesize < size) {
+        *valuesize = size;
+        return 0;
+    } else if ((data = esp_config_default_data(entry, &size, &allocated)) == NULL) {
+        return -1;
+    }
+    memcpy(value, data, size);
+    *valuesize = size;
+    free(allocated);
+    return 1;
+}
+
+/*
+ * Copies the part of a value starting at offset, up to *valuesize bytes,
+ * and sets *valuesize to the number of bytes copied. Used by range reads,
+ * see esp_config_get_blob_range().
+ */
+static void esp_config_copy_range(const void *data, size_t size, size_t offset, void *value, size_t *valuesize) {
+
+    size_t length = (offset < size) ? size - offset : 0;
+
+    if (length > *valuesize) {
+        length = *valuesize;
+    }
+    if (length > 0) {
+        memcpy(value, (const uint8_t*)data + offset, length);
+    }
+    *valuesize = length;
+}
+
+#if CONFIG_ESP_CONFIG_CACHE || CONFIG_ESP_CONFIG_SNAPSHOT || CONFIG_ESP_CONFIG_WRITE_BEHIND
+
+/*
+ * Serves a string or blob held in RAM, following the status codes of the
+ * esp_config_get_* functions for values in the NVS. range is the offset of
+ * a range read, or NULL to read the whole value.
+ */
+static int esp_config_copy_value(const void *data, size_t size, const size_t *range, void *value, size_t *valuesize) {
+
+    if (range != NULL) {
+        esp_config_copy_range(data, size, *range, value, valuesize);
+        return 2;
+    } else if (value == NULL || *valuesize < size) { // A short buffer gets the size needed, as from the NVS
+        *valuesize = size;
+        return 0;
+    }
+    memcpy(value, data, size);
+    *valuesize = size;
+    return 2;
+}
+
+#endif
+
+/*
+ * Resolves a value from the defaults database, following the status codes
+ * of the esp_config_get_* functions for default values. range is the
+ * offset of a range read, or NULL to read the whole value.
+ */
+static int esp_config_read_default(const esp_config_entry_t *entry, bool sized, const size_t *range, void *value, size_t *valuesize) {
+
+    bool variable = (entry->encoding == STRING || entry->encoding == BLOB);
+    int copied = 0;
+    const void *data = NULL;
+    void *allocated = NULL;
+    size_t size = 0;
+
+    if (range != NULL) {
+        if ((data = esp_config_default_data(entry, &size, &allocated)) == NULL) {
+            return -1;
+        }
+        esp_config_copy_range(data, size, *range, value, valuesize);
+        free(allocated);
+        return 3;
+    }
+
+    copied = (sized && variable) ? esp_config_copy_default_sized(entry, value, valuesize) : esp_config_copy_default(entry, value, valuesize);
+    if (copied < 0) {
+        return -1;
+    }
+    return variable ? 2 * copied + 1 : 1;
+}
+
+/*
+ * Size of a scalar encoding, 0 for strings and blobs.
+ */
+static size_t esp_config_encoding_size(esp_config_encoding_t encoding) {
+
+    switch (encoding) {
+        case UINT8:
+        case INT8:
+            return 1;
+        case UINT16:
+        case INT16:
+            return 2;
+        case UINT32:
+        case INT32:
+            return 4;
+        case UINT64:
+        case INT64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Compares a value with the default of a database entry. String sizes
+ * include the terminator.
+ */
+static bool esp_config_default_equals(const esp_config_entry_t *entry, const void *value, size_t valuesize) {
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    const void *data = NULL;
+    void *allocated = NULL;
+    size_t size = 0;
+    bool equal = false;
+
+    if (esp_config_compressed(entry)) {
+        if (valuesize != esp_config_default_size(entry) || (data = esp_config_default_data(entry, &size, &allocated)) == NULL) {
+            return false;
+        }
+        equal = (memcmp(value, data, size) == 0);
+        free(allocated);
+        return equal;
+    }
+#endif
+
+    switch (entry->encoding) {
+        case STRING:
+            return valuesize == esp_config_string_length(entry) + 1 && memcmp(value, entry->value.string, valuesize) == 0;
+        case BLOB:
+            return valuesize == entry->value_size && memcmp(value, entry->value.blob, valuesize) == 0;
+        default:
+            return memcmp(value, &entry->value, esp_config_encoding_size(entry->encoding)) == 0; // Every integer member starts the union
+    }
+}
+
+/*
+ * Pool of NVS handles kept open between calls, keyed by namespace.
+ *
+ * The pool is only used between esp_config_init() and esp_config_deinit().
+ * A read-write handle also serves reads of its namespace. A namespace not
+ * in the NVS, which cannot be opened read-only, takes a slot too, so that
+ * reads falling back to the defaults do not try to open it each time,
+ * until it is opened read-write to be written. When the pool is full, or
+ * before initialization, handles are opened and closed around each
+ * operation as usual.
+ */
+typedef struct {
+    char ns[16];                    /**< NVS namespace names are at most 15 characters */
+    int dbns;                       /**< Index of the namespace in database[], -1 if unknown */
+    nvs_open_mode mode;
+    nvs_handle handle;
+    bool used;
+    bool missing;                   /**< The namespace is not in the NVS, handle is not open */
+} esp_config_pool_slot_t;
+
+static esp_config_pool_slot_t pool[CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE + 1]; // One spare slot keeps the array valid when pooling is disabled
+static bool initialized = false;
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+static bool journal_recovered = false; // Reset by esp_config_deinit(), as a reboot would
+static esp_err_t esp_config_journal_recover();
+#endif
+
+/*
+ * Opens a handle on a namespace, from the pool when possible. Callers that
+ * know the index of the namespace in database[] pass it as dbns, which
+ * spares the name comparisons, or -1 otherwise.
+ */
+static esp_err_t esp_config_open(const char *ns, int dbns, nvs_open_mode mode, nvs_handle *handle) {
+
+    esp_err_t esperr = ESP_FAIL;
+    int free_slot = -1;
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+    // An interrupted batch is completed before anything else is written, which it would otherwise land on later
+    if (mode == NVS_READWRITE) {
+        esp_config_journal_recover();
+    }
+#endif
+
+    if (!initialized || strlen(ns) >= sizeof(pool[0].ns)) {
+        return nvs_open(ns, mode, handle);
+    }
+
+    esp_config_port_lock();
+    for (int i = 0; i < CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE; i++) {
+        if (!pool[i].used) {
+            if (free_slot == -1) {
+                free_slot = i;
+            }
+        } else if (!((dbns >= 0 && pool[i].dbns == dbns) || ((dbns < 0 || pool[i].dbns < 0) && strcmp(pool[i].ns, ns) == 0))) {
+            continue;
+        } else if (pool[i].missing && mode == NVS_READWRITE) {
+            pool[i].used = false; // Created by this open
+            free_slot = i;
+        } else if (pool[i].missing) {
+            esp_config_port_unlock();
+            return ESP_ERR_NVS_NOT_FOUND;
+        } else if (pool[i].mode == NVS_READWRITE || mode == NVS_READONLY) {
+            if (pool[i].dbns < 0) {
+                pool[i].dbns = dbns;
+            }
+            *handle = pool[i].handle;
+            esp_config_port_unlock();
+            return ESP_OK;
+        }
+    }
+    esperr = nvs_open(ns, mode, handle);
+    if ((esperr == ESP_OK || (esperr == ESP_ERR_NVS_NOT_FOUND && mode == NVS_READONLY)) && free_slot != -1) {
+        strcpy(pool[free_slot].ns, ns);
+        pool[free_slot].dbns = dbns;
+        pool[free_slot].mode = mode;
+        pool[free_slot].handle = (esperr == ESP_OK) ? *handle : 0;
+        pool[free_slot].missing = (esperr != ESP_OK);
+        pool[free_slot].used = true;
+    }
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+static void esp_config_close(nvs_handle handle) {
+
+    if (initialized) {
+        esp_config_port_lock();
+        for (int i = 0; i < CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE; i++) {
+            if (pool[i].used && !pool[i].missing && pool[i].handle == handle) {
+                esp_config_port_unlock();
+                return; // Pooled, stays open
+            }
+        }
+        esp_config_port_unlock();
+    }
+
+    nvs_close(handle);
+}
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL || CONFIG_ESP_CONFIG_SNAPSHOT || CONFIG_ESP_CONFIG_BLOB_STREAMING
+
+static uint32_t esp_config_crc32(uint32_t crc, const uint8_t *data, size_t length) {
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+#endif
+
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+
+#define ESP_CONFIG_CHUNKED_MAGIC 0x45434b31 // "ECK1"
+#define ESP_CONFIG_CHUNKED_MAX 4096 // Three hex digits of chunk index in chunk keys
+
+/*
+ * Descriptor of a blob stored in chunks, kept under the key of the blob in
+ * place of its value. The chunks are stored in one of two banks of keys
+ * derived from the key, see esp_config_chunk_key(), so that a new value
+ * is written entirely before the descriptor is switched to it.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint16_t chunk;
+    uint8_t bank;
+    uint8_t reserved;
+    uint32_t crc; // Of the fields above
+} esp_config_chunked_t;
+
+/*
+ * Builds the key of a chunk: "~", the CRC32 of the key, the bank and the
+ * index of the chunk, 13 characters in all.
+ */
+static void esp_config_chunk_key(const char *key, uint8_t bank, uint32_t index, char *chunkkey) {
+    snprintf(chunkkey, NVS_KEY_NAME_MAX_SIZE, "~%08" PRIx32 "%u%03" PRIx32, esp_config_crc32(0, (const uint8_t*)key, strlen(key)), (unsigned)bank, index);
+}
+
+/*
+ * @return true if a value is the descriptor of a chunked blob.
+ */
+static bool esp_config_chunked_valid(const void *value, size_t valuesize) {
+
+    esp_config_chunked_t chunked;
+
+    if (valuesize != sizeof(chunked)) {
+        return false;
+    }
+    memcpy(&chunked, value, sizeof(chunked));
+    return chunked.magic == ESP_CONFIG_CHUNKED_MAGIC && chunked.chunk > 0
+            && chunked.crc == esp_config_crc32(0, (const uint8_t*)&chunked, offsetof(esp_config_chunked_t, crc));
+}
+
+/*
+ * Reads the descriptor of a chunked blob.
+ *
+ * @return true if the key holds a chunked blob, false if it holds a plain
+ * value, nothing, or cannot be read.
+ */
+static bool esp_config_chunked_probe(nvs_handle handle, const char *key, esp_config_chunked_t *chunked) {
+
+    size_t size = sizeof(*chunked);
+
+    return nvs_get_blob(handle, key, chunked, &size) == ESP_OK && esp_config_chunked_valid(chunked, size);
+}
+
+/*
+ * Reads length bytes of a chunked blob starting at offset, which must lie
+ * within the blob. Whole chunks are read in place, the chunks at the ends
+ * of the range go through a buffer of one chunk.
+ */
+static esp_err_t esp_config_chunked_read(nvs_handle handle, const char *key, const esp_config_chunked_t *chunked, size_t offset, void *value, size_t length) {
+
+    esp_err_t esperr = ESP_OK;
+    char chunkkey[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t *buffer = NULL;
+    size_t size = 0;
+    size_t expected = 0;
+    size_t skip = 0;
+    size_t part = 0;
+
+    for (uint32_t index = offset / chunked->chunk; length > 0 && esperr == ESP_OK; index++) {
+        expected = chunked->size - (size_t)index * chunked->chunk;
+        expected = (expected < chunked->chunk) ? expected : chunked->chunk;
+        skip = offset - (size_t)index * chunked->chunk;
+        part = (expected - skip < length) ? expected - skip : length;
+        size = expected;
+        esp_config_chunk_key(key, chunked->bank, index, chunkkey);
+        if (skip == 0 && part == expected) {
+            esperr = nvs_get_blob(handle, chunkkey, value, &size);
+        } else {
+            buffer = (buffer != NULL) ? buffer : malloc(chunked->chunk);
+            esperr = (buffer != NULL) ? nvs_get_blob(handle, chunkkey, buffer, &size) : ESP_ERR_NO_MEM;
+            if (esperr == ESP_OK) {
+                memcpy(value, buffer + skip, part);
+            }
+        }
+        if (esperr == ESP_OK && size != expected) {
+            esperr = ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        value = (uint8_t*)value + part;
+        offset += part;
+        length -= part;
+    }
+    free(buffer);
+
+    return esperr;
+}
+
+/*
+ * Reads a blob, chunked or not, with the semantics of nvs_get_blob(). The
+ * key is read once as a plain blob, and only values of the size of a
+ * descriptor are looked at again.
+ */
+static esp_err_t esp_config_chunked_get(nvs_handle handle, const char *key, void *value, size_t *valuesize) {
+
+    esp_config_chunked_t chunked;
+    size_t capacity = (value != NULL) ? *valuesize : 0;
+    esp_err_t esperr = nvs_get_blob(handle, key, value, valuesize);
+
+    if (!((esperr == ESP_OK && *valuesize == sizeof(chunked)) || esperr == ESP_ERR_NVS_INVALID_LENGTH)
+            || !esp_config_chunked_probe(handle, key, &chunked)) {
+        return esperr;
+    }
+
+    *valuesize = chunked.size;
+    if (value == NULL) {
+        return ESP_OK;
+    } else if (capacity < chunked.size) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    return esp_config_chunked_read(handle, key, &chunked, 0, value, chunked.size);
+}
+
+/*
+ * Erases the chunks of a bank. Chunks past the end of the blob, left over
+ * by a write that did not complete, are erased too.
+ */
+static esp_err_t esp_config_chunked_erase(nvs_handle handle, const char *key, const esp_config_chunked_t *chunked) {
+
+    esp_err_t esperr = ESP_OK;
+    char chunkkey[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t count = (chunked->size + chunked->chunk - 1) / chunked->chunk;
+
+    for (uint32_t index = 0; index < ESP_CONFIG_CHUNKED_MAX; index++) {
+        esp_config_chunk_key(key, chunked->bank, index, chunkkey);
+        esperr = nvs_erase_key(handle, chunkkey);
+        if (esperr == ESP_ERR_NVS_NOT_FOUND && index >= count) {
+            return ESP_OK;
+        } else if (esperr != ESP_OK && esperr != ESP_ERR_NVS_NOT_FOUND) {
+            return esperr;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/*
+ * Switches a key to the descriptor of a chunked blob whose chunks are
+ * written, and erases the chunks of the previous value, if any. Chunks
+ * that could not be erased are swept the next time their bank is retired,
+ * see esp_config_chunked_erase().
+ */
+static esp_err_t esp_config_chunked_switch(nvs_handle handle, const char *key, esp_config_chunked_t *chunked, const esp_config_chunked_t *previous) {
+
+    esp_err_t esperr = ESP_OK;
+
+    chunked->magic = ESP_CONFIG_CHUNKED_MAGIC;
+    chunked->reserved = 0;
+    chunked->crc = esp_config_crc32(0, (const uint8_t*)chunked, offsetof(esp_config_chunked_t, crc));
+    esperr = nvs_set_blob(handle, key, chunked, sizeof(*chunked));
+    if (esperr == ESP_OK && previous != NULL && esp_config_chunked_erase(handle, key, previous) != ESP_OK) {
+        ESP_LOGW(tag,"Could not erase previous chunks of %s.", key);
+    }
+
+    return esperr;
+}
+
+/*
+ * Writes a blob with the semantics of nvs_set_blob(). Values larger than
+ * CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE are written in chunks to the bank not
+ * in use, then the descriptor is switched to them. Smaller values are
+ * written as plain blobs, unless they could be mistaken for a descriptor.
+ */
+static esp_err_t esp_config_chunked_set(nvs_handle handle, const char *key, const void *value, size_t valuesize) {
+
+    esp_err_t esperr = ESP_OK;
+    esp_config_chunked_t previous;
+    esp_config_chunked_t chunked;
+    bool replaced = esp_config_chunked_probe(handle, key, &previous);
+    char chunkkey[NVS_KEY_NAME_MAX_SIZE];
+    size_t part = 0;
+
+    if (valuesize <= CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE && !esp_config_chunked_valid(value, valuesize)) {
+        esperr = nvs_set_blob(handle, key, value, valuesize);
+        return (esperr == ESP_OK && replaced) ? esp_config_chunked_erase(handle, key, &previous) : esperr;
+    } else if (valuesize > (size_t)ESP_CONFIG_CHUNKED_MAX * CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    chunked.size = valuesize;
+    chunked.chunk = CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE;
+    chunked.bank = replaced ? !previous.bank : 0;
+    for (uint32_t index = 0; index * chunked.chunk < valuesize && esperr == ESP_OK; index++) {
+        part = valuesize - index * chunked.chunk;
+        part = (part < chunked.chunk) ? part : chunked.chunk;
+        esp_config_chunk_key(key, chunked.bank, index, chunkkey);
+        esperr = nvs_set_blob(handle, chunkkey, (const uint8_t*)value + index * chunked.chunk, part);
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_chunked_switch(handle, key, &chunked, replaced ? &previous : NULL);
+    }
+
+    return esperr;
+}
+
+#endif
+
+/*
+ * Reads a blob, chunked or not, with the semantics of nvs_get_blob().
+ */
+static esp_err_t esp_config_nvs_get_blob(nvs_handle handle, const char *key, void *value, size_t *valuesize) {
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+    return esp_config_chunked_get(handle, key, value, valuesize);
+#else
+    return nvs_get_blob(handle, key, value, valuesize);
+#endif
+}
+
+/*
+ * Writes a blob, chunked if large enough, with the semantics of
+ * nvs_set_blob().
+ */
+static esp_err_t esp_config_nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t valuesize) {
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+    return esp_config_chunked_set(handle, key, value, valuesize);
+#else
+    return nvs_set_blob(handle, key, value, valuesize);
+#endif
+}
+
+/*
+ * @return true if the overrides of an entry of the compiled database are
+ * stored compressed.
+ */
+static bool esp_config_packed(const esp_config_entry_t *compiled) {
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    return esp_config_compressed(compiled);
+#else
+    (void)compiled;
+    return false;
+#endif
+}
+
+/*
+ * @return true if the overrides of the key located by a token are stored
+ * compressed, false for unknown keys.
+ */
+static bool esp_config_token_packed(const esp_config_token_t *token) {
+
+    esp_config_entry_t view;
+
+    return token != NULL && esp_config_packed(esp_config_db_entry(token->ns, token->entry, &view));
+}
+
+/*
+ * @return true if the overrides of a key are stored compressed.
+ */
+static bool esp_config_packed_key(const char *ns, const char *key, esp_config_encoding_t encoding) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *compiled = esp_config_find_compiled(ns, key, encoding, NULL, &view);
+
+    return compiled != NULL && esp_config_packed(compiled);
+}
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+
+/*
+ * Reads a compressed override, always stored as a blob, with the semantics
+ * of nvs_get_blob() for the decompressed value. The compressed value is
+ * read whole even when only its size is asked for, as the NVS cannot read
+ * part of a blob.
+ */
+static esp_err_t esp_config_nvs_get_packed(nvs_handle handle, const char *key, void *value, size_t *valuesize) {
+
+    esp_err_t esperr = ESP_FAIL;
+    uint8_t *packed = NULL;
+    size_t packedsize = 0;
+    size_t size = 0;
+
+    esperr = esp_config_nvs_get_blob(handle, key, NULL, &packedsize);
+    if (esperr != ESP_OK) {
+        return esperr;
+    }
+    packed = malloc(packedsize > 0 ? packedsize : 1);
+    esperr = (packed != NULL) ? esp_config_nvs_get_blob(handle, key, packed, &packedsize) : ESP_ERR_NO_MEM;
+    if (esperr == ESP_OK) {
+        size = esp_config_packed_size(packed, packedsize);
+        if (value != NULL && *valuesize < size) {
+            esperr = ESP_ERR_NVS_INVALID_LENGTH;
+        } else if (value != NULL) {
+            esperr = esp_config_inflate(packed, packedsize, value, size);
+        }
+        *valuesize = size;
+    }
+    free(packed);
+
+    return esperr;
+}
+
+/*
+ * Compresses and writes an override, see esp_config_nvs_get_packed().
+ */
+static esp_err_t esp_config_nvs_set_packed(nvs_handle handle, const char *key, const void *value, size_t valuesize) {
+
+    esp_err_t esperr = ESP_FAIL;
+    size_t packedsize = 0;
+    uint8_t *packed = esp_config_deflate(value, valuesize, &packedsize);
+
+    if (packed == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esperr = esp_config_nvs_set_blob(handle, key, packed, packedsize);
+    free(packed);
+
+    return esperr;
+}
+
+#endif
+
+/*
+ * Reads a value of any supported encoding from an open handle, with the
+ * semantics of nvs_get_str() and nvs_get_blob() for variable-size values.
+ * packed tells whether the value is stored compressed, see
+ * esp_config_packed().
+ */
+static esp_err_t esp_config_nvs_get(nvs_handle handle, const char *key, esp_config_encoding_t encoding, bool packed, void *value, size_t *valuesize) {
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    if (packed) {
+        return esp_config_nvs_get_packed(handle, key, value, valuesize);
+    }
+#else
+    (void)packed;
+#endif
+
+    switch (encoding) {
+        case UINT8:
+            return nvs_get_u8(handle, key, value);
+        case INT8:
+            return nvs_get_i8(handle, key, value);
+        case UINT16:
+            return nvs_get_u16(handle, key, value);
+        case INT16:
+            return nvs_get_i16(handle, key, value);
+        case UINT32:
+            return nvs_get_u32(handle, key, value);
+        case INT32:
+            return nvs_get_i32(handle, key, value);
+        case UINT64:
+            return nvs_get_u64(handle, key, value);
+        case INT64:
+            return nvs_get_i64(handle, key, value);
+        case STRING:
+            return nvs_get_str(handle, key, value, valuesize);
+        case BLOB:
+            return esp_config_nvs_get_blob(handle, key, value, valuesize);
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+/*
+ * Reads part of a blob from an open handle, see esp_config_copy_range().
+ * Chunked blobs are read chunk by chunk, plain and compressed blobs are
+ * read whole into a temporary buffer.
+ */
+static esp_err_t esp_config_nvs_get_range(nvs_handle handle, const char *key, bool packed, size_t offset, void *value, size_t *valuesize) {
+
+    esp_err_t esperr = ESP_FAIL;
+    uint8_t *data = NULL;
+    size_t size = 0;
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+    esp_config_chunked_t chunked;
+
+    if (!packed && esp_config_chunked_probe(handle, key, &chunked)) {
+        size = (offset < chunked.size) ? chunked.size - offset : 0;
+        *valuesize = (size < *valuesize) ? size : *valuesize;
+        return esp_config_chunked_read(handle, key, &chunked, offset, value, *valuesize);
+    }
+#endif
+
+    esperr = esp_config_nvs_get(handle, key, BLOB, packed, NULL, &size);
+    if (esperr == ESP_OK) {
+        data = malloc(size > 0 ? size : 1);
+        esperr = (data != NULL) ? esp_config_nvs_get(handle, key, BLOB, packed, data, &size) : ESP_ERR_NO_MEM;
+        if (esperr == ESP_OK) {
+            esp_config_copy_range(data, size, offset, value, valuesize);
+        }
+        free(data);
+    }
+
+    return esperr;
+}
+
+/*
+ * Writes a value of any supported encoding to an open handle, without
+ * committing it. String sizes include the terminator. packed tells whether
+ * the value is to be stored compressed, see esp_config_packed().
+ */
+static esp_err_t esp_config_nvs_set(nvs_handle handle, const char *key, esp_config_encoding_t encoding, bool packed, const void *value, size_t valuesize) {
+
+    union {
+        uint8_t uint8;
+        int8_t int8;
+        uint16_t uint16;
+        int16_t int16;
+        uint32_t uint32;
+        int32_t int32;
+        uint64_t uint64;
+        int64_t int64;
+    } scalar;
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    if (packed) {
+        return esp_config_nvs_set_packed(handle, key, value, valuesize);
+    }
+#else
+    (void)packed;
+#endif
+
+    memcpy(&scalar, value, esp_config_encoding_size(encoding)); // Values staged in byte buffers may be unaligned
+
+    switch (encoding) {
+        case UINT8:
+            return nvs_set_u8(handle, key, scalar.uint8);
+        case INT8:
+            return nvs_set_i8(handle, key, scalar.int8);
+        case UINT16:
+            return nvs_set_u16(handle, key, scalar.uint16);
+        case INT16:
+            return nvs_set_i16(handle, key, scalar.int16);
+        case UINT32:
+            return nvs_set_u32(handle, key, scalar.uint32);
+        case INT32:
+            return nvs_set_i32(handle, key, scalar.int32);
+        case UINT64:
+            return nvs_set_u64(handle, key, scalar.uint64);
+        case INT64:
+            return nvs_set_i64(handle, key, scalar.int64);
+        case STRING:
+            return nvs_set_str(handle, key, value);
+        case BLOB:
+            return esp_config_nvs_set_blob(handle, key, value, valuesize);
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+/*
+ * Erases a value from an open handle, without committing it. A value that
+ * is not there is already erased.
+ */
+static esp_err_t esp_config_nvs_erase(nvs_handle handle, const char *key) {
+
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+    esp_config_chunked_t chunked;
+    bool split = esp_config_chunked_probe(handle, key, &chunked);
+#endif
+    esp_err_t esperr = nvs_erase_key(handle, key);
+
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+    // The descriptor goes first, so that an interrupted erase only leaves unreachable chunks
+    if (esperr == ESP_OK && split) {
+        esperr = esp_config_chunked_erase(handle, key, &chunked);
+    }
+#endif
+
+    return (esperr == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : esperr;
+}
+
+/*
+ * Closes every pooled handle. Must be called before the NVS is deinitialized.
+ */
+static void esp_config_pool_drain() {
+
+    esp_config_port_lock();
+    for (int i = 0; i < CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE; i++) {
+        if (pool[i].used && !pool[i].missing) {
+            nvs_close(pool[i].handle);
+        }
+        pool[i].used = false;
+    }
+    esp_config_port_unlock();
+}
+
+#if CONFIG_ESP_CONFIG_CACHE
+
+/*
+ * Read-through cache of resolved values, with one slot per database entry.
+ *
+ * A slot is filled the first time its key is read, or for all keys at once
+ * by esp_config_cache_load(), and rewritten by the setters after a
+ * successful commit. Keys missing from the defaults database are never
+ * cached, and NVS errors other than a missing key leave the slot empty so
+ * that the next read tries again.
+ *
+ * Every write, invalidation and clear of a slot bumps its generation. A
+ * read that missed the cache notes the generation before going to the NVS
+ * and only fills the slot if it has not changed since, so that a value
+ * read before a concurrent write is not cached over the new one.
+ */
+typedef enum {
+    ESP_CONFIG_CACHE_EMPTY = 0,     /**< Not resolved yet */
+    ESP_CONFIG_CACHE_NVS,           /**< Overridden, value held in the slot */
+    ESP_CONFIG_CACHE_DEFAULT        /**< Not overridden, value in the defaults database */
+} esp_config_cache_state_t;
+
+typedef struct {
+    esp_config_cache_state_t state;
+    uint32_t generation;            /**< Bumped by every write to the slot but fills */
+    size_t size;                    /**< Size of the NVS value, including the terminator for strings */
+    union {
+        int64_t int64;              /**< Integer values, up to 64 bits */
+        void *data;                 /**< Heap copy of string and blob values */
+    } value;
+} esp_config_cache_slot_t;
+
+static esp_config_cache_slot_t cache[ESP_CONFIG_DB_KEYS];
+
+/*
+ * Sets a slot. Fills pass the generation noted when the read missed the
+ * cache, and are dropped if the slot was written since. Other updates pass
+ * NULL and bump the generation.
+ */
+static void esp_config_cache_put(int id, esp_config_encoding_t encoding, esp_config_cache_state_t state, const void *value, size_t valuesize, const uint32_t *generation) {
+
+    void *data = NULL;
+    bool variable = (encoding == STRING || encoding == BLOB);
+
+    if (state == ESP_CONFIG_CACHE_NVS && variable) {
+        data = malloc(valuesize > 0 ? valuesize : 1);
+        if (data != NULL) {
+            memcpy(data, value, valuesize);
+        } else {
+            state = ESP_CONFIG_CACHE_EMPTY;
+        }
+    }
+
+    esp_config_port_lock();
+    if (generation != NULL && *generation != cache[id].generation) {
+        esp_config_port_unlock();
+        free(data);
+        return;
+    } else if (generation == NULL) {
+        cache[id].generation++;
+    }
+    if (cache[id].state == ESP_CONFIG_CACHE_NVS && variable) {
+        free(cache[id].value.data);
+    }
+    cache[id].state = state;
+    cache[id].size = valuesize;
+    if (state == ESP_CONFIG_CACHE_NVS) {
+        if (variable) {
+            cache[id].value.data = data;
+        } else {
+            memcpy(&cache[id].value, value, valuesize);
+        }
+    }
+    esp_config_port_unlock();
+}
+
+static void esp_config_cache_store(int id, esp_config_encoding_t encoding, esp_config_cache_state_t state, const void *value, size_t valuesize) {
+    esp_config_cache_put(id, encoding, state, value, valuesize, NULL);
+}
+
+/*
+ * Serves a read from the cache, following the status codes of the
+ * esp_config_get_* functions. Sized reads copy defaults with
+ * esp_config_copy_default_sized(), range reads are described in
+ * esp_config_copy_value(). On a miss, the generation of the slot is set
+ * into generation if not NULL, to be given to esp_config_cache_fill().
+ *
+ * @return The status code, or -1 if the read must go to the NVS.
+ */
+static int esp_config_cache_fetch(int id, const esp_config_entry_t *entry, bool sized, const size_t *range, void *value, size_t *valuesize, uint32_t *generation) {
+
+    int status = -1;
+    bool variable = (entry->encoding == STRING || entry->encoding == BLOB);
+
+    esp_config_port_lock();
+    switch (cache[id].state) {
+        case ESP_CONFIG_CACHE_NVS:
+            if (!variable) {
+                memcpy(value, &cache[id].value, cache[id].size);
+                status = 0;
+            } else {
+                status = esp_config_copy_value(cache[id].value.data, cache[id].size, range, value, valuesize);
+            }
+            break;
+        case ESP_CONFIG_CACHE_DEFAULT:
+            status = esp_config_read_default(entry, sized, range, value, valuesize);
+            break;
+        default:
+            break;
+    }
+    if (status == -1 && generation != NULL) {
+        *generation = cache[id].generation;
+    }
+    esp_config_port_unlock();
+
+    return status;
+}
+
+/*
+ * Fills a slot after a read went to the NVS, given the status code and the
+ * last NVS error of that read, and the generation esp_config_cache_fetch()
+ * noted before it.
+ */
+static void esp_config_cache_fill(int id, const esp_config_entry_t *entry, int status, esp_err_t esperr, const void *value, size_t valuesize, uint32_t generation) {
+
+    bool variable = (entry->encoding == STRING || entry->encoding == BLOB);
+
+    if ((!variable && status == 0) || (variable && status == 2)) {
+        esp_config_cache_put(id, entry->encoding, ESP_CONFIG_CACHE_NVS, value, valuesize, &generation);
+    } else if (status > 0 && esperr == ESP_ERR_NVS_NOT_FOUND) {
+        esp_config_cache_put(id, entry->encoding, ESP_CONFIG_CACHE_DEFAULT, NULL, 0, &generation);
+    }
+}
+
+/*
+ * Writes a value through to the cache after it has been committed to the
+ * NVS, or marks it as default if value is NULL.
+ */
+static void esp_config_cache_update(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    esp_config_token_t token;
+
+    if (esp_config_locate(ns, key, encoding, &token)) {
+        esp_config_cache_store(token.id, encoding, (value != NULL) ? ESP_CONFIG_CACHE_NVS : ESP_CONFIG_CACHE_DEFAULT, value, valuesize);
+    }
+}
+
+void esp_config_cache_clear() {
+
+    int id = 0;
+
+    if (!esp_config_db_checked()) {
+        return;
+    }
+
+    esp_config_port_lock();
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+            if (cache[id].state == ESP_CONFIG_CACHE_NVS && (esp_config_db_encoding(i, j) == STRING || esp_config_db_encoding(i, j) == BLOB)) {
+                free(cache[id].value.data);
+            }
+            cache[id].state = ESP_CONFIG_CACHE_EMPTY;
+            cache[id].generation++;
+        }
+    }
+    esp_config_port_unlock();
+}
+
+esp_err_t esp_config_cache_load() {
+
+    esp_err_t esperr = ESP_OK;
+    esp_err_t result = ESP_OK;
+    nvs_handle handle;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+    int64_t scalar = 0;
+    void *data = NULL;
+    size_t size = 0;
+    int id = 0;
+
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        esperr = esp_config_open(database[i].name, i, NVS_READONLY, &handle);
+        if (esperr == ESP_ERR_NVS_NOT_FOUND) { // Namespace never written, nothing is overridden
+            for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+                esp_config_cache_store(id, esp_config_db_encoding(i, j), ESP_CONFIG_CACHE_DEFAULT, NULL, 0);
+            }
+            continue;
+        } else if (esperr != ESP_OK) {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            return esperr;
+        }
+        for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+            entry = esp_config_db_entry(i, j, &view);
+            switch (entry->encoding) {
+                case STRING:
+                case BLOB:
+                    esperr = esp_config_nvs_get(handle, entry->key, entry->encoding, esp_config_packed(entry), NULL, &size);
+                    if (esperr == ESP_OK) {
+                        data = malloc(size > 0 ? size : 1);
+                        if (data == NULL) {
+                            esperr = ESP_ERR_NO_MEM;
+                            break;
+                        }
+                        esperr = esp_config_nvs_get(handle, entry->key, entry->encoding, esp_config_packed(entry), data, &size);
+                        if (esperr == ESP_OK) {
+                            esp_config_cache_store(id, entry->encoding, ESP_CONFIG_CACHE_NVS, data, size);
+                        }
+                        free(data);
+                    }
+                    break;
+                default:
+                    esperr = esp_config_nvs_get(handle, entry->key, entry->encoding, false, &scalar, NULL);
+                    if (esperr == ESP_OK) {
+                        esp_config_cache_store(id, entry->encoding, ESP_CONFIG_CACHE_NVS, &scalar, esp_config_encoding_size(entry->encoding));
+                    }
+                    break;
+            }
+            if (esperr == ESP_ERR_NVS_NOT_FOUND) {
+                esp_config_cache_store(id, entry->encoding, ESP_CONFIG_CACHE_DEFAULT, NULL, 0);
+            } else if (esperr != ESP_OK) {
+                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+                result = esperr;
+            }
+        }
+        esp_config_close(handle);
+    }
+
+    return result;
+}
+
+#endif /* CONFIG_ESP_CONFIG_CACHE */
+
+#if CONFIG_ESP_CONFIG_STATS
+
+/*
+ * Usage statistics, with one set of counters per database entry plus one
+ * for keys outside the database. Namespace and library totals are summed
+ * up on query. Updates are relaxed atomic increments, so that counting
+ * never takes the library lock.
+ */
+#define ESP_CONFIG_STATS_OTHER ESP_CONFIG_DB_KEYS
+#define ESP_CONFIG_STATS_FIELDS(s) (sizeof(s) / (sizeof(uint32_t)))
+
+static esp_config_counters_t stats_keys[ESP_CONFIG_DB_KEYS + 1];
+static esp_config_histogram_t stats_get_latency;
+static esp_config_histogram_t stats_set_latency;
+static esp_config_histogram_t stats_commit_latency;
+static uint32_t stats_period_ms = 0;
+static esp_config_port_event_t stats_event = NULL;
+static esp_config_port_thread_t stats_thread = NULL;
+
+static void esp_config_stats_count(uint32_t *counter) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Counts the time elapsed since start in a histogram.
+ */
+static void esp_config_stats_time(esp_config_histogram_t *histogram, int64_t start) {
+
+    int64_t elapsed = esp_config_port_time_us() - start;
+    int bucket = 0;
+
+    while (bucket < ESP_CONFIG_HISTOGRAM_BUCKETS - 1 && elapsed >= ((int64_t)1 << bucket)) {
+        bucket++;
+    }
+    esp_config_stats_count(&histogram->buckets[bucket]);
+}
+
+/*
+ * Counts a read, given the token of its key (NULL if not in the database)
+ * and the status code it returned.
+ */
+static void esp_config_stats_read(const esp_config_token_t *token, int status, int64_t start) {
+
+    esp_config_counters_t *counters = &stats_keys[(token != NULL) ? token->id : ESP_CONFIG_STATS_OTHER];
+
+    if (status < 0) {
+        esp_config_stats_count(&counters->miss);
+    } else if (status % 2 == 0) { // 0 and 2 come from the NVS, 1 and 3 from the defaults
+        esp_config_stats_count(&counters->nvs);
+    } else {
+        esp_config_stats_count(&counters->fallback);
+    }
+    esp_config_stats_time(&stats_get_latency, start);
+}
+
+/*
+ * Statistics slot of a key given by name, the one of keys outside the
+ * database if not found.
+ */
+static int esp_config_stats_id(const char *ns, const char *key, esp_config_encoding_t encoding) {
+
+    esp_config_token_t token;
+
+    return esp_config_locate(ns, key, encoding, &token) ? token.id : ESP_CONFIG_STATS_OTHER;
+}
+
+/*
+ * Adds up histograms or counters, field by field.
+ */
+static void esp_config_stats_add(uint32_t *sum, const uint32_t *fields, size_t nfields) {
+    for (size_t i = 0; i < nfields; i++) {
+        sum[i] += __atomic_load_n(&fields[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void esp_config_stats_zero(uint32_t *fields, size_t nfields) {
+    for (size_t i = 0; i < nfields; i++) {
+        __atomic_store_n(&fields[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+void esp_config_stats_get(esp_config_stats_t *stats) {
+
+    memset(stats, 0, sizeof(*stats));
+    for (int id = 0; id <= ESP_CONFIG_DB_KEYS; id++) {
+        esp_config_stats_add((uint32_t*)&stats->total, (const uint32_t*)&stats_keys[id], ESP_CONFIG_STATS_FIELDS(stats->total));
+    }
+    esp_config_stats_add(stats->get.buckets, stats_get_latency.buckets, ESP_CONFIG_HISTOGRAM_BUCKETS);
+    esp_config_stats_add(stats->set.buckets, stats_set_latency.buckets, ESP_CONFIG_HISTOGRAM_BUCKETS);
+    esp_config_stats_add(stats->commit.buckets, stats_commit_latency.buckets, ESP_CONFIG_HISTOGRAM_BUCKETS);
+}
+
+esp_err_t esp_config_stats_get_key(const char *ns, const char *key, esp_config_counters_t *counters) {
+
+    int id = 0;
+
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+            if (strcmp(database[i].name, ns) == 0 && strcmp(esp_config_db_key(i, j), key) == 0) {
+                memset(counters, 0, sizeof(*counters));
+                esp_config_stats_add((uint32_t*)counters, (const uint32_t*)&stats_keys[id], ESP_CONFIG_STATS_FIELDS(*counters));
+                return ESP_OK;
+            }
+        }
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_config_stats_get_namespace(const char *ns, esp_config_counters_t *counters) {
+
+    esp_err_t esperr = ESP_ERR_NOT_FOUND;
+    int id = 0;
+
+    memset(counters, 0, sizeof(*counters));
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        if (strcmp(database[i].name, ns) == 0) {
+            for (unsigned int j = 0; j < database[i].nentries; j++) {
+                esp_config_stats_add((uint32_t*)counters, (const uint32_t*)&stats_keys[id + j], ESP_CONFIG_STATS_FIELDS(*counters));
+            }
+            esperr = ESP_OK;
+        }
+        id += database[i].nentries;
+    }
+
+    return esperr;
+}
+
+void esp_config_stats_reset() {
+
+    esp_config_stats_zero((uint32_t*)stats_keys, ESP_CONFIG_STATS_FIELDS(stats_keys));
+    esp_config_stats_zero(stats_get_latency.buckets, ESP_CONFIG_HISTOGRAM_BUCKETS);
+    esp_config_stats_zero(stats_set_latency.buckets, ESP_CONFIG_HISTOGRAM_BUCKETS);
+    esp_config_stats_zero(stats_commit_latency.buckets, ESP_CONFIG_HISTOGRAM_BUCKETS);
+}
+
+static void esp_config_stats_print_counters(const char *name, const esp_config_counters_t *counters) {
+    printf("%s : nvs %" PRIu32 ", fallback %" PRIu32 ", miss %" PRIu32 ", set %" PRIu32 ", commit %" PRIu32 "\n",
+            name, counters->nvs, counters->fallback, counters->miss, counters->set, counters->commit);
+}
+
+static void esp_config_stats_print_histogram(const char *name, const esp_config_histogram_t *histogram) {
+
+    printf("%s latency (us) :", name);
+    for (int i = 0; i < ESP_CONFIG_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->buckets[i] > 0 && i < ESP_CONFIG_HISTOGRAM_BUCKETS - 1) {
+            printf(" <%lu:%" PRIu32, 1ul << i, histogram->buckets[i]);
+        } else if (histogram->buckets[i] > 0) {
+            printf(" >=%lu:%" PRIu32, 1ul << (i - 1), histogram->buckets[i]);
+        }
+    }
+    printf("\n");
+}
+
+void esp_config_stats_print() {
+
+    esp_config_stats_t stats;
+    esp_config_counters_t counters;
+    int id = 0;
+
+    if (!esp_config_db_checked()) {
+        return;
+    }
+
+    esp_config_stats_get(&stats);
+    esp_config_stats_print_counters("total", &stats.total);
+    esp_config_stats_print_histogram("get", &stats.get);
+    esp_config_stats_print_histogram("set", &stats.set);
+    esp_config_stats_print_histogram("commit", &stats.commit);
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        esp_config_stats_get_namespace(database[i].name, &counters);
+        esp_config_stats_print_counters(database[i].name, &counters);
+        for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+            memset(&counters, 0, sizeof(counters));
+            esp_config_stats_add((uint32_t*)&counters, (const uint32_t*)&stats_keys[id], ESP_CONFIG_STATS_FIELDS(counters));
+            if (counters.nvs + counters.fallback + counters.miss + counters.set + counters.commit > 0) {
+                printf("  ");
+                esp_config_stats_print_counters(esp_config_db_key(i, j), &counters);
+            }
+        }
+    }
+
+    memset(&counters, 0, sizeof(counters));
+    esp_config_stats_add((uint32_t*)&counters, (const uint32_t*)&stats_keys[ESP_CONFIG_STATS_OTHER], ESP_CONFIG_STATS_FIELDS(counters));
+    esp_config_stats_print_counters("(not in database)", &counters);
+}
+
+static void esp_config_stats_task(void *arg) {
+
+    esp_config_port_event_t event = arg;
+
+    // A signal means stop, a timeout means print
+    while (!esp_config_port_event_wait(event, stats_period_ms)) {
+        esp_config_stats_print();
+    }
+}
+
+esp_err_t esp_config_stats_print_start(uint32_t period_ms) {
+
+    esp_err_t esperr = ESP_OK;
+
+    esp_config_port_lock();
+    if (stats_thread != NULL) {
+        esperr = ESP_ERR_INVALID_STATE;
+    } else if ((stats_event = esp_config_port_event_create()) == NULL) {
+        esperr = ESP_ERR_NO_MEM;
+    } else {
+        stats_period_ms = period_ms;
+        esperr = esp_config_port_thread_start("esp_config_stats", esp_config_stats_task, stats_event, &stats_thread);
+        if (esperr != ESP_OK) {
+            esp_config_port_event_delete(stats_event);
+            stats_event = NULL;
+            stats_thread = NULL;
+        }
+    }
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+esp_err_t esp_config_stats_print_stop() {
+
+    esp_config_port_thread_t thread = NULL;
+    esp_config_port_event_t event = NULL;
+
+    esp_config_port_lock();
+    thread = stats_thread;
+    event = stats_event;
+    stats_thread = NULL;
+    stats_event = NULL;
+    esp_config_port_unlock();
+
+    if (thread == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_config_port_event_signal(event);
+    esp_config_port_thread_join(thread);
+    esp_config_port_event_delete(event);
+
+    return ESP_OK;
+}
+
+#endif /* CONFIG_ESP_CONFIG_STATS */
+
+/*
+ * Commits an open handle, timing the commit when statistics are enabled.
+ */
+static esp_err_t esp_config_commit(nvs_handle handle) {
+
+#if CONFIG_ESP_CONFIG_STATS
+    int64_t start = esp_config_port_time_us();
+    esp_err_t esperr = nvs_commit(handle);
+
+    esp_config_stats_time(&stats_commit_latency, start);
+    return esperr;
+#else
+    return nvs_commit(handle);
+#endif
+}
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+static esp_err_t esp_config_journal_replay();
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+static esp_err_t esp_config_snapshot_load();
+static int esp_config_snapshot_fetch(const esp_config_token_t *token, bool sized, const size_t *range, void *value, size_t *valuesize);
+static esp_err_t esp_config_snapshot_prepare(const uint8_t *records, size_t length, const char *ns, bool *prepared);
+static esp_err_t esp_config_snapshot_prepare_value(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize, bool *prepared);
+static void esp_config_snapshot_finish(bool prepared, bool committed);
+static void esp_config_snapshot_drop();
+#endif
+
+#if CONFIG_ESP_CONFIG_LAYERS
+static esp_err_t esp_config_layers_load();
+static void esp_config_layers_drop();
+#endif
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+static esp_err_t esp_config_write_behind_stage(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize);
+static int esp_config_write_behind_fetch(const char *ns, const char *key, esp_config_encoding_t encoding, bool sized, const size_t *range, void *value, size_t *valuesize);
+static void esp_config_write_behind_drop();
+#endif
+
+esp_err_t esp_config_init() {
+
+    esp_err_t esperr = ESP_OK;
+
+    if (initialized) {
+        return ESP_OK;
+    }
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+#if ESP_CONFIG_RAM_INDEX
+    esp_config_index_ready();
+#endif
+
+#if !CONFIG_ESP_CONFIG_COMPRESSION
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++) {
+            if (esp_config_db_flags(i, j) & ESP_CONFIG_FLAG_COMPRESSED) {
+                ESP_LOGE(tag,"Key %s is compressed, enable CONFIG_ESP_CONFIG_COMPRESSION.", esp_config_db_key(i, j));
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+        }
+    }
+#endif
+
+    initialized = true;
+
+#if CONFIG_ESP_CONFIG_LAYERS
+    esperr = esp_config_layers_load();
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"Could not load layers: %s",esp_err_to_name(esperr));
+    }
+#endif
+
+    // Loaded before the journal is replayed, so that the replayed batch also updates the snapshot
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    esperr = esp_config_snapshot_load();
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"Could not load snapshot: %s",esp_err_to_name(esperr));
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+    esperr = esp_config_journal_recover();
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE_LOAD_AT_INIT
+    esperr = esp_config_cache_load();
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+#endif
+
+    return esperr;
+}
+
+void esp_config_deinit() {
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    esp_err_t esperr = ESP_OK;
+#endif
+
+    if (!initialized) {
+        return;
+    }
+
+#if CONFIG_ESP_CONFIG_ASYNC_SET
+    esp_config_async_stop();
+#endif
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    esperr = esp_config_write_behind_stop();
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"Deferred writes still pending, esp_config_flush() must be called again: %s",esp_err_to_name(esperr));
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_STATS
+    esp_config_stats_print_stop();
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    esp_config_snapshot_save();
+#endif
+
+    esp_config_pool_drain();
+    initialized = false;
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+    __atomic_store_n(&journal_recovered, false, __ATOMIC_RELEASE);
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    esp_config_snapshot_drop();
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE
+    esp_config_cache_clear();
+#endif
+
+#if CONFIG_ESP_CONFIG_LAYERS
+    esp_config_layers_drop();
+#endif
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    esp_config_inflated_drop();
+#endif
+}
+
+/*
+ * NVS namespace opened once for reads of several of its keys, by the
+ * first of them that gets to the NVS, and closed by
+ * esp_config_session_end().
+ */
+typedef struct {
+    nvs_handle handle;
+    esp_err_t opened;       // Result of opening the namespace, ESP_ERR_INVALID_STATE until tried
+} esp_config_session_t;
+
+static esp_err_t esp_config_session_open(esp_config_session_t *session, const char *ns, int dbns, nvs_handle *handle) {
+
+    if (session == NULL) {
+        return esp_config_open(ns, dbns, NVS_READONLY, handle);
+    }
+    if (session->opened == ESP_ERR_INVALID_STATE) {
+        session->opened = esp_config_open(ns, dbns, NVS_READONLY, &session->handle);
+    }
+    *handle = session->handle;
+    return session->opened;
+}
+
+static void esp_config_session_close(esp_config_session_t *session, nvs_handle handle) {
+    if (session == NULL) {
+        esp_config_close(handle);
+    }
+}
+
+static void esp_config_session_end(esp_config_session_t *session) {
+    if (session->opened == ESP_OK) {
+        esp_config_close(session->handle);
+    }
+    session->opened = ESP_ERR_INVALID_STATE;
+}
+
+/*
+ * Resolves a value in the lookup order of the library: values staged for
+ * deferred writing, the snapshot, the cache, the NVS, and finally the
+ * defaults database.
+ * The token locates the key in the defaults database, or is NULL if the
+ * key is not there. Reads of several keys of a namespace in a row share
+ * an NVS session, or pass NULL to open and close the namespace each.
+ *
+ * @return The status code of the esp_config_get_* functions.
+ */
+static int esp_config_lookup(const char *ns, const char *key, const esp_config_token_t *token, esp_config_encoding_t encoding, bool sized, void *value, size_t *valuesize, esp_config_session_t *session) {
+
+    int status = -1;
+    bool variable = (encoding == STRING || encoding == BLOB);
+    int found = (variable && value != NULL) ? 2 : 0; // Status when found in NVS, defaults are one more
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = (token != NULL) ? esp_config_token_entry(token, &view) : NULL;
+#if CONFIG_ESP_CONFIG_CACHE
+    uint32_t generation = 0;
+#endif
+
+    // Frozen keys cannot be overridden, so the NVS is never looked at
+    if (entry != NULL && (entry->flags & ESP_CONFIG_FLAG_FROZEN)) {
+        return esp_config_read_default(entry, sized, NULL, value, valuesize);
+    }
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if ((status = esp_config_write_behind_fetch(ns, key, encoding, sized, NULL, value, valuesize)) >= 0) {
+        return status;
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    if (token != NULL && (status = esp_config_snapshot_fetch(token, sized, NULL, value, valuesize)) >= 0) {
+        return status;
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE
+    if (token != NULL && (status = esp_config_cache_fetch(token->id, entry, sized, NULL, value, valuesize, &generation)) >= 0) {
+        return status;
+    }
+#endif
+
+    // Try to fetch the value from the NVS first
+    esperr = esp_config_session_open(session, ns, (token != NULL) ? token->ns : -1, &handle);
+    if (esperr == ESP_OK) {
+        esperr = esp_config_nvs_get(handle, key, encoding, esp_config_token_packed(token), value, valuesize);
+        if (esperr == ESP_OK) {
+            status = found;
+        } else if (esperr == ESP_ERR_NVS_INVALID_LENGTH && variable && value != NULL) {
+            status = 0; // The buffer is too short, the NVS has set the size needed
+        } else if (esperr != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        }
+        esp_config_session_close(session, handle);
+    } else if (esperr != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+
+    // Not finding the key or its namespace only means that it is not overridden
+#if CONFIG_ESP_CONFIG_LOG_MISSES
+    if (esperr == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(tag,"%s/%s not in NVS",ns,key);
+    }
+#endif
+
+    // If fetching from the NVS failed, retrieve the value from the internal defaults database
+    if (status == -1) {
+        if (entry != NULL) {
+            status = esp_config_read_default(entry, sized, NULL, value, valuesize);
+        } else {
+            ESP_LOGE(tag,"Could not get default value.");
+        }
+    }
+
+#if CONFIG_ESP_CONFIG_CACHE
+    if (token != NULL) {
+        esp_config_cache_fill(token->id, entry, status, esperr, value, variable ? *valuesize : esp_config_encoding_size(encoding), generation);
+    }
+#endif
+
+    return status;
+}
+
+/*
+ * Resolves a value, see esp_config_lookup(), and counts the read.
+ */
+static int esp_config_read(const char *ns, const char *key, const esp_config_token_t *token, esp_config_encoding_t encoding, bool sized, void *value, size_t *valuesize, esp_config_session_t *session) {
+
+#if CONFIG_ESP_CONFIG_STATS
+    int64_t start = esp_config_port_time_us();
+    int status = esp_config_lookup(ns, key, token, encoding, sized, value, valuesize, session);
+
+    esp_config_stats_read(token, status, start);
+    return status;
+#else
+    return esp_config_lookup(ns, key, token, encoding, sized, value, valuesize, session);
+#endif
+}
+
+/*
+ * Resolves a value given its namespace and key, see esp_config_read().
+ */
+static int esp_config_read_key(const char *ns, const char *key, esp_config_encoding_t encoding, bool sized, void *value, size_t *valuesize) {
+
+    esp_config_token_t token;
+    bool known = esp_config_locate(ns, key, encoding, &token);
+
+    return esp_config_read(ns, key, known ? &token : NULL, encoding, sized, value, valuesize, NULL);
+}
+
+/*
+ * Resolves a value given its token, see esp_config_read().
+ */
+static int esp_config_read_token(esp_config_token_t token, void *value, size_t *valuesize) {
+
+    if (!esp_config_token_valid(&token)) {
+        ESP_LOGE(tag,"Invalid token.");
+        return -1;
+    }
+
+    return esp_config_read(database[token.ns].name, esp_config_db_key(token.ns, token.entry), &token, token.encoding, false, value, valuesize, NULL);
+}
+
 int esp_config_get_i32(const char *ns, const char *key, int32_t *value) {
 
-    int status = -1;
-    int interr = -1;
-    esp_err_t esperr = ESP_FAIL;
-    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+    int status = esp_config_read_key(ns, key, INT32, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_u8(const char *ns, const char *key, uint8_t *value) {
+
+    int status = esp_config_read_key(ns, key, UINT8, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_i8(const char *ns, const char *key, int8_t *value) {
+
+    int status = esp_config_read_key(ns, key, INT8, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_u16(const char *ns, const char *key, uint16_t *value) {
+
+    int status = esp_config_read_key(ns, key, UINT16, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_i16(const char *ns, const char *key, int16_t *value) {
+
+    int status = esp_config_read_key(ns, key, INT16, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_u32(const char *ns, const char *key, uint32_t *value) {
+
+    int status = esp_config_read_key(ns, key, UINT32, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_u64(const char *ns, const char *key, uint64_t *value) {
+
+    int status = esp_config_read_key(ns, key, UINT64, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_i64(const char *ns, const char *key, int64_t *value) {
+
+    int status = esp_config_read_key(ns, key, INT64, false, value, NULL);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_str(const char *ns, const char *key, char *value, size_t *valuesize) {
+
+    int status = esp_config_read_key(ns, key, STRING, false, value, valuesize);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_blob(const char *ns, const char *key, void *value, size_t *valuesize) {
+
+    int status = esp_config_read_key(ns, key, BLOB, false, value, valuesize);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_str_into(const char *ns, const char *key, char *value, size_t *valuesize) {
+
+    int status = esp_config_read_key(ns, key, STRING, true, value, valuesize);
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_blob_into(const char *ns, const char *key, void *value, size_t *valuesize) {
+
+    int status = esp_config_read_key(ns, key, BLOB, true, value, valuesize);
+
+    assert(status >= 0);
+    return status;
+}
+
+/*
+ * Resolves part of a blob in the lookup order of esp_config_lookup(),
+ * reading no more of it than each tier requires. The cache is not filled,
+ * as it holds whole values.
+ *
+ * @return 2 if read from the NVS, 3 if read from the defaults database,
+ * -1 if the key is unknown.
+ */
+static int esp_config_lookup_range(const char *ns, const char *key, const esp_config_token_t *token, size_t offset, void *value, size_t *valuesize) {
+
+    int status = -1;
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = (token != NULL) ? esp_config_token_entry(token, &view) : NULL;
+
+    if (entry != NULL && (entry->flags & ESP_CONFIG_FLAG_FROZEN)) {
+        return esp_config_read_default(entry, false, &offset, value, valuesize);
+    }
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if ((status = esp_config_write_behind_fetch(ns, key, BLOB, false, &offset, value, valuesize)) >= 0) {
+        return status;
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    if (token != NULL && (status = esp_config_snapshot_fetch(token, false, &offset, value, valuesize)) >= 0) {
+        return status;
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE
+    if (token != NULL && (status = esp_config_cache_fetch(token->id, entry, false, &offset, value, valuesize, NULL)) >= 0) {
+        return status;
+    }
+#endif
+
+    esperr = esp_config_open(ns, (token != NULL) ? token->ns : -1, NVS_READONLY, &handle);
+    if (esperr == ESP_OK) {
+        esperr = esp_config_nvs_get_range(handle, key, esp_config_token_packed(token), offset, value, valuesize);
+        if (esperr == ESP_OK) {
+            status = 2;
+        } else if (esperr != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        }
+        esp_config_close(handle);
+    } else if (esperr != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+
+    if (status == -1) {
+        if (entry != NULL) {
+            status = esp_config_read_default(entry, false, &offset, value, valuesize);
+        } else {
+            ESP_LOGE(tag,"Could not get default value.");
+        }
+    }
+
+    return status;
+}
+
+int esp_config_get_blob_range(const char *ns, const char *key, size_t offset, void *value, size_t *valuesize) {
+
+    esp_config_token_t token;
+    bool known = esp_config_locate(ns, key, BLOB, &token);
+#if CONFIG_ESP_CONFIG_STATS
+    int64_t start = esp_config_port_time_us();
+    int status = esp_config_lookup_range(ns, key, known ? &token : NULL, offset, value, valuesize);
+
+    esp_config_stats_read(known ? &token : NULL, status, start);
+#else
+    int status = esp_config_lookup_range(ns, key, known ? &token : NULL, offset, value, valuesize);
+#endif
+
+    assert(status >= 0);
+    return status;
+}
+
+/*
+ * Reads a string or blob into the free space of an arena, advancing it
+ * only if the whole value fits. Values start at pointer-aligned offsets.
+ */
+static int esp_config_read_arena(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_arena_t *arena, const void **value, size_t *valuesize) {
+
+    int status = -1;
+    size_t offset = (arena->used + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    uint8_t *base = arena->base;
+
+    *value = NULL;
+    *valuesize = (offset < arena->size) ? arena->size - offset : 0;
+    status = esp_config_read_key(ns, key, encoding, true, (offset < arena->size) ? base + offset : NULL, valuesize);
+    if (status >= 2) {
+        *value = base + offset;
+        arena->used = offset + *valuesize;
+    }
+
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_get_str_arena(const char *ns, const char *key, esp_config_arena_t *arena, const char **value, size_t *valuesize) {
+    return esp_config_read_arena(ns, key, STRING, arena, (const void**)value, valuesize);
+}
+
+int esp_config_get_blob_arena(const char *ns, const char *key, esp_config_arena_t *arena, const void **value, size_t *valuesize) {
+    return esp_config_read_arena(ns, key, BLOB, arena, value, valuesize);
+}
+
+/*
+ * Points to a default string or blob in place, unless the key is
+ * overridden. Overrides are only probed for, never read.
+ *
+ * @return 1 if *value points to the default, 0 if the key is overridden.
+ */
+static int esp_config_lookup_ref(const esp_config_token_t *token, const void **value, size_t *valuesize) {
+
+    int status = -1;
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    size_t size = 0;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_token_entry(token, &view);
+    const char *ns = database[token->ns].name;
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    void *allocated = NULL;
+#endif
+#if CONFIG_ESP_CONFIG_CACHE
+    uint32_t generation = 0;
+#endif
+
+    if (entry->flags & ESP_CONFIG_FLAG_FROZEN) {
+        status = 1;
+    }
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if (status == -1) {
+        status = esp_config_write_behind_fetch(ns, entry->key, token->encoding, false, NULL, NULL, &size);
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    if (status == -1) {
+        status = esp_config_snapshot_fetch(token, false, NULL, NULL, &size);
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE
+    if (status == -1) {
+        status = esp_config_cache_fetch(token->id, entry, false, NULL, NULL, &size, &generation);
+    }
+#endif
+
+    if (status == -1) {
+        esperr = esp_config_open(ns, token->ns, NVS_READONLY, &handle);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_nvs_get(handle, entry->key, token->encoding, esp_config_token_packed(token), NULL, &size);
+            esp_config_close(handle);
+        }
+        status = (esperr == ESP_OK) ? 0 : 1;
+#if CONFIG_ESP_CONFIG_CACHE
+        esp_config_cache_fill(token->id, entry, status, esperr, NULL, 0, generation);
+#endif
+    }
+
+    if (status == 0) {
+        return 0;
+    }
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    // Only a decompressed copy kept in RAM lives long enough to be pointed to
+    if (esp_config_compressed(entry)) {
+        *value = esp_config_default_data(entry, valuesize, &allocated);
+        *valuesize -= (token->encoding == STRING);
+        free(allocated);
+        return (*value != NULL && allocated == NULL) ? 1 : 0;
+    }
+#endif
+
+    if (token->encoding == STRING) {
+        *value = entry->value.string;
+        *valuesize = esp_config_string_length(entry);
+    } else {
+        *value = entry->value.blob;
+        *valuesize = entry->value_size;
+    }
+    return 1;
+}
+
+/*
+ * Points to a default value in place, see esp_config_lookup_ref(), and
+ * counts the read.
+ */
+static int esp_config_read_ref(const esp_config_token_t *token, const void **value, size_t *valuesize) {
+
+#if CONFIG_ESP_CONFIG_STATS
+    int64_t start = esp_config_port_time_us();
+    int status = esp_config_lookup_ref(token, value, valuesize);
+
+    esp_config_stats_read(token, status, start);
+    return status;
+#else
+    return esp_config_lookup_ref(token, value, valuesize);
+#endif
+}
+
+int esp_config_get_str_ref(const char *ns, const char *key, const char **value, size_t *valuesize) {
+
+    esp_config_token_t token;
+
+    if (!esp_config_locate(ns, key, STRING, &token)) {
+        return -1;
+    }
+
+    return esp_config_read_ref(&token, (const void **)value, valuesize);
+}
+
+int esp_config_get_blob_ref(const char *ns, const char *key, const void **value, size_t *valuesize) {
+
+    esp_config_token_t token;
+
+    if (!esp_config_locate(ns, key, BLOB, &token)) {
+        return -1;
+    }
+
+    return esp_config_read_ref(&token, value, valuesize);
+}
+
+int esp_config_token_get_str_ref(esp_config_token_t token, const char **value, size_t *valuesize) {
+    assert(token.encoding == STRING);
+    return esp_config_token_valid(&token) ? esp_config_read_ref(&token, (const void **)value, valuesize) : -1;
+}
+
+int esp_config_token_get_blob_ref(esp_config_token_t token, const void **value, size_t *valuesize) {
+    assert(token.encoding == BLOB);
+    return esp_config_token_valid(&token) ? esp_config_read_ref(&token, value, valuesize) : -1;
+}
+
+int esp_config_get_i32_default(const char *ns, const char *key, int32_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, INT32, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    *value = entry->value.int32;
+    return 0;
+}
+
+int esp_config_get_u8_default(const char *ns, const char *key, uint8_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, UINT8, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_i8_default(const char *ns, const char *key, int8_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, INT8, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_u16_default(const char *ns, const char *key, uint16_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, UINT16, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_i16_default(const char *ns, const char *key, int16_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, INT16, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_u32_default(const char *ns, const char *key, uint32_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, UINT32, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_u64_default(const char *ns, const char *key, uint64_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, UINT64, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_i64_default(const char *ns, const char *key, int64_t *value) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, INT64, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    esp_config_copy_default(entry, value, NULL);
+    return 0;
+}
+
+int esp_config_get_str_default(const char *ns, const char *key, char *value, size_t *valuesize) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, STRING, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    return esp_config_copy_default(entry, value, valuesize);
+}
+
+int esp_config_get_blob_default(const char *ns, const char *key, void *value, size_t *valuesize) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = esp_config_find_default(ns, key, BLOB, NULL, &view);
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    return esp_config_copy_default(entry, value, valuesize);
+}
+
+esp_err_t esp_config_get_bulk(const char *ns, esp_config_bulk_item_t *items, size_t count) {
+
+    esp_config_session_t session;
+    esp_config_token_t token;
+    esp_config_bulk_item_t *item = NULL;
+    bool known = false;
+    bool variable = false;
+    esp_err_t esperr = ESP_OK;
+#if !ESP_CONFIG_RAM_INDEX && !defined(ESP_CONFIG_DB_SORTED)
+    int dbns = -1;
+    int base = 0;
+#endif
+
+    if (ns == NULL || (items == NULL && count > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+#if !ESP_CONFIG_RAM_INDEX && !defined(ESP_CONFIG_DB_SORTED)
+    // Without an index, the namespace is looked up once and only its entries are scanned for each key
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES && dbns < 0; i++) {
+        if (strcmp(ns, database[i].name) == 0) {
+            dbns = i;
+        } else {
+            base += database[i].nentries;
+        }
+    }
+#endif
+
+    session.opened = ESP_ERR_INVALID_STATE;
+    for (size_t i = 0; i < count; i++) {
+        item = &items[i];
+#if !ESP_CONFIG_RAM_INDEX && !defined(ESP_CONFIG_DB_SORTED)
+        known = (dbns >= 0) && esp_config_locate_in(dbns, base, item->key, item->encoding, &token);
+#else
+        known = esp_config_locate(ns, item->key, item->encoding, &token);
+#endif
+        variable = (item->encoding == STRING || item->encoding == BLOB);
+        item->status = esp_config_read(ns, item->key, known ? &token : NULL, item->encoding, variable, item->value,
+                variable ? &item->valuesize : NULL, &session);
+        if (item->status < 0) {
+            esperr = ESP_ERR_NOT_FOUND;
+        }
+    }
+    esp_config_session_end(&session);
+
+    return esperr;
+}
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+
+/*
+ * Change notifications.
+ *
+ * Subscriptions are slots of a fixed array, chained from the key or the
+ * namespace they are for, so that a change only visits its own
+ * subscribers and the write path allocates nothing. Links are slot
+ * indexes plus one, 0 ending a chain. Chains are changed and walked under
+ * the library lock, but the subscribers found are copied out and called
+ * after it is released, so that a callback waiting for another task using
+ * the library cannot deadlock, and can subscribe and unsubscribe.
+ */
+struct esp_config_subscription {
+    esp_config_change_cb_t callback;    /**< NULL for a free slot */
+    void *arg;
+    uint8_t *head;                      /**< Start of the chain the subscription is in */
+    uint8_t next;                       /**< Next subscription of the chain */
+};
+
+/*
+ * Subscriber to call, copied out of its slot, which may be reused meanwhile.
+ */
+struct esp_config_subscriber {
+    esp_config_change_cb_t callback;
+    void *arg;
+};
+
+static struct esp_config_subscription subscriptions[CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS];
+static uint8_t subscribed_keys[ESP_CONFIG_DB_KEYS];          // First subscription of each key
+static uint8_t subscribed_namespaces[ESP_CONFIG_DB_ENTRIES]; // First subscription of each namespace
+
+esp_err_t esp_config_subscribe(const char *ns, const char *key, esp_config_change_cb_t callback, void *arg, esp_config_subscription_t *subscription) {
+
+    esp_config_token_t token;
+    bool found = false;
+    uint8_t *head = NULL;
+    int slot = -1;
+
+    if (ns == NULL || callback == NULL || subscription == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (key != NULL) {
+        for (int encoding = UINT8; !found && encoding <= BLOB; encoding++) {
+            found = esp_config_locate(ns, key, (esp_config_encoding_t)encoding, &token);
+        }
+        head = found ? &subscribed_keys[token.id] : NULL;
+    } else {
+        for (int i = 0; head == NULL && i < ESP_CONFIG_DB_ENTRIES; i++) {
+            if (strcmp(ns, database[i].name) == 0) {
+                head = &subscribed_namespaces[i];
+            }
+        }
+    }
+    if (head == NULL) {
+        ESP_LOGE(tag,"%s/%s is not in the database.", ns, (key != NULL) ? key : "*");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_config_port_lock();
+    for (int i = 0; slot < 0 && i < CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS; i++) {
+        if (subscriptions[i].callback == NULL) {
+            slot = i;
+        }
+    }
+    if (slot >= 0) {
+        subscriptions[slot].callback = callback;
+        subscriptions[slot].arg = arg;
+        subscriptions[slot].head = head;
+        subscriptions[slot].next = *head;
+        __atomic_store_n(head, slot + 1, __ATOMIC_RELAXED);
+        *subscription = &subscriptions[slot];
+    }
+    esp_config_port_unlock();
+
+    return (slot >= 0) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_config_unsubscribe(esp_config_subscription_t subscription) {
+
+    uint8_t *link = NULL;
+    uint8_t slot = 0;
+
+    if (subscription < subscriptions || subscription >= subscriptions + CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    slot = subscription - subscriptions + 1;
+
+    esp_config_port_lock();
+    if (subscription->callback == NULL) {
+        esp_config_port_unlock();
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (link = subscription->head; *link != slot; link = &subscriptions[*link - 1].next);
+    __atomic_store_n(link, subscription->next, __ATOMIC_RELAXED);
+    subscription->callback = NULL;
+    esp_config_port_unlock();
+
+    return ESP_OK;
+}
+
+/*
+ * Points to the default of an entry as passed to subscribers, NULL for
+ * compressed defaults not kept decompressed, which would take an
+ * allocation.
+ */
+static const void* esp_config_notify_default(const esp_config_entry_t *entry, size_t *valuesize) {
+
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    const esp_config_inflated_t *kept = NULL;
+#endif
+
+    if (entry->encoding != STRING && entry->encoding != BLOB) {
+        *valuesize = esp_config_encoding_size(entry->encoding);
+        return &entry->value; // Every integer member starts the union
+    }
+
+    *valuesize = esp_config_default_size(entry);
+#if CONFIG_ESP_CONFIG_COMPRESSION
+    if (esp_config_compressed(entry)) {
+        kept = esp_config_inflated_find(entry);
+        return (kept != NULL) ? kept->value : NULL;
+    }
+#endif
+
+    return (entry->encoding == STRING) ? (const void*)entry->value.string : entry->value.blob;
+}
+
+/*
+ * Calls the subscribers of a key and of its namespace with its new value:
+ * the override written, NULL if not held in RAM, or the default if
+ * overridden is false.
+ */
+static void esp_config_notify(const esp_config_token_t *token, bool overridden, const void *value, size_t valuesize) {
+
+    esp_config_item_t item;
+    esp_config_entry_t view;
+    const struct esp_config_subscription *subscription = NULL;
+    struct esp_config_subscriber subscribers[CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS];
+    int count = 0;
+    uint8_t next = 0;
+
+    // Unlocked check, a subscription made meanwhile may miss this change
+    if (__atomic_load_n(&subscribed_keys[token->id], __ATOMIC_RELAXED) == 0
+            && __atomic_load_n(&subscribed_namespaces[token->ns], __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    item.ns = database[token->ns].name;
+    item.key = esp_config_db_key(token->ns, token->entry);
+    item.encoding = token->encoding;
+    item.source = overridden ? ESP_CONFIG_SOURCE_NVS : ESP_CONFIG_SOURCE_DEFAULT;
+    item.value = value;
+    item.valuesize = valuesize;
+    if (!overridden) {
+        item.value = esp_config_notify_default(esp_config_token_entry(token, &view), &item.valuesize);
+    }
+
+    // Each subscription is in one chain, so both fit in the table
+    esp_config_port_lock();
+    for (next = subscribed_keys[token->id]; next != 0; next = subscription->next) {
+        subscription = &subscriptions[next - 1];
+        subscribers[count].callback = subscription->callback;
+        subscribers[count++].arg = subscription->arg;
+    }
+    for (next = subscribed_namespaces[token->ns]; next != 0; next = subscription->next) {
+        subscription = &subscriptions[next - 1];
+        subscribers[count].callback = subscription->callback;
+        subscribers[count++].arg = subscription->arg;
+    }
+    esp_config_port_unlock();
+
+    for (int i = 0; i < count; i++) {
+        subscribers[i].callback(&item, subscribers[i].arg);
+    }
+}
+
+/*
+ * Notifies the subscribers of every key of the namespace database[dbns],
+ * or of the whole database if dbns is -1, of their default.
+ */
+static void esp_config_notify_revert(int dbns) {
+
+    esp_config_token_t token;
+
+    token.id = 0;
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++, token.id++) {
+            if (dbns < 0 || i == dbns) {
+                token.ns = i;
+                token.entry = j;
+                token.encoding = esp_config_db_encoding(i, j);
+                esp_config_notify(&token, false, NULL, 0);
+            }
+        }
+    }
+}
+
+#endif /* CONFIG_ESP_CONFIG_SUBSCRIPTIONS */
+
+/*
+ * Chooses how a write takes effect, by comparing the value with the one
+ * currently in effect and with the default. A value equal to its default
+ * is never kept in the NVS. Keys outside the defaults database are always
+ * written.
+ */
+static esp_config_set_action_t esp_config_store_action(const char *ns, const char *key, const esp_config_token_t *token, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    int status = -1;
+    bool variable = (encoding == STRING || encoding == BLOB);
+    bool overridden = false;
+    bool unchanged = false;
+    int64_t scalar = 0;
+    uint8_t buffer[64];
+    void *current = variable ? (void*)buffer : (void*)&scalar;
+    size_t size = valuesize;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = (token != NULL) ? esp_config_token_entry(token, &view) : NULL;
+
+    if (entry == NULL) {
+        return ESP_CONFIG_SET_WRITTEN; // Keys outside the database have nothing to compare with
+    }
+    if (variable && valuesize > sizeof(buffer)) {
+        current = malloc(valuesize);
+        if (current == NULL) {
+            return ESP_CONFIG_SET_WRITTEN; // Cannot compare, the value is written anyway
+        }
+    }
+
+    // A value of another size is not copied, so only whole values of the same size are compared
+    status = esp_config_lookup(ns, key, token, encoding, true, current, &size, NULL);
+    overridden = (status == 0 || status == 2);
+    if (variable) {
+        unchanged = (status == 2 || status == 3) && size == valuesize && memcmp(current, value, valuesize) == 0;
+    } else {
+        unchanged = (status >= 0) && memcmp(current, value, esp_config_encoding_size(encoding)) == 0;
+    }
+
+    if (current != buffer && current != &scalar) {
+        free(current);
+    }
+
+    if (esp_config_default_equals(entry, value, valuesize)) {
+        return overridden ? ESP_CONFIG_SET_ERASED : ESP_CONFIG_SET_UNCHANGED;
+    }
+    return unchanged ? ESP_CONFIG_SET_UNCHANGED : ESP_CONFIG_SET_WRITTEN;
+}
+
+/*
+ * Writes a value to the NVS and commits it, or erases it if value is NULL,
+ * or stages it when writes are deferred. The token locates the key in the
+ * defaults database, or is NULL if the key is not there.
+ */
+static esp_err_t esp_config_persist(const char *ns, const char *key, const esp_config_token_t *token, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    bool prepared = false;
+#endif
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    esperr = esp_config_write_behind_stage(ns, key, encoding, value, valuesize);
+    if (esperr != ESP_ERR_INVALID_STATE) {
+        return esperr;
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    if (token != NULL && (esperr = esp_config_snapshot_prepare_value(ns, key, encoding, value, valuesize, &prepared)) != ESP_OK) {
+        return esperr;
+    }
+#endif
+
+    esperr = esp_config_open(ns, (token != NULL) ? token->ns : -1, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = (value != NULL) ? esp_config_nvs_set(handle, key, encoding, esp_config_token_packed(token), value, valuesize) : esp_config_nvs_erase(handle, key);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+            if (esperr == ESP_OK) {
+#if CONFIG_ESP_CONFIG_CACHE
+                if (token != NULL) {
+                    esp_config_cache_store(token->id, encoding, (value != NULL) ? ESP_CONFIG_CACHE_NVS : ESP_CONFIG_CACHE_DEFAULT, value, valuesize);
+                }
+#endif
+#if CONFIG_ESP_CONFIG_STATS
+                esp_config_stats_count(&stats_keys[(token != NULL) ? token->id : ESP_CONFIG_STATS_OTHER].commit);
+#endif
+            } else {
+                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            }
+        } else {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        }
+        esp_config_close(handle);
+    } else {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    esp_config_snapshot_finish(prepared, esperr == ESP_OK);
+#endif
+
+    return esperr;
+}
+
+/*
+ * Writes a value, see esp_config_persist(). Values already in effect are
+ * not written, and values equal to their default erase the override
+ * instead.
+ */
+static esp_err_t esp_config_store(const char *ns, const char *key, const esp_config_token_t *token, esp_config_encoding_t encoding, const void *value, size_t valuesize, esp_config_set_action_t *action) {
+
+    esp_config_set_action_t taken = ESP_CONFIG_SET_WRITTEN;
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    esp_err_t esperr = ESP_FAIL;
+#endif
+
+    if (token != NULL && (esp_config_db_flags(token->ns, token->entry) & ESP_CONFIG_FLAG_FROZEN)) {
+        ESP_LOGE(tag,"Key %s is frozen.", key);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    taken = esp_config_store_action(ns, key, token, encoding, value, valuesize);
+    if (action != NULL) {
+        *action = taken;
+    }
+    if (taken == ESP_CONFIG_SET_UNCHANGED) {
+        return ESP_OK;
+    } else if (taken == ESP_CONFIG_SET_ERASED) {
+        value = NULL; // Erases the override
+        valuesize = 0;
+    }
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    esperr = esp_config_persist(ns, key, token, encoding, value, valuesize);
+    if (esperr == ESP_OK && token != NULL) {
+        esp_config_notify(token, value != NULL, value, valuesize);
+    }
+    return esperr;
+#else
+    return esp_config_persist(ns, key, token, encoding, value, valuesize);
+#endif
+}
+
+/*
+ * Writes a value, see esp_config_store(), and counts the write.
+ */
+static esp_err_t esp_config_write(const char *ns, const char *key, const esp_config_token_t *token, esp_config_encoding_t encoding, const void *value, size_t valuesize, esp_config_set_action_t *action) {
+
+#if CONFIG_ESP_CONFIG_STATS
+    int64_t start = esp_config_port_time_us();
+    esp_err_t esperr = esp_config_store(ns, key, token, encoding, value, valuesize, action);
+
+    esp_config_stats_count(&stats_keys[(token != NULL) ? token->id : ESP_CONFIG_STATS_OTHER].set);
+    esp_config_stats_time(&stats_set_latency, start);
+    return esperr;
+#else
+    return esp_config_store(ns, key, token, encoding, value, valuesize, action);
+#endif
+}
+
+static esp_err_t esp_config_write_key(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    esp_config_token_t token;
+    bool known = esp_config_locate(ns, key, encoding, &token);
+
+    return esp_config_write(ns, key, known ? &token : NULL, encoding, value, valuesize, NULL);
+}
+
+static esp_err_t esp_config_write_token(esp_config_token_t token, const void *value, size_t valuesize) {
+
+    if (!esp_config_token_valid(&token)) {
+        ESP_LOGE(tag,"Invalid token.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return esp_config_write(database[token.ns].name, esp_config_db_key(token.ns, token.entry), &token, token.encoding, value, valuesize, NULL);
+}
+
+esp_err_t esp_config_set_i32(const char* ns, const char* key, int32_t value) {
+    return esp_config_write_key(ns, key, INT32, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_u8(const char* ns, const char* key, uint8_t value) {
+    return esp_config_write_key(ns, key, UINT8, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_i8(const char* ns, const char* key, int8_t value) {
+    return esp_config_write_key(ns, key, INT8, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_u16(const char* ns, const char* key, uint16_t value) {
+    return esp_config_write_key(ns, key, UINT16, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_i16(const char* ns, const char* key, int16_t value) {
+    return esp_config_write_key(ns, key, INT16, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_u32(const char* ns, const char* key, uint32_t value) {
+    return esp_config_write_key(ns, key, UINT32, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_u64(const char* ns, const char* key, uint64_t value) {
+    return esp_config_write_key(ns, key, UINT64, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_i64(const char* ns, const char* key, int64_t value) {
+    return esp_config_write_key(ns, key, INT64, &value, sizeof(value));
+}
+
+esp_err_t esp_config_set_str(const char* ns, const char* key, const char* value) {
+    return esp_config_write_key(ns, key, STRING, value, strlen(value) + 1);
+}
+
+esp_err_t esp_config_set_blob(const char* ns, const char* key, const void* value, size_t valuesize) {
+    return esp_config_write_key(ns, key, BLOB, value, valuesize);
+}
+
+esp_err_t esp_config_set(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize, esp_config_set_action_t *action) {
+
+    esp_config_token_t token;
+    bool known = false;
+
+    if (ns == NULL || key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    known = esp_config_locate(ns, key, encoding, &token);
+    if (encoding == STRING) {
+        valuesize = strlen(value) + 1;
+    } else if (encoding != BLOB) {
+        valuesize = esp_config_encoding_size(encoding);
+    }
+
+    return esp_config_write(ns, key, known ? &token : NULL, encoding, value, valuesize, action);
+}
+
+esp_err_t esp_config_token_resolve(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token) {
+
+    if (!esp_config_locate(ns, key, encoding, token)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+int esp_config_token_get_i32(esp_config_token_t token, int32_t *value) {
+
+    int status = -1;
+
+    assert(token.encoding == INT32);
+    status = esp_config_read_token(token, value, NULL);
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_token_get_str(esp_config_token_t token, char *value, size_t *valuesize) {
+
+    int status = -1;
+
+    assert(token.encoding == STRING);
+    status = esp_config_read_token(token, value, valuesize);
+    assert(status >= 0);
+    return status;
+}
+
+int esp_config_token_get_blob(esp_config_token_t token, void *value, size_t *valuesize) {
+
+    int status = -1;
+
+    assert(token.encoding == BLOB);
+    status = esp_config_read_token(token, value, valuesize);
+    assert(status >= 0);
+    return status;
+}
+
+esp_err_t esp_config_token_set_i32(esp_config_token_t token, int32_t value) {
+    assert(token.encoding == INT32);
+    return esp_config_write_token(token, &value, sizeof(value));
+}
+
+esp_err_t esp_config_token_set_str(esp_config_token_t token, const char *value) {
+    assert(token.encoding == STRING);
+    return esp_config_write_token(token, value, strlen(value) + 1);
+}
+
+esp_err_t esp_config_token_set_blob(esp_config_token_t token, const void *value, size_t valuesize) {
+    assert(token.encoding == BLOB);
+    return esp_config_write_token(token, value, valuesize);
+}
+
+int esp_config_token_get(esp_config_token_t token, void *value, size_t *valuesize) {
+
+    int status = esp_config_read_token(token, value, valuesize);
+
+    assert(status >= 0);
+    return status;
+}
+
+esp_err_t esp_config_token_set(esp_config_token_t token, const void *value, size_t valuesize) {
+
+    switch (token.encoding) {
+        case STRING:
+            return esp_config_write_token(token, value, strlen(value) + 1);
+        case BLOB:
+            return esp_config_write_token(token, value, valuesize);
+        default:
+            return esp_config_write_token(token, value, esp_config_encoding_size(token.encoding));
+    }
+}
+
+/*
+ * Batch writes.
+ *
+ * Staged values are serialized as records in a single growing buffer:
+ *
+ *   | encoding (1) | ns length (1) | key length (1) | value size (4) | ns | key | value |
+ *
+ * Names are stored without terminators, strings with theirs. A key erased
+ * back to its default has ESP_CONFIG_BATCH_ERASE set in the encoding and
+ * no value. When the
+ * journal is enabled, the same buffer is first committed to the NVS as a
+ * redo log, so that a batch interrupted by a power loss is completed on
+ * the next boot instead of being left half-applied. It is completed by
+ * esp_config_init(), or by the first write if that comes first, so that
+ * it never lands on top of later values. A batch that fails to apply
+ * while the device runs has its error reported and its journal erased.
+ */
+#define ESP_CONFIG_BATCH_RECORD_HEADER 7
+#define ESP_CONFIG_BATCH_ERASE 0x80
+#define ESP_CONFIG_JOURNAL_KEY "journal"
+#define ESP_CONFIG_JOURNAL_MAGIC 0x45434a31 // "ECJ1"
+
+struct esp_config_batch {
+    uint8_t *records;
+    size_t length;
+    size_t capacity;
+};
+
+typedef struct {
+    esp_config_encoding_t encoding;
+    char ns[16];
+    char key[16];
+    const uint8_t *value;           /**< NULL for an erased key */
+    size_t valuesize;
+} esp_config_batch_record_t;
+
+/*
+ * Parses the record at *offset and advances it.
+ *
+ * @return true if a well-formed record was read.
+ */
+static bool esp_config_batch_next(const uint8_t *records, size_t length, size_t *offset, esp_config_batch_record_t *record) {
+
+    size_t nslength = 0;
+    size_t keylength = 0;
+    uint32_t valuesize = 0;
+    bool erase = false;
+    esp_config_encoding_t encoding;
+    const uint8_t *cursor = records + *offset;
+
+    if (length - *offset < ESP_CONFIG_BATCH_RECORD_HEADER) {
+        return false;
+    }
+    erase = (cursor[0] & ESP_CONFIG_BATCH_ERASE) != 0;
+    encoding = (esp_config_encoding_t)(cursor[0] & ~ESP_CONFIG_BATCH_ERASE);
+    nslength = cursor[1];
+    keylength = cursor[2];
+    memcpy(&valuesize, &cursor[3], sizeof(valuesize));
+    if (nslength >= sizeof(record->ns) || keylength >= sizeof(record->key)
+            || (erase && valuesize != 0)
+            || (!erase && esp_config_encoding_size(encoding) != 0 && esp_config_encoding_size(encoding) != valuesize)
+            || length - *offset - ESP_CONFIG_BATCH_RECORD_HEADER < nslength + keylength + valuesize) {
+        return false;
+    }
+
+    record->encoding = encoding;
+    cursor += ESP_CONFIG_BATCH_RECORD_HEADER;
+    memcpy(record->ns, cursor, nslength);
+    record->ns[nslength] = '\0';
+    cursor += nslength;
+    memcpy(record->key, cursor, keylength);
+    record->key[keylength] = '\0';
+    cursor += keylength;
+    record->value = erase ? NULL : cursor;
+    record->valuesize = valuesize;
+
+    *offset += ESP_CONFIG_BATCH_RECORD_HEADER + nslength + keylength + valuesize;
+    return true;
+}
+
+/*
+ * Applies serialized records to the NVS, with one commit per namespace.
+ * Namespaces are processed in order of first appearance, and records
+ * within a namespace in staging order, so the last value staged wins.
+ * The snapshot, the cache and, if notify is set, subscribers are updated
+ * with the values of each namespace once it is committed, so that they
+ * match the NVS when a later namespace fails.
+ */
+static esp_err_t esp_config_batch_apply(const uint8_t *records, size_t length, bool notify) {
+
+    esp_err_t esperr = ESP_OK;
+    nvs_handle handle;
+    esp_config_batch_record_t record;
+    esp_config_batch_record_t other;
+    size_t offset = 0;
+    size_t scan = 0;
+    size_t previous = 0;
+    bool seen = false;
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    bool prepared = false;
+#endif
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    esp_config_token_t token;
+#else
+    (void)notify;
+#endif
+
+    while (esperr == ESP_OK && offset < length) {
+        previous = offset;
+        if (!esp_config_batch_next(records, length, &offset, &record)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        // Skip namespaces already applied by an earlier record
+        seen = false;
+        for (scan = 0; scan < previous && !seen; ) {
+            esp_config_batch_next(records, length, &scan, &other);
+            seen = (strcmp(other.ns, record.ns) == 0);
+        }
+        if (seen) {
+            continue;
+        }
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+        esperr = esp_config_snapshot_prepare(records + previous, length - previous, record.ns, &prepared);
+        if (esperr != ESP_OK) {
+            break;
+        }
+#endif
+        esperr = esp_config_open(record.ns, -1, NVS_READWRITE, &handle);
+        if (esperr != ESP_OK) {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+            esp_config_snapshot_finish(prepared, false);
+#endif
+            break;
+        }
+        for (scan = previous; esperr == ESP_OK && scan < length; ) {
+            esp_config_batch_next(records, length, &scan, &other);
+            if (strcmp(other.ns, record.ns) == 0 && other.value != NULL) {
+                esperr = esp_config_nvs_set(handle, other.key, other.encoding, esp_config_packed_key(other.ns, other.key, other.encoding), other.value, other.valuesize);
+            } else if (strcmp(other.ns, record.ns) == 0) {
+                esperr = esp_config_nvs_erase(handle, other.key);
+            }
+        }
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        if (esperr != ESP_OK) {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        }
+        esp_config_close(handle);
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+        esp_config_snapshot_finish(prepared, esperr == ESP_OK);
+#endif
+
+        for (scan = previous; esperr == ESP_OK && scan < length; ) {
+            esp_config_batch_next(records, length, &scan, &other);
+            if (strcmp(other.ns, record.ns) != 0) {
+                continue;
+            }
+#if CONFIG_ESP_CONFIG_CACHE
+            esp_config_cache_update(other.ns, other.key, other.encoding, other.value, other.valuesize);
+#endif
+#if CONFIG_ESP_CONFIG_STATS
+            esp_config_stats_count(&stats_keys[esp_config_stats_id(other.ns, other.key, other.encoding)].commit);
+#endif
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+            if (notify && esp_config_locate(other.ns, other.key, other.encoding, &token)) {
+                esp_config_notify(&token, other.value != NULL, other.value, other.valuesize);
+            }
+#endif
+        }
+    }
+
+    return esperr;
+}
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+
+/*
+ * Commits records to the journal. The journal is a blob made of the magic
+ * number, the CRC32 of the records, and the records themselves.
+ */
+static esp_err_t esp_config_journal_write(const uint8_t *records, size_t length) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    uint8_t *journal = NULL;
+    uint32_t magic = ESP_CONFIG_JOURNAL_MAGIC;
+    uint32_t crc = esp_config_crc32(0, records, length);
+
+    journal = malloc(sizeof(magic) + sizeof(crc) + length);
+    if (journal == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(journal, &magic, sizeof(magic));
+    memcpy(journal + sizeof(magic), &crc, sizeof(crc));
+    memcpy(journal + sizeof(magic) + sizeof(crc), records, length);
+
+    esperr = esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = nvs_set_blob(handle, ESP_CONFIG_JOURNAL_KEY, journal, sizeof(magic) + sizeof(crc) + length);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        esp_config_close(handle);
+    }
+
+    free(journal);
+    return esperr;
+}
+
+static esp_err_t esp_config_journal_clear() {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+
+    esperr = esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = nvs_erase_key(handle, ESP_CONFIG_JOURNAL_KEY);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        esp_config_close(handle);
+    }
+
+    return esperr;
+}
+
+/*
+ * Completes a batch interrupted after its journal was committed. A journal
+ * that fails its checksum was never fully written, so the batch it belongs
+ * to never started applying and is dropped. So is a journal that fails to
+ * apply, which would otherwise be applied again over later writes.
+ */
+static esp_err_t esp_config_journal_replay() {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    uint8_t *journal = NULL;
+    size_t size = 0;
+    uint32_t magic = 0;
+    uint32_t crc = 0;
+
+    esperr = esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READONLY, &handle);
+    if (esperr == ESP_OK) {
+        esperr = nvs_get_blob(handle, ESP_CONFIG_JOURNAL_KEY, NULL, &size);
+        if (esperr == ESP_OK) {
+            journal = malloc(size > 0 ? size : 1);
+            esperr = journal != NULL ? nvs_get_blob(handle, ESP_CONFIG_JOURNAL_KEY, journal, &size) : ESP_ERR_NO_MEM;
+        }
+        esp_config_close(handle);
+    }
+    if (esperr == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK; // No interrupted batch
+    } else if (esperr != ESP_OK) {
+        free(journal);
+        return esperr;
+    }
+
+    if (size >= sizeof(magic) + sizeof(crc)) {
+        memcpy(&magic, journal, sizeof(magic));
+        memcpy(&crc, journal + sizeof(magic), sizeof(crc));
+    }
+    if (magic == ESP_CONFIG_JOURNAL_MAGIC && crc == esp_config_crc32(0, journal + sizeof(magic) + sizeof(crc), size - sizeof(magic) - sizeof(crc))) {
+        ESP_LOGW(tag,"Completing interrupted batch");
+        esperr = esp_config_batch_apply(journal + sizeof(magic) + sizeof(crc), size - sizeof(magic) - sizeof(crc), false);
+    } else {
+        ESP_LOGW(tag,"Dropping corrupted batch journal");
+    }
+    free(journal);
+
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"Dropping batch journal that could not be applied: %s",esp_err_to_name(esperr));
+        esp_config_journal_clear();
+        return esperr;
+    }
+
+    return esp_config_journal_clear();
+}
+
+/*
+ * Replays the journal once per esp_config_init(), from there or from the
+ * first write before it. Writes made by the replay itself do not recurse.
+ */
+static esp_err_t esp_config_journal_recover() {
+
+    esp_err_t esperr = ESP_OK;
+
+    if (__atomic_load_n(&journal_recovered, __ATOMIC_ACQUIRE)) {
+        return ESP_OK;
+    }
+
+    esp_config_port_lock();
+    if (!journal_recovered) {
+        __atomic_store_n(&journal_recovered, true, __ATOMIC_RELEASE);
+        esperr = esp_config_journal_replay();
+        if (esperr != ESP_OK) {
+            ESP_LOGE(tag,"Could not replay batch journal: %s",esp_err_to_name(esperr));
+        }
+    }
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+#endif /* CONFIG_ESP_CONFIG_BATCH_JOURNAL */
+
+/*
+ * Finds the record staged for a key.
+ *
+ * @return The offset of the record, or -1 if the key is not staged.
+ */
+static long esp_config_batch_find(esp_config_batch_t batch, const char *ns, const char *key, esp_config_batch_record_t *record) {
+
+    size_t offset = 0;
+    size_t previous = 0;
+
+    while (offset < batch->length) {
+        previous = offset;
+        if (!esp_config_batch_next(batch->records, batch->length, &offset, record)) {
+            break;
+        }
+        if (strcmp(record->key, key) == 0 && strcmp(record->ns, ns) == 0) {
+            return previous;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Removes the record staged for a key, if any.
+ */
+static void esp_config_batch_remove(esp_config_batch_t batch, const char *ns, const char *key) {
+
+    esp_config_batch_record_t record;
+    long start = esp_config_batch_find(batch, ns, key, &record);
+    size_t end = 0;
+
+    if (start != -1) {
+        end = (size_t)start + ESP_CONFIG_BATCH_RECORD_HEADER + strlen(record.ns) + strlen(record.key) + record.valuesize;
+        memmove(batch->records + start, batch->records + end, batch->length - end);
+        batch->length -= end - start;
+    }
+}
+
+/*
+ * Stages a value, replacing the one staged for the same key if any. A NULL
+ * value stages an erase of the key.
+ */
+static esp_err_t esp_config_batch_stage(esp_config_batch_t batch, const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    size_t nslength = 0;
+    size_t keylength = 0;
+    size_t needed = 0;
+    size_t capacity = 0;
+    uint8_t *records = NULL;
+    uint32_t size32 = 0;
+    uint8_t *cursor = NULL;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+
+    if (batch == NULL || ns == NULL || key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (value == NULL) {
+        valuesize = 0;
+    }
+    size32 = valuesize;
+    nslength = strlen(ns);
+    keylength = strlen(key);
+    if (nslength > 15 || keylength > 15) {
+        return ESP_ERR_INVALID_ARG; // NVS limit, better caught now than halfway through the commit
+    }
+    entry = esp_config_find_default(ns, key, encoding, NULL, &view);
+    if (entry != NULL && (entry->flags & ESP_CONFIG_FLAG_FROZEN)) {
+        ESP_LOGE(tag,"Key %s is frozen.", key);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // A key staged again replaces its previous value, so that it is written only once
+    esp_config_batch_remove(batch, ns, key);
+
+    needed = batch->length + ESP_CONFIG_BATCH_RECORD_HEADER + nslength + keylength + valuesize;
+    if (needed > batch->capacity) {
+        capacity = batch->capacity > 0 ? batch->capacity : 128;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        records = realloc(batch->records, capacity);
+        if (records == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        batch->records = records;
+        batch->capacity = capacity;
+    }
+
+    cursor = batch->records + batch->length;
+    cursor[0] = (value != NULL) ? encoding : (encoding | ESP_CONFIG_BATCH_ERASE);
+    cursor[1] = nslength;
+    cursor[2] = keylength;
+    memcpy(&cursor[3], &size32, sizeof(size32));
+    cursor += ESP_CONFIG_BATCH_RECORD_HEADER;
+    memcpy(cursor, ns, nslength);
+    cursor += nslength;
+    memcpy(cursor, key, keylength);
+    cursor += keylength;
+    if (value != NULL) {
+        memcpy(cursor, value, valuesize);
+    }
+    batch->length = needed;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_config_batch_begin(esp_config_batch_t *batch) {
+
+    *batch = calloc(1, sizeof(struct esp_config_batch));
+    if (*batch == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/*
+ * Stages a value set by the application, see esp_config_batch_stage(),
+ * and counts the write. A value equal to its default is staged as an
+ * erase, so that the override is dropped rather than rewritten.
+ */
+static esp_err_t esp_config_batch_set(esp_config_batch_t batch, const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+
+    if (ns == NULL || key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#if CONFIG_ESP_CONFIG_STATS
+    esp_config_stats_count(&stats_keys[esp_config_stats_id(ns, key, encoding)].set);
+#endif
+
+    entry = esp_config_find_default(ns, key, encoding, NULL, &view);
+    if (entry != NULL && esp_config_default_equals(entry, value, valuesize)) {
+        value = NULL;
+    }
+
+    return esp_config_batch_stage(batch, ns, key, encoding, value, valuesize);
+}
+
+esp_err_t esp_config_batch_set_i32(esp_config_batch_t batch, const char *ns, const char *key, int32_t value) {
+    return esp_config_batch_set(batch, ns, key, INT32, &value, sizeof(value));
+}
+
+esp_err_t esp_config_batch_set_str(esp_config_batch_t batch, const char *ns, const char *key, const char *value) {
+    return esp_config_batch_set(batch, ns, key, STRING, value, value != NULL ? strlen(value) + 1 : 0);
+}
+
+esp_err_t esp_config_batch_set_blob(esp_config_batch_t batch, const char *ns, const char *key, const void *value, size_t valuesize) {
+    return esp_config_batch_set(batch, ns, key, BLOB, value, valuesize);
+}
+
+esp_err_t esp_config_batch_commit(esp_config_batch_t batch) {
+
+    esp_err_t esperr = ESP_OK;
+
+    if (batch == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (batch->length == 0) {
+        esp_config_batch_abort(batch);
+        return ESP_OK;
+    }
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    esp_config_flush(); // Earlier deferred writes must not land on top of the batch
+#endif
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+    esperr = esp_config_journal_write(batch->records, batch->length);
+    if (esperr != ESP_OK) { // Nothing applied yet, the batch is simply not committed
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        esp_config_batch_abort(batch);
+        return esperr;
+    }
+#endif
+
+    esperr = esp_config_batch_apply(batch->records, batch->length, true);
+
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+    if (esperr == ESP_OK) {
+        esperr = esp_config_journal_clear();
+    } else {
+        // Applying it again on the next boot would override values written after this error
+        ESP_LOGE(tag,"Batch partially applied");
+        esp_config_journal_clear();
+    }
+#endif
+
+    esp_config_batch_abort(batch);
+    return esperr;
+}
+
+void esp_config_batch_abort(esp_config_batch_t batch) {
+
+    if (batch != NULL) {
+        free(batch->records);
+        free(batch);
+    }
+}
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+
+/*
+ * Boot snapshot.
+ *
+ * All values overridden in the NVS are also kept in a single blob, made of
+ * a header and of records in the batch format:
+ *
+ *   | magic (4) | version (2) | reserved (2) | CRC32 of the records (4) | records |
+ *
+ * The blob is read once by esp_config_init(), kept in RAM, and indexed
+ * against the defaults database, so that reads never go to the NVS. Writes
+ * update the snapshot in RAM and the per-key entries, but the blob is only
+ * rewritten by esp_config_snapshot_save() and esp_config_deinit(). The
+ * first write after the blob was saved records a dirty marker instead, so
+ * that a blob left out of date by a reset is rebuilt from the per-key
+ * entries on the next boot.
+ *
+ * Writers are serialized and own the committed records. Readers see a
+ * published copy of them, a version, guarded by a sequence number that is
+ * odd while the version is rewritten. With lock-free reads, two versions
+ * alternate: the writer only rewrites the one readers were moved away
+ * from, and a reader that was still on it notices the sequence change and
+ * reads again. Buffers outgrown by a version are retired rather than freed,
+ * as a late reader may still be copying from them, and released by
+ * esp_config_deinit(). Since buffers grow by doubling, retired buffers take
+ * at most as much memory as the versions themselves.
+ */
+#define ESP_CONFIG_SNAPSHOT_KEY "snapshot"
+#define ESP_CONFIG_SNAPSHOT_DIRTY_KEY "snapshot_dirty" // Present while the blob is older than the per-key entries
+#define ESP_CONFIG_SNAPSHOT_MAGIC 0x45435331 // "ECS1"
+#define ESP_CONFIG_SNAPSHOT_VERSION 1
+#define ESP_CONFIG_SNAPSHOT_HEADER 12
+#define ESP_CONFIG_SNAPSHOT_GUESS 512 // Snapshots up to this size are read in one call
+
+#if CONFIG_ESP_CONFIG_LOCKFREE_READS
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+#error "CONFIG_ESP_CONFIG_LOCKFREE_READS requires CONFIG_ESP_CONFIG_WRITE_BEHIND to be disabled"
+#endif
+#define ESP_CONFIG_SNAPSHOT_VERSIONS 2
+#else
+#define ESP_CONFIG_SNAPSHOT_VERSIONS 1
+#endif
+
+typedef struct esp_config_snapshot_buffer {
+    size_t capacity;                            /**< Never changes, so readers can bound their reads */
+    struct esp_config_snapshot_buffer *retired; /**< Next retired buffer */
+    uint8_t records[];
+} esp_config_snapshot_buffer_t;
+
+typedef struct {
+    uint32_t sequence;                          /**< Odd while the version is rewritten */
+    esp_config_snapshot_buffer_t *buffer;
+    size_t length;
+    int32_t offsets[ESP_CONFIG_DB_KEYS];        /**< Record of every key, -1 if not overridden */
+} esp_config_snapshot_version_t;
+
+static struct esp_config_batch snapshot_records; // Committed records, owned by the writer
+static esp_config_snapshot_version_t snapshot_versions[ESP_CONFIG_SNAPSHOT_VERSIONS];
+static esp_config_snapshot_version_t *snapshot = NULL; // Version readers use, NULL if not loaded
+static esp_config_snapshot_buffer_t *snapshot_retired = NULL;
+static esp_config_port_mutex_t snapshot_write_lock = NULL;
+static bool snapshot_dirty = false; // The blob is out of date, guarded by snapshot_write_lock
+static struct esp_config_batch snapshot_next; // Records prepared, guarded by snapshot_write_lock
+static esp_config_snapshot_buffer_t *snapshot_next_buffer = NULL;
+
+/*
+ * Points every key of the database to its record in a version. Records of
+ * keys no longer in the database are ignored.
+ */
+static void esp_config_snapshot_index(esp_config_snapshot_version_t *version) {
+
+    esp_config_batch_record_t record;
+    esp_config_token_t token;
+    size_t offset = 0;
+    size_t previous = 0;
+
+    for (int id = 0; id < ESP_CONFIG_DB_KEYS; id++) {
+        __atomic_store_n(&version->offsets[id], -1, __ATOMIC_RELAXED);
+    }
+    while (previous = offset, esp_config_batch_next(version->buffer->records, version->length, &offset, &record)) {
+        if (esp_config_locate(record.ns, record.key, record.encoding, &token)) {
+            __atomic_store_n(&version->offsets[token.id], previous, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*
+ * The version the writer publishes to next, which readers are not using.
+ */
+static esp_config_snapshot_version_t* esp_config_snapshot_next_version() {
+
+#if CONFIG_ESP_CONFIG_LOCKFREE_READS
+    if (__atomic_load_n(&snapshot, __ATOMIC_RELAXED) == &snapshot_versions[0]) {
+        return &snapshot_versions[1];
+    }
+#endif
+    return &snapshot_versions[0];
+}
+
+/*
+ * Allocates the buffer needed to publish records of the given length, so
+ * that publishing cannot fail once the records are committed to the NVS.
+ * *buffer is set to NULL if the current buffer is large enough.
+ */
+static esp_err_t esp_config_snapshot_reserve(size_t length, esp_config_snapshot_buffer_t **buffer) {
+
+    esp_config_snapshot_version_t *version = esp_config_snapshot_next_version();
+    size_t capacity = 0;
+
+    *buffer = NULL;
+    if (version->buffer != NULL && version->buffer->capacity >= length) {
+        return ESP_OK;
+    }
+
+    capacity = (version->buffer != NULL) ? 2 * version->buffer->capacity : 128;
+    while (capacity < length) {
+        capacity *= 2;
+    }
+    *buffer = malloc(sizeof(esp_config_snapshot_buffer_t) + capacity);
+    if (*buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*buffer)->capacity = capacity;
+    (*buffer)->retired = NULL;
+
+    return ESP_OK;
+}
+
+/*
+ * Makes next the committed records, taking ownership of them, copies them
+ * to the version readers are not using, and moves readers to it. Called by
+ * the writer only, with the buffer from esp_config_snapshot_reserve().
+ */
+static void esp_config_snapshot_publish(struct esp_config_batch *next, esp_config_snapshot_buffer_t *buffer) {
+
+    esp_config_snapshot_version_t *version = esp_config_snapshot_next_version();
+
+    free(snapshot_records.records);
+    snapshot_records = *next;
+    memset(next, 0, sizeof(*next));
+
+#if !CONFIG_ESP_CONFIG_LOCKFREE_READS
+    esp_config_port_lock();
+#endif
+    __atomic_store_n(&version->sequence, version->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (buffer != NULL) {
+#if CONFIG_ESP_CONFIG_LOCKFREE_READS
+        if (version->buffer != NULL) {
+            version->buffer->retired = snapshot_retired;
+            snapshot_retired = version->buffer;
+        }
+#else
+        free(version->buffer); // Readers hold the lock, none can be on it
+#endif
+        __atomic_store_n(&version->buffer, buffer, __ATOMIC_RELAXED);
+    }
+    if (snapshot_records.length > 0) {
+        memcpy(version->buffer->records, snapshot_records.records, snapshot_records.length);
+    }
+    __atomic_store_n(&version->length, snapshot_records.length, __ATOMIC_RELAXED);
+    esp_config_snapshot_index(version);
+
+    __atomic_store_n(&version->sequence, version->sequence + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&snapshot, version, __ATOMIC_RELEASE);
+#if !CONFIG_ESP_CONFIG_LOCKFREE_READS
+    esp_config_port_unlock();
+#endif
+}
+
+/*
+ * Copies a value out of a version, which may be rewritten meanwhile with
+ * lock-free reads. Every offset and size is checked against the buffer, so
+ * that a torn read stays within it and is only discarded by the caller.
+ */
+static int esp_config_snapshot_copy(const esp_config_snapshot_version_t *version, const esp_config_token_t *token, bool sized, const size_t *range, void *value, size_t *valuesize) {
+
+    int32_t offset = __atomic_load_n(&version->offsets[token->id], __ATOMIC_RELAXED);
+    esp_config_snapshot_buffer_t *buffer = __atomic_load_n(&version->buffer, __ATOMIC_RELAXED);
+    size_t length = __atomic_load_n(&version->length, __ATOMIC_RELAXED);
+    size_t cursor = offset;
+    esp_config_batch_record_t record;
+    esp_config_entry_t view;
+
+    if (offset < 0) {
+        return esp_config_read_default(esp_config_token_entry(token, &view), sized, range, value, valuesize);
+    }
+    if (buffer == NULL || length > buffer->capacity || cursor >= length
+            || !esp_config_batch_next(buffer->records, length, &cursor, &record) || record.encoding != token->encoding) {
+        return -1;
+    }
+
+    if (record.encoding != STRING && record.encoding != BLOB) {
+        memcpy(value, record.value, record.valuesize);
+        return 0;
+    }
+    return esp_config_copy_value(record.value, record.valuesize, range, value, valuesize);
+}
+
+/*
+ * Serves a read from the snapshot, following the status codes of the
+ * esp_config_get_* functions. With lock-free reads, the read is retried
+ * until it did not overlap with a rewrite of the version it was served
+ * from.
+ *
+ * @return The status code, or -1 if no snapshot is loaded.
+ */
+static int esp_config_snapshot_fetch(const esp_config_token_t *token, bool sized, const size_t *range, void *value, size_t *valuesize) {
+
+    int status = -1;
+    esp_config_snapshot_version_t *version = NULL;
+#if CONFIG_ESP_CONFIG_LOCKFREE_READS
+    uint32_t sequence = 0;
+    size_t size = (valuesize != NULL) ? *valuesize : 0;
+
+    do {
+        version = __atomic_load_n(&snapshot, __ATOMIC_ACQUIRE);
+        if (version == NULL) {
+            return -1;
+        }
+        sequence = __atomic_load_n(&version->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            continue; // Being rewritten, readers are about to be moved away from it
+        }
+        if (valuesize != NULL) {
+            *valuesize = size; // A torn read may have changed it
+        }
+        status = esp_config_snapshot_copy(version, token, sized, range, value, valuesize);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || __atomic_load_n(&version->sequence, __ATOMIC_RELAXED) != sequence);
+#else
+    esp_config_port_lock();
+    version = snapshot;
+    if (version != NULL) {
+        status = esp_config_snapshot_copy(version, token, sized, range, value, valuesize);
+    }
+    esp_config_port_unlock();
+#endif
+
+    return status;
+}
+
+/*
+ * Writes a snapshot blob to the NVS and commits it.
+ */
+static esp_err_t esp_config_snapshot_write(const struct esp_config_batch *next) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    uint8_t *blob = NULL;
+    uint32_t magic = ESP_CONFIG_SNAPSHOT_MAGIC;
+    uint16_t version = ESP_CONFIG_SNAPSHOT_VERSION;
+    uint32_t crc = esp_config_crc32(0, next->records, next->length);
+
+    blob = calloc(1, ESP_CONFIG_SNAPSHOT_HEADER + next->length);
+    if (blob == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(blob, &magic, sizeof(magic));
+    memcpy(blob + 4, &version, sizeof(version));
+    memcpy(blob + 8, &crc, sizeof(crc));
+    if (next->length > 0) {
+        memcpy(blob + ESP_CONFIG_SNAPSHOT_HEADER, next->records, next->length);
+    }
+
+    esperr = esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = nvs_set_blob(handle, ESP_CONFIG_SNAPSHOT_KEY, blob, ESP_CONFIG_SNAPSHOT_HEADER + next->length);
+        if (esperr == ESP_OK) {
+            // Erased after the blob is written, a reset in between only costs a rebuild
+            esperr = nvs_erase_key(handle, ESP_CONFIG_SNAPSHOT_DIRTY_KEY);
+            esperr = (esperr == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : esperr;
+        }
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        esp_config_close(handle);
+    }
+    if (esperr == ESP_OK) {
+        snapshot_dirty = false;
+    }
+
+    free(blob);
+    return esperr;
+}
+
+/*
+ * Records that the blob is about to fall behind the per-key entries, once
+ * per save. Called by the writer, before the per-key entries are written.
+ */
+static esp_err_t esp_config_snapshot_mark_dirty() {
+
+    esp_err_t esperr = ESP_OK;
+    nvs_handle handle;
+
+    if (snapshot_dirty) {
+        return ESP_OK;
+    }
+
+    esperr = esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = nvs_set_u8(handle, ESP_CONFIG_SNAPSHOT_DIRTY_KEY, 1);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        esp_config_close(handle);
+    }
+    if (esperr == ESP_OK) {
+        snapshot_dirty = true;
+    }
+
+    return esperr;
+}
+
+esp_err_t esp_config_snapshot_save() {
+
+    esp_err_t esperr = ESP_OK;
+
+    if (__atomic_load_n(&snapshot, __ATOMIC_ACQUIRE) == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_config_port_mutex_lock(snapshot_write_lock);
+    if (snapshot_dirty) {
+        esperr = esp_config_snapshot_write(&snapshot_records);
+    }
+    esp_config_port_mutex_unlock(snapshot_write_lock);
+
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"Could not save snapshot: %s",esp_err_to_name(esperr));
+    }
+    return esperr;
+}
+
+/*
+ * Prepares the snapshot in RAM with serialized records merged in, those of
+ * namespace ns only unless it is NULL, without publishing it yet: the
+ * writer calls esp_config_snapshot_finish() once the records are committed
+ * to the NVS or failed, so that readers never see a value that was not
+ * written. Keys outside the defaults database are left out, as reads of
+ * them go to the NVS, and erased keys are removed. Writers are serialized
+ * from here to esp_config_snapshot_finish().
+ *
+ * @return ESP_OK if success, with *prepared set if there is a snapshot to
+ * finish.
+ */
+static esp_err_t esp_config_snapshot_prepare(const uint8_t *records, size_t length, const char *ns, bool *prepared) {
+
+    esp_err_t esperr = ESP_OK;
+    esp_config_batch_record_t record;
+    esp_config_entry_t view;
+    size_t offset = 0;
+
+    *prepared = false;
+    if (__atomic_load_n(&snapshot, __ATOMIC_ACQUIRE) == NULL) {
+        return ESP_OK;
+    }
+
+    // Readers keep using the current version until the new one is committed
+    esp_config_port_mutex_lock(snapshot_write_lock);
+
+    memset(&snapshot_next, 0, sizeof(snapshot_next));
+    snapshot_next_buffer = NULL;
+    snapshot_next.capacity = snapshot_records.length;
+    snapshot_next.records = malloc(snapshot_next.capacity > 0 ? snapshot_next.capacity : 1);
+    if (snapshot_next.records != NULL) {
+        snapshot_next.length = snapshot_records.length;
+        if (snapshot_next.length > 0) {
+            memcpy(snapshot_next.records, snapshot_records.records, snapshot_next.length);
+        }
+    } else {
+        esperr = ESP_ERR_NO_MEM;
+    }
+
+    while (esperr == ESP_OK && esp_config_batch_next(records, length, &offset, &record)) {
+        if ((ns != NULL && strcmp(record.ns, ns) != 0) || esp_config_find_default(record.ns, record.key, record.encoding, NULL, &view) == NULL) {
+            continue;
+        } else if (record.value == NULL) {
+            esp_config_batch_remove(&snapshot_next, record.ns, record.key); // Erased keys are at their default
+        } else {
+            esperr = esp_config_batch_stage(&snapshot_next, record.ns, record.key, record.encoding, record.value, record.valuesize);
+        }
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_snapshot_reserve(snapshot_next.length, &snapshot_next_buffer);
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_snapshot_mark_dirty();
+    }
+    if (esperr == ESP_OK) {
+        *prepared = true;
+    } else {
+        ESP_LOGE(tag,"Could not update snapshot: %s",esp_err_to_name(esperr));
+        esp_config_snapshot_finish(true, false);
+    }
+
+    return esperr;
+}
+
+/*
+ * Prepares the snapshot with a single value, or with an erase if value is
+ * NULL, see esp_config_snapshot_prepare().
+ */
+static esp_err_t esp_config_snapshot_prepare_value(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize, bool *prepared) {
+
+    esp_err_t esperr = ESP_OK;
+    struct esp_config_batch one = {0};
+
+    *prepared = false;
+    if (__atomic_load_n(&snapshot, __ATOMIC_ACQUIRE) == NULL) {
+        return ESP_OK;
+    }
+
+    esperr = esp_config_batch_stage(&one, ns, key, encoding, value, valuesize);
+    if (esperr == ESP_OK) {
+        esperr = esp_config_snapshot_prepare(one.records, one.length, NULL, prepared);
+    }
+
+    free(one.records);
+    return esperr;
+}
+
+/*
+ * Publishes the snapshot prepared by esp_config_snapshot_prepare() if the
+ * records it mirrors were committed, drops it otherwise. The blob stays
+ * marked dirty either way, which only costs a rebuild.
+ */
+static void esp_config_snapshot_finish(bool prepared, bool committed) {
+
+    if (!prepared) {
+        return;
+    }
+
+    if (committed) {
+        esp_config_snapshot_publish(&snapshot_next, snapshot_next_buffer);
+    } else {
+        free(snapshot_next.records);
+        free(snapshot_next_buffer);
+        memset(&snapshot_next, 0, sizeof(snapshot_next));
+    }
+    snapshot_next_buffer = NULL;
+
+    esp_config_port_mutex_unlock(snapshot_write_lock);
+}
+
+/*
+ * Drops every value of a namespace from the snapshot, or every value if ns
+ * is NULL, see esp_config_snapshot_update().
+ */
+static esp_err_t esp_config_snapshot_revert(const char *ns) {
+
+    esp_err_t esperr = ESP_OK;
+    struct esp_config_batch next = {0};
+    esp_config_snapshot_buffer_t *buffer = NULL;
+    esp_config_batch_record_t record;
+    size_t offset = 0;
+
+    if (__atomic_load_n(&snapshot, __ATOMIC_ACQUIRE) == NULL) {
+        return ESP_OK;
+    }
+
+    esp_config_port_mutex_lock(snapshot_write_lock);
+
+    while (ns != NULL && esperr == ESP_OK && esp_config_batch_next(snapshot_records.records, snapshot_records.length, &offset, &record)) {
+        if (strcmp(record.ns, ns) != 0) {
+            esperr = esp_config_batch_stage(&next, record.ns, record.key, record.encoding, record.value, record.valuesize);
+        }
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_snapshot_reserve(next.length, &buffer);
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_snapshot_mark_dirty();
+    }
+    if (esperr == ESP_OK) {
+        esp_config_snapshot_publish(&next, buffer);
+    } else {
+        ESP_LOGE(tag,"Could not update snapshot: %s",esp_err_to_name(esperr));
+        free(next.records);
+        free(buffer);
+    }
+
+    esp_config_port_mutex_unlock(snapshot_write_lock);
+    return esperr;
+}
+
+/*
+ * Reads the snapshot blob, in a single call if it is small enough.
+ *
+ * @return ESP_OK if a valid snapshot was read into *records.
+ */
+static esp_err_t esp_config_snapshot_read(struct esp_config_batch *records) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    uint8_t *blob = NULL;
+    size_t size = ESP_CONFIG_SNAPSHOT_GUESS;
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    uint32_t crc = 0;
+    size_t offset = 0;
+    esp_config_batch_record_t record;
+
+    esperr = esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READONLY, &handle);
+    if (esperr == ESP_OK) {
+        blob = malloc(size);
+        esperr = (blob != NULL) ? nvs_get_blob(handle, ESP_CONFIG_SNAPSHOT_KEY, blob, &size) : ESP_ERR_NO_MEM;
+        if (esperr == ESP_ERR_NVS_INVALID_LENGTH) { // Larger than guessed, size now holds the actual size
+            free(blob);
+            blob = malloc(size);
+            esperr = (blob != NULL) ? nvs_get_blob(handle, ESP_CONFIG_SNAPSHOT_KEY, blob, &size) : ESP_ERR_NO_MEM;
+        }
+        esp_config_close(handle);
+    }
+    if (esperr != ESP_OK) {
+        free(blob);
+        return esperr;
+    }
+
+    if (size >= ESP_CONFIG_SNAPSHOT_HEADER) {
+        memcpy(&magic, blob, sizeof(magic));
+        memcpy(&version, blob + 4, sizeof(version));
+        memcpy(&crc, blob + 8, sizeof(crc));
+    }
+    if (magic != ESP_CONFIG_SNAPSHOT_MAGIC || version != ESP_CONFIG_SNAPSHOT_VERSION
+            || crc != esp_config_crc32(0, blob + ESP_CONFIG_SNAPSHOT_HEADER, size - ESP_CONFIG_SNAPSHOT_HEADER)) {
+        free(blob);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Records are moved to the front, the blob becomes the record buffer
+    records->length = size - ESP_CONFIG_SNAPSHOT_HEADER;
+    memmove(blob, blob + ESP_CONFIG_SNAPSHOT_HEADER, records->length);
+    records->records = blob;
+    records->capacity = size;
+    while (offset < records->length) {
+        if (!esp_config_batch_next(records->records, records->length, &offset, &record)) {
+            free(blob);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_config_snapshot_rebuild() {
+
+    esp_err_t esperr = ESP_OK;
+    nvs_handle handle;
+    struct esp_config_batch next = {0};
+    esp_config_snapshot_buffer_t *buffer = NULL;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+    int64_t scalar = 0;
+    void *value = NULL;
+    size_t size = 0;
+
+    if (!initialized || snapshot_write_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#if CONFIG_ESP_CONFIG_BATCH_JOURNAL
+    // Writing the blob would complete an interrupted batch, after the entries it changes were read
+    esp_config_journal_recover();
+#endif
+
+    for (int i = 0; esperr == ESP_OK && i < ESP_CONFIG_DB_ENTRIES; i++) {
+        esperr = esp_config_open(database[i].name, i, NVS_READONLY, &handle);
+        if (esperr == ESP_ERR_NVS_NOT_FOUND) { // Namespace never written, nothing is overridden
+            esperr = ESP_OK;
+            continue;
+        } else if (esperr != ESP_OK) {
+            break;
+        }
+        for (unsigned int j = 0; esperr == ESP_OK && j < database[i].nentries; j++) {
+            entry = esp_config_db_entry(i, j, &view);
+            if (entry->encoding == STRING || entry->encoding == BLOB) {
+                esperr = esp_config_nvs_get(handle, entry->key, entry->encoding, esp_config_packed(entry), NULL, &size);
+                value = (esperr == ESP_OK) ? malloc(size > 0 ? size : 1) : NULL;
+                if (esperr == ESP_OK && value == NULL) {
+                    esperr = ESP_ERR_NO_MEM;
+                } else if (esperr == ESP_OK) {
+                    esperr = esp_config_nvs_get(handle, entry->key, entry->encoding, esp_config_packed(entry), value, &size);
+                }
+            } else {
+                value = &scalar;
+                size = esp_config_encoding_size(entry->encoding);
+                esperr = esp_config_nvs_get(handle, entry->key, entry->encoding, false, value, NULL);
+            }
+            if (esperr == ESP_OK) {
+                esperr = esp_config_batch_stage(&next, database[i].name, entry->key, entry->encoding, value, size);
+            } else if (esperr == ESP_ERR_NVS_NOT_FOUND) {
+                esperr = ESP_OK;
+            }
+            if (value != &scalar) {
+                free(value);
+            }
+        }
+        esp_config_close(handle);
+    }
+
+    if (esperr == ESP_OK) {
+        esp_config_port_mutex_lock(snapshot_write_lock);
+        esperr = esp_config_snapshot_reserve(next.length, &buffer);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_snapshot_write(&next);
+        }
+        if (esperr == ESP_OK) {
+            esp_config_snapshot_publish(&next, buffer);
+        } else {
+            free(buffer);
+        }
+        esp_config_port_mutex_unlock(snapshot_write_lock);
+    }
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"Could not rebuild snapshot: %s",esp_err_to_name(esperr));
+    }
+
+    free(next.records);
+    return esperr;
+}
+
+/*
+ * @return true if the dirty marker was left by writes made after the last
+ *         save of the blob.
+ */
+static bool esp_config_snapshot_marked_dirty() {
+
+    nvs_handle handle;
+    uint8_t marker = 0;
+
+    if (esp_config_open(ESP_CONFIG_NVS_NAMESPACE, -1, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    if (nvs_get_u8(handle, ESP_CONFIG_SNAPSHOT_DIRTY_KEY, &marker) != ESP_OK) {
+        marker = 0;
+    }
+    esp_config_close(handle);
+
+    return marker != 0;
+}
+
+/*
+ * Loads the snapshot, or builds it from the per-key entries if it is
+ * missing, invalid or out of date, e.g. on the first boot with snapshots
+ * enabled or after a reset with unsaved writes.
+ */
+static esp_err_t esp_config_snapshot_load() {
+
+    esp_err_t esperr = ESP_OK;
+    struct esp_config_batch records = {0};
+    esp_config_snapshot_buffer_t *buffer = NULL;
+
+    if (snapshot_write_lock == NULL && (snapshot_write_lock = esp_config_port_mutex_create()) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esperr = esp_config_snapshot_read(&records);
+    if (esperr == ESP_OK && esp_config_snapshot_marked_dirty()) {
+        ESP_LOGI(tag,"Snapshot out of date, rebuilding it");
+        free(records.records);
+        return esp_config_snapshot_rebuild();
+    }
+    if (esperr == ESP_OK) {
+        esp_config_port_mutex_lock(snapshot_write_lock);
+        esperr = esp_config_snapshot_reserve(records.length, &buffer);
+        if (esperr == ESP_OK) {
+            esp_config_snapshot_publish(&records, buffer);
+        }
+        esp_config_port_mutex_unlock(snapshot_write_lock);
+        free(records.records);
+        return esperr;
+    }
+
+    if (esperr != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(tag,"Invalid snapshot, rebuilding it: %s",esp_err_to_name(esperr));
+    }
+    return esp_config_snapshot_rebuild();
+}
+
+/*
+ * Releases the snapshot. Readers must not be running, as with
+ * esp_config_deinit().
+ */
+static void esp_config_snapshot_drop() {
+
+    esp_config_snapshot_buffer_t *retired = NULL;
+
+    esp_config_port_lock();
+    __atomic_store_n(&snapshot, NULL, __ATOMIC_RELEASE);
+    free(snapshot_records.records);
+    memset(&snapshot_records, 0, sizeof(snapshot_records));
+    snapshot_dirty = false;
+    for (int i = 0; i < ESP_CONFIG_SNAPSHOT_VERSIONS; i++) {
+        free(snapshot_versions[i].buffer);
+        snapshot_versions[i].buffer = NULL;
+    }
+    while (snapshot_retired != NULL) {
+        retired = snapshot_retired->retired;
+        free(snapshot_retired);
+        snapshot_retired = retired;
+    }
+    esp_config_port_unlock();
+}
+
+#endif /* CONFIG_ESP_CONFIG_SNAPSHOT */
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+
+/*
+ * Write-behind mode.
+ *
+ * Setters stage values in the pending batch and return immediately. A
+ * background task flushes the batch once no value has been set for the
+ * quiet period, so that a burst of writes to the same key costs a single
+ * NVS write. While a flush is in progress its values stay visible to
+ * readers through the flushing batch, until the NVS and the cache hold
+ * them.
+ */
+static struct esp_config_batch pending;
+static struct esp_config_batch flushing;
+static bool write_behind = false;
+static bool write_behind_stopping = false;
+static uint32_t write_behind_quiet_ms = 0;
+static int64_t write_behind_last_us = 0;
+static esp_config_port_event_t write_behind_event = NULL;
+static esp_config_port_mutex_t write_behind_flush_lock = NULL;
+static esp_config_port_thread_t write_behind_thread = NULL;
+static esp_err_t write_behind_error = ESP_OK; // Of the last flush of the task when stopping
+
+static esp_err_t esp_config_write_behind_stage(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    esp_err_t esperr = ESP_ERR_INVALID_STATE;
+
+    esp_config_port_lock();
+    // Once stopped, values still in flight are staged behind, so that they are not overtaken by a direct write
+    if (write_behind || pending.length > 0 || flushing.length > 0) {
+        esperr = esp_config_batch_stage(&pending, ns, key, encoding, value, valuesize);
+        write_behind_last_us = esp_config_port_time_us();
+        if (esperr == ESP_OK && write_behind_event != NULL) {
+            esp_config_port_event_signal(write_behind_event); // Restarts the quiet period
+        }
+    }
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+/*
+ * Serves a read from the values not flushed yet, following the status
+ * codes of the esp_config_get_* functions. Keys pending an erase are
+ * served from the defaults database.
+ *
+ * @return The status code, or -1 if the key is not pending.
+ */
+static int esp_config_write_behind_fetch(const char *ns, const char *key, esp_config_encoding_t encoding, bool sized, const size_t *range, void *value, size_t *valuesize) {
+
+    int status = -1;
+    esp_config_batch_record_t record;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+
+    esp_config_port_lock();
+    if ((pending.length > 0 && esp_config_batch_find(&pending, ns, key, &record) != -1)
+            || (flushing.length > 0 && esp_config_batch_find(&flushing, ns, key, &record) != -1)) {
+        if (record.encoding != encoding) {
+            // Mismatching type, as in the NVS
+        } else if (record.value == NULL) {
+            entry = esp_config_find_default(ns, key, encoding, NULL, &view);
+            status = (entry != NULL) ? esp_config_read_default(entry, sized, range, value, valuesize) : -1;
+        } else if (encoding != STRING && encoding != BLOB) {
+            memcpy(value, record.value, record.valuesize);
+            status = 0;
+        } else {
+            status = esp_config_copy_value(record.value, record.valuesize, range, value, valuesize);
+        }
+    }
+    esp_config_port_unlock();
+
+    return status;
+}
+
+static void esp_config_write_behind_drop() {
+
+    esp_config_port_lock();
+    free(pending.records);
+    memset(&pending, 0, sizeof(pending));
+    esp_config_port_unlock();
+}
+
+/*
+ * Drops the values not flushed yet of one key, of a namespace if key is
+ * NULL, or all of them if ns is NULL too. The caller holds
+ * write_behind_flush_lock, so that no flush is in progress.
+ */
+static void esp_config_write_behind_discard(const char *ns, const char *key) {
+
+    esp_config_batch_record_t record;
+    size_t offset = 0;
+    size_t previous = 0;
+
+    esp_config_port_lock();
+    if (key != NULL) {
+        esp_config_batch_remove(&pending, ns, key);
+    } else {
+        while (offset < pending.length) {
+            previous = offset;
+            if (!esp_config_batch_next(pending.records, pending.length, &offset, &record)) {
+                break;
+            }
+            if (ns == NULL || strcmp(record.ns, ns) == 0) {
+                esp_config_batch_remove(&pending, record.ns, record.key);
+                offset = previous; // The next record moved here
+            }
+        }
+    }
+    esp_config_port_unlock();
+}
+
+esp_err_t esp_config_flush() {
+
+    esp_err_t esperr = ESP_OK;
+    struct esp_config_batch merged = {0};
+    esp_config_batch_record_t record;
+    size_t offset = 0;
+
+    if (write_behind_flush_lock == NULL) {
+        return ESP_OK; // Write-behind never started, nothing can be pending
+    }
+
+    esp_config_port_mutex_lock(write_behind_flush_lock);
+
+    esp_config_port_lock();
+    flushing = pending;
+    memset(&pending, 0, sizeof(pending));
+    esp_config_port_unlock();
+
+    if (flushing.length > 0) {
+        esperr = esp_config_batch_apply(flushing.records, flushing.length, false); // Subscribers were notified when the values were staged
+        if (esperr != ESP_OK) {
+            ESP_LOGE(tag,"Deferred writes failed, will retry: %s",esp_err_to_name(esperr));
+        }
+    }
+
+    esp_config_port_lock();
+    if (esperr != ESP_OK) {
+        // Keep the values for the next flush, unless they were set again in the meantime
+        for (offset = 0; esp_config_batch_next(flushing.records, flushing.length, &offset, &record); ) {
+            esp_config_batch_stage(&merged, record.ns, record.key, record.encoding, record.value, record.valuesize);
+        }
+        for (offset = 0; esp_config_batch_next(pending.records, pending.length, &offset, &record); ) {
+            esp_config_batch_stage(&merged, record.ns, record.key, record.encoding, record.value, record.valuesize);
+        }
+        free(pending.records);
+        pending = merged;
+    }
+    free(flushing.records);
+    memset(&flushing, 0, sizeof(flushing));
+    esp_config_port_unlock();
+
+    esp_config_port_mutex_unlock(write_behind_flush_lock);
+
+    return esperr;
+}
+
+static void esp_config_write_behind_task(void *arg) {
+
+    uint32_t timeout_ms = ESP_CONFIG_PORT_WAIT_FOREVER;
+    int64_t elapsed_us = 0;
+    bool stopping = false;
+    bool waiting = false;
+    esp_err_t esperr = ESP_OK;
+
+    (void)arg;
+    while (true) {
+        esp_config_port_event_wait(write_behind_event, timeout_ms);
+
+        esp_config_port_lock();
+        stopping = write_behind_stopping;
+        waiting = pending.length > 0;
+        elapsed_us = esp_config_port_time_us() - write_behind_last_us;
+        esp_config_port_unlock();
+
+        if (stopping) {
+            // Values set while stopping are still staged, flush until none is left or a flush fails
+            while ((esperr = esp_config_flush()) == ESP_OK && waiting) {
+                esp_config_port_lock();
+                waiting = pending.length > 0;
+                esp_config_port_unlock();
+            }
+            esp_config_port_lock();
+            write_behind_error = esperr;
+            esp_config_port_unlock();
+            break;
+        }
+
+        if (!waiting) {
+            timeout_ms = ESP_CONFIG_PORT_WAIT_FOREVER;
+        } else if (elapsed_us >= (int64_t)write_behind_quiet_ms * 1000) {
+            esp_config_flush();
+            timeout_ms = write_behind_quiet_ms; // Check again for values set during the flush, or retry a failed one
+        } else {
+            timeout_ms = (uint32_t)(((int64_t)write_behind_quiet_ms * 1000 - elapsed_us + 999) / 1000);
+        }
+    }
+}
+
+esp_err_t esp_config_write_behind_start(uint32_t quiet_ms) {
+
+    esp_err_t esperr = ESP_OK;
+
+    esp_config_port_lock();
+    write_behind_quiet_ms = quiet_ms;
+    if (write_behind) {
+        esp_config_port_unlock();
+        return ESP_OK;
+    }
+
+    if (write_behind_flush_lock == NULL) {
+        write_behind_flush_lock = esp_config_port_mutex_create();
+    }
+    write_behind_event = esp_config_port_event_create();
+    if (write_behind_flush_lock == NULL || write_behind_event == NULL) {
+        esperr = ESP_ERR_NO_MEM;
+    } else {
+        write_behind_stopping = false;
+        esperr = esp_config_port_thread_start("esp_config_wb", esp_config_write_behind_task, NULL, &write_behind_thread);
+    }
+    if (esperr == ESP_OK) {
+        write_behind = true;
+    } else if (write_behind_event != NULL) {
+        esp_config_port_event_delete(write_behind_event);
+        write_behind_event = NULL;
+    }
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+esp_err_t esp_config_write_behind_stop() {
+
+    esp_err_t esperr = ESP_OK;
+
+    esp_config_port_lock();
+    if (!write_behind) {
+        esp_config_port_unlock();
+        return ESP_OK;
+    }
+    write_behind = false;
+    write_behind_stopping = true;
+    esp_config_port_unlock();
+
+    esp_config_port_event_signal(write_behind_event);
+    esp_config_port_thread_join(write_behind_thread);
+
+    esp_config_port_lock();
+    esp_config_port_event_delete(write_behind_event);
+    write_behind_event = NULL;
+    write_behind_thread = NULL;
+    // A failed flush keeps its values pending, for esp_config_flush() to retry
+    esperr = (pending.length == 0) ? ESP_OK : ((write_behind_error != ESP_OK) ? write_behind_error : ESP_FAIL);
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+#endif /* CONFIG_ESP_CONFIG_WRITE_BEHIND */
+
+#if CONFIG_ESP_CONFIG_ASYNC_SET
+
+/*
+ * Asynchronous writes.
+ *
+ * Writes are queued in a ring of CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH
+ * requests and applied one at a time by the storage task, in the order
+ * they were queued, which keeps the writes to each key in order. Writers
+ * finding the ring full wait for the async_space event, which every
+ * writer passes on while space is left, so that one signal wakes them
+ * all in turn. A request without namespace only completes its handle,
+ * marking the point esp_config_async_flush() waits for.
+ */
+typedef struct {
+    const char *ns;                 /**< In the database, or in copy for keys outside it, NULL for a marker */
+    const char *key;
+    esp_config_token_t token;       /**< Valid if known */
+    bool known;                     /**< The key is in the defaults database */
+    esp_config_encoding_t encoding;
+    size_t valuesize;
+    int64_t scalar;                 /**< Value of integers */
+    void *copy;                     /**< Value of strings and blobs, followed by the names of keys outside the database */
+    esp_config_set_cb_t callback;
+    void *arg;
+    esp_config_async_t *handle;
+} esp_config_async_request_t;
+
+static esp_config_async_request_t async_queue[CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH];
+static int async_head = 0;
+static int async_count = 0;
+static bool async = false;
+static bool async_stopping = false;
+static esp_config_port_event_t async_work = NULL;
+static esp_config_port_event_t async_space = NULL; // Never deleted, as writers may still wait on it while stopping
+static esp_config_port_thread_t async_thread = NULL;
+
+static void esp_config_async_complete(esp_config_async_t *handle, esp_err_t result, esp_config_set_action_t action) {
+
+    esp_config_port_lock();
+    handle->result = result;
+    handle->action = action;
+    handle->done = true;
+    if (handle->waiter != NULL) {
+        esp_config_port_event_signal((esp_config_port_event_t)handle->waiter);
+    }
+    esp_config_port_unlock();
+}
+
+static void esp_config_async_apply(esp_config_async_request_t *request) {
+
+    esp_err_t esperr = ESP_OK;
+    esp_config_set_action_t action = ESP_CONFIG_SET_UNCHANGED;
+    bool variable = (request->encoding == STRING || request->encoding == BLOB);
+
+    if (request->ns != NULL) {
+        esperr = esp_config_write(request->ns, request->key, request->known ? &request->token : NULL, request->encoding,
+                variable ? request->copy : (const void*)&request->scalar, request->valuesize, &action);
+        if (request->callback != NULL) {
+            request->callback(request->ns, request->key, esperr, action, request->arg);
+        }
+    }
+    if (request->handle != NULL) {
+        esp_config_async_complete(request->handle, esperr, action);
+    }
+    free(request->copy);
+}
+
+static void esp_config_async_task(void *arg) {
+
+    esp_config_async_request_t request;
+
+    (void)arg;
+    while (true) {
+        esp_config_port_lock();
+        while (async_count == 0 && !async_stopping) {
+            esp_config_port_unlock();
+            esp_config_port_event_wait(async_work, ESP_CONFIG_PORT_WAIT_FOREVER);
+            esp_config_port_lock();
+        }
+        if (async_count == 0) {
+            esp_config_port_unlock();
+            break; // Stopping, and every write queued completed
+        }
+        request = async_queue[async_head];
+        async_head = (async_head + 1) % CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH;
+        async_count--;
+        esp_config_port_unlock();
+
+        esp_config_port_event_signal(async_space);
+        esp_config_async_apply(&request);
+    }
+}
+
+/*
+ * Appends a request to the queue, waiting up to timeout_ms for space.
+ * The request copy is freed if the request is not queued.
+ */
+static esp_err_t esp_config_async_queue(esp_config_async_request_t *request, uint32_t timeout_ms) {
+
+    esp_err_t esperr = ESP_OK;
+    int64_t deadline_us = esp_config_port_time_us() + (int64_t)timeout_ms * 1000;
+    int64_t remaining_us = 0;
+    bool space = false;
+
+    esp_config_port_lock();
+    while (async && async_count == CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH) {
+        remaining_us = deadline_us - esp_config_port_time_us();
+        if (timeout_ms != ESP_CONFIG_ASYNC_WAIT_FOREVER && remaining_us <= 0) {
+            esp_config_port_unlock();
+            free(request->copy);
+            return ESP_ERR_TIMEOUT;
+        }
+        esp_config_port_unlock();
+        esp_config_port_event_wait(async_space, (timeout_ms == ESP_CONFIG_ASYNC_WAIT_FOREVER) ? ESP_CONFIG_PORT_WAIT_FOREVER : (uint32_t)((remaining_us + 999) / 1000));
+        esp_config_port_lock();
+    }
+    if (async) {
+        async_queue[(async_head + async_count) % CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH] = *request;
+        async_count++;
+        esp_config_port_event_signal(async_work);
+    } else {
+        esperr = ESP_ERR_INVALID_STATE;
+    }
+    space = !async || async_count < CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH;
+    if (space && async_space != NULL) {
+        esp_config_port_event_signal(async_space); // Passes the signal on to the next writer waiting, if any
+    }
+    esp_config_port_unlock();
+
+    if (esperr != ESP_OK) {
+        free(request->copy);
+    }
+
+    return esperr;
+}
+
+/*
+ * Waits for a handle with an event created by the caller, and deletes
+ * the event.
+ */
+static esp_err_t esp_config_async_block(esp_config_async_t *handle, esp_config_port_event_t waiter, uint32_t timeout_ms) {
+
+    esp_err_t esperr = ESP_OK;
+
+    esp_config_port_lock();
+    if (!handle->done) {
+        handle->waiter = waiter;
+        esp_config_port_unlock();
+        esp_config_port_event_wait(waiter, (timeout_ms == ESP_CONFIG_ASYNC_WAIT_FOREVER) ? ESP_CONFIG_PORT_WAIT_FOREVER : timeout_ms);
+        esp_config_port_lock();
+        handle->waiter = NULL;
+    }
+    esperr = handle->done ? handle->result : ESP_ERR_TIMEOUT;
+    esp_config_port_unlock();
+
+    esp_config_port_event_delete(waiter);
+
+    return esperr;
+}
+
+esp_err_t esp_config_async_start() {
+
+    esp_err_t esperr = ESP_OK;
+
+    esp_config_port_lock();
+    if (async) {
+        esp_config_port_unlock();
+        return ESP_OK;
+    }
+
+    if (async_work == NULL) {
+        async_work = esp_config_port_event_create();
+    }
+    if (async_space == NULL) {
+        async_space = esp_config_port_event_create();
+    }
+    if (async_work == NULL || async_space == NULL) {
+        esperr = ESP_ERR_NO_MEM;
+    } else {
+        async_stopping = false;
+        esperr = esp_config_port_thread_start("esp_config_async", esp_config_async_task, NULL, &async_thread);
+    }
+    if (esperr == ESP_OK) {
+        async = true;
+    }
+    esp_config_port_unlock();
+
+    return esperr;
+}
+
+esp_err_t esp_config_async_stop() {
+
+    esp_config_port_lock();
+    if (!async) {
+        esp_config_port_unlock();
+        return ESP_OK;
+    }
+    async = false;
+    async_stopping = true;
+    esp_config_port_unlock();
+
+    esp_config_port_event_signal(async_work);
+    esp_config_port_event_signal(async_space); // Writers waiting for space fail, and pass the signal on
+    esp_config_port_thread_join(async_thread);
+
+    esp_config_port_lock();
+    async_thread = NULL;
+    esp_config_port_unlock();
+
+    return ESP_OK;
+}
+
+esp_err_t esp_config_set_async(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize, uint32_t timeout_ms, esp_config_set_cb_t callback, void *arg, esp_config_async_t *handle) {
+
+    esp_config_async_request_t request = {0};
+    bool variable = (encoding == STRING || encoding == BLOB);
+    size_t nslength = 0;
+    size_t keylength = 0;
+    size_t copysize = 0;
+
+    if (ns == NULL || key == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (encoding == STRING) {
+        valuesize = strlen(value) + 1;
+    } else if (encoding != BLOB) {
+        valuesize = esp_config_encoding_size(encoding);
+        memcpy(&request.scalar, value, valuesize);
+    }
+
+    request.known = esp_config_locate(ns, key, encoding, &request.token);
+    if (request.known) {
+        request.ns = database[request.token.ns].name;
+        request.key = esp_config_db_key(request.token.ns, request.token.entry);
+    } else {
+        nslength = strlen(ns) + 1;
+        keylength = strlen(key) + 1;
+    }
+
+    // Strings, blobs and the names of keys outside the database are copied in one allocation
+    copysize = (variable ? valuesize : 0) + nslength + keylength;
+    if (copysize > 0) {
+        request.copy = malloc(copysize);
+        if (request.copy == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        if (variable) {
+            memcpy(request.copy, value, valuesize);
+        }
+        if (!request.known) {
+            request.ns = (char*)request.copy + (copysize - nslength - keylength);
+            request.key = request.ns + nslength;
+            memcpy((char*)request.ns, ns, nslength);
+            memcpy((char*)request.key, key, keylength);
+        }
+    }
+
+    request.encoding = encoding;
+    request.valuesize = valuesize;
+    request.callback = callback;
+    request.arg = arg;
+    request.handle = handle;
+    if (handle != NULL) {
+        memset(handle, 0, sizeof(*handle));
+    }
+
+    return esp_config_async_queue(&request, timeout_ms);
+}
+
+esp_err_t esp_config_async_wait(esp_config_async_t *handle, uint32_t timeout_ms) {
+
+    esp_err_t esperr = ESP_ERR_TIMEOUT;
+    esp_config_port_event_t waiter = NULL;
+
+    esp_config_port_lock();
+    if (handle->done) {
+        esperr = handle->result;
+    }
+    esp_config_port_unlock();
+
+    if (esperr != ESP_ERR_TIMEOUT || timeout_ms == 0) {
+        return esperr;
+    }
+    waiter = esp_config_port_event_create();
+    if (waiter == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return esp_config_async_block(handle, waiter, timeout_ms);
+}
+
+esp_err_t esp_config_async_flush() {
+
+    esp_err_t esperr = ESP_OK;
+    esp_config_async_request_t marker = {0};
+    esp_config_async_t handle = {0};
+    esp_config_port_event_t waiter = NULL;
+
+    // Created before queuing the marker, so that waiting cannot fail once the storage task may complete the handle
+    waiter = esp_config_port_event_create();
+    if (waiter == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    marker.handle = &handle;
+    esperr = esp_config_async_queue(&marker, ESP_CONFIG_ASYNC_WAIT_FOREVER);
+    if (esperr != ESP_OK) {
+        esp_config_port_event_delete(waiter);
+        return esperr;
+    }
+
+    return esp_config_async_block(&handle, waiter, ESP_CONFIG_ASYNC_WAIT_FOREVER);
+}
+
+#endif /* CONFIG_ESP_CONFIG_ASYNC_SET */
+
+#if CONFIG_ESP_CONFIG_LAYERS
+
+esp_err_t esp_config_layers_set(const char *const *partitions, int count) {
+
+    if (initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (count < 0 || count > CONFIG_ESP_CONFIG_MAX_LAYERS || (count > 0 && partitions == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < count; i++) {
+        layers[i] = partitions[i];
+    }
+    nlayers = count;
+
+    return ESP_OK;
+}
+
+/*
+ * Allocates an entry of the merged view, with a copy of the value. String
+ * sizes include the terminator.
+ *
+ * @return The entry, or NULL if out of memory.
+ */
+static const esp_config_entry_t* esp_config_layered_new(const esp_config_entry_t *compiled, const void *value, size_t valuesize) {
+
+    bool variable = (compiled->encoding == STRING || compiled->encoding == BLOB);
+    esp_config_layered_t *allocated = malloc(sizeof(esp_config_layered_t) + (variable ? valuesize : 0));
+    int64_t scalar = 0;
+
+    if (allocated == NULL) {
+        return NULL;
+    }
+
+    // The members of an entry are const, so it is built on the stack and copied
+    if (variable) {
+        memcpy(allocated->value, value, valuesize);
+        esp_config_entry_t entry = {
+            .key = compiled->key,
+            .encoding = compiled->encoding,
+            .value = {.blob = allocated->value},
+            .value_size = valuesize,
+            .flags = compiled->flags & ~ESP_CONFIG_FLAG_COMPRESSED // Layers hold values as they are
+        };
+        memcpy(&allocated->entry, &entry, sizeof(entry));
+    } else {
+        memcpy(&scalar, value, esp_config_encoding_size(compiled->encoding)); // Every integer member starts the union
+        esp_config_entry_t entry = {
+            .key = compiled->key,
+            .encoding = compiled->encoding,
+            .value = {.int64 = scalar},
+            .value_size = compiled->value_size,
+            .flags = compiled->flags
+        };
+        memcpy(&allocated->entry, &entry, sizeof(entry));
+    }
+
+    allocated->next = layered_allocated;
+    layered_allocated = allocated;
+    return &allocated->entry;
+}
+
+/*
+ * Reads the value of a key from an open handle on a layer into a new entry
+ * of the merged view.
+ *
+ * @return ESP_OK if *entry is set, ESP_ERR_NVS_NOT_FOUND if the layer has
+ * no value for the key, other error codes if fail.
+ */
+static esp_err_t esp_config_layer_read(nvs_handle handle, const esp_config_entry_t *compiled, const esp_config_entry_t **entry) {
+
+    esp_err_t esperr = ESP_FAIL;
+    int64_t scalar = 0;
+    void *value = &scalar;
+    size_t size = 0;
+
+    if (compiled->encoding == STRING || compiled->encoding == BLOB) {
+        esperr = esp_config_nvs_get(handle, compiled->key, compiled->encoding, false, NULL, &size);
+        value = (esperr == ESP_OK) ? malloc(size > 0 ? size : 1) : NULL;
+        if (esperr == ESP_OK && value == NULL) {
+            esperr = ESP_ERR_NO_MEM;
+        } else if (esperr == ESP_OK) {
+            esperr = esp_config_nvs_get(handle, compiled->key, compiled->encoding, false, value, &size);
+        }
+    } else {
+        esperr = esp_config_nvs_get(handle, compiled->key, compiled->encoding, false, value, NULL);
+    }
+
+    if (esperr == ESP_OK) {
+        *entry = esp_config_layered_new(compiled, value, size);
+        esperr = (*entry != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+
+    if (value != &scalar) {
+        free(value);
+    }
+    return esperr;
+}
+
+/*
+ * Resolves a key through the layers from the given one down, publishing the
+ * entry of the first layer that has a value for it, or NULL for the
+ * compiled entry. Layers whose partition is missing are empty. The caller
+ * holds layers_write_lock.
+ */
+static esp_err_t esp_config_layers_resolve(const esp_config_token_t *token, int from) {
+
+    esp_err_t esperr = ESP_ERR_NVS_NOT_FOUND;
+    nvs_handle handle;
+    esp_config_entry_t view;
+    const esp_config_entry_t *compiled = esp_config_db_entry(token->ns, token->entry, &view);
+    const esp_config_entry_t *entry = NULL;
+    int layer = 0;
+
+    for (layer = from; layer >= 0; layer--) {
+        esperr = nvs_open_from_partition(layers[layer], database[token->ns].name, NVS_READONLY, &handle);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_layer_read(handle, compiled, &entry);
+            nvs_close(handle);
+        }
+        if (esperr != ESP_ERR_NVS_NOT_FOUND && esperr != ESP_ERR_NVS_PART_NOT_FOUND) {
+            break;
+        }
+    }
+    if (esperr == ESP_ERR_NVS_NOT_FOUND || esperr == ESP_ERR_NVS_PART_NOT_FOUND) {
+        esperr = ESP_OK; // No layer has it, back to the compiled default
+    }
+
+    if (esperr == ESP_OK) {
+        layered_from[token->id] = layer;
+        __atomic_store_n(&layered[token->id], entry, __ATOMIC_RELEASE);
+    }
+    return esperr;
+}
+
+/*
+ * Builds the merged view of the layers, reading each namespace of each
+ * layer once, from the lowest layer up. A layer whose partition is missing
+ * is reported once and left empty.
+ */
+static esp_err_t esp_config_layers_load() {
+
+    esp_err_t esperr = ESP_OK;
+    esp_err_t result = ESP_OK;
+    nvs_handle handle;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+    int id = 0;
+
+    if (layers_write_lock == NULL && (layers_write_lock = esp_config_port_mutex_create()) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (id = 0; id < ESP_CONFIG_DB_KEYS; id++) {
+        layered_from[id] = -1;
+        __atomic_store_n(&layered[id], NULL, __ATOMIC_RELEASE);
+    }
+
+    for (int layer = 0; layer < nlayers; layer++) {
+        id = 0;
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; id += database[i].nentries, i++) {
+            esperr = nvs_open_from_partition(layers[layer], database[i].name, NVS_READONLY, &handle);
+            if (esperr == ESP_ERR_NVS_NOT_FOUND) { // Namespace not in this layer
+                continue;
+            } else if (esperr == ESP_ERR_NVS_PART_NOT_FOUND) {
+                ESP_LOGE(tag,"Layer %s: %s",layers[layer],esp_err_to_name(esperr));
+                result = esperr;
+                break;
+            } else if (esperr != ESP_OK) {
+                ESP_LOGE(tag,"Layer %s: %s",layers[layer],esp_err_to_name(esperr));
+                result = esperr;
+                continue;
+            }
+            for (unsigned int j = 0; j < database[i].nentries; j++) {
+                if (esp_config_db_flags(i, j) & ESP_CONFIG_FLAG_FROZEN) {
+                    continue;
+                }
+                esperr = esp_config_layer_read(handle, esp_config_db_entry(i, j, &view), &entry);
+                if (esperr == ESP_OK) {
+                    layered_from[id + j] = layer;
+                    __atomic_store_n(&layered[id + j], entry, __ATOMIC_RELEASE);
+                } else if (esperr != ESP_ERR_NVS_NOT_FOUND) {
+                    ESP_LOGE(tag,"Layer %s, key %s: %s",layers[layer],esp_config_db_key(i, j),esp_err_to_name(esperr));
+                    result = esperr;
+                }
+            }
+            nvs_close(handle);
+        }
+    }
+
+    return result;
+}
+
+esp_err_t esp_config_layer_set(int layer, const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    esp_config_token_t token;
+    esp_config_entry_t view;
+    const esp_config_entry_t *compiled = NULL;
+    const esp_config_entry_t *entry = NULL;
+
+    if (!initialized || layers_write_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (layer < 0 || layer >= nlayers || ns == NULL || key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    compiled = esp_config_find_compiled(ns, key, encoding, &token, &view);
+    if (compiled == NULL) {
+        ESP_LOGE(tag,"Key %s is not in the database.", key);
+        return ESP_ERR_NOT_FOUND;
+    } else if (compiled->flags & ESP_CONFIG_FLAG_FROZEN) {
+        ESP_LOGE(tag,"Key %s is frozen.", key);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (value != NULL && encoding == STRING) {
+        valuesize = strlen(value) + 1;
+    } else if (value != NULL && encoding != BLOB) {
+        valuesize = esp_config_encoding_size(encoding);
+    }
+
+    esp_config_port_mutex_lock(layers_write_lock);
+
+    esperr = nvs_open_from_partition(layers[layer], ns, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = (value != NULL) ? esp_config_nvs_set(handle, key, encoding, false, value, valuesize) : esp_config_nvs_erase(handle, key);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    // Only the key written changes in the merged view, and only if no higher layer hides it
+    if (esperr == ESP_OK && value != NULL && layer >= layered_from[token.id]) {
+        entry = esp_config_layered_new(compiled, value, valuesize);
+        if (entry != NULL) {
+            layered_from[token.id] = layer;
+            __atomic_store_n(&layered[token.id], entry, __ATOMIC_RELEASE);
+        } else {
+            esperr = ESP_ERR_NO_MEM;
+        }
+    } else if (esperr == ESP_OK && value == NULL && layer == layered_from[token.id]) {
+        esperr = esp_config_layers_resolve(&token, layer - 1);
+    }
+
+    esp_config_port_mutex_unlock(layers_write_lock);
+
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+    return esperr;
+}
+
+/*
+ * Releases the merged view. Readers must not be running, as with
+ * esp_config_deinit().
+ */
+static void esp_config_layers_drop() {
+
+    esp_config_layered_t *next = NULL;
+
+    for (int id = 0; id < ESP_CONFIG_DB_KEYS; id++) {
+        __atomic_store_n(&layered[id], NULL, __ATOMIC_RELEASE);
+    }
+    while (layered_allocated != NULL) {
+        next = layered_allocated->next;
+        free(layered_allocated);
+        layered_allocated = next;
+    }
+}
+
+#endif /* CONFIG_ESP_CONFIG_LAYERS */
+
+esp_err_t esp_config_reset() {
+
+    esp_err_t esperr = ESP_FAIL;
+
+#if CONFIG_ESP_CONFIG_CACHE
+    esp_config_cache_clear(); // Whatever the outcome, overrides must be read again
+#endif
+    esp_config_pool_drain(); // Handles do not survive nvs_flash_deinit()
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    esp_config_write_behind_drop();
+#endif
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    esp_config_snapshot_drop(); // Rebuilt from the erased NVS on the next esp_config_init()
+#endif
+
+    // Not sure if deinit() and init() are necessary here, but in a previous code iterations they were added after an initial implementation without.
+    esperr = nvs_flash_deinit();
+    if (esperr == ESP_OK) {
+        esperr = nvs_flash_erase();
+        if (esperr == ESP_OK) {
+            esperr = nvs_flash_init();
+            if (esperr == ESP_OK) {
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+                esp_config_notify_revert(-1);
+#endif
+            } else {
+                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            }
+        } else {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        }
+    } else {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+
+    return esperr;
+}
+
+esp_err_t esp_config_reset_key(const char *ns, const char *key) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+    esp_config_token_t token;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+
+    if (ns == NULL || key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int encoding = UINT8; entry == NULL && encoding <= BLOB; encoding++) {
+        entry = esp_config_find_default(ns, key, (esp_config_encoding_t)encoding, &token, &view);
+    }
+    if (entry != NULL && (entry->flags & ESP_CONFIG_FLAG_FROZEN)) {
+        return ESP_OK; // Never overridden
+    } else if (entry != NULL) {
+        esperr = esp_config_persist(ns, key, &token, entry->encoding, NULL, 0);
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+        if (esperr == ESP_OK) {
+            esp_config_notify(&token, false, NULL, 0);
+        }
+#endif
+        return esperr;
+    }
+
+    // Not in the database, the encoding of the override is unknown so it is erased directly
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if (write_behind_flush_lock != NULL) {
+        esp_config_port_mutex_lock(write_behind_flush_lock);
+        esp_config_write_behind_discard(ns, key);
+    }
+#endif
+    esperr = esp_config_open(ns, -1, NVS_READONLY, &handle);
+    if (esperr == ESP_OK) {
+        esp_config_close(handle);
+        esperr = esp_config_open(ns, -1, NVS_READWRITE, &handle);
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_nvs_erase(handle, key);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        esp_config_close(handle);
+    } else if (esperr == ESP_ERR_NVS_NOT_FOUND) {
+        esperr = ESP_OK; // Namespace never written, not created for nothing
+    }
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if (write_behind_flush_lock != NULL) {
+        esp_config_port_mutex_unlock(write_behind_flush_lock);
+    }
+#endif
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+
+    return esperr;
+}
+
+/*
+ * Erases every entry of a namespace with nvs_erase_all(). A namespace that
+ * was never written has nothing to erase, and is not created.
+ */
+static esp_err_t esp_config_erase_namespace(const char *ns, int dbns) {
+
+    esp_err_t esperr = ESP_FAIL;
+    nvs_handle handle;
+
+    esperr = esp_config_open(ns, dbns, NVS_READONLY, &handle);
+    if (esperr == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    } else if (esperr != ESP_OK) {
+        return esperr;
+    }
+    esp_config_close(handle);
+
+    esperr = esp_config_open(ns, dbns, NVS_READWRITE, &handle);
+    if (esperr == ESP_OK) {
+        esperr = nvs_erase_all(handle);
+        if (esperr == ESP_OK) {
+            esperr = esp_config_commit(handle);
+        }
+        esp_config_close(handle);
+    }
+
+    return esperr;
+}
+
+/*
+ * Reverts the namespace database[dbns] to its defaults, or every namespace
+ * of the database and the library's own records if dbns is -1. Values not
+ * flushed yet are dropped, and the snapshot is updated before the NVS as a
+ * batch would.
+ */
+static esp_err_t esp_config_revert(int dbns) {
+
+    esp_err_t esperr = ESP_OK;
+    const char *ns = (dbns >= 0) ? database[dbns].name : NULL;
+#if CONFIG_ESP_CONFIG_CACHE
+    int id = 0;
+#endif
+
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if (write_behind_flush_lock != NULL) {
+        esp_config_port_mutex_lock(write_behind_flush_lock);
+        esp_config_write_behind_discard(ns, NULL);
+    }
+#endif
+
+    if (ns == NULL) {
+        esperr = esp_config_erase_namespace(ESP_CONFIG_NVS_NAMESPACE, -1);
+    }
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    if (esperr == ESP_OK) {
+        esperr = esp_config_snapshot_revert(ns);
+    }
+#endif
+    for (int i = 0; esperr == ESP_OK && i < ESP_CONFIG_DB_ENTRIES; i++) {
+        if (dbns < 0 || i == dbns) {
+            esperr = esp_config_erase_namespace(database[i].name, i);
+        }
+    }
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if (write_behind_flush_lock != NULL) {
+        esp_config_port_mutex_unlock(write_behind_flush_lock);
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE
+    // On failure part of the namespace may still be overridden, the slots are read again
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+            if (dbns < 0 || i == dbns) {
+                esp_config_cache_store(id, esp_config_db_encoding(i, j),
+                        (esperr == ESP_OK) ? ESP_CONFIG_CACHE_DEFAULT : ESP_CONFIG_CACHE_EMPTY, NULL, 0);
+            }
+        }
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    if (esperr == ESP_OK) {
+        esp_config_notify_revert(dbns);
+    }
+#endif
+
+    if (esperr != ESP_OK) {
+        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    }
+
+    return esperr;
+}
+
+esp_err_t esp_config_reset_namespace(const char *ns) {
+
+    if (ns == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        if (strcmp(ns, database[i].name) == 0) {
+            return esp_config_revert(i);
+        }
+    }
+
+    ESP_LOGE(tag,"Namespace %s is not in the database.", ns);
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_config_reset_all() {
+    return esp_config_revert(-1);
+}
+
+#define ESP_CONFIG_NVS_ENTRY_SIZE 32 // Bytes of an NVS entry, strings and blobs take one more for their header
+
+/*
+ * Pass over the NVS entries of the configuration. Namespaces are scanned
+ * one at a time, usage[] being indexed like database[] with the library's
+ * own namespace last, through an NVS iterator kept across steps. Keys to
+ * erase are collected until their namespace is scanned, so that nothing
+ * is erased under the iterator.
+ */
+struct esp_config_gc {
+    bool erase;
+    esp_config_gc_cb_t callback;
+    void *arg;
+    int ns;                                 // Namespace scanned, past the last one when done
+    bool scanning;                          // The iterator was created for it
+    nvs_iterator_t iterator;                // NULL once it ran out
+    nvs_handle handle;                      // Read-only, to size strings and blobs
+    bool opened;
+    char (*doomed)[NVS_KEY_NAME_MAX_SIZE];  // Keys of the namespace to erase
+    size_t ndoomed;
+    size_t capacity;
+    esp_config_gc_usage_t usage[ESP_CONFIG_DB_ENTRIES + 1];
+};
+
+/*
+ * @return The type of the NVS entries holding the overrides of an entry of
+ * the compiled database.
+ */
+static nvs_type_t esp_config_nvs_type(const esp_config_entry_t *compiled) {
+
+    if (esp_config_packed(compiled)) {
+        return NVS_TYPE_BLOB;
+    }
+
+    switch (compiled->encoding) {
+        case UINT8:
+            return NVS_TYPE_U8;
+        case INT8:
+            return NVS_TYPE_I8;
+        case UINT16:
+            return NVS_TYPE_U16;
+        case INT16:
+            return NVS_TYPE_I16;
+        case UINT32:
+            return NVS_TYPE_U32;
+        case INT32:
+            return NVS_TYPE_I32;
+        case UINT64:
+            return NVS_TYPE_U64;
+        case INT64:
+            return NVS_TYPE_I64;
+        case STRING:
+            return NVS_TYPE_STR;
+        case BLOB:
+            return NVS_TYPE_BLOB;
+        default:
+            return NVS_TYPE_ANY;
+    }
+}
+
+/*
+ * Checks an NVS entry of the namespace database[dbns] against the
+ * database. Entries of the library's own namespace are all live.
+ */
+static esp_config_gc_state_t esp_config_gc_check(int dbns, const nvs_entry_info_t *info) {
+
+    esp_config_entry_t view;
+    const esp_config_entry_t *compiled = NULL;
+    esp_config_gc_state_t state = ESP_CONFIG_GC_STALE;
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+    char chunkkey[NVS_KEY_NAME_MAX_SIZE];
+#endif
+
+    if (dbns == ESP_CONFIG_DB_ENTRIES) {
+        return ESP_CONFIG_GC_LIVE;
+    }
+
+    for (unsigned int j = 0; j < database[dbns].nentries; j++) {
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+        // Chunks belong to the blob whose key they are derived from, whatever their bank and index
+        if (info->key[0] == '~') {
+            if (esp_config_db_encoding(dbns, j) == BLOB) {
+                esp_config_chunk_key(esp_config_db_key(dbns, j), 0, 0, chunkkey);
+                if (strncmp(chunkkey, info->key, 9) == 0) { // "~" and the CRC32 of the key
+                    return (esp_config_db_flags(dbns, j) & ESP_CONFIG_FLAG_FROZEN) ? ESP_CONFIG_GC_STALE : ESP_CONFIG_GC_LIVE;
+                }
+            }
+            continue;
+        }
+#endif
+        if (strcmp(info->key, esp_config_db_key(dbns, j)) != 0) {
+            continue;
+        }
+        compiled = esp_config_db_entry(dbns, j, &view);
+        if (esp_config_nvs_type(compiled) != info->type) {
+            state = ESP_CONFIG_GC_MISMATCH; // Unless the key has another entry of the right type
+            continue;
+        }
+        return (compiled->flags & ESP_CONFIG_FLAG_FROZEN) ? ESP_CONFIG_GC_STALE : ESP_CONFIG_GC_LIVE;
+    }
+
+    return state;
+}
+
+/*
+ * @return The number of NVS entries an NVS entry takes, one for integers
+ * and one plus the data for strings and blobs.
+ */
+static size_t esp_config_gc_slots(esp_config_gc_t gc, const nvs_entry_info_t *info) {
+
+    esp_err_t esperr = ESP_FAIL;
+    size_t size = 0;
+
+    if ((info->type != NVS_TYPE_STR && info->type != NVS_TYPE_BLOB) || !gc->opened) {
+        return 1;
+    }
+
+    if (info->type == NVS_TYPE_STR) {
+        esperr = nvs_get_str(gc->handle, info->key, NULL, &size);
+    } else {
+        esperr = nvs_get_blob(gc->handle, info->key, NULL, &size);
+    }
+
+    return 1 + ((esperr == ESP_OK) ? (size + ESP_CONFIG_NVS_ENTRY_SIZE - 1) / ESP_CONFIG_NVS_ENTRY_SIZE : 0);
+}
+
+/*
+ * Checks the NVS entry the iterator of a pass is on, and collects it for
+ * erasing if it is not live and the pass erases.
+ */
+static esp_err_t esp_config_gc_visit(esp_config_gc_t gc) {
+
+    nvs_entry_info_t info;
+    esp_config_gc_entry_t entry;
+    esp_config_gc_usage_t *usage = &gc->usage[gc->ns];
+    void *grown = NULL;
+
+    nvs_entry_info(gc->iterator, &info);
+    entry.ns = usage->ns;
+    entry.key = info.key;
+    entry.type = info.type;
+    entry.state = esp_config_gc_check(gc->ns, &info);
+    entry.slots = esp_config_gc_slots(gc, &info);
+
+    usage->keys[entry.state]++;
+    usage->slots[entry.state] += entry.slots;
+    if (gc->callback != NULL) {
+        gc->callback(&entry, gc->arg);
+    }
+
+    if (!gc->erase || entry.state == ESP_CONFIG_GC_LIVE) {
+        return ESP_OK;
+    }
+    if (gc->ndoomed == gc->capacity) {
+        grown = realloc(gc->doomed, (gc->capacity > 0 ? 2 * gc->capacity : 8) * sizeof(*gc->doomed));
+        if (grown == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        gc->doomed = grown;
+        gc->capacity = (gc->capacity > 0) ? 2 * gc->capacity : 8;
+    }
+    strcpy(gc->doomed[gc->ndoomed++], info.key);
+
+    return ESP_OK;
+}
+
+/*
+ * Ends the scan of a namespace, erasing the keys collected with a single
+ * commit, and moves the pass to the next namespace.
+ */
+static esp_err_t esp_config_gc_finish(esp_config_gc_t gc) {
+
+    esp_err_t esperr = ESP_OK;
+    nvs_handle handle;
+    esp_config_gc_usage_t *usage = &gc->usage[gc->ns];
+    int dbns = (gc->ns < ESP_CONFIG_DB_ENTRIES) ? gc->ns : -1;
+#if CONFIG_ESP_CONFIG_CACHE
+    int id = 0;
+#endif
+
+    if (gc->opened) {
+        esp_config_close(gc->handle);
+        gc->opened = false;
+    }
+
+    if (gc->ndoomed > 0) {
+        esperr = esp_config_open(usage->ns, dbns, NVS_READWRITE, &handle);
+        if (esperr == ESP_OK) {
+            // Chunks of a blob erased before them are already gone, which esp_config_nvs_erase() takes as erased
+            for (size_t i = 0; esperr == ESP_OK && i < gc->ndoomed; i++) {
+                esperr = esp_config_nvs_erase(handle, gc->doomed[i]);
+                usage->erased += (esperr == ESP_OK) ? 1 : 0;
+            }
+            if (esperr == ESP_OK) {
+                esperr = esp_config_commit(handle);
+            }
+            esp_config_close(handle);
+        }
+        if (esperr != ESP_OK) {
+            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        }
+#if CONFIG_ESP_CONFIG_CACHE
+        // Erased overrides of the wrong type may be cached as unreadable, the slots are read again
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+            for (unsigned int j = 0; j < database[i].nentries; j++, id++) {
+                if (i == dbns) {
+                    esp_config_cache_store(id, esp_config_db_encoding(i, j), ESP_CONFIG_CACHE_EMPTY, NULL, 0);
+                }
+            }
+        }
+#endif
+    }
+
+    gc->ndoomed = 0;
+    gc->scanning = false;
+    gc->ns++;
+
+    return esperr;
+}
+
+esp_err_t esp_config_gc_begin(bool erase, esp_config_gc_cb_t callback, void *arg, esp_config_gc_t *gc) {
+
+    if (gc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    *gc = calloc(1, sizeof(struct esp_config_gc));
+    if (*gc == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*gc)->erase = erase;
+    (*gc)->callback = callback;
+    (*gc)->arg = arg;
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        (*gc)->usage[i].ns = database[i].name;
+    }
+    (*gc)->usage[ESP_CONFIG_DB_ENTRIES].ns = ESP_CONFIG_NVS_NAMESPACE;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_config_gc_step(esp_config_gc_t gc, uint32_t budget, bool *done) {
+
+    esp_err_t esperr = ESP_OK;
+
+    if (gc == NULL || done == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    // Try to fetch the value from the NVS first
-    esperr = nvs_open(ns, NVS_READONLY, &handle);
-    if (esperr == ESP_OK) {
-        esperr = nvs_get_i32(handle, key, value);
-        if (esperr == ESP_OK) {
-            status = 0;
+    while (esperr == ESP_OK && budget > 0 && gc->ns <= ESP_CONFIG_DB_ENTRIES) {
+        if (!gc->scanning) {
+            gc->opened = (esp_config_open(gc->usage[gc->ns].ns, (gc->ns < ESP_CONFIG_DB_ENTRIES) ? gc->ns : -1, NVS_READONLY, &gc->handle) == ESP_OK);
+            gc->iterator = nvs_entry_find(NVS_DEFAULT_PART_NAME, gc->usage[gc->ns].ns, NVS_TYPE_ANY);
+            gc->scanning = true;
+        } else if (gc->iterator != NULL) {
+            esperr = esp_config_gc_visit(gc);
+            gc->iterator = nvs_entry_next(gc->iterator);
+            budget--;
         } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            esperr = esp_config_gc_finish(gc);
         }
-        nvs_close(handle);
-    } else {
-        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
     }
+    *done = (gc->ns > ESP_CONFIG_DB_ENTRIES);
 
-    // If fetching from the NVS failed, retrieve the value from the internal defaults database
-    if (status != 0) {
-        interr = esp_config_get_i32_default(ns, key, value);
-        if (interr != -1) {
-            status = 1;
-        } else {
-            ESP_LOGE(tag,"Could not get default i32 value.");
-        }
+    return esperr;
+}
+
+esp_err_t esp_config_gc_get_usage(esp_config_gc_t gc, int index, esp_config_gc_usage_t *usage) {
+
+    if (gc == NULL || usage == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (index < 0 || index > ESP_CONFIG_DB_ENTRIES) {
+        return ESP_ERR_NOT_FOUND;
     }
 
-    assert(status >= 0);
-    return status;
+    *usage = gc->usage[index];
+    return ESP_OK;
 }
 
-int esp_config_get_str(const char *ns, const char *key, char *value, size_t *valuesize) {
+void esp_config_gc_end(esp_config_gc_t gc) {
+
+    if (gc == NULL) {
+        return;
+    }
+    if (gc->iterator != NULL) {
+        nvs_release_iterator(gc->iterator);
+    }
+    if (gc->opened) {
+        esp_config_close(gc->handle);
+    }
+    free(gc->doomed);
+    free(gc);
+}
+
+esp_err_t esp_config_foreach(void *buffer, size_t buffersize, esp_config_foreach_cb_t callback, void *arg) {
 
     int status = -1;
-    int interr = -1;
-    esp_err_t esperr = ESP_FAIL;
-    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+    esp_config_token_t token;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
+    esp_config_item_t item;
+    int64_t scalar = 0;
+    size_t size = 0;
+    void *allocated = NULL;
+    bool proceed = true;
 
-    // If the passed value parameter is NULL, retrieve the string length
-    if (value == NULL) {
+    if (callback == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!esp_config_db_checked()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
 
-        // Try with NVS first
-        esperr = nvs_open(ns, NVS_READONLY, &handle);
-        if (esperr == ESP_OK) {
-            esperr = nvs_get_str(handle, key, NULL, valuesize);
-            if (esperr == ESP_OK) {
-                status = 0;
+    token.id = 0;
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++, token.id++) {
+            token.ns = i;
+            token.entry = j;
+            token.encoding = esp_config_db_encoding(i, j);
+            item.ns = database[i].name;
+            item.key = esp_config_db_key(i, j);
+            item.encoding = token.encoding;
+
+            if (token.encoding == STRING || token.encoding == BLOB) {
+                size = buffersize;
+                status = esp_config_lookup(item.ns, item.key, &token, token.encoding, true, buffer, &size, NULL);
+                item.value = (status >= 2) ? buffer : NULL;
+                item.valuesize = size;
+                if (status == 1) { // Default larger than the buffer, passed in place
+                    entry = esp_config_token_entry(&token, &view);
+                    item.value = esp_config_default_data(entry, &size, &allocated);
+                }
             } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+                status = esp_config_lookup(item.ns, item.key, &token, token.encoding, false, &scalar, NULL, NULL);
+                item.value = &scalar;
+                item.valuesize = esp_config_encoding_size(token.encoding);
             }
-            nvs_close(handle);
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-        }
+            item.source = (status == 0 || status == 2) ? ESP_CONFIG_SOURCE_NVS : ESP_CONFIG_SOURCE_DEFAULT;
 
-        // If NVS retrieval failed, use the internal database
-        if (status != 0) {
-            interr = esp_config_get_str_default(ns, key, NULL, valuesize);
-            if (interr != -1) {
-                status = 1;
-            } else {
-                ESP_LOGE(tag,"Could not get default str value size.");
+            proceed = callback(&item, arg);
+            free(allocated); // Compressed default decompressed for the callback
+            allocated = NULL;
+            if (!proceed) {
+                return ESP_OK;
             }
         }
+    }
 
-    } else { // If the passed value parameter is NOT NULL, retrieve the string
+    return ESP_OK;
+}
 
-        // Try with NVS first
-        esperr = nvs_open(ns, NVS_READONLY, &handle);
-        if (esperr == ESP_OK) {
-            esperr = nvs_get_str(handle, key, value, valuesize);
-            if (esperr == ESP_OK) {
-                status = 2;
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-            }
-            nvs_close(handle);
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-        }
+/*
+ * Prints an integer value of any encoding.
+ */
+static int esp_config_print_scalar(FILE *stream, esp_config_encoding_t encoding, const void *value) {
 
-        // If NVS retrieval failed, use the internal database
-        if (status != 2) {
-            interr = esp_config_get_str_default(ns, key, value, valuesize);
-            if (interr != -1) {
-                status = 3;
-            } else {
-                ESP_LOGE(tag,"Could not get default str value.");
-            }
-        }
+    union {
+        uint8_t uint8;
+        int8_t int8;
+        uint16_t uint16;
+        int16_t int16;
+        uint32_t uint32;
+        int32_t int32;
+        uint64_t uint64;
+        int64_t int64;
+    } scalar;
+
+    memcpy(&scalar, value, esp_config_encoding_size(encoding));
 
+    switch (encoding) {
+        case UINT8:
+            return fprintf(stream, "%" PRIu8, scalar.uint8);
+        case INT8:
+            return fprintf(stream, "%" PRId8, scalar.int8);
+        case UINT16:
+            return fprintf(stream, "%" PRIu16, scalar.uint16);
+        case INT16:
+            return fprintf(stream, "%" PRId16, scalar.int16);
+        case UINT32:
+            return fprintf(stream, "%" PRIu32, scalar.uint32);
+        case INT32:
+            return fprintf(stream, "%" PRId32, scalar.int32);
+        case UINT64:
+            return fprintf(stream, "%" PRIu64, scalar.uint64);
+        default:
+            return fprintf(stream, "%" PRId64, scalar.int64);
     }
+}
 
-    assert(status >= 0);
-    return status;
+/*
+ * Prints a blob in hexadecimal.
+ */
+static int esp_config_print_hex(FILE *stream, const uint8_t *value, size_t valuesize) {
+
+    int result = 0;
+
+    for (size_t i = 0; i < valuesize && result >= 0; i++) {
+        result = fprintf(stream, "%02x", value[i]);
+    }
+    return result;
 }
 
-int esp_config_get_blob(const char *ns, const char *key, void *value, size_t *valuesize) {
+static bool esp_config_print_item(const esp_config_item_t *item, void *arg) {
 
-    int status = -1;
-    int interr = -1;
-    esp_err_t esperr = ESP_FAIL;
-    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+    const char **ns = arg; // Namespace printed last
 
-    // If the passed value parameter is NULL, retrieve the string length
-    if (value == NULL) {
+    if (*ns != item->ns) {
+        printf("%s\n", item->ns);
+        *ns = item->ns;
+    }
+    printf("%s : ", item->key);
+    if (item->value == NULL) {
+        printf("<%u bytes>", (unsigned)item->valuesize);
+    } else if (item->encoding == STRING) {
+        printf("%.*s", (int)strnlen(item->value, item->valuesize), (const char*)item->value);
+    } else if (item->encoding == BLOB) {
+        esp_config_print_hex(stdout, item->value, item->valuesize);
+    } else {
+        esp_config_print_scalar(stdout, item->encoding, item->value);
+    }
+    printf((item->source == ESP_CONFIG_SOURCE_NVS) ? " (NVS)\n" : " (default)\n");
 
-        // Try with NVS first
-        esperr = nvs_open(ns, NVS_READONLY, &handle);
-        if (esperr == ESP_OK) {
-            esperr = nvs_get_blob(handle, key, NULL, valuesize);
-            if (esperr == ESP_OK) {
-                status = 0;
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-            }
-            nvs_close(handle);
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-        }
+    return true;
+}
 
-        // If NVS retrieval failed, use the internal database
-        if (status != 0) {
-            interr = esp_config_get_blob_default(ns, key, NULL, valuesize);
-            if (interr != -1) {
-                status = 1;
-            } else {
-                ESP_LOGE(tag,"Could not get default str value size.");
-            }
-        }
+void esp_config_print_summary() {
 
-    } else { // If the passed value parameter is NOT NULL, retrieve the string
+    char buffer[ESP_CONFIG_DUMP_BUFFER];
+    const char *ns = NULL;
 
-        // Try with NVS first
-        esperr = nvs_open(ns, NVS_READONLY, &handle);
-        if (esperr == ESP_OK) {
-            esperr = nvs_get_blob(handle, key, value, valuesize);
-            if (esperr == ESP_OK) {
-                status = 2;
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-            }
-            nvs_close(handle);
+    esp_config_foreach(buffer, sizeof(buffer), esp_config_print_item, &ns);
+}
+
+typedef struct {
+    FILE *stream;
+    const char *ns;     /**< Namespace written last */
+    bool failed;
+} esp_config_json_t;
+
+/*
+ * Writes a JSON string, escaping quotes, backslashes and control
+ * characters.
+ */
+static int esp_config_json_string(FILE *stream, const char *value, size_t length) {
+
+    int result = fputc('"', stream);
+
+    for (size_t i = 0; i < length && result >= 0; i++) {
+        if (value[i] == '"' || value[i] == '\\') {
+            result = fprintf(stream, "\\%c", value[i]);
+        } else if ((unsigned char)value[i] < 0x20) {
+            result = fprintf(stream, "\\u%04x", (unsigned char)value[i]);
         } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            result = fputc(value[i], stream);
         }
+    }
+    if (result >= 0) {
+        result = fputc('"', stream);
+    }
+    return result;
+}
 
-        // If NVS retrieval failed, use the internal database
-        if (status != 2) {
-            interr = esp_config_get_blob_default(ns, key, value, valuesize);
-            if (interr != -1) {
-                status = 3;
-            } else {
-                ESP_LOGE(tag,"Could not get default str value.");
-            }
+static bool esp_config_json_item(const esp_config_item_t *item, void *arg) {
+
+    esp_config_json_t *json = arg;
+    FILE *stream = json->stream;
+    int result = 0;
+
+    // A new namespace closes the object of the previous one
+    if (json->ns != item->ns) {
+        result = fputs((json->ns == NULL) ? "{" : "},", stream);
+        if (result >= 0) {
+            result = esp_config_json_string(stream, item->ns, strlen(item->ns));
         }
+        if (result >= 0) {
+            result = fputs(":{", stream);
+        }
+        json->ns = item->ns;
+    } else {
+        result = fputc(',', stream);
+    }
 
+    if (result >= 0) {
+        result = esp_config_json_string(stream, item->key, strlen(item->key));
+    }
+    if (result >= 0) {
+        result = fputs(":{\"value\":", stream);
+    }
+    if (result >= 0 && item->value == NULL) {
+        result = fprintf(stream, "null,\"size\":%u", (unsigned)item->valuesize);
+    } else if (result >= 0 && item->encoding == STRING) {
+        result = esp_config_json_string(stream, item->value, strnlen(item->value, item->valuesize));
+    } else if (result >= 0 && item->encoding == BLOB) {
+        result = fputc('"', stream);
+        if (result >= 0) {
+            result = esp_config_print_hex(stream, item->value, item->valuesize);
+        }
+        if (result >= 0) {
+            result = fputc('"', stream);
+        }
+    } else if (result >= 0) {
+        result = esp_config_print_scalar(stream, item->encoding, item->value);
+    }
+    if (result >= 0) {
+        result = fprintf(stream, ",\"source\":\"%s\"}", (item->source == ESP_CONFIG_SOURCE_NVS) ? "nvs" : "default");
     }
 
-    assert(status >= 0);
-    return status;
+    json->failed = (result < 0);
+    return !json->failed;
 }
 
-int esp_config_get_i32_default(const char *ns, const char *key, int32_t *value) {
+esp_err_t esp_config_export_json(FILE *stream) {
 
-    for (int i=0; i<ESP_CONFIG_DB_ENTRIES; i++) {
-        if (strcmp(ns,database[i].name) == 0) {
-            for (int j=0; j<database[i].nentries; j++) {
-                if (strcmp(key,database[i].entries[j].key) == 0 && database[i].entries[j].encoding == INT32) {
-                    *value = database[i].entries[j].value.int32;
-                    return 0;
-                }
-            }
-        }
+    char buffer[ESP_CONFIG_DUMP_BUFFER];
+    esp_config_json_t json = {.stream = stream, .ns = NULL, .failed = false};
+    esp_err_t esperr = ESP_OK;
+
+    esperr = esp_config_foreach(buffer, sizeof(buffer), esp_config_json_item, &json);
+    if (esperr != ESP_OK) {
+        return esperr;
+    }
+    if (!json.failed) {
+        json.failed = fputs((json.ns == NULL) ? "{}\n" : "}}\n", stream) < 0;
     }
 
-    return -1;
+    return json.failed ? ESP_FAIL : ESP_OK;
 }
 
-int esp_config_get_str_default(const char *ns, const char *key, char *value, size_t *valuesize) {
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
 
-    for (int i=0; i<ESP_CONFIG_DB_ENTRIES; i++) {
-        if (strcmp(ns,database[i].name) == 0) {
-            for (int j=0; j<database[i].nentries; j++) {
-                if (strcmp(key,database[i].entries[j].key) == 0 && database[i].entries[j].encoding == STRING) {
-                    // printf("namespace %s key %s value %s\n",database[i].name,database[i].entries[j].key,database[i].entries[j].value.string);
-                    if (value == NULL) {
-                        *valuesize = strlen(database[i].entries[j].value.string);
-                        return 0;
-                    }
-                    strncpy(value, database[i].entries[j].value.string, *valuesize);
-                    return 1;
-                }
-            }
-        }
+/*
+ * A blob being written in chunks. Chunks equal to the default are only
+ * written once the value departs from it, so that streaming the default
+ * back does not write anything but the erase of the override.
+ */
+struct esp_config_blob_writer {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    bool known;                         // In the defaults database
+    esp_config_token_t token;
+    const void *matched;                // Default blob matching the value so far, or NULL
+    nvs_handle handle;
+    bool replaced;                      // Key held a chunked blob already
+    esp_config_chunked_t previous;
+    esp_config_chunked_t chunked;
+    uint32_t flushed;                   // Chunks written to the NVS
+    size_t received;                    // Bytes received, including those in buffer
+    size_t fill;                        // Bytes in buffer
+    uint8_t buffer[];                   // Chunk being received
+};
+
+/*
+ * Writes the chunks before the one in the buffer that are not written yet,
+ * from the default they are equal to, and the chunk in the buffer if
+ * current is set.
+ */
+static esp_err_t esp_config_blob_writer_flush(esp_config_blob_writer_t writer, bool current) {
+
+    esp_err_t esperr = ESP_OK;
+    char chunkkey[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t index = (writer->received - writer->fill) / writer->chunked.chunk;
+
+    for (; writer->flushed < index && esperr == ESP_OK; writer->flushed++) {
+        esp_config_chunk_key(writer->key, writer->chunked.bank, writer->flushed, chunkkey);
+        esperr = nvs_set_blob(writer->handle, chunkkey, (const uint8_t*)writer->matched + (size_t)writer->flushed * writer->chunked.chunk, writer->chunked.chunk);
+    }
+    if (esperr == ESP_OK && current) {
+        esp_config_chunk_key(writer->key, writer->chunked.bank, index, chunkkey);
+        esperr = nvs_set_blob(writer->handle, chunkkey, writer->buffer, writer->fill);
+        writer->flushed = index + 1;
     }
 
-    return -1;
+    return esperr;
 }
 
-int esp_config_get_blob_default(const char *ns, const char *key, void *value, size_t *valuesize) {
+/*
+ * Closes the handle of a writer and frees it. Chunks written for a value
+ * that is not committed are erased.
+ */
+static void esp_config_blob_writer_release(esp_config_blob_writer_t writer, bool discard) {
 
-    for (int i=0; i<ESP_CONFIG_DB_ENTRIES; i++) {
-        if (strcmp(ns,database[i].name) == 0) {
-            for (int j=0; j<database[i].nentries; j++) {
-                if (strcmp(key,database[i].entries[j].key) == 0 && database[i].entries[j].encoding == BLOB) {
-                    // printf("namespace %s key %s value %s\n",database[i].name,database[i].entries[j].key,database[i].entries[j].value.string);
-                    if (value == NULL) {
-                        *valuesize = database[i].entries[j].value_size;
-                        return 0;
-                    }
-                    memcpy(value, database[i].entries[j].value.blob, *valuesize);
-                    return 1;
-                }
-            }
-        }
+    if (discard && writer->flushed > 0) {
+        esp_config_chunked_erase(writer->handle, writer->key, &writer->chunked);
     }
-
-    return -1;
+    esp_config_close(writer->handle);
+    free(writer);
 }
 
-esp_err_t esp_config_set_i32(const char* ns, const char* key, int32_t value) {
-    
+esp_err_t esp_config_blob_write_begin(const char *ns, const char *key, size_t size, esp_config_blob_writer_t *writer) {
+
     esp_err_t esperr = ESP_FAIL;
-    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+    esp_config_blob_writer_t created = NULL;
+    esp_config_entry_t view;
+    const esp_config_entry_t *entry = NULL;
 
-    esperr = nvs_open(ns, NVS_READWRITE, &handle);
-    if (esperr == ESP_OK) {
-        esperr = nvs_set_i32(handle, key, value);
-        if (esperr == ESP_OK) {
-            esperr = nvs_commit(handle);
-            if (esperr == ESP_OK) {
-                // Do nothing! Success.
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-            }
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-        }
-        nvs_close(handle);
-    } else {
+    if (ns == NULL || key == NULL || writer == NULL || strlen(ns) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (size > (size_t)ESP_CONFIG_CHUNKED_MAX * CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    created = calloc(1, sizeof(struct esp_config_blob_writer) + CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE);
+    if (created == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(created->ns, ns);
+    strcpy(created->key, key);
+    entry = esp_config_find_default(ns, key, BLOB, &created->token, &view);
+    created->known = (entry != NULL);
+    if (created->known && (entry->flags & ESP_CONFIG_FLAG_FROZEN)) {
+        ESP_LOGE(tag,"Key %s is frozen.", key);
+        free(created);
+        return ESP_ERR_NOT_SUPPORTED;
+    } else if (created->known && esp_config_token_packed(&created->token)) {
+        ESP_LOGE(tag,"Key %s is compressed, it is set whole.", key);
+        free(created);
+        return ESP_ERR_NOT_SUPPORTED;
+    } else if (created->known && entry->value_size == size) {
+        created->matched = entry->value.blob;
+    }
+
+    esperr = esp_config_open(ns, created->known ? created->token.ns : -1, NVS_READWRITE, &created->handle);
+    if (esperr != ESP_OK) {
         ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        free(created);
+        return esperr;
     }
+    created->replaced = esp_config_chunked_probe(created->handle, key, &created->previous);
+    created->chunked.size = size;
+    created->chunked.chunk = CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE;
+    created->chunked.bank = created->replaced ? !created->previous.bank : 0;
+    *writer = created;
 
-    return esperr;
+    return ESP_OK;
 }
 
-esp_err_t esp_config_set_str(const char* ns, const char* key, const char* value) {
-    
-    esp_err_t esperr = ESP_FAIL;
-    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+esp_err_t esp_config_blob_write(esp_config_blob_writer_t writer, const void *data, size_t length) {
 
-    esperr = nvs_open(ns, NVS_READWRITE, &handle);
-    if (esperr == ESP_OK) {
-        esperr = nvs_set_str(handle, key, value);
-        if (esperr == ESP_OK) {
-            esperr = nvs_commit(handle);
-            if (esperr == ESP_OK) {
-                // Do nothing! Success.
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    esp_err_t esperr = ESP_OK;
+    size_t part = 0;
+
+    if (writer == NULL || (data == NULL && length > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (length > writer->chunked.size - writer->received) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (length > 0 && esperr == ESP_OK) {
+        // A full chunk is written once more data comes, so that the last one stays for commit
+        if (writer->fill == writer->chunked.chunk) {
+            if (writer->matched == NULL) {
+                esperr = esp_config_blob_writer_flush(writer, true);
             }
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            writer->fill = 0;
+            continue;
         }
-        nvs_close(handle);
-    } else {
-        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+        part = writer->chunked.chunk - writer->fill;
+        part = (part < length) ? part : length;
+        memcpy(writer->buffer + writer->fill, data, part);
+        if (writer->matched != NULL && memcmp((const uint8_t*)writer->matched + writer->received, data, part) != 0) {
+            esperr = esp_config_blob_writer_flush(writer, false); // Departs from the default, the chunks before are written
+            writer->matched = NULL;
+        }
+        writer->fill += part;
+        writer->received += part;
+        data = (const uint8_t*)data + part;
+        length -= part;
     }
 
     return esperr;
 }
 
-esp_err_t esp_config_set_blob(const char* ns, const char* key, const void* value, size_t valuesize) {
-    
-    esp_err_t esperr = ESP_FAIL;
-    nvs_handle handle; // Not initialized as we do not know what would fit as an invalid handle
+esp_err_t esp_config_blob_write_commit(esp_config_blob_writer_t writer) {
 
-    esperr = nvs_open(ns, NVS_READWRITE, &handle);
-    if (esperr == ESP_OK) {
-        esperr = nvs_set_blob(handle, key, value, valuesize);
-        if (esperr == ESP_OK) {
-            esperr = nvs_commit(handle);
-            if (esperr == ESP_OK) {
-                // Do nothing! Success.
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-            }
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-        }
-        nvs_close(handle);
-    } else {
-        ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+    esp_err_t esperr = ESP_OK;
+    const esp_config_token_t *token = NULL;
+    bool switched = false;
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    uint8_t *value = NULL;
+    bool prepared = false;
+#endif
+
+    if (writer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (writer->received != writer->chunked.size) {
+        esp_config_blob_writer_release(writer, true);
+        return ESP_ERR_INVALID_SIZE;
     }
+    token = writer->known ? &writer->token : NULL;
 
-    return esperr;
-}
+    // Values that fit a chunk are stored plain, and the default erases the override, as with esp_config_set_blob()
+    if (writer->chunked.size <= writer->chunked.chunk || writer->matched != NULL) {
+        esperr = esp_config_write(writer->ns, writer->key, token, BLOB,
+                (writer->matched != NULL) ? writer->matched : writer->buffer, writer->chunked.size, NULL);
+        esp_config_blob_writer_release(writer, false);
+        return esperr;
+    }
 
-esp_err_t esp_config_reset() {
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    // A value staged earlier would overwrite this one when flushed
+    if (write_behind_flush_lock != NULL) {
+        esp_config_port_mutex_lock(write_behind_flush_lock);
+        esp_config_write_behind_discard(writer->ns, writer->key);
+    }
+#endif
 
-    esp_err_t esperr = ESP_FAIL;
+    esperr = esp_config_blob_writer_flush(writer, true);
 
-    // Not sure if deinit() and init() are necessary here, but in a previous code iterations they were added after an initial implementation without.
-    esperr = nvs_flash_deinit();
-    if (esperr == ESP_OK) {
-        esperr = nvs_flash_erase();
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    // The snapshot holds whole values, so this one is read back in full, and published once committed
+    if (esperr == ESP_OK && token != NULL && __atomic_load_n(&snapshot, __ATOMIC_ACQUIRE) != NULL) {
+        value = malloc(writer->chunked.size);
+        esperr = (value != NULL) ? esp_config_chunked_read(writer->handle, writer->key, &writer->chunked, 0, value, writer->chunked.size) : ESP_ERR_NO_MEM;
         if (esperr == ESP_OK) {
-            esperr = nvs_flash_init();
-            if (esperr == ESP_OK) {
-                // Success!
-            } else {
-                ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
-            }
-        } else {
-            ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
+            esperr = esp_config_snapshot_prepare_value(writer->ns, writer->key, BLOB, value, writer->chunked.size, &prepared);
         }
-    } else {
+        free(value);
+    }
+#endif
+
+    if (esperr == ESP_OK) {
+        esperr = esp_config_chunked_switch(writer->handle, writer->key, &writer->chunked, writer->replaced ? &writer->previous : NULL);
+        switched = (esperr == ESP_OK);
+    }
+    if (esperr == ESP_OK) {
+        esperr = esp_config_commit(writer->handle);
+    }
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+    esp_config_snapshot_finish(prepared, esperr == ESP_OK);
+#endif
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+    if (write_behind_flush_lock != NULL) {
+        esp_config_port_mutex_unlock(write_behind_flush_lock);
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_CACHE
+    if (token != NULL) {
+        esp_config_cache_store(token->id, BLOB, ESP_CONFIG_CACHE_EMPTY, NULL, 0); // Resolved again by the next read
+    }
+#endif
+#if CONFIG_ESP_CONFIG_STATS
+    esp_config_stats_count(&stats_keys[(token != NULL) ? token->id : ESP_CONFIG_STATS_OTHER].set);
+    if (esperr == ESP_OK) {
+        esp_config_stats_count(&stats_keys[(token != NULL) ? token->id : ESP_CONFIG_STATS_OTHER].commit);
+    }
+#endif
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    if (esperr == ESP_OK && token != NULL) {
+        esp_config_notify(token, true, NULL, writer->chunked.size);
+    }
+#endif
+
+    if (esperr != ESP_OK) {
         ESP_LOGE(tag,"%s",esp_err_to_name(esperr));
     }
+    esp_config_blob_writer_release(writer, !switched); // Once switched to, the chunks are the value
 
     return esperr;
 }
 
-void esp_config_print_summary() {
-
-    int status = -1;
-    const char* ns = NULL;
-    const char* key = NULL;
-
-    // int8_t int8value = 0;
-    // uint8_t uint8value = 0;
-    // int16_t int16value = 0;
-    // uint16_t uint16value = 0;
-    int32_t int32value = 0;
-    // uint32_t uint32value = 0;
-    // int64_t int64value = 0;
-    // uint64_t uint64value = 0;
-    char* strvalue = NULL;
-    size_t strlength = 0;
-    void* blobvalue = NULL;
-    size_t bloblength = 0;
+esp_err_t esp_config_blob_write_abort(esp_config_blob_writer_t writer) {
 
-    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
-        ns = database[i].name;
-        printf("%s\n", ns);
-        for (int j = 0; j < database[i].nentries; j++) {
-            key = database[i].entries[j].key;
-            printf("%s : ", key);
-            switch (database[i].entries[j].encoding) {
-                // case INT8:
-                // 	esp_config_get_i8(ns, key, &int8value);
-                // 	printf("%d\n", int8value);
-                // 	break;
-                // case UINT8:
-                // 	esp_config_get_u8(ns, key, &uint8value);
-                // 	printf("%u\n", uint8value);
-                // 	break;
-                // case INT16:
-                // 	esp_config_get_i16(ns, key, &int16value);
-                // 	printf("%d\n", int16value);
-                // 	break;
-                // case UINT16:
-                // 	esp_config_get_u16(ns, key, &uint16value);
-                // 	printf("%u\n", uint16value);
-                // 	break;
-                case INT32:
-                    status = esp_config_get_i32(ns, key, &int32value);
-                    assert(status != -1);
-                    switch(status) {
-                        case 0:
-                            printf("%d (NVS)\n", int32value);
-                            break;
-                        case 1:
-                            printf("%d (default)\n", int32value);
-                            break;
-                        default:
-                            printf("Unknown return code.\n");
-                    }
-                    break;
-                // case UINT32:
-                // 	esp_config_get_u32(ns, key, &uint32value);
-                // 	printf("%u\n", uint32value);
-                // 	break;
-                // case INT64:
-                // 	esp_config_get_i64(ns, key, &int64value);
-                // 	printf("%lld\n", int64value);
-                // 	break;
-                // case UINT64:
-                // 	esp_config_get_u64(ns, key, &uint64value);
-                // 	printf("%llu\n", uint64value);
-                // 	break;
-                case STRING:
-                    esp_config_get_str(ns, key, NULL, &strlength);
-                    strvalue = calloc(1, strlength + 1);
-                    assert(strvalue != NULL);
-                    status = esp_config_get_str(ns, key, strvalue, &strlength);
-                    switch(status) {
-                        case 2:
-                            printf("%s (NVS)\n", strvalue);
-                            break;
-                        case 3:
-                            printf("%s (default)\n", strvalue);
-                            break;
-                        default:
-                            printf("Unknown return code.\n");
-                    }
-                    free(strvalue);
-                    break;
-                case BLOB:
-                    esp_config_get_blob(ns, key, NULL, &bloblength);
-                    blobvalue = calloc(1, bloblength + 1);
-                    assert(blobvalue != NULL);
-                    status = esp_config_get_blob(ns, key, blobvalue, &bloblength);
-                    switch(status) {
-                        case 2:
-                            printf("%s (NVS)\n", (char*)blobvalue);
-                            break;
-                        case 3:
-                            printf("%s (default)\n", (char*)blobvalue);
-                            break;
-                        default:
-                            printf("Unknown return code.\n");
-                    }
-                    free(blobvalue);
-                    break;
-                default:
-                    printf("Unsupported encoding\n");
-            }
-        }
+    if (writer == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
+    esp_config_blob_writer_release(writer, true);
+
+    return ESP_OK;
 }
+
+#endif
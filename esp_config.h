@@ -16,15 +16,41 @@
 #ifndef COMPONENTS_ESP_CONFIG_H_
 #define COMPONENTS_ESP_CONFIG_H_
 
+#include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_config_db.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Initializes the library.
+ * 
+ * Calling this function is optional, every other function works
+ * without it. Once initialized, the library keeps a pool of NVS
+ * handles open across calls instead of opening and closing one
+ * around every operation, and builds its lookup structures up front.
+ * The NVS must be initialized before, via nvs_flash_init().
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_SIZE if ESP_CONFIG_DB_KEYS
+ * differs from the number of keys in the database, in which case no key
+ * of the database is found, other error codes if fail.
+ */
+esp_err_t esp_config_init();
+
+/**
+ * @brief Deinitializes the library.
+ * 
+ * This function closes all pooled NVS handles and drops cached
+ * values. It must be called before nvs_flash_deinit().
+ */
+void esp_config_deinit();
+
 /**
  * @brief Convenience function for retrieving an int32_t configuration value
  * 
@@ -36,6 +62,69 @@ extern "C" {
  */
 int esp_config_get_i32(const char *ns, const char *key, int32_t *value);
 
+/**
+ * @brief Convenience function for retrieving a uint8_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_u8(const char *ns, const char *key, uint8_t *value);
+
+/**
+ * @brief Convenience function for retrieving a int8_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_i8(const char *ns, const char *key, int8_t *value);
+
+/**
+ * @brief Convenience function for retrieving a uint16_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_u16(const char *ns, const char *key, uint16_t *value);
+
+/**
+ * @brief Convenience function for retrieving a int16_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_i16(const char *ns, const char *key, int16_t *value);
+
+/**
+ * @brief Convenience function for retrieving a uint32_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_u32(const char *ns, const char *key, uint32_t *value);
+
+/**
+ * @brief Convenience function for retrieving a uint64_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_u64(const char *ns, const char *key, uint64_t *value);
+
+/**
+ * @brief Convenience function for retrieving a int64_t configuration value
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_get_i64(const char *ns, const char *key, int64_t *value);
+
 /**
  * @brief Convenience function for retrieving a string configuration value
  * 
@@ -67,6 +156,103 @@ int esp_config_get_str(const char *ns, const char *key, char *value, size_t *val
  */
 int esp_config_get_blob(const char *ns, const char *key, void *value, size_t *valuesize);
 
+/**
+ * @brief Retrieves a string configuration value in a single call
+ * 
+ * Same as esp_config_get_str(), but *valuesize is the size of the
+ * buffer on input. If the whole value fits, terminator included, it is
+ * copied and *valuesize set to its size. Otherwise nothing is copied and
+ * *valuesize is set to the size needed, for both NVS and default values.
+ * 
+ * @return 0 if *valuesize set via NVS, 1 if valuesize set via defaults database, 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_get_str_into(const char *ns, const char *key, char *value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a blob configuration value in a single call
+ * 
+ * Same as esp_config_get_str_into(), for blobs.
+ * 
+ * @return 0 if *valuesize set via NVS, 1 if valuesize set via defaults database, 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_get_blob_into(const char *ns, const char *key, void *value, size_t *valuesize);
+
+/**
+ * @brief Retrieves part of a blob configuration value
+ * 
+ * Copies up to *valuesize bytes of the value starting at offset, and sets
+ * *valuesize to the number of bytes copied, which is 0 past the end of the
+ * value. Large blobs can be read this way with a buffer of any size: blobs
+ * stored in chunks, see CONFIG_ESP_CONFIG_BLOB_STREAMING, and defaults are
+ * read no further than needed.
+ * 
+ * @return 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_get_blob_range(const char *ns, const char *key, size_t offset, void *value, size_t *valuesize);
+
+/**
+ * @brief Caller-supplied memory for the esp_config_get_*_arena functions
+ * 
+ * Values are allocated one after the other, each aligned to a pointer.
+ * Set used to 0 to release all of them at once.
+ */
+typedef struct {
+    void *base;             /**< Start of the memory */
+    size_t size;            /**< Size of the memory */
+    size_t used;            /**< Bytes already allocated */
+} esp_config_arena_t;
+
+/**
+ * @brief Retrieves a string configuration value into an arena
+ * 
+ * Same as esp_config_get_str_into(), but the value is stored in the
+ * free space of the arena, which is then advanced past it. On success
+ * *value points to the value in the arena. If the arena has not enough
+ * free space, *value is set to NULL, *valuesize to the size needed and
+ * the arena is left untouched.
+ * 
+ * @return 0 if *valuesize set via NVS, 1 if valuesize set via defaults database, 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_get_str_arena(const char *ns, const char *key, esp_config_arena_t *arena, const char **value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a blob configuration value into an arena
+ * 
+ * Same as esp_config_get_str_arena(), for blobs.
+ * 
+ * @return 0 if *valuesize set via NVS, 1 if valuesize set via defaults database, 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_get_blob_arena(const char *ns, const char *key, esp_config_arena_t *arena, const void **value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a string configuration value in place, without copying it
+ * 
+ * If the value is not overridden in the NVS, *value is set to point
+ * straight into the defaults database and *valuesize to its length,
+ * without any allocation or copy. The pointed memory is read-only and
+ * valid forever. If the value is overridden, nothing is set and the
+ * override must be read with esp_config_get_str(). The same goes for
+ * compressed defaults, unless kept decompressed in RAM, see
+ * CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE.
+ * 
+ * @return 1 if *value points to the default value, 0 if the value is overridden in NVS, -1 if the key is not in the defaults database.
+ */
+int esp_config_get_str_ref(const char *ns, const char *key, const char **value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a blob configuration value in place, without copying it
+ * 
+ * If the value is not overridden in the NVS, *value is set to point
+ * straight into the defaults database and *valuesize to its size,
+ * without any allocation or copy. The pointed memory is read-only and
+ * valid forever. If the value is overridden, nothing is set and the
+ * override must be read with esp_config_get_blob(). Compressed defaults
+ * are handled as by esp_config_get_str_ref().
+ * 
+ * @return 1 if *value points to the default value, 0 if the value is overridden in NVS, -1 if the key is not in the defaults database.
+ */
+int esp_config_get_blob_ref(const char *ns, const char *key, const void **value, size_t *valuesize);
+
 /**
  * @brief Retrieve an int32_t configuration value from the defaults database
  * 
@@ -77,6 +263,69 @@ int esp_config_get_blob(const char *ns, const char *key, void *value, size_t *va
  */
 int esp_config_get_i32_default(const char *ns, const char *key, int32_t *value);
 
+/**
+ * @brief Retrieve a uint8_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_u8_default(const char *ns, const char *key, uint8_t *value);
+
+/**
+ * @brief Retrieve a int8_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_i8_default(const char *ns, const char *key, int8_t *value);
+
+/**
+ * @brief Retrieve a uint16_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_u16_default(const char *ns, const char *key, uint16_t *value);
+
+/**
+ * @brief Retrieve a int16_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_i16_default(const char *ns, const char *key, int16_t *value);
+
+/**
+ * @brief Retrieve a uint32_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_u32_default(const char *ns, const char *key, uint32_t *value);
+
+/**
+ * @brief Retrieve a uint64_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_u64_default(const char *ns, const char *key, uint64_t *value);
+
+/**
+ * @brief Retrieve a int64_t configuration value from the defaults database
+ * 
+ * Same as esp_config_get_i32_default().
+ * 
+ * @return 0 if value is found, -1 if value is not found.
+ */
+int esp_config_get_i64_default(const char *ns, const char *key, int64_t *value);
+
 /**
  * @brief Retrieve a string configuration value from the defaults database
  * 
@@ -103,18 +352,122 @@ int esp_config_get_str_default(const char *ns, const char *key, char *value, siz
  */
 int esp_config_get_blob_default(const char *ns, const char *key, void *value, size_t *valuesize);
 
+// Bulk read functions
+
+/**
+ * @brief Configuration value retrieved by esp_config_get_bulk().
+ */
+typedef struct {
+    const char *key;                /**< Key */
+    esp_config_encoding_t encoding; /**< Value encoding */
+    void *value;                    /**< Variable of the encoding, or buffer for strings and blobs */
+    size_t valuesize;               /**< For strings and blobs, size of the buffer on input and of the value on output */
+    int status;                     /**< Set to the status code of the esp_config_get_* function for the encoding, -1 if the key is missing */
+} esp_config_bulk_item_t;
+
+/**
+ * @brief Retrieves several configuration values of a namespace at once
+ * 
+ * Same as calling esp_config_get_i32() and the like for every item, or
+ * esp_config_get_str_into() and esp_config_get_blob_into() for strings
+ * and blobs, but the namespace is opened in the NVS only once for all of
+ * them, and only if some value is not served from RAM. Meant for
+ * components reading their whole configuration at initialization.
+ * 
+ * The status of each item is set, a key missing from both the NVS and the
+ * defaults database leaving its value untouched.
+ * 
+ * @return ESP_OK if all values were found, ESP_ERR_NOT_FOUND if some key is missing, ESP_ERR_INVALID_ARG if ns or items is NULL.
+ */
+esp_err_t esp_config_get_bulk(const char *ns, esp_config_bulk_item_t *items, size_t count);
+
 // NVS config write functions
 
+/**
+ * @brief Action taken by a configuration write.
+ */
+typedef enum {
+    ESP_CONFIG_SET_WRITTEN,         /**< The value was written to the NVS */
+    ESP_CONFIG_SET_UNCHANGED,       /**< The value was already in effect, nothing was written */
+    ESP_CONFIG_SET_ERASED           /**< The value equals the default, its override was erased from the NVS */
+} esp_config_set_action_t;
+
 /**
  * @brief Convenience function for setting an int32_t configuration value in the NVS.
  * 
  * This function sets a configuration value in the NVS, overriding
- * the one in the defaults database.
+ * the one in the defaults database. The NVS is only written when the
+ * value changes: a value already in effect is not written again, and
+ * a value equal to the default erases the override, so that the NVS
+ * only holds values that differ from their defaults.
  * 
  * @return ESP_OK if success, other error codes if fail.
  */
 esp_err_t esp_config_set_i32(const char* ns, const char* key, const int32_t value);
 
+/**
+ * @brief Convenience function for setting a uint8_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_u8(const char* ns, const char* key, const uint8_t value);
+
+/**
+ * @brief Convenience function for setting a int8_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_i8(const char* ns, const char* key, const int8_t value);
+
+/**
+ * @brief Convenience function for setting a uint16_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_u16(const char* ns, const char* key, const uint16_t value);
+
+/**
+ * @brief Convenience function for setting a int16_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_i16(const char* ns, const char* key, const int16_t value);
+
+/**
+ * @brief Convenience function for setting a uint32_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_u32(const char* ns, const char* key, const uint32_t value);
+
+/**
+ * @brief Convenience function for setting a uint64_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_u64(const char* ns, const char* key, const uint64_t value);
+
+/**
+ * @brief Convenience function for setting a int64_t configuration value in the NVS.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set_i64(const char* ns, const char* key, const int64_t value);
+
 /**
  * @brief Convenience function for setting an int32_t configuration value in the NVS.
  * 
@@ -135,23 +488,825 @@ esp_err_t esp_config_set_str(const char* ns, const char* key, const char* value)
  */
 esp_err_t esp_config_set_blob(const char* ns, const char* key, const void* value, size_t valuesize);
 
+/**
+ * @brief Sets a configuration value of any encoding, reporting the action taken.
+ * 
+ * Same as the esp_config_set_* functions. valuesize is only used for
+ * blobs, strings must be terminated. If action is not NULL, it is set
+ * to the action taken when the function succeeds.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_set(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize, esp_config_set_action_t *action);
+
 /**
  * @brief Convenience function for erasing the NVS memory and all configuration overrides.
  * 
  * This function completely erases the NVS and all the configuration
- * overrides with it.
+ * overrides with it, including the data of other components. See
+ * esp_config_reset_all() to only revert the configuration.
  * 
  * @return ESP_OK if success, other error codes if fail.
  */
 esp_err_t esp_config_reset();
 
 /**
- * @brief Prints a summary of all known configuration values.
+ * @brief Reverts a key to its default value.
  * 
- * This function prints a summary of all known configuration values
- * together with informations such as namespace and override status.
+ * Erases the override of the key, if any. Keys missing from the
+ * defaults database are erased from the NVS as well.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
  */
-void esp_config_print_summary();
+esp_err_t esp_config_reset_key(const char *ns, const char *key);
+
+/**
+ * @brief Reverts every key of a namespace to its default value.
+ * 
+ * Erases all the entries of the namespace from the NVS, including
+ * overrides of keys missing from the defaults database. Values set
+ * but not flushed yet in write-behind mode are dropped.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND if the namespace is
+ * not in the defaults database, other error codes if fail.
+ */
+esp_err_t esp_config_reset_namespace(const char *ns);
+
+/**
+ * @brief Reverts the whole configuration to its defaults.
+ * 
+ * Same as esp_config_reset_namespace() for every namespace of the
+ * defaults database, and also erases the records the library keeps
+ * for itself. Other NVS entries are left alone.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_reset_all();
+
+// Pre-resolved key functions
+
+/**
+ * @brief Pre-resolved configuration key.
+ * 
+ * A token locates a key of the defaults database and carries its
+ * encoding, so that reads and writes through it need neither a
+ * lookup nor an encoding check. Tokens never expire, as the
+ * database is immutable. A token not set by esp_config_token_resolve()
+ * that does not locate a key with its encoding is rejected: reads fail
+ * as for a key missing from the database, writes with
+ * ESP_ERR_INVALID_ARG.
+ */
+typedef struct {
+    uint16_t id;            /**< Position of the entry across the whole database */
+    uint16_t ns;            /**< Index of the namespace in database[] */
+    uint16_t entry;         /**< Index of the entry in the namespace entries[] */
+    uint16_t encoding;      /**< Value encoding, an esp_config_encoding_t */
+} esp_config_token_t;
+
+/**
+ * @brief Resolves a configuration key to a token.
+ * 
+ * This function is meant to be called once, e.g. at component
+ * initialization, and the token reused on every access.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND if the key is not in the defaults database with this encoding.
+ */
+esp_err_t esp_config_token_resolve(const char *ns, const char *key, esp_config_encoding_t encoding, esp_config_token_t *token);
+
+/**
+ * @brief Retrieves an int32_t configuration value through its token.
+ * 
+ * Same as esp_config_get_i32().
+ * 
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+int esp_config_token_get_i32(esp_config_token_t token, int32_t *value);
+
+/**
+ * @brief Retrieves a string configuration value through its token.
+ * 
+ * Same as esp_config_get_str().
+ * 
+ * @return 0 if *valuesize set via NVS, 1 if valuesize set via defaults database, 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_token_get_str(esp_config_token_t token, char *value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a blob configuration value through its token.
+ * 
+ * Same as esp_config_get_blob().
+ * 
+ * @return 0 if *valuesize set via NVS, 1 if valuesize set via defaults database, 2 if *value set via NVS, 3 if *value set via defaults database.
+ */
+int esp_config_token_get_blob(esp_config_token_t token, void *value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a string configuration value in place through its token.
+ * 
+ * Same as esp_config_get_str_ref().
+ * 
+ * @return 1 if *value points to the default value, 0 if the value is overridden in NVS.
+ */
+int esp_config_token_get_str_ref(esp_config_token_t token, const char **value, size_t *valuesize);
+
+/**
+ * @brief Retrieves a blob configuration value in place through its token.
+ * 
+ * Same as esp_config_get_blob_ref().
+ * 
+ * @return 1 if *value points to the default value, 0 if the value is overridden in NVS.
+ */
+int esp_config_token_get_blob_ref(esp_config_token_t token, const void **value, size_t *valuesize);
+
+/**
+ * @brief Sets an int32_t configuration value through its token.
+ * 
+ * Same as esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_token_set_i32(esp_config_token_t token, int32_t value);
+
+/**
+ * @brief Sets a string configuration value through its token.
+ * 
+ * Same as esp_config_set_str().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_token_set_str(esp_config_token_t token, const char *value);
+
+/**
+ * @brief Sets a blob configuration value through its token.
+ * 
+ * Same as esp_config_set_blob().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_token_set_blob(esp_config_token_t token, const void *value, size_t valuesize);
+
+/**
+ * @brief Retrieves a configuration value of any encoding through its token.
+ * 
+ * *value must point to a variable of the token's encoding. valuesize is
+ * only used for strings and blobs, as in esp_config_get_str() and
+ * esp_config_get_blob().
+ * 
+ * @return The status code of the esp_config_get_* function for the token's encoding.
+ */
+int esp_config_token_get(esp_config_token_t token, void *value, size_t *valuesize);
+
+/**
+ * @brief Sets a configuration value of any encoding through its token.
+ * 
+ * valuesize is only used for blobs, strings must be terminated.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_token_set(esp_config_token_t token, const void *value, size_t valuesize);
+
+// Batch write functions
+
+/**
+ * @brief Handle of a batch of staged configuration writes.
+ */
+typedef struct esp_config_batch *esp_config_batch_t;
+
+/**
+ * @brief Starts a batch of configuration writes.
+ * 
+ * Values staged in a batch are only written to the NVS by
+ * esp_config_batch_commit(), with a single commit per namespace
+ * instead of one per value. Either esp_config_batch_commit() or
+ * esp_config_batch_abort() must be called to release the batch.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NO_MEM if the batch could not be allocated.
+ */
+esp_err_t esp_config_batch_begin(esp_config_batch_t *batch);
+
+/**
+ * @brief Stages an int32_t configuration value in a batch.
+ * 
+ * A value equal to its default is staged as an erase of the
+ * override, as in esp_config_set_i32().
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_batch_set_i32(esp_config_batch_t batch, const char *ns, const char *key, int32_t value);
+
+/**
+ * @brief Stages a string configuration value in a batch.
+ * 
+ * The string is copied, so it does not need to outlive the call.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_batch_set_str(esp_config_batch_t batch, const char *ns, const char *key, const char *value);
+
+/**
+ * @brief Stages a blob configuration value in a batch.
+ * 
+ * The blob is copied, so it does not need to outlive the call.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_batch_set_blob(esp_config_batch_t batch, const char *ns, const char *key, const void *value, size_t valuesize);
+
+/**
+ * @brief Writes all values staged in a batch and releases it.
+ * 
+ * Values are written namespace by namespace, with one NVS commit
+ * each. When the batch journal is enabled, the whole batch is first
+ * committed to the NVS as a single record: if the device loses power
+ * while the values are written, the batch is completed by the next
+ * esp_config_init(), or by the first write if that comes first, so the
+ * configuration is never left half-applied. If writing fails otherwise,
+ * the error is returned and the values of the namespaces already
+ * committed stay in effect, subscribers being notified of them.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_batch_commit(esp_config_batch_t batch);
+
+/**
+ * @brief Discards all values staged in a batch and releases it.
+ */
+void esp_config_batch_abort(esp_config_batch_t batch);
+
+#if CONFIG_ESP_CONFIG_BLOB_STREAMING
+
+/**
+ * @brief Handle of a blob configuration value being written in chunks.
+ */
+typedef struct esp_config_blob_writer *esp_config_blob_writer_t;
+
+/**
+ * @brief Starts writing a blob configuration value of the given size.
+ * 
+ * The value is passed in any number of esp_config_blob_write() calls
+ * and takes effect in esp_config_blob_write_commit(), so that blobs
+ * larger than the RAM available can be set. Only one chunk is held in
+ * RAM, see CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE. With the snapshot enabled,
+ * the whole value is still read back into RAM once to update it.
+ * 
+ * The key must not be written by other means until the writer is
+ * committed or aborted, which must be done to release it. Compressed
+ * keys, see ESP_CONFIG_FLAG_COMPRESSED, are not supported.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_SUPPORTED if the key is frozen or compressed, ESP_ERR_NVS_VALUE_TOO_LONG if the value exceeds 4096 chunks, other errors from NVS or ESP_ERR_NO_MEM.
+ */
+esp_err_t esp_config_blob_write_begin(const char *ns, const char *key, size_t size, esp_config_blob_writer_t *writer);
+
+/**
+ * @brief Writes the next part of a blob started with esp_config_blob_write_begin().
+ * 
+ * Each chunk is written to the NVS as soon as it is complete, next to
+ * the value in effect, which is unchanged until the commit.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_SIZE if past the size given to esp_config_blob_write_begin(), other errors from NVS.
+ */
+esp_err_t esp_config_blob_write(esp_config_blob_writer_t writer, const void *data, size_t length);
+
+/**
+ * @brief Makes a blob written in chunks take effect, and releases the writer.
+ * 
+ * As with esp_config_set_blob(), a value equal to the default erases the
+ * override instead. An interrupted commit leaves the previous value.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_SIZE if fewer bytes were written than announced, other errors from NVS.
+ */
+esp_err_t esp_config_blob_write_commit(esp_config_blob_writer_t writer);
+
+/**
+ * @brief Discards a blob written in chunks, and releases the writer.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_ARG if writer is NULL.
+ */
+esp_err_t esp_config_blob_write_abort(esp_config_blob_writer_t writer);
+
+#endif
+
+#if CONFIG_ESP_CONFIG_WRITE_BEHIND
+
+/**
+ * @brief Starts deferring configuration writes.
+ * 
+ * Once started, esp_config_set_* functions stage the value in RAM and
+ * return immediately, and esp_config_get_* functions see it right
+ * away. A background task writes staged values to the NVS once no
+ * value has been set for quiet_ms milliseconds, so that a key set
+ * many times in a row is written once. Calling this function again
+ * only changes the quiet period.
+ * 
+ * Values not flushed yet are lost on power loss.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NO_MEM if the task could not be started.
+ */
+esp_err_t esp_config_write_behind_start(uint32_t quiet_ms);
+
+/**
+ * @brief Stops deferring configuration writes.
+ * 
+ * All staged values are written before this function returns, and
+ * later writes go straight to the NVS again. It is called by
+ * esp_config_deinit(), which logs its error.
+ * 
+ * Values that could not be written stay staged, and are still read back,
+ * until esp_config_flush() succeeds. Writes made meanwhile are staged
+ * behind them.
+ * 
+ * @return ESP_OK if success, the error of the last flush if some values
+ *         could not be written.
+ */
+esp_err_t esp_config_write_behind_stop();
+
+/**
+ * @brief Writes all staged values to the NVS now.
+ * 
+ * Values that cannot be written stay staged for the next flush.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_flush();
+
+#endif /* CONFIG_ESP_CONFIG_WRITE_BEHIND */
+
+#if CONFIG_ESP_CONFIG_ASYNC_SET
+
+#define ESP_CONFIG_ASYNC_WAIT_FOREVER UINT32_MAX
+
+/**
+ * @brief Completion of an asynchronous configuration write.
+ * 
+ * Owned by the caller of esp_config_set_async(), and must outlive the
+ * write. Its fields are written by the storage task, read them after
+ * esp_config_async_wait() returned the result.
+ */
+typedef struct {
+    bool done;                          /**< The write completed */
+    esp_err_t result;                   /**< Result of the write, as returned by esp_config_set() */
+    esp_config_set_action_t action;     /**< Action taken, if the write succeeded */
+    void *waiter;                       /**< Used by esp_config_async_wait() */
+} esp_config_async_t;
+
+/**
+ * @brief Callback reporting the completion of an asynchronous configuration write.
+ * 
+ * Called from the storage task, so it must return quickly and must not
+ * wait for the completion of other asynchronous writes, nor for queue
+ * space in esp_config_set_async().
+ * 
+ * @param action Action taken, if result is ESP_OK.
+ */
+typedef void (*esp_config_set_cb_t)(const char *ns, const char *key, esp_err_t result, esp_config_set_action_t action, void *arg);
+
+/**
+ * @brief Starts the storage task serving asynchronous configuration writes.
+ * 
+ * Calling this function again does nothing.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NO_MEM if the task could not be started.
+ */
+esp_err_t esp_config_async_start();
+
+/**
+ * @brief Stops the storage task.
+ * 
+ * Writes already queued are completed before this function returns,
+ * later calls to esp_config_set_async() fail. It is called by
+ * esp_config_deinit().
+ * 
+ * @return ESP_OK if success.
+ */
+esp_err_t esp_config_async_stop();
+
+/**
+ * @brief Queues a configuration write to the storage task and returns.
+ * 
+ * The write then takes place as with esp_config_set(), and its result
+ * is reported through callback, if not NULL, and handle, if not NULL,
+ * in this order. The value is copied, so it does not need to outlive
+ * the call. Writes are completed in the order they were queued, so
+ * the last value queued for a key is the one left in effect. Reads
+ * return the previous value until the write completes, and writes
+ * made with the esp_config_set_* functions meanwhile are not ordered
+ * with the queued ones.
+ * 
+ * The queue holds CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH writes. When it
+ * is full, this function waits up to timeout_ms milliseconds for a
+ * write to complete, or forever with ESP_CONFIG_ASYNC_WAIT_FOREVER.
+ * 
+ * @return ESP_OK if queued, ESP_ERR_TIMEOUT if the queue stayed full, ESP_ERR_INVALID_STATE if the storage task is not running, ESP_ERR_INVALID_ARG or ESP_ERR_NO_MEM.
+ */
+esp_err_t esp_config_set_async(const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize, uint32_t timeout_ms, esp_config_set_cb_t callback, void *arg, esp_config_async_t *handle);
+
+/**
+ * @brief Waits for the completion of an asynchronous configuration write.
+ * 
+ * With a timeout_ms of 0, only checks whether the write completed. A
+ * handle can be waited for by one task at a time.
+ * 
+ * @return The result of the write, ESP_ERR_TIMEOUT if it did not complete in time, ESP_ERR_NO_MEM.
+ */
+esp_err_t esp_config_async_wait(esp_config_async_t *handle, uint32_t timeout_ms);
+
+/**
+ * @brief Waits for the completion of all asynchronous configuration writes queued so far.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_STATE if the storage task is not running, ESP_ERR_NO_MEM.
+ */
+esp_err_t esp_config_async_flush();
+
+#endif /* CONFIG_ESP_CONFIG_ASYNC_SET */
+
+#if CONFIG_ESP_CONFIG_CACHE
+
+/**
+ * @brief Fills the cache with the resolved value of every key in the defaults database.
+ * 
+ * Keys are otherwise cached the first time they are read. Loading them
+ * all at boot moves every NVS access out of later reads, which are then
+ * served from RAM until the value is set or the configuration reset.
+ * 
+ * @return ESP_OK if success, other error codes if fail.
+ */
+esp_err_t esp_config_cache_load();
+
+/**
+ * @brief Drops all cached values.
+ * 
+ * This function forces the next read of every key to go to the NVS,
+ * e.g. after the NVS has been written bypassing this library.
+ */
+void esp_config_cache_clear();
+
+#endif /* CONFIG_ESP_CONFIG_CACHE */
+
+#if CONFIG_ESP_CONFIG_SNAPSHOT
+
+/**
+ * @brief Rebuilds the boot snapshot from the values in the NVS.
+ * 
+ * The snapshot is loaded by esp_config_init(), built from the NVS if
+ * missing, invalid or out of date, and kept up to date by the
+ * esp_config_set_* and batch functions. This function is only needed
+ * after the NVS has been written bypassing this library.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_STATE if the library is not initialized, other error codes if fail.
+ */
+esp_err_t esp_config_snapshot_rebuild();
+
+/**
+ * @brief Writes the boot snapshot to the NVS if values were set since it
+ *        was last written.
+ * 
+ * Writes only update the snapshot in RAM, and mark the one in the NVS as
+ * out of date with a single extra NVS write after each save. A snapshot
+ * out of date is rebuilt from the NVS by the next esp_config_init(),
+ * which reads every overridden key. Call this function once a burst of
+ * writes is over, e.g. after provisioning. It is called by
+ * esp_config_deinit().
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_STATE if no snapshot is loaded, other error codes if fail.
+ */
+esp_err_t esp_config_snapshot_save();
+
+#endif /* CONFIG_ESP_CONFIG_SNAPSHOT */
+
+#if CONFIG_ESP_CONFIG_LAYERS
+
+/**
+ * @brief Sets the stack of layers below the NVS overrides.
+ * 
+ * Each layer is an NVS partition, given lowest first, e.g. factory
+ * calibration then site provisioning. For every key, the highest
+ * layer that has a value for it replaces the compiled default, and
+ * values set with the esp_config_set_* functions override them all.
+ * Values of the layers are reported as defaults by the getters, and
+ * are what the reset functions revert to. Frozen keys ignore the
+ * layers.
+ * 
+ * Must be called before esp_config_init(). The partitions must be
+ * initialized with nvs_flash_init_partition(), and the labels must
+ * stay valid. A layer whose partition is missing is logged by
+ * esp_config_init() and left empty, the other layers still apply.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_STATE if the library is already initialized, ESP_ERR_INVALID_ARG if count is above CONFIG_ESP_CONFIG_MAX_LAYERS.
+ */
+esp_err_t esp_config_layers_set(const char *const *partitions, int count);
+
+/**
+ * @brief Writes a value to a layer, or erases it if value is NULL.
+ * 
+ * Only keys of the defaults database can be written. The value is
+ * committed to the partition of the layer, and takes effect at once
+ * unless a higher layer has a value for the key. valuesize is only
+ * used for blobs, strings must be terminated.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND if the key is not in the database, ESP_ERR_NOT_SUPPORTED if it is frozen, other error codes if fail.
+ */
+esp_err_t esp_config_layer_set(int layer, const char *ns, const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize);
+
+#endif /* CONFIG_ESP_CONFIG_LAYERS */
+
+#if CONFIG_ESP_CONFIG_STATS
+
+/**
+ * @brief Usage counters of a key, a namespace, or the whole library.
+ */
+typedef struct {
+    uint32_t nvs;           /**< Reads served by a value overridden in the NVS */
+    uint32_t fallback;      /**< Reads served by the defaults database */
+    uint32_t miss;          /**< Reads of keys neither in the NVS nor in the defaults database */
+    uint32_t set;           /**< Writes, including those staged in batches */
+    uint32_t commit;        /**< Values committed to the NVS */
+} esp_config_counters_t;
+
+#define ESP_CONFIG_HISTOGRAM_BUCKETS 20
+
+/**
+ * @brief Latency histogram.
+ *
+ * Bucket 0 counts operations faster than 1 us, bucket i counts those
+ * taking from 2^(i-1) to 2^i us, and the last bucket all slower ones.
+ */
+typedef struct {
+    uint32_t buckets[ESP_CONFIG_HISTOGRAM_BUCKETS];
+} esp_config_histogram_t;
+
+/**
+ * @brief Statistics of the whole library.
+ */
+typedef struct {
+    esp_config_counters_t total;    /**< Counters summed over all keys */
+    esp_config_histogram_t get;     /**< Latency of the getters */
+    esp_config_histogram_t set;     /**< Latency of the setters, commit included */
+    esp_config_histogram_t commit;  /**< Latency of NVS commits alone */
+} esp_config_stats_t;
+
+/**
+ * @brief Retrieves the statistics of the whole library.
+ */
+void esp_config_stats_get(esp_config_stats_t *stats);
+
+/**
+ * @brief Retrieves the counters of a key of the defaults database.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND if the key is not in the defaults database.
+ */
+esp_err_t esp_config_stats_get_key(const char *ns, const char *key, esp_config_counters_t *counters);
+
+/**
+ * @brief Retrieves the counters of a namespace of the defaults database.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND if the namespace is not in the defaults database.
+ */
+esp_err_t esp_config_stats_get_namespace(const char *ns, esp_config_counters_t *counters);
+
+/**
+ * @brief Zeroes all counters and histograms.
+ */
+void esp_config_stats_reset();
+
+/**
+ * @brief Prints the statistics: totals, histograms, and the counters of
+ * every namespace and of every key used since the last reset.
+ */
+void esp_config_stats_print();
+
+/**
+ * @brief Starts printing the statistics periodically, from a background task.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_STATE if already started, other error codes if fail.
+ */
+esp_err_t esp_config_stats_print_start(uint32_t period_ms);
+
+/**
+ * @brief Stops printing the statistics periodically.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_STATE if not started.
+ */
+esp_err_t esp_config_stats_print_stop();
+
+#endif /* CONFIG_ESP_CONFIG_STATS */
+
+// Iteration functions
+
+/**
+ * @brief Origin of a configuration value.
+ */
+typedef enum {
+    ESP_CONFIG_SOURCE_NVS,          /**< Overridden in the NVS */
+    ESP_CONFIG_SOURCE_DEFAULT       /**< Not overridden, from the defaults database */
+} esp_config_source_t;
+
+/**
+ * @brief Configuration value passed to an esp_config_foreach() callback.
+ * 
+ * value is only valid during the callback. It is NULL if the value is
+ * overridden and larger than the buffer given to esp_config_foreach(),
+ * in which case valuesize is still its size and the value can be read
+ * with the esp_config_get_* functions.
+ */
+typedef struct {
+    const char *ns;                 /**< Namespace */
+    const char *key;                /**< Key */
+    esp_config_encoding_t encoding; /**< Value encoding */
+    esp_config_source_t source;     /**< Origin of the value */
+    const void *value;              /**< Value, or NULL if it did not fit */
+    size_t valuesize;               /**< Size of the value, including the terminator for strings */
+} esp_config_item_t;
+
+/**
+ * @brief Callback of esp_config_foreach().
+ * 
+ * @return true to go on with the next key, false to stop.
+ */
+typedef bool (*esp_config_foreach_cb_t)(const esp_config_item_t *item, void *arg);
+
+/**
+ * @brief Passes every key of the defaults database with its current value to a callback.
+ * 
+ * Keys are visited in database order, each with a single lookup and
+ * without heap allocation, except to decompress compressed values.
+ * Overridden strings and blobs are copied into buffer, defaults are
+ * passed in place whatever their size.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_ARG if callback is NULL.
+ */
+esp_err_t esp_config_foreach(void *buffer, size_t buffersize, esp_config_foreach_cb_t callback, void *arg);
+
+/**
+ * @brief Prints a summary of all known configuration values.
+ * 
+ * This function prints a summary of all known configuration values
+ * together with informations such as namespace and override status.
+ * Blobs are printed in hexadecimal. Overrides too large for the
+ * internal buffer are printed as their size.
+ */
+void esp_config_print_summary();
+
+/**
+ * @brief Writes all known configuration values to a stream as JSON.
+ * 
+ * The document maps each namespace to an object mapping each key to
+ * {"value": ..., "source": "nvs" or "default"}. Strings are escaped,
+ * blobs are hexadecimal strings, and overrides too large for the
+ * internal buffer have a null value and a "size" member.
+ * 
+ * @return ESP_OK if success, ESP_FAIL if writing to the stream failed.
+ */
+esp_err_t esp_config_export_json(FILE *stream);
+
+// NVS maintenance functions
+
+/**
+ * @brief State of an NVS entry found by esp_config_gc_step().
+ */
+typedef enum {
+    ESP_CONFIG_GC_LIVE,             /**< Override of a key of the defaults database, or record of the library */
+    ESP_CONFIG_GC_STALE,            /**< Never read: the key is not in the defaults database, or is frozen */
+    ESP_CONFIG_GC_MISMATCH,         /**< Key of the defaults database stored with another encoding or compression, so unreadable */
+    ESP_CONFIG_GC_STATES            /**< Number of states */
+} esp_config_gc_state_t;
+
+/**
+ * @brief NVS entry passed to an esp_config_gc_begin() callback.
+ */
+typedef struct {
+    const char *ns;                 /**< Namespace */
+    const char *key;                /**< Key */
+    nvs_type_t type;                /**< Type of the NVS entry */
+    esp_config_gc_state_t state;    /**< State of the entry */
+    size_t slots;                   /**< 32-byte NVS entries it takes, estimated */
+} esp_config_gc_entry_t;
+
+/**
+ * @brief Callback of esp_config_gc_begin().
+ */
+typedef void (*esp_config_gc_cb_t)(const esp_config_gc_entry_t *entry, void *arg);
+
+/**
+ * @brief NVS usage of a namespace, see esp_config_gc_get_usage().
+ */
+typedef struct {
+    const char *ns;                         /**< Namespace */
+    uint32_t keys[ESP_CONFIG_GC_STATES];    /**< Keys found in each state */
+    uint32_t slots[ESP_CONFIG_GC_STATES];   /**< 32-byte NVS entries they take, estimated */
+    uint32_t erased;                        /**< Keys erased */
+} esp_config_gc_usage_t;
+
+/**
+ * @brief Handle of a pass over the NVS entries of the configuration.
+ */
+typedef struct esp_config_gc *esp_config_gc_t;
+
+/**
+ * @brief Starts a pass over the NVS entries of the configuration.
+ * 
+ * The pass enumerates the NVS entries of every namespace of the defaults
+ * database, and of the library's own, and checks each of them against
+ * the database, e.g. to find the overrides of keys since removed or
+ * renamed, which would otherwise take NVS space forever. It is run in
+ * steps by esp_config_gc_step(), so that it can be spread over idle time.
+ * The callback, if not NULL, is called with every entry found.
+ * 
+ * With erase, stale and mismatching entries are erased, with one commit
+ * per namespace once it is scanned. Keys set with esp_config_set_*
+ * outside the defaults database are stale too, so do not erase if the
+ * application relies on them. Either way esp_config_gc_end() must be
+ * called to release the pass.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NO_MEM if the pass could not be allocated.
+ */
+esp_err_t esp_config_gc_begin(bool erase, esp_config_gc_cb_t callback, void *arg, esp_config_gc_t *gc);
+
+/**
+ * @brief Checks the next NVS entries of a pass.
+ * 
+ * Visits up to budget entries, then returns. *done is set to true once
+ * every namespace is scanned. Values written between steps may or may
+ * not be visited.
+ * 
+ * @return ESP_OK if success, other errors from NVS when erasing.
+ */
+esp_err_t esp_config_gc_step(esp_config_gc_t gc, uint32_t budget, bool *done);
+
+/**
+ * @brief Retrieves the NVS usage of a namespace found by a pass so far.
+ * 
+ * Namespaces are numbered in database order, the library's own being
+ * last.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND past the last namespace.
+ */
+esp_err_t esp_config_gc_get_usage(esp_config_gc_t gc, int index, esp_config_gc_usage_t *usage);
+
+/**
+ * @brief Releases a pass started with esp_config_gc_begin().
+ * 
+ * Entries found stale in a namespace not completely scanned are not
+ * erased.
+ */
+void esp_config_gc_end(esp_config_gc_t gc);
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+
+// Change notification functions
+
+/**
+ * @brief Handle of a subscription to configuration changes.
+ */
+typedef struct esp_config_subscription *esp_config_subscription_t;
+
+/**
+ * @brief Callback of esp_config_subscribe().
+ * 
+ * item is the new value of the key, as passed to esp_config_foreach()
+ * callbacks, and is only valid during the callback. Its value is NULL for
+ * blobs written in chunks and compressed defaults not kept decompressed
+ * in RAM, read them with the esp_config_get_* functions.
+ */
+typedef void (*esp_config_change_cb_t)(const esp_config_item_t *item, void *arg);
+
+/**
+ * @brief Calls back on every change of a key, or of every key of a namespace.
+ * 
+ * The callback is called with the new value once it is in effect, by the
+ * task that wrote it: after esp_config_set() and the like, in the storage
+ * task for esp_config_set_async(), after esp_config_batch_commit() and
+ * esp_config_blob_write_commit(), and with the default after the key is
+ * reset, every key of a namespace being notified when the namespace is.
+ * Values set to what is already in effect are not notified. Changes of the
+ * defaults through esp_config_layer_set() are not either.
+ * 
+ * Only keys of the defaults database can be subscribed to, with key NULL
+ * for a whole namespace. Callbacks run outside the library lock, so they
+ * can read and write the configuration, wait for other tasks using it,
+ * subscribe and unsubscribe. A write from a callback notifies its
+ * subscribers before the callback returns, so a callback writing the key
+ * it is called for must stop once the value is in effect. Changes written
+ * by different tasks at once may be notified in any order: read the key
+ * again if the latest value matters. The writing task is held up until
+ * every callback returned, keep them short, e.g. post the change to a
+ * queue.
+ * 
+ * @return ESP_OK if success, ESP_ERR_NOT_FOUND if the key or namespace is not in the defaults database, ESP_ERR_NO_MEM if CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS are in use.
+ */
+esp_err_t esp_config_subscribe(const char *ns, const char *key, esp_config_change_cb_t callback, void *arg, esp_config_subscription_t *subscription);
+
+/**
+ * @brief Cancels a subscription made with esp_config_subscribe().
+ * 
+ * The callback is not called anymore once this function returns, except
+ * by a change already being notified in another task, which may still be
+ * running it: arg must stay valid until that call returned too.
+ * 
+ * @return ESP_OK if success, ESP_ERR_INVALID_ARG if subscription is not active.
+ */
+esp_err_t esp_config_unsubscribe(esp_config_subscription_t subscription);
+
+#endif /* CONFIG_ESP_CONFIG_SUBSCRIPTIONS */
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,319 @@
+/* @file esp_config.hpp
+ * @author michele.riva@protonmail.com
+ * @date 17 Oct 2026
+ * @brief C++ interface to the configuration storage library.
+ *
+ * This header-only layer wraps esp_config.h for C++20 code. Keys are
+ * named as template arguments and resolved against the defaults database
+ * at compile time:
+ *
+ *     int32_t value = esp_config::get<"example", "i32">();
+ *     esp_config::set<"example", "i32">(int32_t(42));
+ *
+ * A key missing from the database, or a value whose type does not match
+ * the key encoding, is a compile error. Reading a frozen key (see
+ * ESP_CONFIG_FLAG_FROZEN) compiles down to its default value, and reading
+ * any other key to a single token lookup, without searching for the key
+ * at runtime. Writing a frozen key is a compile error.
+ */
+
+#ifndef COMPONENTS_ESP_CONFIG_HPP_
+#define COMPONENTS_ESP_CONFIG_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "esp_config.h"
+
+namespace esp_config {
+
+/**
+ * @brief String literal usable as a template argument.
+ */
+template <std::size_t N>
+struct fixed_string {
+    char value[N] {};
+
+    constexpr fixed_string(const char (&str)[N]) {
+        for (std::size_t i = 0; i < N; i++) {
+            value[i] = str[i];
+        }
+    }
+};
+
+namespace detail {
+
+constexpr bool equal(const char *a, const char *b) {
+    while (*a != '\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr std::size_t length(const char *str) {
+    std::size_t n = 0;
+    while (str[n] != '\0') {
+        n++;
+    }
+    return n;
+}
+
+#ifdef ESP_CONFIG_DB_COMPACT
+
+constexpr const char* key_at(int ns, int entry) {
+    return &database_keys[database_key[database[ns].first + entry]];
+}
+
+/*
+ * Decodes an entry of a compact database as esp_config_db_entry() in
+ * esp_config.c does, but setting the member of the value union that is
+ * read, as constant evaluation requires.
+ */
+constexpr esp_config_entry_t entry_at(int ns, int entry) {
+    int id = database[ns].first + entry;
+    auto encoding = (esp_config_encoding_t)(database_type[id] & ((1 << ESP_CONFIG_DB_FLAGS_SHIFT) - 1));
+    uint32_t flags = database_type[id] >> ESP_CONFIG_DB_FLAGS_SHIFT;
+    uint32_t value = database_value[id];
+    const char *payload = nullptr;
+    const char *key = key_at(ns, entry);
+    uint64_t scalar = 0;
+    std::size_t size = 0;
+
+    switch (encoding) {
+        case UINT8: return {key, encoding, {.uint8 = (uint8_t)value}, 0, flags};
+        case INT8: return {key, encoding, {.int8 = (int8_t)value}, 0, flags};
+        case UINT16: return {key, encoding, {.uint16 = (uint16_t)value}, 0, flags};
+        case INT16: return {key, encoding, {.int16 = (int16_t)value}, 0, flags};
+        case UINT32: return {key, encoding, {.uint32 = value}, 0, flags};
+        case INT32: return {key, encoding, {.int32 = (int32_t)value}, 0, flags};
+        case UINT64:
+        case INT64:
+            payload = &database_payload[value];
+            for (int i = 7; i >= 0; i--) {
+                scalar = (scalar << 8) | (uint8_t)payload[i];
+            }
+            if (encoding == UINT64) {
+                return {key, encoding, {.uint64 = scalar}, 0, flags};
+            }
+            return {key, encoding, {.int64 = (int64_t)scalar}, 0, flags};
+        default:
+            payload = &database_payload[value];
+            for (int shift = 0; ; shift += 7) {
+                size |= (std::size_t)((uint8_t)*payload & 0x7f) << shift;
+                if (!((uint8_t)*payload++ & 0x80)) {
+                    break;
+                }
+            }
+            if (encoding == STRING && !(flags & ESP_CONFIG_FLAG_COMPRESSED)) {
+                return {key, encoding, {.string = payload}, size, flags};
+            }
+            return {key, encoding, {.blob = payload}, size, flags};
+    }
+}
+
+#else
+
+constexpr const char* key_at(int ns, int entry) {
+    return database[ns].entries[entry].key;
+}
+
+constexpr esp_config_entry_t entry_at(int ns, int entry) {
+    return database[ns].entries[entry];
+}
+
+#endif
+
+/*
+ * Position of a key in the database, with the same global id as the
+ * tokens returned by esp_config_token_resolve(). id is -1 if not found.
+ */
+struct location {
+    int ns;
+    int entry;
+    int id;
+};
+
+constexpr location locate(const char *ns, const char *key) {
+    int base = 0;
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        if (equal(database[i].name, ns)) {
+            for (int j = 0; j < (int)database[i].nentries; j++) {
+                if (equal(key_at(i, j), key)) {
+                    return {i, j, base + j};
+                }
+            }
+        }
+        base += database[i].nentries;
+    }
+    return {0, 0, -1};
+}
+
+constexpr int keys() {
+    int count = 0;
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        count += database[i].nentries;
+    }
+    return count;
+}
+
+static_assert(keys() == ESP_CONFIG_DB_KEYS, "ESP_CONFIG_DB_KEYS differs from the number of keys in the database");
+
+template <esp_config_encoding_t E> struct value_type;
+template <> struct value_type<UINT8> { using type = uint8_t; };
+template <> struct value_type<INT8> { using type = int8_t; };
+template <> struct value_type<UINT16> { using type = uint16_t; };
+template <> struct value_type<INT16> { using type = int16_t; };
+template <> struct value_type<UINT32> { using type = uint32_t; };
+template <> struct value_type<INT32> { using type = int32_t; };
+template <> struct value_type<UINT64> { using type = uint64_t; };
+template <> struct value_type<INT64> { using type = int64_t; };
+template <> struct value_type<STRING> { using type = const char*; };
+template <> struct value_type<BLOB> { using type = const void*; };
+
+} // namespace detail
+
+/**
+ * @brief A configuration key, resolved at compile time.
+ *
+ * The getters follow the status codes of the matching esp_config_get_*
+ * functions in esp_config.h.
+ */
+template <fixed_string Ns, fixed_string Key>
+class key {
+
+    static constexpr detail::location where = detail::locate(Ns.value, Key.value);
+    static_assert(where.id >= 0, "Key not found in the defaults database");
+
+    static constexpr esp_config_entry_t entry = detail::entry_at(where.ns, where.entry);
+
+public:
+    static constexpr esp_config_encoding_t encoding = entry.encoding;
+    static constexpr bool frozen = (entry.flags & ESP_CONFIG_FLAG_FROZEN) != 0;
+    static constexpr bool compressed = (entry.flags & ESP_CONFIG_FLAG_COMPRESSED) != 0;
+    static constexpr bool variable = (encoding == STRING || encoding == BLOB);
+
+    /** Type of the value, const char* for strings and const void* for blobs */
+    using type = typename detail::value_type<encoding>::type;
+
+    /** Token of the key, for the esp_config_token_* functions */
+    static constexpr esp_config_token_t token = {
+        (uint16_t)where.id, (uint16_t)where.ns, (uint16_t)where.entry, (uint16_t)encoding
+    };
+
+    /** Default value, pointing into the database for strings and blobs, not available for compressed ones */
+    static constexpr type default_value() requires (!compressed) {
+        if constexpr (encoding == UINT8) return entry.value.uint8;
+        else if constexpr (encoding == INT8) return entry.value.int8;
+        else if constexpr (encoding == UINT16) return entry.value.uint16;
+        else if constexpr (encoding == INT16) return entry.value.int16;
+        else if constexpr (encoding == UINT32) return entry.value.uint32;
+        else if constexpr (encoding == INT32) return entry.value.int32;
+        else if constexpr (encoding == UINT64) return entry.value.uint64;
+        else if constexpr (encoding == INT64) return entry.value.int64;
+        else if constexpr (encoding == STRING) return entry.value.string;
+        else return entry.value.blob;
+    }
+
+    /** Size of the default value, the length for strings as in esp_config_get_str_default() */
+    static constexpr std::size_t default_size() requires (variable && !compressed) {
+        if constexpr (encoding == STRING) return detail::length(entry.value.string);
+        else return entry.value_size;
+    }
+
+    static type get() requires (!variable) {
+        type value = default_value();
+        if constexpr (!frozen) {
+            esp_config_token_get(token, &value, nullptr);
+        }
+        return value;
+    }
+
+    static int get(type &value) requires (!variable) {
+        if constexpr (frozen) {
+            value = default_value();
+            return 1;
+        } else {
+            return esp_config_token_get(token, &value, nullptr);
+        }
+    }
+
+    static int get(char *value, std::size_t *valuesize) requires (encoding == STRING) {
+        return esp_config_token_get(token, value, valuesize);
+    }
+
+    static int get(void *value, std::size_t *valuesize) requires (encoding == BLOB) {
+        return esp_config_token_get(token, value, valuesize);
+    }
+
+    /** See esp_config_get_str_ref() and esp_config_get_blob_ref() */
+    static int get_ref(type *value, std::size_t *valuesize) requires variable {
+        if constexpr (frozen && !compressed) {
+            *value = default_value();
+            *valuesize = default_size();
+            return 1;
+        } else if constexpr (encoding == STRING) {
+            return esp_config_token_get_str_ref(token, value, valuesize);
+        } else {
+            return esp_config_token_get_blob_ref(token, value, valuesize);
+        }
+    }
+
+    template <typename T>
+    static esp_err_t set(T value) requires (!variable) {
+        static_assert(std::is_same_v<T, type>, "Value type does not match the key encoding");
+        static_assert(!frozen, "Key is frozen");
+        return esp_config_token_set(token, &value, sizeof(value));
+    }
+
+    static esp_err_t set(const char *value) requires (encoding == STRING) {
+        static_assert(!frozen, "Key is frozen");
+        return esp_config_token_set(token, value, 0);
+    }
+
+    static esp_err_t set(const void *value, std::size_t valuesize) requires (encoding == BLOB) {
+        static_assert(!frozen, "Key is frozen");
+        return esp_config_token_set(token, value, valuesize);
+    }
+};
+
+/**
+ * @brief Retrieves an integer configuration value.
+ */
+template <fixed_string Ns, fixed_string Key>
+typename key<Ns, Key>::type get() {
+    return key<Ns, Key>::get();
+}
+
+/**
+ * @brief Retrieves an integer configuration value into a variable of the exact type.
+ *
+ * @return 0 if value found in NVS, 1 if value found in defaults database.
+ */
+template <fixed_string Ns, fixed_string Key, typename T>
+int get(T &value) {
+    static_assert(std::is_same_v<T, typename key<Ns, Key>::type>, "Value type does not match the key encoding");
+    return key<Ns, Key>::get(value);
+}
+
+/**
+ * @brief Retrieves the default value of a key, at compile time.
+ */
+template <fixed_string Ns, fixed_string Key>
+constexpr typename key<Ns, Key>::type get_default() {
+    return key<Ns, Key>::default_value();
+}
+
+/**
+ * @brief Sets an integer configuration value, which must have the exact type of the key.
+ *
+ * @return ESP_OK if success, other error codes if fail.
+ */
+template <fixed_string Ns, fixed_string Key, typename T>
+esp_err_t set(T value) {
+    return key<Ns, Key>::set(value);
+}
+
+} // namespace esp_config
+
+#endif /* COMPONENTS_ESP_CONFIG_HPP_ */
@@ -8,10 +8,10 @@
  * It is designed to be imported alongside esp_config.h.
  * 
  * To define a database, first define your namespaces and then refer them
- * from the database[] array as shown in the example below.
- *
- * TODO:
- * - Complete writing functions for missing types (such as UINT8 and UINT32) in config.h
+ * from the database[] array as shown in the example below. Alternatively,
+ * generate it from a schema with tools/esp_config_gen.py, which also
+ * computes the counts and sizes and a lookup index, and can pack the
+ * entries in a compact layout.
  */
 
 #ifndef COMPONENTS_ESP_CONFIG_DB_H_
@@ -42,6 +42,33 @@ typedef enum {
     BLOB
 } esp_config_encoding_t;
 
+/**
+ * @brief Configuration entry flags.
+ *
+ * ESP_CONFIG_FLAG_FROZEN marks a key that cannot be overridden: reads
+ * always return the default without looking at the NVS, and writes fail
+ * with ESP_ERR_NOT_SUPPORTED.
+ *
+ * ESP_CONFIG_FLAG_COMPRESSED marks a string or blob stored compressed,
+ * which requires CONFIG_ESP_CONFIG_COMPRESSION. Its default is given as
+ * .value.blob and .value_size, as output by tools/esp_config_compress.py,
+ * and its overrides are compressed in the NVS.
+ */
+#define ESP_CONFIG_FLAG_FROZEN (1 << 0)
+#define ESP_CONFIG_FLAG_COMPRESSED (1 << 1)
+
+/**
+ * @brief Qualifier of the database arrays.
+ *
+ * The arrays are constexpr in C++ so that esp_config.hpp can resolve
+ * keys at compile time.
+ */
+#ifdef __cplusplus
+#define ESP_CONFIG_DB_CONST constexpr
+#else
+#define ESP_CONFIG_DB_CONST const
+#endif
+
 /**
  * @brief Configuration entry structure.
  *
@@ -63,7 +90,8 @@ typedef struct {
         const char* string;
         const void* blob;
     } value;						/**< Default value */
-    const size_t value_size;
+    const size_t value_size;				/**< Size of blobs, and of strings with their terminator or 0 to compute it */
+    const uint32_t flags;					/**< ESP_CONFIG_FLAG_* */
 } esp_config_entry_t;
 
 /**
@@ -78,14 +106,66 @@ typedef struct {
     const esp_config_entry_t *entries;		/**< Pointer to the entries array */
 } esp_config_namespace_t;
 
+/**
+ * @brief Lookup index entry.
+ *
+ * Databases generated by tools/esp_config_gen.py define
+ * ESP_CONFIG_DB_SORTED and a database_index[] of one entry per key,
+ * sorted by hash, which is binary searched in place of the hash index
+ * built in RAM.
+ */
+typedef struct {
+    uint32_t hash;      /**< FNV-1a of namespace, 0xff and key */
+    uint16_t ns;        /**< Index in database[] */
+    uint16_t entry;     /**< Index in the namespace entries[] */
+    uint16_t id;        /**< Position of the entry across the whole database */
+} esp_config_db_index_t;
+
+/**
+ * @brief Compact database namespace.
+ *
+ * Databases generated by tools/esp_config_gen.py --compact define
+ * ESP_CONFIG_DB_COMPACT, and hold no esp_config_entry_t. The entries of
+ * all namespaces are laid out instead in arrays of one element per key,
+ * indexed by the position of the key across the whole database:
+ * - database_key[]: offset in database_keys[] of the key name, all names
+ *   being pooled there with their terminator
+ * - database_type[]: encoding, or'ed with the ESP_CONFIG_FLAG_* shifted
+ *   by ESP_CONFIG_DB_FLAGS_SHIFT
+ * - database_value[]: value of integers up to 32 bits, or offset in
+ *   database_payload[] of 64-bit integers, little endian, and of strings
+ *   and blobs, preceded by their size as a LEB128 varint
+ *
+ * This takes 7 bytes per key, plus the names and the payload, against
+ * sizeof(esp_config_entry_t) for other databases. The library decodes an
+ * entry from the arrays whenever it needs one.
+ */
+#define ESP_CONFIG_DB_FLAGS_SHIFT 4
+
+typedef struct {
+    const char *name;           /**< Namespace name */
+    const uint16_t nentries;    /**< Number of entries */
+    const uint16_t first;       /**< Position of its first entry across the whole database */
+} esp_config_db_compact_namespace_t;
+
+#ifdef ESP_CONFIG_DB_HEADER
+
+/*
+ * The database is defined in another header, named by the macro, such as
+ * one generated by tools/esp_config_gen.py. This is also used by the host
+ * benchmarks to build against generated databases.
+ */
+#include ESP_CONFIG_DB_HEADER
+
+#else
+
 /**
  * @brief EXAMPLE DEFINITION OF A NAMESPACE
  *
  * Here an example namespace and its key-value entries are
  * defined.
  */
-#define ESP_CONFIG_DB_ENTRIES_EXAMPLE 3
-static const esp_config_entry_t example[] = {
+static ESP_CONFIG_DB_CONST esp_config_entry_t example[] = {
     {
         .key = "i32",
         .encoding = INT32,
@@ -103,6 +183,7 @@ static const esp_config_entry_t example[] = {
         .value_size = 6
     }
 };
+#define ESP_CONFIG_DB_ENTRIES_EXAMPLE ((int)(sizeof(example) / sizeof(example[0])))
 
 /**
  * @brief DATABASE DEFINITION
@@ -110,14 +191,26 @@ static const esp_config_entry_t example[] = {
  * Here the defaults database is defined as an array of
  * esp_config_entry_t namespaces.
  */
-#define ESP_CONFIG_DB_ENTRIES 1
-static const esp_config_namespace_t database[] = {
+static ESP_CONFIG_DB_CONST esp_config_namespace_t database[] = {
     {
         .name = "example",
         .nentries = ESP_CONFIG_DB_ENTRIES_EXAMPLE,
         .entries = example
     }
 };
+#define ESP_CONFIG_DB_ENTRIES ((int)(sizeof(database) / sizeof(database[0])))
+
+/**
+ * @brief Total number of entries in the database
+ *
+ * Sum of the entry counts of all namespaces, one term per namespace.
+ * It sizes the lookup index and the per key tables: esp_config_init()
+ * fails if it differs from the number of keys in database[], and C++
+ * builds including esp_config.hpp do not compile.
+ */
+#define ESP_CONFIG_DB_KEYS (ESP_CONFIG_DB_ENTRIES_EXAMPLE)
+
+#endif /* ESP_CONFIG_DB_HEADER */
 
 
 #ifdef __cplusplus
@@ -0,0 +1,284 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_config_port.h"
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+struct esp_config_port_thread {
+    TaskHandle_t task;
+    SemaphoreHandle_t done;         /**< Given when the function returns, FreeRTOS tasks cannot be joined */
+    void (*function)(void *);
+    void *arg;
+};
+
+static SemaphoreHandle_t lock = NULL;
+
+void esp_config_port_lock() {
+
+    SemaphoreHandle_t created = NULL;
+    SemaphoreHandle_t expected = NULL;
+
+    // Created on first use, the loser of a concurrent creation deletes its own copy
+    if (__atomic_load_n(&lock, __ATOMIC_ACQUIRE) == NULL) {
+        created = xSemaphoreCreateRecursiveMutex();
+        assert(created != NULL);
+        if (!__atomic_compare_exchange_n(&lock, &expected, created, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            vSemaphoreDelete(created);
+        }
+    }
+
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+}
+
+void esp_config_port_unlock() {
+    xSemaphoreGiveRecursive(lock);
+}
+
+esp_config_port_mutex_t esp_config_port_mutex_create() {
+    return (esp_config_port_mutex_t)xSemaphoreCreateMutex();
+}
+
+void esp_config_port_mutex_delete(esp_config_port_mutex_t mutex) {
+    vSemaphoreDelete((SemaphoreHandle_t)mutex);
+}
+
+void esp_config_port_mutex_lock(esp_config_port_mutex_t mutex) {
+    xSemaphoreTake((SemaphoreHandle_t)mutex, portMAX_DELAY);
+}
+
+void esp_config_port_mutex_unlock(esp_config_port_mutex_t mutex) {
+    xSemaphoreGive((SemaphoreHandle_t)mutex);
+}
+
+esp_config_port_event_t esp_config_port_event_create() {
+    return (esp_config_port_event_t)xSemaphoreCreateBinary();
+}
+
+void esp_config_port_event_delete(esp_config_port_event_t event) {
+    vSemaphoreDelete((SemaphoreHandle_t)event);
+}
+
+void esp_config_port_event_signal(esp_config_port_event_t event) {
+    xSemaphoreGive((SemaphoreHandle_t)event);
+}
+
+bool esp_config_port_event_wait(esp_config_port_event_t event, uint32_t timeout_ms) {
+    return xSemaphoreTake((SemaphoreHandle_t)event, timeout_ms == ESP_CONFIG_PORT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+static void esp_config_port_thread_main(void *arg) {
+
+    esp_config_port_thread_t thread = arg;
+
+    thread->function(thread->arg);
+    xSemaphoreGive(thread->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_config_port_thread_start(const char *name, void (*function)(void *), void *arg, esp_config_port_thread_t *thread) {
+
+    *thread = calloc(1, sizeof(struct esp_config_port_thread));
+    if (*thread == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*thread)->function = function;
+    (*thread)->arg = arg;
+    (*thread)->done = xSemaphoreCreateBinary();
+    if ((*thread)->done == NULL
+            || xTaskCreate(esp_config_port_thread_main, name, CONFIG_ESP_CONFIG_TASK_STACK_SIZE, *thread, CONFIG_ESP_CONFIG_TASK_PRIORITY, &(*thread)->task) != pdPASS) {
+        if ((*thread)->done != NULL) {
+            vSemaphoreDelete((*thread)->done);
+        }
+        free(*thread);
+        *thread = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void esp_config_port_thread_join(esp_config_port_thread_t thread) {
+
+    xSemaphoreTake(thread->done, portMAX_DELAY);
+    vSemaphoreDelete(thread->done);
+    free(thread);
+}
+
+int64_t esp_config_port_time_us() {
+    return esp_timer_get_time();
+}
+
+#else /* ESP_PLATFORM */
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+struct esp_config_port_mutex {
+    pthread_mutex_t mutex;
+};
+
+struct esp_config_port_event {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signaled;
+};
+
+struct esp_config_port_thread {
+    pthread_t thread;
+    void (*function)(void *);
+    void *arg;
+};
+
+static pthread_mutex_t lock;
+static pthread_once_t lock_once = PTHREAD_ONCE_INIT;
+
+static void esp_config_port_lock_init() {
+
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void esp_config_port_lock() {
+    pthread_once(&lock_once, esp_config_port_lock_init);
+    pthread_mutex_lock(&lock);
+}
+
+void esp_config_port_unlock() {
+    pthread_mutex_unlock(&lock);
+}
+
+esp_config_port_mutex_t esp_config_port_mutex_create() {
+
+    esp_config_port_mutex_t mutex = calloc(1, sizeof(struct esp_config_port_mutex));
+
+    if (mutex != NULL) {
+        pthread_mutex_init(&mutex->mutex, NULL);
+    }
+
+    return mutex;
+}
+
+void esp_config_port_mutex_delete(esp_config_port_mutex_t mutex) {
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+void esp_config_port_mutex_lock(esp_config_port_mutex_t mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void esp_config_port_mutex_unlock(esp_config_port_mutex_t mutex) {
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+esp_config_port_event_t esp_config_port_event_create() {
+
+    esp_config_port_event_t event = calloc(1, sizeof(struct esp_config_port_event));
+    pthread_condattr_t attr;
+
+    if (event != NULL) {
+        pthread_mutex_init(&event->mutex, NULL);
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&event->cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    return event;
+}
+
+void esp_config_port_event_delete(esp_config_port_event_t event) {
+    pthread_cond_destroy(&event->cond);
+    pthread_mutex_destroy(&event->mutex);
+    free(event);
+}
+
+void esp_config_port_event_signal(esp_config_port_event_t event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = true;
+    pthread_cond_signal(&event->cond);
+    pthread_mutex_unlock(&event->mutex);
+}
+
+bool esp_config_port_event_wait(esp_config_port_event_t event, uint32_t timeout_ms) {
+
+    struct timespec deadline;
+    bool signaled = false;
+    int err = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    while (!event->signaled && err != ETIMEDOUT) {
+        if (timeout_ms == ESP_CONFIG_PORT_WAIT_FOREVER) {
+            pthread_cond_wait(&event->cond, &event->mutex);
+        } else {
+            err = pthread_cond_timedwait(&event->cond, &event->mutex, &deadline);
+        }
+    }
+    signaled = event->signaled;
+    event->signaled = false;
+    pthread_mutex_unlock(&event->mutex);
+
+    return signaled;
+}
+
+static void *esp_config_port_thread_main(void *arg) {
+
+    esp_config_port_thread_t thread = arg;
+
+    thread->function(thread->arg);
+    return NULL;
+}
+
+esp_err_t esp_config_port_thread_start(const char *name, void (*function)(void *), void *arg, esp_config_port_thread_t *thread) {
+
+    (void)name;
+
+    *thread = calloc(1, sizeof(struct esp_config_port_thread));
+    if (*thread == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*thread)->function = function;
+    (*thread)->arg = arg;
+    if (pthread_create(&(*thread)->thread, NULL, esp_config_port_thread_main, *thread) != 0) {
+        free(*thread);
+        *thread = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void esp_config_port_thread_join(esp_config_port_thread_t thread) {
+    pthread_join(thread->thread, NULL);
+    free(thread);
+}
+
+int64_t esp_config_port_time_us() {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#endif /* ESP_PLATFORM */
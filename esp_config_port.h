@@ -0,0 +1,93 @@
+/* @file esp_config_port.h
+ * @brief Platform abstraction for the esp_config library.
+ *
+ * Internal header. Wraps the few operating system primitives the library
+ * needs, so that it runs on FreeRTOS when built within ESP-IDF and on
+ * POSIX threads everywhere else.
+ */
+
+#ifndef COMPONENTS_ESP_CONFIG_PORT_H_
+#define COMPONENTS_ESP_CONFIG_PORT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_CONFIG_PORT_WAIT_FOREVER UINT32_MAX
+
+typedef struct esp_config_port_mutex *esp_config_port_mutex_t;
+typedef struct esp_config_port_event *esp_config_port_event_t;
+typedef struct esp_config_port_thread *esp_config_port_thread_t;
+
+/**
+ * @brief Takes the library lock.
+ *
+ * The lock is recursive, so it can be taken again by the task already
+ * holding it.
+ */
+void esp_config_port_lock();
+
+/**
+ * @brief Releases the library lock.
+ */
+void esp_config_port_unlock();
+
+/**
+ * @brief Creates a non-recursive mutex.
+ *
+ * @return The mutex, NULL if out of memory.
+ */
+esp_config_port_mutex_t esp_config_port_mutex_create();
+
+void esp_config_port_mutex_delete(esp_config_port_mutex_t mutex);
+void esp_config_port_mutex_lock(esp_config_port_mutex_t mutex);
+void esp_config_port_mutex_unlock(esp_config_port_mutex_t mutex);
+
+/**
+ * @brief Creates an auto-reset event.
+ *
+ * Signals do not accumulate: any number of signals sent while nobody
+ * waits wake up a single wait.
+ *
+ * @return The event, NULL if out of memory.
+ */
+esp_config_port_event_t esp_config_port_event_create();
+
+void esp_config_port_event_delete(esp_config_port_event_t event);
+void esp_config_port_event_signal(esp_config_port_event_t event);
+
+/**
+ * @brief Waits for an event to be signaled.
+ *
+ * @return true if the event was signaled, false on timeout.
+ */
+bool esp_config_port_event_wait(esp_config_port_event_t event, uint32_t timeout_ms);
+
+/**
+ * @brief Starts a thread, a FreeRTOS task on target.
+ *
+ * Stack size and priority come from the component configuration.
+ *
+ * @return ESP_OK if success, ESP_ERR_NO_MEM if the thread could not be created.
+ */
+esp_err_t esp_config_port_thread_start(const char *name, void (*function)(void *), void *arg, esp_config_port_thread_t *thread);
+
+/**
+ * @brief Waits for a thread to return and releases it.
+ */
+void esp_config_port_thread_join(esp_config_port_thread_t thread);
+
+/**
+ * @brief Monotonic time in microseconds.
+ */
+int64_t esp_config_port_time_us();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_ESP_CONFIG_PORT_H_ */
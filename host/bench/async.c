@@ -0,0 +1,206 @@
+/* @file async.c
+ * @brief Host test and benchmark of asynchronous configuration writes.
+ *
+ * The emulated NVS is slowed down to ASYNC_COMMIT_DELAY_US per commit, as
+ * a flash write would be. The program reports how long the caller is
+ * blocked per write, on average and at worst, and how long the writes
+ * take to complete, for:
+ *
+ * - set: esp_config_set(), blocking for the whole commit
+ * - async-burst: as many asynchronous writes as the queue holds
+ * - async-stream: more asynchronous writes than the queue holds, waiting
+ *   for space when it is full
+ *
+ * It checks that completions are reported in the order the writes were
+ * queued, that the last value queued for each key is the one in effect,
+ * that handles carry the result and the action taken, and that a full
+ * queue is reported with a zero timeout. It exits with 1 if any check
+ * failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define ASYNC_COMMIT_DELAY_US 1000
+#define ASYNC_WRITES 200
+
+typedef struct {
+    const char *name;
+    int64_t blocked_ns;
+    int64_t worst_ns;
+    int64_t elapsed_ns;
+    long ops;
+} async_result_t;
+
+static long completed = 0;
+
+/*
+ * Checks that writes complete in the order they were queued, arg being
+ * the sequence number of the write.
+ */
+static void async_completed(const char *ns, const char *key, esp_err_t result, esp_config_set_action_t action, void *arg) {
+
+    (void)ns;
+    (void)key;
+    (void)action;
+    harness_check(result == ESP_OK, "write result");
+    harness_check((long)(intptr_t)arg == completed, "completion order");
+    completed++;
+}
+
+/*
+ * Writes value i to one of four keys of every encoding in turn.
+ */
+static esp_err_t async_write(long i, bool async, uint32_t timeout_ms) {
+
+    static const char *keys[] = {"k0", "k1", "k3", "k4"};
+    static const esp_config_encoding_t encodings[] = {INT32, INT32, STRING, BLOB};
+    int32_t int32value = (int32_t)i + 1000;
+    char value[24];
+    const void *data = (i % 4 < 2) ? (const void*)&int32value : (const void*)value;
+
+    memset(value, 0, sizeof(value));
+    snprintf(value, sizeof(value), "value%d", (int)i);
+    if (!async) {
+        return esp_config_set("bench0", keys[i % 4], encodings[i % 4], data, sizeof(value), NULL);
+    }
+    return esp_config_set_async("bench0", keys[i % 4], encodings[i % 4], data, sizeof(value), timeout_ms,
+            async_completed, (void*)(intptr_t)i, NULL);
+}
+
+static void async_run(async_result_t *result, const char *name, bool async, long writes) {
+
+    int64_t start = 0;
+    int64_t blocked = 0;
+
+    esp_config_reset_namespace("bench0");
+    completed = 0;
+    result->name = name;
+    result->ops = writes;
+    result->blocked_ns = 0;
+    result->worst_ns = 0;
+    result->elapsed_ns = harness_now_ns();
+    for (long i = 0; i < writes; i++) {
+        start = harness_now_ns();
+        harness_check(async_write(i, async, ESP_CONFIG_ASYNC_WAIT_FOREVER) == ESP_OK, "write queued");
+        blocked = harness_now_ns() - start;
+        result->blocked_ns += blocked;
+        result->worst_ns = (blocked > result->worst_ns) ? blocked : result->worst_ns;
+    }
+    if (async) {
+        harness_check(esp_config_async_flush() == ESP_OK, "flush");
+        harness_check(completed == writes, "all writes completed");
+    }
+    result->elapsed_ns = harness_now_ns() - result->elapsed_ns;
+}
+
+static void async_print(const async_result_t *result) {
+    printf("%-14s %6ld %14.1f %14.1f %12.1f\n", result->name, result->ops,
+            result->blocked_ns / 1e3 / result->ops, result->worst_ns / 1e3, result->elapsed_ns / 1e6);
+}
+
+/*
+ * Checks that every key holds the last value written to it.
+ */
+static void async_check_values(long writes) {
+
+    int32_t int32value = 0;
+    char value[24];
+    char expected[24];
+    size_t size = 0;
+
+    for (long i = writes - 4; i < writes; i++) {
+        snprintf(expected, sizeof(expected), "value%d", (int)i);
+        size = sizeof(value);
+        switch (i % 4) {
+            case 0:
+                esp_config_get_i32("bench0", "k0", &int32value);
+                harness_check(int32value == i + 1000, "last value of k0");
+                break;
+            case 1:
+                esp_config_get_i32("bench0", "k1", &int32value);
+                harness_check(int32value == i + 1000, "last value of k1");
+                break;
+            case 2:
+                esp_config_get_str_into("bench0", "k3", value, &size);
+                harness_check(strcmp(value, expected) == 0, "last value of k3");
+                break;
+            default:
+                esp_config_get_blob_into("bench0", "k4", value, &size);
+                harness_check(size == sizeof(value) && strcmp(value, expected) == 0, "last value of k4");
+                break;
+        }
+    }
+}
+
+/*
+ * Checks the result and action carried by handles, and that a full
+ * queue is reported with a zero timeout.
+ */
+static void async_check_handles() {
+
+    esp_config_async_t handle;
+    int32_t value = 42;
+    long rejected = 0;
+
+    esp_config_reset_namespace("bench0");
+    harness_check(esp_config_set_async("bench0", "k0", INT32, &value, 0, 0, NULL, NULL, &handle) == ESP_OK, "write queued");
+    harness_check(esp_config_async_wait(&handle, ESP_CONFIG_ASYNC_WAIT_FOREVER) == ESP_OK, "handle result");
+    harness_check(handle.done && handle.action == ESP_CONFIG_SET_WRITTEN, "handle action written");
+    harness_check(esp_config_set_async("bench0", "k0", INT32, &value, 0, 0, NULL, NULL, &handle) == ESP_OK, "write queued");
+    harness_check(esp_config_async_wait(&handle, ESP_CONFIG_ASYNC_WAIT_FOREVER) == ESP_OK, "handle result");
+    harness_check(handle.action == ESP_CONFIG_SET_UNCHANGED, "handle action unchanged");
+    value = 0;
+    harness_check(esp_config_set_async("bench0", "k0", INT32, &value, 0, 0, NULL, NULL, &handle) == ESP_OK, "write queued");
+    harness_check(esp_config_async_wait(&handle, ESP_CONFIG_ASYNC_WAIT_FOREVER) == ESP_OK, "handle result");
+    harness_check(handle.action == ESP_CONFIG_SET_ERASED, "handle action erased");
+    harness_check(esp_config_set_async("bench0", "nokey", INT32, &value, 0, 0, NULL, NULL, &handle) == ESP_OK, "write queued");
+    harness_check(esp_config_async_wait(&handle, ESP_CONFIG_ASYNC_WAIT_FOREVER) == ESP_OK, "key outside the database");
+
+    completed = 0;
+    for (long i = 0; i < 2 * CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH + 2; i++) {
+        if (async_write(i - rejected, true, 0) == ESP_ERR_TIMEOUT) {
+            rejected++;
+        }
+    }
+    harness_check(rejected > 0, "full queue rejected");
+    harness_check(esp_config_async_flush() == ESP_OK, "flush");
+}
+
+int main() {
+
+    async_result_t result;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    nvs_host_set_commit_delay_us(ASYNC_COMMIT_DELAY_US);
+    esp_config_init();
+    esp_config_async_start();
+
+    printf("queue length %d, commit delay %d us\n", CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH, ASYNC_COMMIT_DELAY_US);
+    printf("%-14s %6s %14s %14s %12s\n", "workload", "writes", "blocked us/op", "worst us", "total ms");
+
+    async_run(&result, "set", false, ASYNC_WRITES);
+    async_print(&result);
+    async_check_values(ASYNC_WRITES);
+
+    async_run(&result, "async-burst", true, CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH);
+    async_print(&result);
+    async_check_values(CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH);
+
+    async_run(&result, "async-stream", true, ASYNC_WRITES);
+    async_print(&result);
+    async_check_values(ASYNC_WRITES);
+
+    async_check_handles();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,319 @@
+/* @file bench.c
+ * @brief Host microbenchmarks of esp_config.
+ *
+ * Built once per generated database size and configuration, see
+ * CMakeLists.txt. Each workload reports the time per operation and the
+ * number of nvs_* calls per operation, as counted by the emulated NVS:
+ *
+ * - resolve: lookups of keys in the defaults database
+ * - get-fallback: reads of keys not overridden, served by the defaults
+ * - set: one write of every key
+ * - get-hit: reads of keys overridden in the NVS
+ * - get-bulk: same, with one esp_config_get_bulk() per namespace
+ * - summary: esp_config_print_summary(), per key printed
+ *
+ * Wall times on the host only compare implementations with each other,
+ * the NVS call counts carry over to the device. The sizes of the database
+ * tables and data in flash and of the lookup index in RAM are reported
+ * first, to compare databases written by hand with those generated from a
+ * schema, in either layout.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define BENCH_TARGET_OPS 200000
+#define BENCH_INDEX_SLOT_SIZE 12 // sizeof(esp_config_index_slot_t) in esp_config.c
+
+/*
+ * What the workloads need to know of an entry.
+ */
+typedef struct {
+    const char *key;
+    esp_config_encoding_t encoding;
+    int32_t int32;
+} bench_key_t;
+
+typedef struct {
+    const char *name;
+    int64_t elapsed_ns;
+    long ops;
+    nvs_host_stats_t stats;
+} bench_result_t;
+
+static bench_key_t bench_key(int i, int j) {
+
+#ifdef ESP_CONFIG_DB_COMPACT
+    int id = database[i].first + j;
+    bench_key_t key = {
+        &database_keys[database_key[id]],
+        (esp_config_encoding_t)(database_type[id] & ((1 << ESP_CONFIG_DB_FLAGS_SHIFT) - 1)),
+        (int32_t)database_value[id]
+    };
+#else
+    bench_key_t key = {database[i].entries[j].key, database[i].entries[j].encoding, database[i].entries[j].value.int32};
+#endif
+
+    return key;
+}
+
+/*
+ * Reads one key with the getter matching its encoding.
+ */
+static void bench_get(const char *ns, bench_key_t entry) {
+
+    int32_t int32value = 0;
+    char buffer[32];
+    size_t size = sizeof(buffer);
+
+    switch (entry.encoding) {
+        case INT32:
+            esp_config_get_i32(ns, entry.key, &int32value);
+            break;
+        case STRING:
+            esp_config_get_str_into(ns, entry.key, buffer, &size);
+            break;
+        case BLOB:
+            esp_config_get_blob_into(ns, entry.key, buffer, &size);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Overrides one key with a value different from its default.
+ */
+static void bench_set(const char *ns, bench_key_t entry) {
+
+    static const char blob[10] = "overridden";
+
+    switch (entry.encoding) {
+        case INT32:
+            esp_config_set_i32(ns, entry.key, entry.int32 + 1); // Negating would leave a default of 0 unchanged
+            break;
+        case STRING:
+            esp_config_set_str(ns, entry.key, "overridden");
+            break;
+        case BLOB:
+            esp_config_set_blob(ns, entry.key, blob, sizeof(blob));
+            break;
+        default:
+            break;
+    }
+}
+
+static void bench_start(bench_result_t *result, const char *name) {
+    result->name = name;
+    result->ops = 0;
+    nvs_host_reset_stats();
+    result->elapsed_ns = harness_now_ns();
+}
+
+static void bench_stop(bench_result_t *result) {
+    result->elapsed_ns = harness_now_ns() - result->elapsed_ns;
+    nvs_host_get_stats(&result->stats);
+}
+
+static void bench_print(const bench_result_t *result) {
+
+    double ops = result->ops;
+
+    printf("%-14s %9ld %12.1f %9.3f %9.3f %9.3f %9.3f\n",
+            result->name, result->ops, result->elapsed_ns / ops,
+            result->stats.open / ops, result->stats.get / ops,
+            result->stats.set / ops, result->stats.commit / ops);
+}
+
+/*
+ * @return The size of the database tables, without the names and values
+ * they point to.
+ */
+static size_t bench_table_size() {
+
+    size_t size = sizeof(database);
+
+#ifdef ESP_CONFIG_DB_COMPACT
+    size += sizeof(database_key) + sizeof(database_type) + sizeof(database_value);
+#else
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        size += database[i].nentries * sizeof(esp_config_entry_t);
+    }
+#endif
+#ifdef ESP_CONFIG_DB_SORTED
+    size += sizeof(database_index);
+#endif
+
+    return size;
+}
+
+/*
+ * @return The size of the key names and of the string and blob values,
+ * pooled by compact databases and separate literals otherwise.
+ */
+static size_t bench_data_size() {
+
+#ifdef ESP_CONFIG_DB_COMPACT
+    return sizeof(database_keys) + sizeof(database_payload) - 2; // Without the terminators of the literals
+#else
+    size_t size = 0;
+    const esp_config_entry_t *entry = NULL;
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++) {
+            entry = &database[i].entries[j];
+            size += strlen(entry->key) + 1;
+            if (entry->encoding == STRING) {
+                size += strlen(entry->value.string) + 1;
+            } else if (entry->encoding == BLOB) {
+                size += entry->value_size;
+            }
+        }
+    }
+    return size;
+#endif
+}
+
+/*
+ * @return The size of the hash index built in RAM.
+ */
+static size_t bench_index_size() {
+#ifdef ESP_CONFIG_DB_SORTED
+    return 0;
+#else
+    return CONFIG_ESP_CONFIG_INDEX ? (2 * ESP_CONFIG_DB_KEYS + 1) * BENCH_INDEX_SLOT_SIZE : 0;
+#endif
+}
+
+static void bench_reads(bench_result_t *result, const char *name, int rounds) {
+
+    bench_start(result, name);
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+            for (unsigned int j = 0; j < database[i].nentries; j++) {
+                bench_get(database[i].name, bench_key(i, j));
+                result->ops++;
+            }
+        }
+    }
+    bench_stop(result);
+}
+
+/*
+ * Reads every key with one esp_config_get_bulk() per namespace, the
+ * values being strings and blobs of up to 32 bytes or int32_t.
+ */
+static void bench_reads_bulk(bench_result_t *result, const char *name, int rounds) {
+
+    esp_config_bulk_item_t *items = NULL;
+    char (*buffers)[32] = NULL;
+    unsigned int most = 0;
+    bench_key_t key;
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        most = (database[i].nentries > most) ? database[i].nentries : most;
+    }
+    items = calloc(most, sizeof(*items));
+    buffers = calloc(most, sizeof(*buffers));
+
+    bench_start(result, name);
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+            for (unsigned int j = 0; j < database[i].nentries; j++) {
+                key = bench_key(i, j);
+                items[j].key = key.key;
+                items[j].encoding = key.encoding;
+                items[j].value = buffers[j];
+                items[j].valuesize = sizeof(buffers[j]);
+            }
+            esp_config_get_bulk(database[i].name, items, database[i].nentries);
+            result->ops += database[i].nentries;
+        }
+    }
+    bench_stop(result);
+
+    free(items);
+    free(buffers);
+}
+
+int main() {
+
+    int rounds = BENCH_TARGET_OPS / ESP_CONFIG_DB_KEYS;
+    int summaries = rounds / 10;
+    int out = -1;
+    int null = -1;
+    bench_result_t result;
+    esp_config_token_t token;
+    bench_key_t key;
+
+    rounds = (rounds > 0) ? rounds : 1;
+    summaries = (summaries > 0) ? summaries : 1;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    printf("%d keys, %d namespaces, index %d, cache %d, handle pool %d\n",
+            ESP_CONFIG_DB_KEYS, ESP_CONFIG_DB_ENTRIES, CONFIG_ESP_CONFIG_INDEX,
+            CONFIG_ESP_CONFIG_CACHE, CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE);
+    printf("tables %zu bytes and data %zu bytes in flash, index %zu bytes in RAM\n", bench_table_size(), bench_data_size(), bench_index_size());
+    printf("%-14s %9s %12s %9s %9s %9s %9s\n", "workload", "ops", "ns/op", "open/op", "get/op", "set/op", "commit/op");
+
+    bench_start(&result, "resolve");
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+            for (unsigned int j = 0; j < database[i].nentries; j++) {
+                key = bench_key(i, j);
+                esp_config_token_resolve(database[i].name, key.key, key.encoding, &token);
+                result.ops++;
+            }
+        }
+    }
+    bench_stop(&result);
+    bench_print(&result);
+
+    bench_reads(&result, "get-fallback", rounds);
+    bench_print(&result);
+
+    bench_start(&result, "set");
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        for (unsigned int j = 0; j < database[i].nentries; j++) {
+            bench_set(database[i].name, bench_key(i, j));
+            result.ops++;
+        }
+    }
+    bench_stop(&result);
+    bench_print(&result);
+
+    bench_reads(&result, "get-hit", rounds);
+    bench_print(&result);
+
+    bench_reads_bulk(&result, "get-bulk", rounds);
+    bench_print(&result);
+
+    // The summary goes to stdout, which is muted meanwhile
+    fflush(stdout);
+    out = dup(STDOUT_FILENO);
+    null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    bench_start(&result, "summary");
+    for (int i = 0; i < summaries; i++) {
+        esp_config_print_summary();
+        result.ops += ESP_CONFIG_DB_KEYS;
+    }
+    fflush(stdout);
+    bench_stop(&result);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    bench_print(&result);
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+    return 0;
+}
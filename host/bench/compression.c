@@ -0,0 +1,252 @@
+/* @file compression.c
+ * @brief Host benchmark of compressed strings and blobs.
+ *
+ * The database of gen_compression_db.py holds every sample value twice,
+ * as is in namespace "raw" and compressed in namespace "packed". For each
+ * sample and namespace, the benchmark reports the size of the default in
+ * flash, the size of an override in the NVS and the number of 32-byte
+ * NVS entries it takes, and the time to read the default, to write the
+ * override and to read it back.
+ *
+ * It also checks, for each sample, that both namespaces read back the
+ * raw value as default, as override, once set back to the default, which
+ * erases the override, and once the override is erased with
+ * esp_config_reset_key(). It exits with 1 if any check failed.
+ *
+ * Built with and without decompressed defaults kept in RAM, see
+ * CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define COMPRESSION_ROUNDS 2000
+#define COMPRESSION_NVS_ENTRY 32
+
+/*
+ * Reads a key into buffer, COMPRESSION_ROUNDS times.
+ *
+ * @return The time per read in ns.
+ */
+static double compression_get(const char *ns, const esp_config_entry_t *entry, void *buffer, size_t buffersize) {
+
+    size_t size = 0;
+    int64_t start = harness_now_ns();
+
+    for (int i = 0; i < COMPRESSION_ROUNDS; i++) {
+        size = buffersize;
+        if (entry->encoding == STRING) {
+            esp_config_get_str_into(ns, entry->key, buffer, &size);
+        } else {
+            esp_config_get_blob_into(ns, entry->key, buffer, &size);
+        }
+    }
+
+    return (double)(harness_now_ns() - start) / COMPRESSION_ROUNDS;
+}
+
+/*
+ * Writes a key COMPRESSION_ROUNDS times, alternating two values.
+ *
+ * @return The time per write in ns.
+ */
+static double compression_set(const char *ns, const esp_config_entry_t *entry, uint8_t *value, size_t size) {
+
+    int64_t start = harness_now_ns();
+
+    for (int i = 0; i < COMPRESSION_ROUNDS; i++) {
+        value[0] = 'a' + i % 2; // Differs from the default, so that every write is stored
+        if (entry->encoding == STRING) {
+            esp_config_set_str(ns, entry->key, (const char*)value);
+        } else {
+            esp_config_set_blob(ns, entry->key, value, size);
+        }
+    }
+
+    return (double)(harness_now_ns() - start) / COMPRESSION_ROUNDS;
+}
+
+/*
+ * @return The size of the override of a key as stored in the NVS.
+ */
+static size_t compression_stored(const char *ns, const char *key) {
+
+    nvs_handle handle;
+    size_t size = 0;
+
+    if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK) {
+        return 0;
+    }
+    if (nvs_get_str(handle, key, NULL, &size) != ESP_OK && nvs_get_blob(handle, key, NULL, &size) != ESP_OK) {
+        size = 0;
+    }
+    nvs_close(handle);
+
+    return size;
+}
+
+/*
+ * Reads a sample from both namespaces.
+ *
+ * @return true if both read status, and the size and bytes of expected.
+ */
+static bool compression_read(unsigned int j, int status, const uint8_t *expected, size_t size, uint8_t *buffer) {
+
+    size_t read = 0;
+    int got = -1;
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        const esp_config_entry_t *entry = &database[i].entries[j];
+
+        read = size;
+        if (entry->encoding == STRING) {
+            got = esp_config_get_str_into(database[i].name, entry->key, (char*)buffer, &read);
+        } else {
+            got = esp_config_get_blob_into(database[i].name, entry->key, buffer, &read);
+        }
+        if (got != status || read != size || memcmp(buffer, expected, size) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Writes a sample to both namespaces.
+ *
+ * @return true if both writes succeeded and left an override in the NVS
+ *         if stored, none otherwise.
+ */
+static bool compression_write(unsigned int j, const uint8_t *value, size_t size, bool stored) {
+
+    esp_err_t esperr = ESP_FAIL;
+
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        const esp_config_entry_t *entry = &database[i].entries[j];
+
+        if (entry->encoding == STRING) {
+            esperr = esp_config_set_str(database[i].name, entry->key, (const char*)value);
+        } else {
+            esperr = esp_config_set_blob(database[i].name, entry->key, value, size);
+        }
+        if (esperr != ESP_OK || (compression_stored(database[i].name, entry->key) > 0) != stored) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Checks that the packed copy of a sample reads as its raw copy, through
+ * overrides and back to the default.
+ */
+static void compression_check(unsigned int j) {
+
+    const esp_config_entry_t *raw = &database[0].entries[j];
+    const uint8_t *def = raw->value.blob;
+    size_t size = raw->value_size;
+    uint8_t *buffer = malloc(size);
+    uint8_t *value = malloc(size);
+    char what[64];
+    bool reset = true;
+
+    if (buffer == NULL || value == NULL) {
+        harness_check(false, "sample buffers allocated");
+        free(buffer);
+        free(value);
+        return;
+    }
+    memcpy(value, def, size);
+    value[0] = def[0] == 'a' ? 'b' : 'a'; // Keeps strings terminated
+
+    snprintf(what, sizeof(what), "%s read as default", raw->key);
+    harness_check(compression_read(j, 3, def, size, buffer), what);
+
+    snprintf(what, sizeof(what), "%s overridden", raw->key);
+    harness_check(compression_write(j, value, size, true), what);
+    snprintf(what, sizeof(what), "%s read as override", raw->key);
+    harness_check(compression_read(j, 2, value, size, buffer), what);
+
+    snprintf(what, sizeof(what), "%s set back to the default", raw->key);
+    harness_check(compression_write(j, def, size, false), what);
+    snprintf(what, sizeof(what), "%s read as default once set back", raw->key);
+    harness_check(compression_read(j, 3, def, size, buffer), what);
+
+    compression_write(j, value, size, true);
+    for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+        reset = esp_config_reset_key(database[i].name, raw->key) == ESP_OK
+                && compression_stored(database[i].name, raw->key) == 0 && reset;
+    }
+    snprintf(what, sizeof(what), "%s override erased", raw->key);
+    harness_check(reset, what);
+    snprintf(what, sizeof(what), "%s read as default once erased", raw->key);
+    harness_check(compression_read(j, 3, def, size, buffer), what);
+
+    free(buffer);
+    free(value);
+}
+
+int main() {
+
+    size_t size = 0;
+    size_t stored = 0;
+    uint8_t *buffer = NULL;
+    uint8_t *value = NULL;
+    double get_default = 0;
+    double set = 0;
+    double get_nvs = 0;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    printf("decompressed defaults kept in RAM: %d bytes\n", CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE);
+    printf("%-8s %-7s %7s %7s %7s %7s %12s %12s %12s\n",
+            "sample", "ns", "size", "flash", "nvs", "entries", "get-default", "set", "get-nvs");
+
+    for (unsigned int j = 0; j < database[0].nentries; j++) {
+        compression_check(j);
+    }
+
+    for (unsigned int j = 0; j < database[0].nentries; j++) {
+        for (int i = 0; i < ESP_CONFIG_DB_ENTRIES; i++) {
+            const esp_config_entry_t *entry = &database[i].entries[j];
+
+            size = 0;
+            if (entry->encoding == STRING) {
+                esp_config_get_str_default(database[i].name, entry->key, NULL, &size);
+                size++;
+            } else {
+                esp_config_get_blob_default(database[i].name, entry->key, NULL, &size);
+            }
+            buffer = malloc(size);
+            value = malloc(size);
+            if (buffer == NULL || value == NULL) {
+                return 1;
+            }
+
+            get_default = compression_get(database[i].name, entry, buffer, size);
+            memcpy(value, buffer, size);
+            set = compression_set(database[i].name, entry, value, size);
+            get_nvs = compression_get(database[i].name, entry, buffer, size);
+            stored = compression_stored(database[i].name, entry->key);
+
+            printf("%-8s %-7s %7zu %7zu %7zu %7zu %12.0f %12.0f %12.0f\n",
+                    entry->key, database[i].name, size, entry->value_size, stored,
+                    1 + (stored + COMPRESSION_NVS_ENTRY - 1) / COMPRESSION_NVS_ENTRY, get_default, set, get_nvs);
+
+            free(buffer);
+            free(value);
+        }
+    }
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+    return harness_result();
+}
@@ -0,0 +1,205 @@
+/* @file concurrency.c
+ * @brief Host stress test and read scaling benchmark of esp_config.
+ *
+ * One writer thread keeps rewriting the keys of a generated database with
+ * values of changing sizes, and setting them back to their defaults, while
+ * a growing number of reader threads read them. Every value read is
+ * checked to be either the default or a value the writer could have set
+ * as a whole, so that a torn read is caught. The program reports the reads
+ * per second for each number of readers, and exits with 1 if any read was
+ * inconsistent.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt, with the
+ * snapshot read under the library lock, with lock-free snapshot reads, and
+ * without snapshot.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define CONCURRENCY_MAX_READERS 8
+#define CONCURRENCY_RUN_MS 500
+#define CONCURRENCY_MAX_SIZE 40
+
+typedef struct {
+    long reads;
+    char padding[64 - sizeof(long)]; // One cache line per reader, so that counting does not limit scaling
+} concurrency_reader_t;
+
+static bool running = false;
+static long writes = 0;
+static long inconsistent = 0;
+
+/*
+ * Writes round r to one key: a value of 1 to CONCURRENCY_MAX_SIZE bytes
+ * all equal to one character for strings and blobs, a value with equal
+ * halves for integers, or the default every seventh round.
+ */
+static void concurrency_write(const esp_config_entry_t *entry, long r) {
+
+    char value[CONCURRENCY_MAX_SIZE + 1];
+    size_t size = 1 + r % CONCURRENCY_MAX_SIZE;
+    int32_t int32value = (int32_t)((r & 0x7fff) * 0x10001);
+
+    if (r % 7 == 0) {
+        switch (entry->encoding) {
+            case INT32:
+                esp_config_set_i32("bench0", entry->key, entry->value.int32);
+                break;
+            case STRING:
+                esp_config_set_str("bench0", entry->key, entry->value.string);
+                break;
+            case BLOB:
+                esp_config_set_blob("bench0", entry->key, entry->value.blob, entry->value_size);
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+
+    memset(value, 'a' + r % 26, size);
+    value[size] = '\0';
+    switch (entry->encoding) {
+        case INT32:
+            esp_config_set_i32("bench0", entry->key, int32value);
+            break;
+        case STRING:
+            esp_config_set_str("bench0", entry->key, value);
+            break;
+        case BLOB:
+            esp_config_set_blob("bench0", entry->key, value, size);
+            break;
+        default:
+            break;
+    }
+}
+
+static void* concurrency_writer(void *arg) {
+
+    long r = 0;
+
+    (void)arg;
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        for (unsigned int j = 0; j < database[0].nentries && __atomic_load_n(&running, __ATOMIC_RELAXED); j++) {
+            concurrency_write(&database[0].entries[j], r);
+        }
+        r++;
+        __atomic_fetch_add(&writes, database[0].nentries, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+static bool concurrency_uniform(const char *value, size_t size) {
+
+    for (size_t i = 1; i < size; i++) {
+        if (value[i] != value[0]) {
+            return false;
+        }
+    }
+    return size > 0 && value[0] >= 'a' && value[0] <= 'z';
+}
+
+/*
+ * Reads one key and checks the value.
+ *
+ * @return true if the value is consistent.
+ */
+static bool concurrency_read(const esp_config_entry_t *entry) {
+
+    int32_t int32value = 0;
+    char value[CONCURRENCY_MAX_SIZE + 1];
+    size_t size = sizeof(value);
+    int status = -1;
+
+    switch (entry->encoding) {
+        case INT32:
+            status = esp_config_get_i32("bench0", entry->key, &int32value);
+            return (status == 1 && int32value == entry->value.int32)
+                    || (status == 0 && (int32value & 0xffff) == ((int32value >> 16) & 0xffff));
+        case STRING:
+            status = esp_config_get_str_into("bench0", entry->key, value, &size);
+            return (status == 3 && strcmp(value, entry->value.string) == 0)
+                    || (status == 2 && size == strlen(value) + 1 && concurrency_uniform(value, size - 1));
+        case BLOB:
+            status = esp_config_get_blob_into("bench0", entry->key, value, &size);
+            return (status == 3 && size == entry->value_size && memcmp(value, entry->value.blob, size) == 0)
+                    || (status == 2 && concurrency_uniform(value, size));
+        default:
+            return true;
+    }
+}
+
+static void* concurrency_reader(void *arg) {
+
+    concurrency_reader_t *reader = arg;
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        for (unsigned int j = 0; j < database[0].nentries; j++) {
+            if (!concurrency_read(&database[0].entries[j])) {
+                __atomic_fetch_add(&inconsistent, 1, __ATOMIC_RELAXED);
+            }
+        }
+        reader->reads += database[0].nentries;
+    }
+
+    return NULL;
+}
+
+int main() {
+
+    pthread_t writer;
+    pthread_t readers[CONCURRENCY_MAX_READERS];
+    concurrency_reader_t readers_state[CONCURRENCY_MAX_READERS];
+    long total = 0;
+    int64_t elapsed_ns = 0;
+    struct timespec run = {CONCURRENCY_RUN_MS / 1000, (CONCURRENCY_RUN_MS % 1000) * 1000000L};
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    printf("snapshot %d, lock-free reads %d, cache %d\n",
+            CONFIG_ESP_CONFIG_SNAPSHOT, CONFIG_ESP_CONFIG_LOCKFREE_READS, CONFIG_ESP_CONFIG_CACHE);
+    printf("%-8s %14s %14s %12s\n", "readers", "reads/s", "reads/s/thread", "writes/s");
+
+    for (int n = 1; n <= CONCURRENCY_MAX_READERS; n *= 2) {
+        __atomic_store_n(&running, true, __ATOMIC_RELAXED);
+        writes = 0;
+        elapsed_ns = harness_now_ns();
+        pthread_create(&writer, NULL, concurrency_writer, NULL);
+        for (int i = 0; i < n; i++) {
+            readers_state[i].reads = 0;
+            pthread_create(&readers[i], NULL, concurrency_reader, &readers_state[i]);
+        }
+        nanosleep(&run, NULL);
+        __atomic_store_n(&running, false, __ATOMIC_RELAXED);
+        for (int i = 0; i < n; i++) {
+            pthread_join(readers[i], NULL);
+        }
+        pthread_join(writer, NULL);
+        elapsed_ns = harness_now_ns() - elapsed_ns;
+
+        total = 0;
+        for (int i = 0; i < n; i++) {
+            total += readers_state[i].reads;
+        }
+        printf("%-8d %14.0f %14.0f %12.0f\n", n, total * 1e9 / elapsed_ns,
+                total * 1e9 / elapsed_ns / n, writes * 1e9 / elapsed_ns);
+    }
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    if (inconsistent > 0) {
+        printf("%ld inconsistent reads\n", inconsistent);
+    }
+    harness_check(inconsistent == 0, "consistent reads");
+    return harness_result();
+}
@@ -0,0 +1,175 @@
+/* @file gc.c
+ * @brief Host test and benchmark of the NVS garbage collection pass.
+ *
+ * Checks that a pass reports overrides of keys removed from the database
+ * as stale and overrides of the wrong type as mismatching, erases them
+ * only when asked to, leaves live overrides and namespaces outside the
+ * database alone, and runs within its budget. It exits with 1 if any
+ * check failed.
+ *
+ * It then reports the time per NVS entry visited, and the longest step,
+ * of a reporting pass and of an erasing pass over the 100 keys overridden
+ * and as many stale entries.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define GC_STALE 100
+#define GC_BUDGET 16
+
+
+static void gc_count(const esp_config_gc_entry_t *entry, void *arg) {
+    (void)entry;
+    (*(long*)arg)++;
+}
+
+/*
+ * Writes entries of the namespace bench0 that the database does not
+ * define, bypassing the library.
+ */
+static void gc_write_stale(int count) {
+
+    nvs_handle handle;
+    char key[16];
+
+    nvs_open("bench0", NVS_READWRITE, &handle);
+    for (int i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "gone%d", i);
+        nvs_set_i32(handle, key, i);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+/*
+ * Runs a pass to its end with the given budget per step.
+ *
+ * @return The number of steps, or -1 on error.
+ */
+static long gc_run(esp_config_gc_t gc, uint32_t budget, int64_t *longest) {
+
+    bool done = false;
+    long steps = 0;
+    int64_t elapsed = 0;
+
+    *longest = 0;
+    while (!done) {
+        elapsed = harness_now_ns();
+        if (esp_config_gc_step(gc, budget, &done) != ESP_OK) {
+            return -1;
+        }
+        elapsed = harness_now_ns() - elapsed;
+        *longest = (elapsed > *longest) ? elapsed : *longest;
+        steps++;
+    }
+    return steps;
+}
+
+static void gc_check_pass() {
+
+    nvs_handle handle;
+    esp_config_gc_t gc;
+    esp_config_gc_usage_t usage;
+    int32_t value = 0;
+    long visited = 0;
+    long steps = 0;
+    int64_t longest = 0;
+
+    esp_config_reset_namespace("bench0");
+    esp_config_set_i32("bench0", "k1", 11);
+    esp_config_set_str("bench0", "k3", "live");
+    gc_write_stale(2);
+    nvs_open("bench0", NVS_READWRITE, &handle);
+    nvs_set_str(handle, "k0", "wrong type");
+    nvs_commit(handle);
+    nvs_close(handle);
+    nvs_open("other", NVS_READWRITE, &handle);
+    nvs_set_i32(handle, "gone0", 1);
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    harness_check(esp_config_gc_begin(false, gc_count, &visited, &gc) == ESP_OK, "begin report");
+    steps = gc_run(gc, 1, &longest);
+    harness_check(visited >= 5 && steps >= visited, "one entry per step"); // Plus the snapshot, if any
+    harness_check(esp_config_gc_get_usage(gc, 0, &usage) == ESP_OK && strcmp(usage.ns, "bench0") == 0, "usage of bench0");
+    harness_check(usage.keys[ESP_CONFIG_GC_LIVE] == 2 && usage.keys[ESP_CONFIG_GC_STALE] == 2 && usage.keys[ESP_CONFIG_GC_MISMATCH] == 1, "entries classified");
+    harness_check(usage.slots[ESP_CONFIG_GC_LIVE] == 3 && usage.slots[ESP_CONFIG_GC_MISMATCH] == 2, "slots counted");
+    harness_check(usage.erased == 0, "nothing erased when reporting");
+    harness_check(esp_config_gc_get_usage(gc, 1, &usage) == ESP_OK && strcmp(usage.ns, "esp_config") == 0, "usage of the library namespace");
+    harness_check(esp_config_gc_get_usage(gc, 2, &usage) == ESP_ERR_NOT_FOUND, "usage past the end");
+    esp_config_gc_end(gc);
+
+    harness_check(esp_config_gc_begin(true, NULL, NULL, &gc) == ESP_OK, "begin erase");
+    harness_check(gc_run(gc, GC_BUDGET, &longest) > 0, "erasing pass");
+    esp_config_gc_get_usage(gc, 0, &usage);
+    harness_check(usage.erased == 3, "stale and mismatching erased");
+    esp_config_gc_end(gc);
+
+    nvs_open("bench0", NVS_READONLY, &handle);
+    harness_check(nvs_get_i32(handle, "gone0", &value) == ESP_ERR_NVS_NOT_FOUND, "stale entry gone");
+    nvs_close(handle);
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 0, "default back in effect");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 0 && value == 11, "live override kept");
+    nvs_open("other", NVS_READONLY, &handle);
+    harness_check(nvs_get_i32(handle, "gone0", &value) == ESP_OK, "other namespace untouched");
+    nvs_close(handle);
+
+    esp_config_gc_begin(false, NULL, NULL, &gc);
+    esp_config_gc_end(gc);
+    esp_config_reset_namespace("bench0");
+}
+
+static void gc_bench(const char *name, bool erase) {
+
+    esp_config_gc_t gc;
+    esp_config_gc_usage_t usage;
+    long visited = 0;
+    int64_t longest = 0;
+    int64_t elapsed = 0;
+
+    esp_config_gc_begin(erase, gc_count, &visited, &gc);
+    elapsed = harness_now_ns();
+    gc_run(gc, GC_BUDGET, &longest);
+    elapsed = harness_now_ns() - elapsed;
+    esp_config_gc_get_usage(gc, 0, &usage);
+    esp_config_gc_end(gc);
+
+    printf("%-10s %8ld %8u %12.1f %12lld\n", name, visited, (unsigned)usage.erased,
+        elapsed / (double)(visited > 0 ? visited : 1), (long long)longest);
+}
+
+int main() {
+
+    char key[8];
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    gc_check_pass();
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        if (i % 5 < 3) {
+            esp_config_set_i32("bench0", key, i + 1);
+        }
+    }
+    gc_write_stale(GC_STALE);
+
+    printf("%d entries per step\n", GC_BUDGET);
+    printf("%-10s %8s %8s %12s %12s\n", "pass", "entries", "erased", "ns/entry", "longest ns");
+    gc_bench("report", false);
+    gc_bench("erase", true);
+    gc_bench("clean", false);
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Generates the defaults database of the compression benchmark.
+
+The same sample values are defined twice, uncompressed in namespace "raw"
+and compressed with tools/esp_config_compress.py in namespace "packed":
+a JSON document, a PEM certificate, a calibration table and a sparse
+blob.
+
+Usage: gen_compression_db.py OUTPUT
+"""
+
+import base64
+import json
+import math
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools"))
+import esp_config_compress  # noqa: E402
+
+
+def samples():
+    rand = random.Random(1)
+    document = {
+        "wifi": {"ssid": "factory-floor", "channel": 6, "power_save": True},
+        "mqtt": {"host": "broker.example.com", "port": 8883, "keepalive": 60, "qos": 1},
+        "sensors": [
+            {"name": "sensor%d" % n, "pin": n, "interval_ms": 1000 * (n % 5 + 1), "enabled": n % 3 != 0}
+            for n in range(24)
+        ],
+    }
+    text = json.dumps(document, indent=2).encode()
+    der = bytes(rand.getrandbits(8) for _ in range(900))
+    pem = b"-----BEGIN CERTIFICATE-----\n"
+    pem += b"\n".join(base64.encodebytes(der).split(b"\n"))
+    pem += b"-----END CERTIFICATE-----\n"
+    table = b"".join(int(2000 * math.sin(n / 80) + 2048).to_bytes(2, "little") for n in range(512))
+    sparse = bytearray(1024)
+    for n in range(0, 1024, 97):
+        sparse[n] = n & 0xff
+    return [
+        ("json", "STRING", text + b"\0"),
+        ("pem", "STRING", pem + b"\0"),
+        ("table", "BLOB", table),
+        ("sparse", "BLOB", bytes(sparse)),
+    ]
+
+
+def c_bytes(name, data):
+    lines = ["static const uint8_t %s[%d] = {" % (name, len(data))]
+    for start in range(0, len(data), 16):
+        lines.append("    " + " ".join("0x%02x," % byte for byte in data[start:start + 16]))
+    lines.append("};")
+    return lines
+
+
+def generate():
+    lines = ["/* Generated by gen_compression_db.py, do not edit. */", ""]
+    raw = []
+    packed = []
+    for name, encoding, data in samples():
+        lines += c_bytes("raw_" + name, data)
+        lines += c_bytes("packed_" + name, esp_config_compress.compress(data))
+        lines.append("")
+        raw.append('    {.key = "%s", .encoding = %s, .value = {.blob = raw_%s}, .value_size = sizeof(raw_%s)},'
+                   % (name, encoding, name, name))
+        packed.append('    {.key = "%s", .encoding = %s, .value = {.blob = packed_%s}, .value_size = sizeof(packed_%s),'
+                      ' .flags = ESP_CONFIG_FLAG_COMPRESSED},' % (name, encoding, name, name))
+
+    count = len(raw)
+    lines.append("static ESP_CONFIG_DB_CONST esp_config_entry_t raw[] = {")
+    lines += raw
+    lines.append("};")
+    lines.append("static ESP_CONFIG_DB_CONST esp_config_entry_t packed[] = {")
+    lines += packed
+    lines.append("};")
+    lines.append("")
+    lines.append("#define ESP_CONFIG_DB_ENTRIES 2")
+    lines.append("static ESP_CONFIG_DB_CONST esp_config_namespace_t database[] = {")
+    lines.append('    {.name = "raw", .nentries = %d, .entries = raw},' % count)
+    lines.append('    {.name = "packed", .nentries = %d, .entries = packed},' % count)
+    lines.append("};")
+    lines.append("")
+    lines.append("#define ESP_CONFIG_DB_KEYS %d" % (2 * count))
+    lines.append("")
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "w") as output:
+        output.write(generate())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Generates a defaults database header for the host benchmarks.
+
+The header is meant to be selected with -DESP_CONFIG_DB_HEADER and holds
+KEYS entries spread over namespaces of at most 100 keys. Three out of
+five keys are int32 values, the others alternate between strings and
+blobs. With --schema, the same keys are written as a schema for
+tools/esp_config_gen.py instead. With DECLARED, ESP_CONFIG_DB_KEYS is
+set to it instead of KEYS, for checks of a miscounted database.
+
+Usage: gen_db.py [--schema] KEYS OUTPUT [DECLARED]
+"""
+
+import json
+import sys
+
+KEYS_PER_NAMESPACE = 100
+
+
+def entry(index):
+    key = "k%d" % index
+    kind = index % 5
+    if kind < 3:
+        return '    {.key = "%s", .encoding = INT32, .value = {.int32 = %d}},' % (key, index)
+    if kind == 3:
+        return '    {.key = "%s", .encoding = STRING, .value = {.string = "value%d"}},' % (key, index)
+    return '    {.key = "%s", .encoding = BLOB, .value = {.blob = "blob%06d"}, .value_size = 10},' % (key, index)
+
+
+def generate(keys, declared):
+    lines = [
+        "/* Generated by gen_db.py, do not edit. */",
+        "",
+        "#define ESP_CONFIG_BENCH_KEYS %d" % keys,
+        "",
+    ]
+    namespaces = []
+    for first in range(0, keys, KEYS_PER_NAMESPACE):
+        count = min(KEYS_PER_NAMESPACE, keys - first)
+        name = "bench%d" % len(namespaces)
+        lines.append("static ESP_CONFIG_DB_CONST esp_config_entry_t %s[] = {" % name)
+        lines.extend(entry(index) for index in range(first, first + count))
+        lines.append("};")
+        lines.append("")
+        namespaces.append((name, count))
+
+    lines.append("#define ESP_CONFIG_DB_ENTRIES %d" % len(namespaces))
+    lines.append("static ESP_CONFIG_DB_CONST esp_config_namespace_t database[] = {")
+    for name, count in namespaces:
+        lines.append('    {.name = "%s", .nentries = %d, .entries = %s},' % (name, count, name))
+    lines.append("};")
+    lines.append("")
+    lines.append("#define ESP_CONFIG_DB_KEYS %d" % declared)
+    lines.append("")
+    return "\n".join(lines)
+
+
+def generate_schema(keys):
+    schema = {}
+    for index in range(keys):
+        kind = index % 5
+        if kind < 3:
+            spec = {"type": "i32", "default": index}
+        elif kind == 3:
+            spec = {"type": "string", "default": "value%d" % index}
+        else:
+            spec = {"type": "blob", "default": "blob%06d" % index}
+        schema.setdefault("bench%d" % (index // KEYS_PER_NAMESPACE), {})["k%d" % index] = spec
+    return json.dumps(schema, indent=1) + "\n"
+
+
+def main():
+    args = sys.argv[1:]
+    schema = bool(args) and args[0] == "--schema"
+    if schema:
+        args = args[1:]
+    if len(args) not in (2, 3) or (schema and len(args) == 3):
+        sys.exit(__doc__)
+    keys = int(args[0])
+    declared = int(args[2]) if len(args) == 3 else keys
+    with open(args[1], "w") as output:
+        output.write(generate_schema(keys) if schema else generate(keys, declared))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,237 @@
+/* @file subscriptions.c
+ * @brief Host test and benchmark of configuration change notifications.
+ *
+ * Checks that subscribers of a key and of a namespace are called with the
+ * new value after esp_config_set(), esp_config_reset_key(),
+ * esp_config_reset_namespace() and esp_config_batch_commit(), that
+ * unchanged values, other keys and cancelled subscriptions are not
+ * notified, and that a full subscription table is reported. Also checks
+ * that callbacks run outside the library lock: one waits for another
+ * thread writing the configuration, and one cancels its own subscription.
+ * It exits with 1 if any check failed.
+ *
+ * It then reports the time per esp_config_set() of a key:
+ *
+ * - none: without any subscription
+ * - other-keys: with every subscription taken by other keys
+ * - same-key: with one subscription to the key written
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define SUBSCRIPTIONS_WRITES 2000
+#define SUBSCRIPTIONS_WAIT_MS 1000
+
+typedef struct {
+    long calls;
+    char key[16];
+    esp_config_source_t source;
+    int32_t int32;
+    char string[32];
+} subscriptions_seen_t;
+
+
+/*
+ * Records the last change notified, arg being a subscriptions_seen_t.
+ */
+static void subscriptions_changed(const esp_config_item_t *item, void *arg) {
+
+    subscriptions_seen_t *seen = arg;
+
+    seen->calls++;
+    snprintf(seen->key, sizeof(seen->key), "%s", item->key);
+    seen->source = item->source;
+    if (item->encoding == INT32) {
+        memcpy(&seen->int32, item->value, sizeof(seen->int32));
+    } else if (item->encoding == STRING && item->value != NULL) {
+        snprintf(seen->string, sizeof(seen->string), "%s", (const char*)item->value);
+    }
+}
+
+static void subscriptions_count(const esp_config_item_t *item, void *arg) {
+    (void)item;
+    (*(long*)arg)++;
+}
+
+typedef struct {
+    pthread_t thread;
+    bool written;           /**< Set by the thread once its write returned */
+    bool waited;            /**< The callback saw the write done */
+    long calls;
+    esp_config_subscription_t subscription;
+    esp_err_t unsubscribed;
+} subscriptions_nested_t;
+
+static void* subscriptions_write(void *arg) {
+
+    subscriptions_nested_t *nested = arg;
+
+    esp_config_set_i32("bench0", "k2", 5);
+    __atomic_store_n(&nested->written, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * Waits for another thread to write the configuration, which would never
+ * happen if callbacks held the library lock.
+ */
+static void subscriptions_wait_for_writer(const esp_config_item_t *item, void *arg) {
+
+    subscriptions_nested_t *nested = arg;
+    struct timespec pause = {0, 1000000};
+
+    (void)item;
+    pthread_create(&nested->thread, NULL, subscriptions_write, nested);
+    for (int i = 0; i < SUBSCRIPTIONS_WAIT_MS && !__atomic_load_n(&nested->written, __ATOMIC_ACQUIRE); i++) {
+        nanosleep(&pause, NULL);
+    }
+    nested->waited = __atomic_load_n(&nested->written, __ATOMIC_ACQUIRE);
+}
+
+static void subscriptions_unsubscribe_self(const esp_config_item_t *item, void *arg) {
+
+    subscriptions_nested_t *nested = arg;
+
+    (void)item;
+    nested->calls++;
+    nested->unsubscribed = esp_config_unsubscribe(nested->subscription);
+}
+
+static void subscriptions_check_nested() {
+
+    subscriptions_nested_t waiting = {0};
+    subscriptions_nested_t self = {0};
+    esp_config_subscription_t subscription;
+    int32_t value = 0;
+
+    esp_config_subscribe("bench0", "k1", subscriptions_wait_for_writer, &waiting, &subscription);
+    esp_config_set_i32("bench0", "k1", 11);
+    pthread_join(waiting.thread, NULL);
+    harness_check(waiting.waited, "callback waiting for another writer");
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 0 && value == 5, "write of the other thread");
+    esp_config_unsubscribe(subscription);
+
+    esp_config_subscribe("bench0", "k1", subscriptions_unsubscribe_self, &self, &self.subscription);
+    esp_config_set_i32("bench0", "k1", 12);
+    esp_config_set_i32("bench0", "k1", 13);
+    harness_check(self.calls == 1 && self.unsubscribed == ESP_OK, "callback cancelling its subscription");
+    esp_config_reset_namespace("bench0");
+}
+
+static void subscriptions_check_changes() {
+
+    subscriptions_seen_t key = {0};
+    subscriptions_seen_t ns = {0};
+    esp_config_subscription_t keysub;
+    esp_config_subscription_t nssub;
+    esp_config_batch_t batch;
+
+    esp_config_reset_namespace("bench0");
+    harness_check(esp_config_subscribe("bench0", "k0", subscriptions_changed, &key, &keysub) == ESP_OK, "subscribe key");
+    harness_check(esp_config_subscribe("bench0", NULL, subscriptions_changed, &ns, &nssub) == ESP_OK, "subscribe namespace");
+    harness_check(esp_config_subscribe("bench0", "nokey", subscriptions_changed, &key, &keysub) == ESP_ERR_NOT_FOUND, "key outside the database");
+
+    esp_config_set_i32("bench0", "k0", 42);
+    harness_check(key.calls == 1 && key.int32 == 42 && key.source == ESP_CONFIG_SOURCE_NVS, "key set");
+    harness_check(ns.calls == 1 && strcmp(ns.key, "k0") == 0, "namespace set");
+
+    esp_config_set_i32("bench0", "k0", 42);
+    harness_check(key.calls == 1, "unchanged value not notified");
+
+    esp_config_set_str("bench0", "k3", "changed");
+    harness_check(key.calls == 1, "other key not notified");
+    harness_check(ns.calls == 2 && strcmp(ns.string, "changed") == 0, "namespace string set");
+
+    esp_config_reset_key("bench0", "k0");
+    harness_check(key.calls == 2 && key.int32 == 0 && key.source == ESP_CONFIG_SOURCE_DEFAULT, "key reset");
+
+    esp_config_set_i32("bench0", "k0", 0);
+    harness_check(key.calls == 2, "default not overridden not notified");
+
+    esp_config_batch_begin(&batch);
+    esp_config_batch_set_i32(batch, "bench0", "k0", 7);
+    esp_config_batch_set_str(batch, "bench0", "k8", "batched");
+    esp_config_batch_commit(batch);
+    harness_check(key.calls == 3 && key.int32 == 7, "batch commit");
+    harness_check(strcmp(ns.string, "batched") == 0, "namespace batch commit");
+
+    ns.calls = 0;
+    esp_config_reset_namespace("bench0");
+    harness_check(key.calls == 4 && key.int32 == 0 && key.source == ESP_CONFIG_SOURCE_DEFAULT, "namespace reset");
+    harness_check(ns.calls == 100, "every key of the namespace reset");
+
+    harness_check(esp_config_unsubscribe(keysub) == ESP_OK, "unsubscribe key");
+    harness_check(esp_config_unsubscribe(keysub) == ESP_ERR_INVALID_ARG, "unsubscribe twice");
+    esp_config_set_i32("bench0", "k0", 1);
+    harness_check(key.calls == 4, "cancelled subscription not notified");
+    harness_check(esp_config_unsubscribe(nssub) == ESP_OK, "unsubscribe namespace");
+    esp_config_reset_namespace("bench0");
+}
+
+/*
+ * Fills the table with subscriptions to keys other than k0, checking that
+ * one more is rejected.
+ */
+static void subscriptions_fill(esp_config_subscription_t *taken, long *calls) {
+
+    char key[8];
+    esp_config_subscription_t extra;
+
+    for (int i = 0; i < CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS; i++) {
+        snprintf(key, sizeof(key), "k%d", 1 + i % 99);
+        harness_check(esp_config_subscribe("bench0", key, subscriptions_count, calls, &taken[i]) == ESP_OK, "subscribe other key");
+    }
+    harness_check(esp_config_subscribe("bench0", "k0", subscriptions_count, calls, &extra) == ESP_ERR_NO_MEM, "full table rejected");
+}
+
+static void subscriptions_run(const char *name) {
+
+    int64_t elapsed = harness_now_ns();
+
+    for (long i = 0; i < SUBSCRIPTIONS_WRITES; i++) {
+        esp_config_set_i32("bench0", "k0", (int32_t)i + 1);
+    }
+    elapsed = harness_now_ns() - elapsed;
+    printf("%-14s %6d %12.1f\n", name, SUBSCRIPTIONS_WRITES, elapsed / (double)SUBSCRIPTIONS_WRITES);
+}
+
+int main() {
+
+    esp_config_subscription_t taken[CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS];
+    esp_config_subscription_t same;
+    long calls = 0;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    subscriptions_check_changes();
+    subscriptions_check_nested();
+
+    printf("%d subscriptions at most\n", CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS);
+    printf("%-14s %6s %12s\n", "workload", "writes", "ns/op");
+
+    subscriptions_run("none");
+
+    subscriptions_fill(taken, &calls);
+    subscriptions_run("other-keys");
+    harness_check(calls == 0, "other keys not notified");
+
+    esp_config_unsubscribe(taken[0]);
+    esp_config_subscribe("bench0", "k0", subscriptions_count, &calls, &same);
+    subscriptions_run("same-key");
+    harness_check(calls == SUBSCRIPTIONS_WRITES, "every write notified");
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,48 @@
+/* @file harness.h
+ * @brief Shared harness of the host checks and benchmarks.
+ *
+ * Each program is a single translation unit including this header once.
+ * Failed checks are counted, from any thread, and turned by
+ * harness_result() into the exit status CTest reads.
+ */
+
+#ifndef HOST_HARNESS_H_
+#define HOST_HARNESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static long harness_errors = 0;
+
+static inline int64_t harness_now_ns() {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static inline void harness_check(bool condition, const char *what) {
+    if (!condition) {
+        printf("failed: %s\n", what);
+        __atomic_fetch_add(&harness_errors, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * @return The exit status of the program, 1 if any check failed.
+ */
+static inline int harness_result() {
+
+    long errors = __atomic_load_n(&harness_errors, __ATOMIC_RELAXED);
+
+    if (errors > 0) {
+        printf("%ld failed checks\n", errors);
+        return 1;
+    }
+    return 0;
+}
+
+#endif /* HOST_HARNESS_H_ */
@@ -0,0 +1,54 @@
+/* @file esp_log.h
+ * @brief Host stand-in for the ESP-IDF logging macros.
+ *
+ * Log lines go to stderr so that they do not mix with summaries printed
+ * on stdout. Debug and verbose levels are compiled out. As on the device,
+ * esp_log_level_set() silences the lower levels at runtime, which the
+ * benchmarks use to keep logging out of the measurements.
+ */
+
+#ifndef HOST_ESP_LOG_H_
+#define HOST_ESP_LOG_H_
+
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+extern esp_log_level_t esp_log_host_level;
+
+/**
+ * @brief Sets the log level. The host build has a single level for all tags.
+ */
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+#define ESP_LOG_HOST(level, letter, tag, format, ...) \
+    do { \
+        if (esp_log_host_level >= (level)) { \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, format, ...) do { (void)(tag); } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_ESP_LOG_H_ */
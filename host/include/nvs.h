@@ -0,0 +1,154 @@
+/* @file nvs.h
+ * @brief Host stand-in for the ESP-IDF NVS API.
+ *
+ * Declares the subset of the nvs_* functions used by esp_config, with the
+ * same signatures and error codes as ESP-IDF v4.4. The implementation in
+ * nvs_host.c keeps all data in memory and can optionally persist it to a
+ * file.
+ */
+
+#ifndef HOST_NVS_H_
+#define HOST_NVS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t nvs_handle_t;
+typedef nvs_handle_t nvs_handle;
+
+#define NVS_DEFAULT_PART_NAME "nvs"
+#define NVS_PART_NAME_MAX_SIZE 16
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+typedef nvs_open_mode_t nvs_open_mode;
+
+typedef enum {
+    NVS_TYPE_U8    = 0x01,
+    NVS_TYPE_I8    = 0x11,
+    NVS_TYPE_U16   = 0x02,
+    NVS_TYPE_I16   = 0x12,
+    NVS_TYPE_U32   = 0x04,
+    NVS_TYPE_I32   = 0x14,
+    NVS_TYPE_U64   = 0x08,
+    NVS_TYPE_I64   = 0x18,
+    NVS_TYPE_STR   = 0x21,
+    NVS_TYPE_BLOB  = 0x42,
+    NVS_TYPE_ANY   = 0xff
+} nvs_type_t;
+
+typedef struct {
+    char namespace_name[16];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_type_t type;
+} nvs_entry_info_t;
+
+typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+esp_err_t nvs_open_from_partition(const char *part_name, const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char *key, int8_t value);
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value);
+esp_err_t nvs_set_i16(nvs_handle_t handle, const char *key, int16_t value);
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value);
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value);
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char *key, int64_t value);
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value);
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *out_value);
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value);
+esp_err_t nvs_get_i16(nvs_handle_t handle, const char *key, int16_t *out_value);
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value);
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value);
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char *key, int64_t *out_value);
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out_value);
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length);
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_erase_all(nvs_handle_t handle);
+
+nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type);
+nvs_iterator_t nvs_entry_next(nvs_iterator_t iterator);
+void nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info);
+void nvs_release_iterator(nvs_iterator_t iterator);
+
+/**
+ * @brief Host-only counters of nvs_* calls, used by the benchmarks.
+ */
+typedef struct {
+    uint32_t open;          /**< nvs_open / nvs_open_from_partition calls */
+    uint32_t close;         /**< nvs_close calls */
+    uint32_t get;           /**< nvs_get_* calls */
+    uint32_t set;           /**< nvs_set_* calls */
+    uint32_t erase;         /**< nvs_erase_* calls */
+    uint32_t commit;        /**< nvs_commit calls */
+} nvs_host_stats_t;
+
+/**
+ * @brief Returns the current host NVS call counters.
+ */
+void nvs_host_get_stats(nvs_host_stats_t *stats);
+
+/**
+ * @brief Resets the host NVS call counters.
+ */
+void nvs_host_reset_stats(void);
+
+/**
+ * @brief Backs the emulated NVS with a file.
+ *
+ * The file is loaded immediately if it exists and rewritten on every
+ * nvs_commit(). Pass NULL to go back to a purely in-memory store.
+ */
+esp_err_t nvs_host_set_file(const char *path);
+
+/**
+ * @brief Adds an artificial delay to every nvs_commit(), emulating flash writes.
+ */
+void nvs_host_set_commit_delay_us(uint32_t delay_us);
+
+/**
+ * @brief Calls hook with the key after every nvs_get_* call, found or not.
+ *
+ * Lets host checks act between a read of the emulated NVS and what the
+ * reader does with the value. Pass NULL to remove the hook.
+ */
+void nvs_host_set_get_hook(void (*hook)(const char *key, void *arg), void *arg);
+
+/**
+ * @brief Calls hook after every successful nvs_commit().
+ *
+ * Detaching the backing file from the hook emulates a power loss right
+ * after that commit. Pass NULL to remove the hook.
+ */
+void nvs_host_set_commit_hook(void (*hook)(void *arg), void *arg);
+
+/**
+ * @brief Makes nvs_set_* calls fail with ESP_ERR_NVS_NOT_ENOUGH_SPACE once count more have succeeded.
+ *
+ * Pass -1 to stop failing.
+ */
+void nvs_host_fail_sets_after(int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_NVS_H_ */
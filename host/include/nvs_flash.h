@@ -0,0 +1,25 @@
+/* @file nvs_flash.h
+ * @brief Host stand-in for the ESP-IDF NVS flash API.
+ */
+
+#ifndef HOST_NVS_FLASH_H_
+#define HOST_NVS_FLASH_H_
+
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_init_partition(const char *partition_label);
+esp_err_t nvs_flash_deinit(void);
+esp_err_t nvs_flash_deinit_partition(const char *partition_label);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_flash_erase_partition(const char *part_name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_NVS_FLASH_H_ */
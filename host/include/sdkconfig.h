@@ -0,0 +1,100 @@
+/* @file sdkconfig.h
+ * @brief Host configuration for esp_config.
+ *
+ * Mirrors the options in the component Kconfig, with the same defaults.
+ * Every option can be overridden from the compiler command line, e.g.
+ * -DCONFIG_ESP_CONFIG_INDEX=0.
+ */
+
+#ifndef HOST_SDKCONFIG_H_
+#define HOST_SDKCONFIG_H_
+
+#ifndef CONFIG_ESP_CONFIG_INDEX
+#define CONFIG_ESP_CONFIG_INDEX 1
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_CACHE
+#define CONFIG_ESP_CONFIG_CACHE 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_CACHE_LOAD_AT_INIT
+#define CONFIG_ESP_CONFIG_CACHE_LOAD_AT_INIT 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE
+#define CONFIG_ESP_CONFIG_HANDLE_POOL_SIZE 8
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_BATCH_JOURNAL
+#define CONFIG_ESP_CONFIG_BATCH_JOURNAL 1
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_WRITE_BEHIND
+#define CONFIG_ESP_CONFIG_WRITE_BEHIND 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_ASYNC_SET
+#define CONFIG_ESP_CONFIG_ASYNC_SET 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH
+#define CONFIG_ESP_CONFIG_ASYNC_QUEUE_LENGTH 16
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+#define CONFIG_ESP_CONFIG_SUBSCRIPTIONS 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS
+#define CONFIG_ESP_CONFIG_MAX_SUBSCRIPTIONS 16
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_SNAPSHOT
+#define CONFIG_ESP_CONFIG_SNAPSHOT 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_LOCKFREE_READS
+#define CONFIG_ESP_CONFIG_LOCKFREE_READS 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_LAYERS
+#define CONFIG_ESP_CONFIG_LAYERS 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_MAX_LAYERS
+#define CONFIG_ESP_CONFIG_MAX_LAYERS 2
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_BLOB_STREAMING
+#define CONFIG_ESP_CONFIG_BLOB_STREAMING 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE
+#define CONFIG_ESP_CONFIG_BLOB_CHUNK_SIZE 1024
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_COMPRESSION
+#define CONFIG_ESP_CONFIG_COMPRESSION 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE
+#define CONFIG_ESP_CONFIG_INFLATED_CACHE_SIZE 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_STATS
+#define CONFIG_ESP_CONFIG_STATS 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_LOG_MISSES
+#define CONFIG_ESP_CONFIG_LOG_MISSES 0
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_TASK_STACK_SIZE
+#define CONFIG_ESP_CONFIG_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef CONFIG_ESP_CONFIG_TASK_PRIORITY
+#define CONFIG_ESP_CONFIG_TASK_PRIORITY 2
+#endif
+
+#endif /* HOST_SDKCONFIG_H_ */
@@ -0,0 +1,671 @@
+/* @file nvs_host.c
+ * @brief In-memory NVS emulation for host builds.
+ *
+ * Implements the nvs_* calls used by esp_config on top of a hash table
+ * keyed by (partition, namespace, key). Values are applied immediately,
+ * as in ESP-IDF, and nvs_commit() only persists the store when it is
+ * backed by a file. All calls are serialized by a single mutex, which
+ * plays the role of the NVS internal lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define NVS_HOST_MAX_HANDLES 256
+#define NVS_HOST_MAX_PARTITIONS 8
+#define NVS_HOST_MAX_NAMESPACES 254
+#define NVS_HOST_STR_MAX 4000
+#define NVS_HOST_BLOB_MAX 508000
+#define NVS_HOST_NAME_MAX 15
+
+typedef struct {
+    char part[NVS_PART_NAME_MAX_SIZE];
+    char ns[16];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_type_t type;
+    size_t size;
+    uint8_t *data;
+    int next;           /**< Next item in the same bucket, -1 terminates */
+    bool used;
+} nvs_host_item_t;
+
+typedef struct {
+    char part[NVS_PART_NAME_MAX_SIZE];
+    char ns[16];
+    nvs_open_mode_t mode;
+    bool used;
+} nvs_host_handle_t;
+
+typedef struct {
+    char name[NVS_PART_NAME_MAX_SIZE];
+    bool initialized;
+} nvs_host_partition_t;
+
+typedef struct {
+    char part[NVS_PART_NAME_MAX_SIZE];
+    char ns[16];
+    bool used;
+} nvs_host_namespace_t;
+
+struct nvs_opaque_iterator_t {
+    char part[NVS_PART_NAME_MAX_SIZE];
+    char ns[16];
+    nvs_type_t type;
+    int position;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static nvs_host_item_t *items = NULL;
+static int items_capacity = 0;
+static int *buckets = NULL;
+static int buckets_count = 0;
+static int items_used = 0;
+
+static nvs_host_handle_t handles[NVS_HOST_MAX_HANDLES];
+static nvs_host_partition_t partitions[NVS_HOST_MAX_PARTITIONS];
+static nvs_host_namespace_t namespaces[NVS_HOST_MAX_NAMESPACES];
+
+static nvs_host_stats_t stats;
+static char *backing_file = NULL;
+static uint32_t commit_delay_us = 0;
+static void (*get_hook)(const char *key, void *arg) = NULL;
+static void *get_hook_arg = NULL;
+static void (*commit_hook)(void *arg) = NULL;
+static void *commit_hook_arg = NULL;
+static int sets_before_failure = -1;
+
+#define STAT_INC(field) __atomic_fetch_add(&stats.field, 1, __ATOMIC_RELAXED)
+
+static uint32_t nvs_host_hash(const char *part, const char *ns, const char *key) {
+    uint32_t hash = 2166136261u;
+    const char *strings[3] = {part, ns, key};
+    for (int i = 0; i < 3; i++) {
+        for (const char *c = strings[i]; *c != '\0'; c++) {
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+        }
+        hash = (hash ^ 0xff) * 16777619u;
+    }
+    return hash;
+}
+
+static void nvs_host_rehash(int count) {
+    free(buckets);
+    buckets = malloc(count * sizeof(int));
+    if (buckets == NULL) {
+        abort();
+    }
+    buckets_count = count;
+    for (int i = 0; i < count; i++) {
+        buckets[i] = -1;
+    }
+    for (int i = 0; i < items_capacity; i++) {
+        if (items[i].used) {
+            uint32_t bucket = nvs_host_hash(items[i].part, items[i].ns, items[i].key) & (count - 1);
+            items[i].next = buckets[bucket];
+            buckets[bucket] = i;
+        }
+    }
+}
+
+static int nvs_host_find(const char *part, const char *ns, const char *key) {
+    if (buckets_count == 0) {
+        return -1;
+    }
+    uint32_t bucket = nvs_host_hash(part, ns, key) & (buckets_count - 1);
+    for (int i = buckets[bucket]; i != -1; i = items[i].next) {
+        if (strcmp(items[i].key, key) == 0 && strcmp(items[i].ns, ns) == 0 && strcmp(items[i].part, part) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void nvs_host_unlink(int index) {
+    uint32_t bucket = nvs_host_hash(items[index].part, items[index].ns, items[index].key) & (buckets_count - 1);
+    int *link = &buckets[bucket];
+    while (*link != index) {
+        link = &items[*link].next;
+    }
+    *link = items[index].next;
+    free(items[index].data);
+    items[index].data = NULL;
+    items[index].used = false;
+    items_used--;
+}
+
+static int nvs_host_insert(const char *part, const char *ns, const char *key) {
+    if (items_used + 1 > buckets_count / 2) {
+        nvs_host_rehash(buckets_count == 0 ? 64 : buckets_count * 2);
+    }
+    int index = -1;
+    for (int i = 0; i < items_capacity; i++) {
+        if (!items[i].used) {
+            index = i;
+            break;
+        }
+    }
+    if (index == -1) {
+        int capacity = items_capacity == 0 ? 64 : items_capacity * 2;
+        nvs_host_item_t *grown = realloc(items, capacity * sizeof(nvs_host_item_t));
+        if (grown == NULL) {
+            abort();
+        }
+        memset(&grown[items_capacity], 0, (capacity - items_capacity) * sizeof(nvs_host_item_t));
+        index = items_capacity;
+        items = grown;
+        items_capacity = capacity;
+    }
+    nvs_host_item_t *item = &items[index];
+    memset(item, 0, sizeof(*item));
+    strcpy(item->part, part);
+    strcpy(item->ns, ns);
+    strcpy(item->key, key);
+    item->used = true;
+    uint32_t bucket = nvs_host_hash(part, ns, key) & (buckets_count - 1);
+    item->next = buckets[bucket];
+    buckets[bucket] = index;
+    items_used++;
+    return index;
+}
+
+static nvs_host_partition_t *nvs_host_partition(const char *name) {
+    for (int i = 0; i < NVS_HOST_MAX_PARTITIONS; i++) {
+        if (partitions[i].initialized && strcmp(partitions[i].name, name) == 0) {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+static bool nvs_host_namespace_exists(const char *part, const char *ns) {
+    for (int i = 0; i < NVS_HOST_MAX_NAMESPACES; i++) {
+        if (namespaces[i].used && strcmp(namespaces[i].part, part) == 0 && strcmp(namespaces[i].ns, ns) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t nvs_host_namespace_create(const char *part, const char *ns) {
+    if (nvs_host_namespace_exists(part, ns)) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < NVS_HOST_MAX_NAMESPACES; i++) {
+        if (!namespaces[i].used) {
+            strcpy(namespaces[i].part, part);
+            strcpy(namespaces[i].ns, ns);
+            namespaces[i].used = true;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+static nvs_host_handle_t *nvs_host_handle(nvs_handle_t handle) {
+    if (handle == 0 || handle > NVS_HOST_MAX_HANDLES || !handles[handle - 1].used) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static void nvs_host_save(void) {
+    if (backing_file == NULL) {
+        return;
+    }
+    FILE *file = fopen(backing_file, "wb");
+    if (file == NULL) {
+        return;
+    }
+    for (int i = 0; i < NVS_HOST_MAX_NAMESPACES; i++) {
+        if (namespaces[i].used) {
+            uint8_t tag = 'N';
+            fwrite(&tag, 1, 1, file);
+            fwrite(namespaces[i].part, 1, sizeof(namespaces[i].part), file);
+            fwrite(namespaces[i].ns, 1, sizeof(namespaces[i].ns), file);
+        }
+    }
+    for (int i = 0; i < items_capacity; i++) {
+        if (items[i].used) {
+            uint8_t tag = 'I';
+            uint32_t type = items[i].type;
+            uint32_t size = items[i].size;
+            fwrite(&tag, 1, 1, file);
+            fwrite(items[i].part, 1, sizeof(items[i].part), file);
+            fwrite(items[i].ns, 1, sizeof(items[i].ns), file);
+            fwrite(items[i].key, 1, sizeof(items[i].key), file);
+            fwrite(&type, sizeof(type), 1, file);
+            fwrite(&size, sizeof(size), 1, file);
+            fwrite(items[i].data, 1, size, file);
+        }
+    }
+    fclose(file);
+}
+
+static void nvs_host_clear(const char *part) {
+    for (int i = 0; i < items_capacity; i++) {
+        if (items[i].used && (part == NULL || strcmp(items[i].part, part) == 0)) {
+            nvs_host_unlink(i);
+        }
+    }
+    for (int i = 0; i < NVS_HOST_MAX_NAMESPACES; i++) {
+        if (namespaces[i].used && (part == NULL || strcmp(namespaces[i].part, part) == 0)) {
+            namespaces[i].used = false;
+        }
+    }
+}
+
+static void nvs_host_load(void) {
+    FILE *file = fopen(backing_file, "rb");
+    if (file == NULL) {
+        return;
+    }
+    nvs_host_clear(NULL);
+    uint8_t tag;
+    while (fread(&tag, 1, 1, file) == 1) {
+        char part[NVS_PART_NAME_MAX_SIZE];
+        char ns[16];
+        if (fread(part, 1, sizeof(part), file) != sizeof(part) || fread(ns, 1, sizeof(ns), file) != sizeof(ns)) {
+            break;
+        }
+        if (tag == 'N') {
+            nvs_host_namespace_create(part, ns);
+            continue;
+        }
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        uint32_t type, size;
+        if (fread(key, 1, sizeof(key), file) != sizeof(key) || fread(&type, sizeof(type), 1, file) != 1 || fread(&size, sizeof(size), 1, file) != 1) {
+            break;
+        }
+        uint8_t *data = malloc(size > 0 ? size : 1);
+        if (data == NULL || fread(data, 1, size, file) != size) {
+            free(data);
+            break;
+        }
+        int index = nvs_host_insert(part, ns, key);
+        items[index].type = (nvs_type_t)type;
+        items[index].size = size;
+        items[index].data = data;
+    }
+    fclose(file);
+}
+
+esp_err_t nvs_flash_init_partition(const char *partition_label) {
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&lock);
+    if (nvs_host_partition(partition_label) == NULL) {
+        err = ESP_ERR_NO_MEM;
+        for (int i = 0; i < NVS_HOST_MAX_PARTITIONS; i++) {
+            if (!partitions[i].initialized) {
+                strncpy(partitions[i].name, partition_label, NVS_PART_NAME_MAX_SIZE - 1);
+                partitions[i].initialized = true;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return nvs_flash_init_partition(NVS_DEFAULT_PART_NAME);
+}
+
+esp_err_t nvs_flash_deinit_partition(const char *partition_label) {
+    esp_err_t err = ESP_ERR_NVS_NOT_INITIALIZED;
+    pthread_mutex_lock(&lock);
+    nvs_host_partition_t *partition = nvs_host_partition(partition_label);
+    if (partition != NULL) {
+        partition->initialized = false;
+        for (int i = 0; i < NVS_HOST_MAX_HANDLES; i++) {
+            if (handles[i].used && strcmp(handles[i].part, partition_label) == 0) {
+                handles[i].used = false;
+            }
+        }
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    return nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+}
+
+esp_err_t nvs_flash_erase_partition(const char *part_name) {
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&lock);
+    if (nvs_host_partition(part_name) != NULL) {
+        err = ESP_ERR_NVS_INVALID_STATE;
+    } else {
+        nvs_host_clear(part_name);
+        nvs_host_save();
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    return nvs_flash_erase_partition(NVS_DEFAULT_PART_NAME);
+}
+
+esp_err_t nvs_open_from_partition(const char *part_name, const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    esp_err_t err = ESP_OK;
+    STAT_INC(open);
+    pthread_mutex_lock(&lock);
+    if (nvs_host_partition(part_name) == NULL) {
+        err = strcmp(part_name, NVS_DEFAULT_PART_NAME) == 0 ? ESP_ERR_NVS_NOT_INITIALIZED : ESP_ERR_NVS_PART_NOT_FOUND;
+    } else if (name == NULL || strlen(name) > NVS_HOST_NAME_MAX) {
+        err = ESP_ERR_NVS_INVALID_NAME;
+    } else if (open_mode == NVS_READONLY && !nvs_host_namespace_exists(part_name, name)) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (open_mode == NVS_READWRITE) {
+        err = nvs_host_namespace_create(part_name, name);
+    }
+    if (err == ESP_OK) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+        for (int i = 0; i < NVS_HOST_MAX_HANDLES; i++) {
+            if (!handles[i].used) {
+                strcpy(handles[i].part, part_name);
+                strcpy(handles[i].ns, name);
+                handles[i].mode = open_mode;
+                handles[i].used = true;
+                *out_handle = i + 1;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    return nvs_open_from_partition(NVS_DEFAULT_PART_NAME, name, open_mode, out_handle);
+}
+
+void nvs_close(nvs_handle_t handle) {
+    STAT_INC(close);
+    pthread_mutex_lock(&lock);
+    nvs_host_handle_t *entry = nvs_host_handle(handle);
+    if (entry != NULL) {
+        entry->used = false;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    esp_err_t err = ESP_OK;
+    STAT_INC(commit);
+    pthread_mutex_lock(&lock);
+    if (nvs_host_handle(handle) == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else {
+        nvs_host_save();
+    }
+    pthread_mutex_unlock(&lock);
+    if (err == ESP_OK && commit_delay_us > 0) {
+        usleep(commit_delay_us);
+    }
+    if (err == ESP_OK && commit_hook != NULL) {
+        commit_hook(commit_hook_arg);
+    }
+    return err;
+}
+
+static esp_err_t nvs_host_set(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t size) {
+    esp_err_t err = ESP_OK;
+    STAT_INC(set);
+    pthread_mutex_lock(&lock);
+    nvs_host_handle_t *entry = nvs_host_handle(handle);
+    if (entry == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (entry->mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if (key == NULL || strlen(key) > NVS_HOST_NAME_MAX) {
+        err = ESP_ERR_NVS_KEY_TOO_LONG;
+    } else if ((type == NVS_TYPE_STR && size > NVS_HOST_STR_MAX) || (type == NVS_TYPE_BLOB && size > NVS_HOST_BLOB_MAX)) {
+        err = ESP_ERR_NVS_VALUE_TOO_LONG;
+    } else if (sets_before_failure == 0) {
+        err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    } else {
+        if (sets_before_failure > 0) {
+            sets_before_failure--;
+        }
+        uint8_t *data = malloc(size > 0 ? size : 1);
+        if (data == NULL) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            memcpy(data, value, size);
+            int index = nvs_host_find(entry->part, entry->ns, key);
+            if (index == -1) {
+                index = nvs_host_insert(entry->part, entry->ns, key);
+            }
+            free(items[index].data);
+            items[index].type = type;
+            items[index].size = size;
+            items[index].data = data;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+static esp_err_t nvs_host_get(nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *size, bool variable) {
+    esp_err_t err = ESP_OK;
+    STAT_INC(get);
+    pthread_mutex_lock(&lock);
+    nvs_host_handle_t *entry = nvs_host_handle(handle);
+    int index = -1;
+    if (entry == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (key == NULL || strlen(key) > NVS_HOST_NAME_MAX) {
+        err = ESP_ERR_NVS_KEY_TOO_LONG;
+    } else if ((index = nvs_host_find(entry->part, entry->ns, key)) == -1 || items[index].type != type) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (!variable) {
+        memcpy(value, items[index].data, items[index].size);
+    } else if (size == NULL) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else if (value == NULL) {
+        *size = items[index].size;
+    } else if (*size < items[index].size) {
+        *size = items[index].size;
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(value, items[index].data, items[index].size);
+        *size = items[index].size;
+    }
+    pthread_mutex_unlock(&lock);
+    if (get_hook != NULL) {
+        get_hook(key, get_hook_arg);
+    }
+    return err;
+}
+
+#define NVS_HOST_SCALAR(suffix, ctype, nvstype) \
+    esp_err_t nvs_set_##suffix(nvs_handle_t handle, const char *key, ctype value) { \
+        return nvs_host_set(handle, key, nvstype, &value, sizeof(value)); \
+    } \
+    esp_err_t nvs_get_##suffix(nvs_handle_t handle, const char *key, ctype *out_value) { \
+        return nvs_host_get(handle, key, nvstype, out_value, NULL, false); \
+    }
+
+NVS_HOST_SCALAR(u8, uint8_t, NVS_TYPE_U8)
+NVS_HOST_SCALAR(i8, int8_t, NVS_TYPE_I8)
+NVS_HOST_SCALAR(u16, uint16_t, NVS_TYPE_U16)
+NVS_HOST_SCALAR(i16, int16_t, NVS_TYPE_I16)
+NVS_HOST_SCALAR(u32, uint32_t, NVS_TYPE_U32)
+NVS_HOST_SCALAR(i32, int32_t, NVS_TYPE_I32)
+NVS_HOST_SCALAR(u64, uint64_t, NVS_TYPE_U64)
+NVS_HOST_SCALAR(i64, int64_t, NVS_TYPE_I64)
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return nvs_host_set(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return nvs_host_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return nvs_host_get(handle, key, NVS_TYPE_STR, out_value, length, true);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return nvs_host_get(handle, key, NVS_TYPE_BLOB, out_value, length, true);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    esp_err_t err = ESP_OK;
+    STAT_INC(erase);
+    pthread_mutex_lock(&lock);
+    nvs_host_handle_t *entry = nvs_host_handle(handle);
+    int index = -1;
+    if (entry == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (entry->mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if ((index = nvs_host_find(entry->part, entry->ns, key)) == -1) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        nvs_host_unlink(index);
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    esp_err_t err = ESP_OK;
+    STAT_INC(erase);
+    pthread_mutex_lock(&lock);
+    nvs_host_handle_t *entry = nvs_host_handle(handle);
+    if (entry == NULL) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (entry->mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        for (int i = 0; i < items_capacity; i++) {
+            if (items[i].used && strcmp(items[i].part, entry->part) == 0 && strcmp(items[i].ns, entry->ns) == 0) {
+                nvs_host_unlink(i);
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+static bool nvs_host_iterator_matches(const struct nvs_opaque_iterator_t *it, int index) {
+    return items[index].used
+        && strcmp(items[index].part, it->part) == 0
+        && (it->ns[0] == '\0' || strcmp(items[index].ns, it->ns) == 0)
+        && (it->type == NVS_TYPE_ANY || items[index].type == it->type);
+}
+
+static nvs_iterator_t nvs_host_iterator_advance(nvs_iterator_t it) {
+    for (it->position++; it->position < items_capacity; it->position++) {
+        if (nvs_host_iterator_matches(it, it->position)) {
+            return it;
+        }
+    }
+    free(it);
+    return NULL;
+}
+
+nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type) {
+    nvs_iterator_t it = calloc(1, sizeof(*it));
+    if (it == NULL) {
+        return NULL;
+    }
+    strncpy(it->part, part_name, NVS_PART_NAME_MAX_SIZE - 1);
+    if (namespace_name != NULL) {
+        strncpy(it->ns, namespace_name, sizeof(it->ns) - 1);
+    }
+    it->type = type;
+    it->position = -1;
+    pthread_mutex_lock(&lock);
+    it = nvs_host_iterator_advance(it);
+    pthread_mutex_unlock(&lock);
+    return it;
+}
+
+nvs_iterator_t nvs_entry_next(nvs_iterator_t iterator) {
+    if (iterator == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    iterator = nvs_host_iterator_advance(iterator);
+    pthread_mutex_unlock(&lock);
+    return iterator;
+}
+
+void nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info) {
+    pthread_mutex_lock(&lock);
+    memset(out_info, 0, sizeof(*out_info));
+    if (iterator->position < items_capacity && items[iterator->position].used) {
+        strcpy(out_info->namespace_name, items[iterator->position].ns);
+        strcpy(out_info->key, items[iterator->position].key);
+        out_info->type = items[iterator->position].type;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator) {
+    free(iterator);
+}
+
+void nvs_host_get_stats(nvs_host_stats_t *out) {
+    out->open = __atomic_load_n(&stats.open, __ATOMIC_RELAXED);
+    out->close = __atomic_load_n(&stats.close, __ATOMIC_RELAXED);
+    out->get = __atomic_load_n(&stats.get, __ATOMIC_RELAXED);
+    out->set = __atomic_load_n(&stats.set, __ATOMIC_RELAXED);
+    out->erase = __atomic_load_n(&stats.erase, __ATOMIC_RELAXED);
+    out->commit = __atomic_load_n(&stats.commit, __ATOMIC_RELAXED);
+}
+
+void nvs_host_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+esp_err_t nvs_host_set_file(const char *path) {
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&lock);
+    free(backing_file);
+    backing_file = NULL;
+    if (path != NULL) {
+        backing_file = strdup(path);
+        if (backing_file == NULL) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            nvs_host_load();
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+void nvs_host_set_commit_delay_us(uint32_t delay_us) {
+    commit_delay_us = delay_us;
+}
+
+void nvs_host_set_get_hook(void (*hook)(const char *key, void *arg), void *arg) {
+    get_hook_arg = arg;
+    get_hook = hook;
+}
+
+void nvs_host_set_commit_hook(void (*hook)(void *arg), void *arg) {
+    commit_hook_arg = arg;
+    commit_hook = hook;
+}
+
+void nvs_host_fail_sets_after(int count) {
+    pthread_mutex_lock(&lock);
+    sets_before_failure = count;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,88 @@
+/* @file arena.c
+ * @brief Host check of the single-call and arena getters.
+ *
+ * Checks that values fitting the buffer are copied in one call, from the
+ * NVS and from the defaults, that short buffers get the size needed and
+ * nothing else, and that arenas are filled with aligned values, left
+ * untouched when too short or full, and reused once released. It exits
+ * with 1 if any check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static void arena_check_into() {
+
+    char value[16];
+    uint8_t blob[16];
+    size_t size = 0;
+
+    size = sizeof(value);
+    harness_check(esp_config_get_str_into("bench0", "k3", value, &size) == 3 && size == 7 && strcmp(value, "value3") == 0, "default string");
+    size = 7;
+    harness_check(esp_config_get_str_into("bench0", "k3", value, &size) == 3 && size == 7, "default string, exact buffer");
+    size = 6;
+    memset(value, 'x', sizeof(value));
+    harness_check(esp_config_get_str_into("bench0", "k3", value, &size) == 1 && size == 7 && value[0] == 'x', "default string, short buffer");
+    size = sizeof(blob);
+    harness_check(esp_config_get_blob_into("bench0", "k4", blob, &size) == 3 && size == 10 && memcmp(blob, "blob000004", 10) == 0, "default blob");
+
+    esp_config_set_str("bench0", "k3", "overridden");
+    esp_config_set_blob("bench0", "k4", "0123456789AB", 12);
+    size = sizeof(value);
+    harness_check(esp_config_get_str_into("bench0", "k3", value, &size) == 2 && size == 11 && strcmp(value, "overridden") == 0, "stored string");
+    size = 10;
+    memset(value, 'x', sizeof(value));
+    harness_check(esp_config_get_str_into("bench0", "k3", value, &size) == 0 && size == 11 && value[0] == 'x', "stored string, short buffer");
+    size = 0;
+    harness_check(esp_config_get_blob_into("bench0", "k4", blob, &size) == 0 && size == 12, "stored blob, empty buffer");
+    size = sizeof(blob);
+    harness_check(esp_config_get_blob_into("bench0", "k4", blob, &size) == 2 && size == 12 && memcmp(blob, "0123456789AB", 12) == 0, "stored blob");
+}
+
+static void arena_check_fill() {
+
+    void *memory[4];    // Pointer-aligned, 32 bytes on 64-bit hosts
+    esp_config_arena_t arena = { .base = memory, .size = sizeof(memory), .used = 0 };
+    const char *string = NULL;
+    const void *blob = NULL;
+    size_t size = 0;
+    size_t used = 0;
+
+    harness_check(esp_config_get_str_arena("bench0", "k3", &arena, &string, &size) == 2 && size == 11 && strcmp(string, "overridden") == 0, "string into the arena");
+    harness_check(string == (const char*)memory && arena.used == 11, "arena advanced");
+    harness_check(esp_config_get_str_arena("bench0", "k8", &arena, &string, &size) == 3 && strcmp(string, "value8") == 0, "default into the arena");
+    harness_check(((uintptr_t)string % sizeof(void*)) == 0 && arena.used == (size_t)(string - (const char*)memory) + 7, "value aligned");
+
+    used = arena.used;
+    harness_check(esp_config_get_blob_arena("bench0", "k4", &arena, &blob, &size) == 0 && size == 12, "short arena");
+    harness_check(blob == NULL && arena.used == used, "short arena untouched");
+    harness_check(esp_config_get_blob_arena("bench0", "k9", &arena, &blob, &size) == 1 && size == 10 && blob == NULL && arena.used == used, "default into a short arena");
+
+    arena.used = arena.size;
+    harness_check(esp_config_get_str_arena("bench0", "k8", &arena, &string, &size) == 1 && size == 7 && string == NULL, "full arena");
+    harness_check(arena.used == arena.size, "full arena untouched");
+
+    arena.used = 0;
+    harness_check(esp_config_get_blob_arena("bench0", "k4", &arena, &blob, &size) == 2 && blob == memory && memcmp(blob, "0123456789AB", 12) == 0, "released arena reused");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    arena_check_into();
+    arena_check_fill();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
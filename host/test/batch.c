@@ -0,0 +1,144 @@
+/* @file batch.c
+ * @brief Host check of batch commits and of their journal.
+ *
+ * A batch spans the namespaces bench0 and bench1, so that it is applied
+ * with two commits. The emulated NVS is made to fail between them, and
+ * to lose power after the journal is committed by detaching its backing
+ * file. Checks that a failed batch is not replayed over later writes,
+ * and that an interrupted batch is completed by esp_config_init() or by
+ * the first write before it. It exits with 1 if any check failed.
+ *
+ * Built against the 200 keys database, and again with the cache, the
+ * snapshot and subscriptions, which must only see the namespaces a failed
+ * batch committed, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static char batch_file[256]; // Next to the program, one per build of this check
+
+static void batch_power_loss(void *arg) {
+    (void)arg;
+    nvs_host_set_commit_hook(NULL, NULL);
+    nvs_host_set_file(NULL);
+}
+
+/*
+ * Restarts the library and the NVS, reloading the NVS from its file if
+ * one is given, without calling esp_config_init().
+ */
+static void batch_reboot(const char *file) {
+    esp_config_deinit();
+    nvs_flash_deinit();
+    if (file != NULL) {
+        nvs_host_set_file(file);
+    }
+    nvs_flash_init();
+}
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+static void batch_changed(const esp_config_item_t *item, void *arg) {
+    (void)item;
+    (*(int *)arg)++;
+}
+#endif
+
+static esp_err_t batch_commit(int32_t first, int32_t second) {
+
+    esp_config_batch_t batch;
+
+    esp_config_batch_begin(&batch);
+    esp_config_batch_set_i32(batch, "bench0", "k0", first);
+    esp_config_batch_set_i32(batch, "bench1", "k100", second);
+    return esp_config_batch_commit(batch);
+}
+
+static void batch_check_failure() {
+
+    int32_t value = 0;
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    esp_config_subscription_t subscriptions[2];
+    int changes[2] = {0, 0};
+#endif
+
+    esp_config_init();
+    harness_check(batch_commit(1, 2) == ESP_OK, "commit");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 1, "first namespace written");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 2, "second namespace written");
+
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    esp_config_subscribe("bench0", NULL, batch_changed, &changes[0], &subscriptions[0]);
+    esp_config_subscribe("bench1", NULL, batch_changed, &changes[1], &subscriptions[1]);
+#endif
+    nvs_host_fail_sets_after(2); // The journal and bench0
+    harness_check(batch_commit(10, 20) != ESP_OK, "failed commit reported");
+    nvs_host_fail_sets_after(-1);
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 10, "first namespace applied");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 2, "second namespace not applied");
+#if CONFIG_ESP_CONFIG_SUBSCRIPTIONS
+    harness_check(changes[0] == 1, "first namespace notified");
+    harness_check(changes[1] == 0, "second namespace not notified");
+    esp_config_unsubscribe(subscriptions[0]);
+    esp_config_unsubscribe(subscriptions[1]);
+#endif
+
+    esp_config_set_i32("bench0", "k0", 30);
+    batch_reboot(NULL);
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 30, "failed batch not replayed over a later write");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 2, "failed batch not completed");
+    esp_config_reset_all();
+}
+
+/*
+ * Commits a batch that loses power right after its journal, then reboots.
+ */
+static void batch_interrupt(int32_t first, int32_t second) {
+
+    esp_config_init();
+    esp_config_reset_all();
+    nvs_host_set_file(batch_file);
+    nvs_host_set_commit_hook(batch_power_loss, NULL);
+    batch_commit(first, second);
+    batch_reboot(batch_file);
+    nvs_host_set_file(NULL);
+}
+
+static void batch_check_power_loss() {
+
+    int32_t value = 0;
+
+    batch_interrupt(11, 21);
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1, "batch not applied before the reboot");
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 11, "first namespace completed by init");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 21, "second namespace completed by init");
+
+    batch_interrupt(12, 22);
+    harness_check(esp_config_set_i32("bench1", "k100", 40) == ESP_OK, "write before init");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 12, "completed by the first write");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 40, "write after the completed batch");
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 40, "not replayed again by init");
+    esp_config_reset_all();
+}
+
+int main(int argc, char **argv) {
+
+    (void)argc;
+    snprintf(batch_file, sizeof(batch_file), "%s.nvs", argv[0]);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    remove(batch_file);
+    nvs_flash_init();
+
+    batch_check_failure();
+    batch_check_power_loss();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+    remove(batch_file);
+
+    return harness_result();
+}
@@ -0,0 +1,154 @@
+/* @file blob.c
+ * @brief Host check of blob range reads and streaming writes.
+ *
+ * Chunks are 16 bytes, so that a 100 bytes value is streamed in seven of
+ * them. Checks range reads of defaults, plain overrides and chunked
+ * values, across chunk boundaries and at and past the end of the value,
+ * and that streamed values take effect only once committed, overwrite
+ * each other, erase the override when equal to the default, that the
+ * writer rejects writes past the announced size and short commits, and
+ * that a commit the NVS refuses leaves the previous value in effect. It
+ * exits with 1 if any check failed.
+ *
+ * Built against the 100 keys database, and again with the snapshot, see
+ * CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define BLOB_SIZE 100
+
+/*
+ * Reads a range of k9 and compares it with the expected bytes.
+ */
+static bool blob_range(size_t offset, size_t size, int status, const uint8_t *expected, size_t expectedsize) {
+
+    uint8_t value[BLOB_SIZE];
+    size_t valuesize = size;
+
+    memset(value, 0xee, sizeof(value));
+    return esp_config_get_blob_range("bench0", "k9", offset, value, &valuesize) == status
+            && valuesize == expectedsize && (expectedsize == 0 || memcmp(value, expected, expectedsize) == 0);
+}
+
+static void blob_check_ranges() {
+
+    const uint8_t *def = (const uint8_t*)"blob000009";
+    const uint8_t *plain = (const uint8_t*)"0123456789AB";
+
+    harness_check(blob_range(0, 4, 3, def, 4), "default head");
+    harness_check(blob_range(8, 4, 3, def + 8, 2), "default tail");
+    harness_check(blob_range(10, 4, 3, NULL, 0), "default at the end");
+    harness_check(blob_range(1000, 4, 3, NULL, 0), "default past the end");
+    harness_check(blob_range(SIZE_MAX, 4, 3, NULL, 0), "default at the largest offset");
+
+    esp_config_set_blob("bench0", "k9", plain, 12);
+    harness_check(blob_range(2, 5, 2, plain + 2, 5), "override middle");
+    harness_check(blob_range(12, 4, 2, NULL, 0), "override at the end");
+    harness_check(blob_range(SIZE_MAX, 4, 2, NULL, 0), "override at the largest offset");
+    harness_check(blob_range(0, 0, 2, NULL, 0), "empty range");
+}
+
+/*
+ * Streams a value into k9 in parts of 7 bytes.
+ */
+static esp_err_t blob_stream(const uint8_t *value, size_t size) {
+
+    esp_config_blob_writer_t writer = NULL;
+    esp_err_t esperr = esp_config_blob_write_begin("bench0", "k9", size, &writer);
+
+    for (size_t offset = 0; esperr == ESP_OK && offset < size; offset += 7) {
+        esperr = esp_config_blob_write(writer, value + offset, (size - offset < 7) ? size - offset : 7);
+    }
+    return (esperr == ESP_OK) ? esp_config_blob_write_commit(writer) : esperr;
+}
+
+static void blob_check_stream() {
+
+    uint8_t value[BLOB_SIZE];
+    uint8_t read[BLOB_SIZE];
+    size_t size = 0;
+
+    for (int i = 0; i < BLOB_SIZE; i++) {
+        value[i] = i;
+    }
+    harness_check(blob_stream(value, sizeof(value)) == ESP_OK, "streamed");
+    harness_check(esp_config_get_blob("bench0", "k9", NULL, &size) == 0 && size == BLOB_SIZE, "streamed size");
+    harness_check(esp_config_get_blob("bench0", "k9", read, &size) == 2 && memcmp(read, value, BLOB_SIZE) == 0, "streamed value");
+
+    harness_check(blob_range(10, 40, 2, value + 10, 40), "range across chunks");
+    harness_check(blob_range(16, 16, 2, value + 16, 16), "whole chunk");
+    harness_check(blob_range(96, 10, 2, value + 96, 4), "range past the end");
+    harness_check(blob_range(BLOB_SIZE, 10, 2, NULL, 0), "chunked at the end");
+    harness_check(blob_range(5000, 10, 2, NULL, 0), "chunked past the end");
+    harness_check(blob_range(SIZE_MAX, 10, 2, NULL, 0), "chunked at the largest offset");
+
+    value[50] = 0xff;
+    harness_check(blob_stream(value, sizeof(value)) == ESP_OK, "streamed again");
+    harness_check(blob_range(48, 4, 2, value + 48, 4), "second value in effect");
+
+    harness_check(blob_stream((const uint8_t*)"blob000009", 10) == ESP_OK, "default streamed");
+    harness_check(esp_config_get_blob("bench0", "k9", NULL, &size) == 1 && size == 10, "override erased");
+}
+
+static void blob_check_writer() {
+
+    esp_config_blob_writer_t writer = NULL;
+    uint8_t value[BLOB_SIZE] = {0};
+    size_t size = 0;
+
+    harness_check(esp_config_blob_write_begin("bench0", "k9", 40, &writer) == ESP_OK, "begin");
+    harness_check(esp_config_blob_write(writer, value, 41) == ESP_ERR_INVALID_SIZE, "past the announced size");
+    harness_check(esp_config_blob_write(writer, value, 30) == ESP_OK, "part written");
+    harness_check(esp_config_blob_write_commit(writer) == ESP_ERR_INVALID_SIZE, "short commit");
+    harness_check(esp_config_get_blob("bench0", "k9", NULL, &size) == 1 && size == 10, "nothing in effect");
+
+    harness_check(esp_config_blob_write_begin("bench0", "k9", 40, &writer) == ESP_OK, "begin again");
+    esp_config_blob_write(writer, value, 40);
+    harness_check(esp_config_blob_write_abort(writer) == ESP_OK, "abort");
+    harness_check(esp_config_get_blob("bench0", "k9", NULL, &size) == 1 && size == 10, "nothing in effect after abort");
+
+    harness_check(esp_config_blob_write_begin("bench0", "k9", SIZE_MAX, &writer) == ESP_ERR_NVS_VALUE_TOO_LONG, "too long");
+    harness_check(esp_config_blob_write_begin(NULL, "k9", 10, &writer) == ESP_ERR_INVALID_ARG, "no namespace");
+    harness_check(esp_config_blob_write_abort(NULL) == ESP_ERR_INVALID_ARG, "abort without writer");
+}
+
+static void blob_check_failed_commit() {
+
+    esp_config_blob_writer_t writer = NULL;
+    uint8_t value[BLOB_SIZE];
+    uint8_t read[BLOB_SIZE];
+    size_t size = sizeof(read);
+
+    memset(value, 0x5a, sizeof(value));
+    harness_check(blob_stream(value, sizeof(value)) == ESP_OK, "streamed before a refused commit");
+    memset(value, 0xa5, sizeof(value));
+    harness_check(esp_config_blob_write_begin("bench0", "k9", sizeof(value), &writer) == ESP_OK, "begin before a refused commit");
+    esp_config_blob_write(writer, value, sizeof(value));
+    nvs_host_fail_sets_after(1); // The last chunk is written, not the descriptor
+    harness_check(esp_config_blob_write_commit(writer) == ESP_ERR_NVS_NOT_ENOUGH_SPACE, "refused commit");
+    nvs_host_fail_sets_after(-1);
+    harness_check(esp_config_get_blob("bench0", "k9", read, &size) == 2 && size == BLOB_SIZE && read[0] == 0x5a, "previous value in effect");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    blob_check_ranges();
+    blob_check_stream();
+    blob_check_writer();
+    blob_check_failed_commit();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
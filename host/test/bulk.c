@@ -0,0 +1,101 @@
+/* @file bulk.c
+ * @brief Host check of bulk reads.
+ *
+ * Checks that esp_config_get_bulk() sets the status and value of every
+ * item as the single-key getters would, for overrides and defaults of
+ * every kind, that keys missing from the database or of another encoding
+ * only fail their own item, that strings and blobs larger than their
+ * buffer only report their size, and that the namespace is opened once
+ * for the whole call. It exits with 1 if any check failed.
+ *
+ * Built against the 100 keys database, with the hash index and again
+ * without it, so that keys are found by scanning their namespace, see
+ * CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static void bulk_check_items() {
+
+    nvs_host_stats_t stats;
+    int32_t overridden = 0;
+    int32_t def = 0;
+    int32_t missing = -5;
+    char string[16];
+    char defstring[16];
+    char shortstring[2];
+    uint8_t blob[16];
+    uint8_t defblob[16];
+    uint8_t shortblob[4];
+    esp_config_bulk_item_t items[] = {
+        {.key = "k0", .encoding = INT32, .value = &overridden},
+        {.key = "k1", .encoding = INT32, .value = &def},
+        {.key = "nokey", .encoding = INT32, .value = &missing},
+        {.key = "k3", .encoding = STRING, .value = string, .valuesize = sizeof(string)},
+        {.key = "k8", .encoding = STRING, .value = defstring, .valuesize = sizeof(defstring)},
+        {.key = "k3", .encoding = STRING, .value = shortstring, .valuesize = sizeof(shortstring)},
+        {.key = "k13", .encoding = STRING, .value = shortstring, .valuesize = sizeof(shortstring)},
+        {.key = "k4", .encoding = BLOB, .value = blob, .valuesize = sizeof(blob)},
+        {.key = "k9", .encoding = BLOB, .value = defblob, .valuesize = sizeof(defblob)},
+        {.key = "k4", .encoding = BLOB, .value = shortblob, .valuesize = sizeof(shortblob)},
+        {.key = "k14", .encoding = BLOB, .value = shortblob, .valuesize = sizeof(shortblob)},
+        {.key = "k2", .encoding = STRING, .value = string, .valuesize = sizeof(string)},
+    };
+
+    esp_config_set_i32("bench0", "k0", 7);
+    esp_config_set_str("bench0", "k3", "over");
+    esp_config_set_blob("bench0", "k4", "0123456789", 10);
+    memset(shortstring, 'x', sizeof(shortstring));
+    memset(shortblob, 'x', sizeof(shortblob));
+
+    nvs_host_reset_stats();
+    harness_check(esp_config_get_bulk("bench0", items, sizeof(items) / sizeof(items[0])) == ESP_ERR_NOT_FOUND, "missing keys reported");
+    nvs_host_get_stats(&stats);
+    harness_check(stats.open == 1, "namespace opened once");
+
+    harness_check(items[0].status == 0 && overridden == 7, "overridden integer");
+    harness_check(items[1].status == 1 && def == 1, "default integer");
+    harness_check(items[2].status == -1 && missing == -5, "missing key left untouched");
+    harness_check(items[3].status == 2 && items[3].valuesize == 5 && strcmp(string, "over") == 0, "overridden string");
+    harness_check(items[4].status == 3 && items[4].valuesize == 7 && strcmp(defstring, "value8") == 0, "default string");
+    harness_check(items[5].status == 0 && items[5].valuesize == 5, "overridden string larger than its buffer");
+    harness_check(items[6].status == 1 && items[6].valuesize == 8, "default string larger than its buffer");
+    harness_check(items[7].status == 2 && items[7].valuesize == 10 && memcmp(blob, "0123456789", 10) == 0, "overridden blob");
+    harness_check(items[8].status == 3 && items[8].valuesize == 10 && memcmp(defblob, "blob000009", 10) == 0, "default blob");
+    harness_check(items[9].status == 0 && items[9].valuesize == 10, "overridden blob larger than its buffer");
+    harness_check(items[10].status == 1 && items[10].valuesize == 10, "default blob larger than its buffer");
+    harness_check(memcmp(shortstring, "xx", 2) == 0 && memcmp(shortblob, "xxxx", 4) == 0, "short buffers left untouched");
+    harness_check(items[11].status == -1, "key of another encoding");
+
+    harness_check(esp_config_get_bulk("bench0", items, 2) == ESP_OK, "all keys found");
+    harness_check(items[0].status == 0 && items[1].status == 1, "statuses of a successful call");
+    esp_config_reset_all();
+}
+
+static void bulk_check_arguments() {
+
+    int32_t value = -5;
+    esp_config_bulk_item_t item = {.key = "k0", .encoding = INT32, .value = &value};
+
+    harness_check(esp_config_get_bulk("nons", &item, 1) == ESP_ERR_NOT_FOUND && item.status == -1 && value == -5, "namespace not in the database");
+    harness_check(esp_config_get_bulk("bench0", NULL, 0) == ESP_OK, "no items");
+    harness_check(esp_config_get_bulk(NULL, &item, 1) == ESP_ERR_INVALID_ARG, "no namespace");
+    harness_check(esp_config_get_bulk("bench0", NULL, 1) == ESP_ERR_INVALID_ARG, "no items array");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+
+    bulk_check_items();
+    bulk_check_arguments();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,103 @@
+/* @file cache.c
+ * @brief Host check of the read-through cache.
+ *
+ * Checks that reads fill the cache and writes go through it, and that a
+ * read that went to the NVS does not cache what it read over a write made
+ * meanwhile: a hook of the emulated NVS writes the key right after the
+ * read, before the reader fills the slot. It exits with 1 if any check
+ * failed.
+ *
+ * Built against the 100 keys database with the cache, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+typedef struct {
+    const char *key;
+    int32_t int32;
+    const char *string;
+} cache_write_t;
+
+/*
+ * Writes the key once, as another task would between the NVS read and
+ * the cache fill, arg being a cache_write_t.
+ */
+static void cache_write_meanwhile(const char *key, void *arg) {
+
+    const cache_write_t *write = arg;
+
+    if (strcmp(key, write->key) != 0) {
+        return;
+    }
+    nvs_host_set_get_hook(NULL, NULL);
+    if (write->string != NULL) {
+        esp_config_set_str("bench0", write->key, write->string);
+    } else {
+        esp_config_set_i32("bench0", write->key, write->int32);
+    }
+}
+
+static void cache_check_through() {
+
+    nvs_host_stats_t stats;
+    int32_t value = 0;
+
+    esp_config_reset_namespace("bench0");
+    esp_config_cache_clear();
+    harness_check(esp_config_set_i32("bench0", "k0", 5) == ESP_OK, "set");
+    nvs_host_reset_stats();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 5, "written through");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 1, "default read");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 1, "default cached");
+    nvs_host_get_stats(&stats);
+    harness_check(stats.get == 1, "one NVS read for both keys");
+}
+
+static void cache_check_race() {
+
+    cache_write_t write = {.key = "k0", .int32 = 2};
+    cache_write_t string = {.key = "k3", .string = "written"};
+    cache_write_t reset = {.key = "k1", .int32 = 7};
+    int32_t value = 0;
+    char buffer[16];
+    size_t size = sizeof(buffer);
+
+    esp_config_set_i32("bench0", "k0", 1);
+    esp_config_cache_clear();
+    nvs_host_set_get_hook(cache_write_meanwhile, &write);
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 1, "value read before the write");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 2, "write not overwritten by the fill");
+
+    esp_config_set_str("bench0", "k3", "before");
+    esp_config_cache_clear();
+    nvs_host_set_get_hook(cache_write_meanwhile, &string);
+    esp_config_get_str_into("bench0", "k3", buffer, &size);
+    size = sizeof(buffer);
+    harness_check(esp_config_get_str_into("bench0", "k3", buffer, &size) == 2 && strcmp(buffer, "written") == 0, "string write not overwritten");
+
+    esp_config_cache_clear();
+    nvs_host_set_get_hook(cache_write_meanwhile, &reset);
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 1, "default read before the write");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 0 && value == 7, "write not hidden by a default fill");
+
+    nvs_host_set_get_hook(NULL, NULL);
+    esp_config_reset_namespace("bench0");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    cache_check_through();
+    cache_check_race();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
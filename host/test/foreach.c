@@ -0,0 +1,122 @@
+/* @file foreach.c
+ * @brief Host check of the configuration iterator and the JSON export.
+ *
+ * Checks that esp_config_foreach() visits every key once, in database
+ * order, with its source and value: overrides copied into the buffer or
+ * reported by size when larger, defaults passed in place whatever the
+ * buffer, even without one. Also checks a callback stopping early, that passes run to
+ * exhaustion are repeatable, and the JSON export of overrides too large
+ * for its buffer and to a stream that cannot be written. It exits with 1
+ * if any check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+typedef struct {
+    int visited;
+    int stop;                   // Visits before stopping, or -1
+    size_t buffersize;
+    bool ordered;
+    bool values;
+} foreach_state_t;
+
+static bool foreach_item(const esp_config_item_t *item, void *arg) {
+
+    foreach_state_t *state = arg;
+    char key[8];
+    int32_t expected = state->visited;
+
+    snprintf(key, sizeof(key), "k%d", state->visited);
+    state->ordered &= strcmp(item->ns, "bench0") == 0 && strcmp(item->key, key) == 0;
+
+    if (state->visited == 2) {
+        expected = 20;
+        state->values &= item->source == ESP_CONFIG_SOURCE_NVS && item->valuesize == 4 && memcmp(item->value, &expected, 4) == 0;
+    } else if (state->visited == 3) {
+        state->values &= item->source == ESP_CONFIG_SOURCE_NVS && item->valuesize == 11
+                && ((state->buffersize < 11) ? item->value == NULL : strcmp(item->value, "overridden") == 0);
+    } else if (state->visited == 4) {
+        state->values &= item->source == ESP_CONFIG_SOURCE_NVS && item->value == NULL && item->valuesize == 200;
+    } else if (item->encoding == INT32) {
+        state->values &= item->source == ESP_CONFIG_SOURCE_DEFAULT && memcmp(item->value, &expected, 4) == 0;
+    } else if (item->encoding == STRING) {
+        snprintf(key, sizeof(key), "value%d", state->visited);
+        state->values &= item->source == ESP_CONFIG_SOURCE_DEFAULT && item->value != NULL && strcmp(item->value, key) == 0;
+    } else {
+        state->values &= item->source == ESP_CONFIG_SOURCE_DEFAULT && item->value != NULL && item->valuesize == 10;
+    }
+
+    state->visited++;
+    return state->visited != state->stop;
+}
+
+static void foreach_check_pass(size_t buffersize, const char *what) {
+
+    char buffer[64];
+    foreach_state_t state = { .visited = 0, .stop = -1, .buffersize = buffersize, .ordered = true, .values = true };
+
+    harness_check(esp_config_foreach((buffersize > 0) ? buffer : NULL, buffersize, foreach_item, &state) == ESP_OK, what);
+    harness_check(state.visited == 100 && state.ordered && state.values, what);
+}
+
+static void foreach_check_iteration() {
+
+    char buffer[64];
+    uint8_t large[200] = {0};
+    foreach_state_t state = { .visited = 0, .stop = 5, .buffersize = sizeof(buffer), .ordered = true, .values = true };
+
+    esp_config_set_i32("bench0", "k2", 20);
+    esp_config_set_str("bench0", "k3", "overridden");
+    esp_config_set_blob("bench0", "k4", large, sizeof(large));
+
+    foreach_check_pass(0, "pass without buffer");
+    foreach_check_pass(sizeof(buffer), "whole pass");
+    foreach_check_pass(sizeof(buffer), "pass after exhaustion");
+
+    harness_check(esp_config_foreach(buffer, sizeof(buffer), foreach_item, &state) == ESP_OK && state.visited == 5, "stopped early");
+    harness_check(esp_config_foreach(buffer, sizeof(buffer), NULL, NULL) == ESP_ERR_INVALID_ARG, "no callback");
+}
+
+static void foreach_check_json() {
+
+    char document[8192] = "";
+    FILE *stream = tmpfile();
+    size_t length = 0;
+
+    harness_check(esp_config_export_json(stream) == ESP_OK, "export");
+    rewind(stream);
+    length = fread(document, 1, sizeof(document) - 1, stream);
+    fclose(stream);
+    document[length] = '\0';
+
+    harness_check(strncmp(document, "{\"bench0\":{\"k0\":{\"value\":0,\"source\":\"default\"}", 46) == 0, "first key exported");
+    harness_check(strstr(document, "\"k2\":{\"value\":20,\"source\":\"nvs\"}") != NULL, "override exported");
+    harness_check(strstr(document, "\"k4\":{\"value\":null,\"size\":200,\"source\":\"nvs\"}") != NULL, "override larger than the buffer");
+    harness_check(strstr(document, "\"k9\":{\"value\":\"626c6f62303030303039\",\"source\":\"default\"}") != NULL, "blob as hexadecimal");
+    harness_check(length > 3 && strcmp(document + length - 3, "}}\n") == 0, "document closed");
+
+    stream = fopen("/dev/null", "r");
+    harness_check(esp_config_export_json(stream) == ESP_FAIL, "stream not writable");
+    fclose(stream);
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    foreach_check_iteration();
+    foreach_check_json();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,197 @@
+/* @file hpp.cpp
+ * @brief Host check of the C++ interface, esp_config.hpp.
+ *
+ * The keys, their types and defaults are checked at compile time, as are
+ * the accessors each key has: default values and sizes are not available
+ * for compressed keys, nor integer getters for strings and blobs. Every
+ * accessor is then called on every type of key, before and after it is
+ * overridden, and on frozen and compressed keys, comparing the results
+ * with the C interface. It exits with 1 if any check failed.
+ *
+ * Built against hpp_schema.json, in both database layouts, see
+ * CMakeLists.txt. Keys missing from the database, values of the wrong
+ * type and writes of frozen keys are checked to fail to compile by
+ * hpp_invalid.cpp.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include "esp_config.hpp"
+#include "harness.h"
+
+using esp_config::key;
+
+template <typename K>
+concept has_default = requires { K::default_value(); };
+
+template <typename K>
+concept has_default_size = requires { K::default_size(); };
+
+template <typename K>
+concept has_scalar_get = requires { K::get(); };
+
+template <typename K>
+concept has_ref = requires (typename K::type value, std::size_t size) { K::get_ref(&value, &size); };
+
+static_assert(key<"cpp", "u8">::encoding == UINT8 && std::is_same_v<key<"cpp", "u8">::type, uint8_t>);
+static_assert(key<"cpp", "i8">::encoding == INT8 && std::is_same_v<key<"cpp", "i8">::type, int8_t>);
+static_assert(key<"cpp", "u16">::encoding == UINT16 && std::is_same_v<key<"cpp", "u16">::type, uint16_t>);
+static_assert(key<"cpp", "i16">::encoding == INT16 && std::is_same_v<key<"cpp", "i16">::type, int16_t>);
+static_assert(key<"cpp", "u32">::encoding == UINT32 && std::is_same_v<key<"cpp", "u32">::type, uint32_t>);
+static_assert(key<"cpp", "i32">::encoding == INT32 && std::is_same_v<key<"cpp", "i32">::type, int32_t>);
+static_assert(key<"cpp", "u64">::encoding == UINT64 && std::is_same_v<key<"cpp", "u64">::type, uint64_t>);
+static_assert(key<"cpp", "i64">::encoding == INT64 && std::is_same_v<key<"cpp", "i64">::type, int64_t>);
+static_assert(key<"cpp", "str">::encoding == STRING && std::is_same_v<key<"cpp", "str">::type, const char*>);
+static_assert(key<"cpp", "blob">::encoding == BLOB && std::is_same_v<key<"cpp", "blob">::type, const void*>);
+
+static_assert(esp_config::get_default<"cpp", "u8">() == 200);
+static_assert(esp_config::get_default<"cpp", "i8">() == -100);
+static_assert(esp_config::get_default<"cpp", "u16">() == 60000);
+static_assert(esp_config::get_default<"cpp", "i16">() == -30000);
+static_assert(esp_config::get_default<"cpp", "u32">() == 4000000000u);
+static_assert(esp_config::get_default<"cpp", "i32">() == -2000000000);
+static_assert(esp_config::get_default<"cpp", "u64">() == UINT64_C(18000000000000000000));
+static_assert(esp_config::get_default<"cpp", "i64">() == INT64_C(-9000000000000000000));
+static_assert(esp_config::get_default<"other", "i32">() == 1, "Same key name in another namespace");
+static_assert(key<"cpp", "str">::default_size() == 6 && key<"cpp", "blob">::default_size() == 4);
+static_assert(key<"cpp", "str">::default_value()[0] == 'a');
+
+static_assert(!key<"cpp", "i32">::frozen && !key<"cpp", "i32">::compressed && !key<"cpp", "i32">::variable);
+static_assert(key<"cpp", "frozen_i32">::frozen && esp_config::get_default<"cpp", "frozen_i32">() == 7);
+static_assert(key<"cpp", "frozen_str">::frozen && key<"cpp", "frozen_str">::variable);
+static_assert(key<"cpp", "packed">::compressed && key<"cpp", "packed">::encoding == STRING);
+static_assert(key<"other", "i32">::token.ns == 1 && key<"other", "i32">::token.entry == 0);
+
+static_assert(has_default<key<"cpp", "str">> && !has_default<key<"cpp", "packed">>);
+static_assert(has_default_size<key<"cpp", "blob">> && !has_default_size<key<"cpp", "i32">> && !has_default_size<key<"cpp", "packed">>);
+static_assert(has_scalar_get<key<"cpp", "i64">> && !has_scalar_get<key<"cpp", "str">> && !has_scalar_get<key<"cpp", "blob">>);
+static_assert(has_ref<key<"cpp", "str">> && has_ref<key<"cpp", "blob">> && !has_ref<key<"cpp", "u8">>);
+
+/*
+ * Checks the token of a key against the one resolved at runtime.
+ */
+template <typename K>
+static void hpp_check_token(const char *ns, const char *name) {
+
+    esp_config_token_t token;
+
+    harness_check(esp_config_token_resolve(ns, name, K::encoding, &token) == ESP_OK
+            && token.id == K::token.id && token.ns == K::token.ns && token.entry == K::token.entry, name);
+}
+
+/*
+ * Checks every accessor of an integer key, overriding it with other.
+ */
+template <esp_config::fixed_string Name, typename T>
+static void hpp_check_scalar(T other) {
+
+    using K = key<"cpp", Name>;
+    T value = 0;
+
+    hpp_check_token<K>("cpp", Name.value);
+    harness_check(K::get() == K::default_value() && esp_config::get<"cpp", Name>() == K::default_value(), "get default");
+    harness_check(K::get(value) == 1 && value == K::default_value(), "get default into a variable");
+    harness_check(esp_config::set<"cpp", Name>(other) == ESP_OK, "set");
+    harness_check(esp_config::get<"cpp", Name>() == other, "get override");
+    harness_check(esp_config::get<"cpp", Name>(value) == 0 && value == other, "get override into a variable");
+    harness_check(K::set(K::default_value()) == ESP_OK && K::get(value) == 1, "set back to the default");
+}
+
+static void hpp_check_string() {
+
+    using K = key<"cpp", "str">;
+    char value[16];
+    size_t size = sizeof(value);
+    const char *ref = nullptr;
+    char expected[16];
+    size_t expected_size = sizeof(expected);
+
+    hpp_check_token<K>("cpp", "str");
+    harness_check(K::get(value, &size) == 3 && strcmp(value, "abcdef") == 0, "get default string");
+    harness_check(K::get_ref(&ref, &size) == 1 && size == 6 && memcmp(ref, K::default_value(), size) == 0, "default string in place");
+
+    harness_check(K::set("override") == ESP_OK, "set string");
+    size = sizeof(value);
+    harness_check(K::get(value, &size) == 2 && strcmp(value, "override") == 0, "get string override");
+    esp_config_get_str("cpp", "str", expected, &expected_size);
+    harness_check(size == expected_size && strcmp(value, expected) == 0, "same as the C interface");
+    size = 2;
+    harness_check(K::get(value, &size) == 0 && size == expected_size, "short buffer");
+    harness_check(K::get_ref(&ref, &size) == 0, "string overridden");
+    esp_config_reset_key("cpp", "str");
+}
+
+static void hpp_check_blob() {
+
+    using K = key<"cpp", "blob">;
+    uint8_t value[8];
+    size_t size = 0;
+    const void *ref = nullptr;
+    const uint8_t other[] = {9, 8, 7};
+
+    // Blobs are read with the size of a first call without buffer
+    hpp_check_token<K>("cpp", "blob");
+    harness_check(K::get(nullptr, &size) == 1 && size == 4, "default blob size");
+    harness_check(K::get(value, &size) == 3 && memcmp(value, "\0\1\2\3", 4) == 0, "get default blob");
+    harness_check(K::get_ref(&ref, &size) == 1 && size == 4 && memcmp(ref, K::default_value(), size) == 0, "default blob in place");
+
+    harness_check(K::set(other, sizeof(other)) == ESP_OK, "set blob");
+    harness_check(K::get(nullptr, &size) == 0 && size == 3, "blob override size");
+    harness_check(K::get(value, &size) == 2 && memcmp(value, other, 3) == 0, "get blob override");
+    harness_check(K::get_ref(&ref, &size) == 0, "blob overridden");
+    esp_config_reset_key("cpp", "blob");
+}
+
+static void hpp_check_frozen() {
+
+    nvs_host_stats_t stats;
+    int32_t value = 0;
+    const char *ref = nullptr;
+    size_t size = 0;
+
+    nvs_host_reset_stats();
+    harness_check(esp_config::get<"cpp", "frozen_i32">() == 7, "get frozen");
+    harness_check(esp_config::get<"cpp", "frozen_i32">(value) == 1 && value == 7, "get frozen into a variable");
+    harness_check(key<"cpp", "frozen_str">::get_ref(&ref, &size) == 1 && strcmp(ref, "fixed") == 0 && size == 5, "frozen string in place");
+    nvs_host_get_stats(&stats);
+    harness_check(stats.open == 0 && stats.get == 0, "frozen keys not read from the NVS");
+    harness_check(esp_config_set_i32("cpp", "frozen_i32", 8) == ESP_ERR_NOT_SUPPORTED, "frozen in the C interface too");
+}
+
+static void hpp_check_compressed() {
+
+    using K = key<"cpp", "packed">;
+    char value[64];
+    size_t size = sizeof(value);
+    const char *ref = nullptr;
+    size_t refsize = 0;
+
+    harness_check(K::get(value, &size) == 3 && strcmp(value, "compressed compressed compressed compressed") == 0, "get compressed default");
+    harness_check(K::get_ref(&ref, &refsize) >= 0, "compressed default by reference");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    hpp_check_scalar<"u8">(uint8_t(1));
+    hpp_check_scalar<"i8">(int8_t(-1));
+    hpp_check_scalar<"u16">(uint16_t(2));
+    hpp_check_scalar<"i16">(int16_t(-2));
+    hpp_check_scalar<"u32">(uint32_t(3));
+    hpp_check_scalar<"i32">(int32_t(-3));
+    hpp_check_scalar<"u64">(uint64_t(4));
+    hpp_check_scalar<"i64">(int64_t(-4));
+    hpp_check_token<key<"other", "i32">>("other", "i32");
+    hpp_check_string();
+    hpp_check_blob();
+    hpp_check_frozen();
+    hpp_check_compressed();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
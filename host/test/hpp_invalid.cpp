@@ -0,0 +1,29 @@
+/* @file hpp_invalid.cpp
+ * @brief Uses of esp_config.hpp that must not compile.
+ *
+ * Each case is selected by a compile definition, and built by a test that
+ * expects the static_assert message of esp_config.hpp, see
+ * CMakeLists.txt.
+ */
+
+#if defined(HPP_INVALID_KEYS)
+#include "esp_config_db.h"
+#undef ESP_CONFIG_DB_KEYS
+#define ESP_CONFIG_DB_KEYS 1
+#endif
+
+#include "esp_config.hpp"
+
+void hpp_invalid() {
+
+#if defined(HPP_INVALID_MISSING_KEY)
+    esp_config::get<"cpp", "nokey">();
+#elif defined(HPP_INVALID_SET_TYPE)
+    esp_config::set<"cpp", "i32">(5u);
+#elif defined(HPP_INVALID_GET_TYPE)
+    int64_t value = 0;
+    esp_config::get<"cpp", "i32">(value);
+#elif defined(HPP_INVALID_FROZEN)
+    esp_config::set<"cpp", "frozen_i32">(int32_t(1));
+#endif
+}
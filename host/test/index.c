@@ -0,0 +1,65 @@
+/* @file index.c
+ * @brief Host check of the first lookups, racing to build the hash index.
+ *
+ * INDEX_THREADS threads released together read every int32 key of the
+ * database, last first, before esp_config_init(), so that the first of them builds the
+ * index while the others look keys up. Every read must find its key with
+ * its default. It exits with 1 if any check failed.
+ *
+ * Built against the 10000 keys database, see CMakeLists.txt.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define INDEX_THREADS 8
+
+static pthread_barrier_t start;
+
+static void* index_reader(void *arg) {
+
+    char key[16];
+    int32_t value = 0;
+    long missed = 0;
+
+    (void)arg;
+    pthread_barrier_wait(&start);
+    // Last key first, so that a late builder refilling the slots in database order has not reached it yet
+    for (int i = ESP_CONFIG_DB_KEYS - 1; i >= 0; i--) {
+        if (i % 5 >= 3) {
+            continue;
+        }
+        snprintf(key, sizeof(key), "k%d", i);
+        if (esp_config_get_i32(database[i / 100].name, key, &value) != 1 || value != i) {
+            missed++;
+        }
+    }
+    harness_check(missed == 0, "every key found during the build");
+
+    return NULL;
+}
+
+int main() {
+
+    pthread_t readers[INDEX_THREADS];
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    pthread_barrier_init(&start, NULL, INDEX_THREADS);
+
+    for (int i = 0; i < INDEX_THREADS; i++) {
+        pthread_create(&readers[i], NULL, index_reader, NULL);
+    }
+    for (int i = 0; i < INDEX_THREADS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    harness_check(esp_config_init() == ESP_OK, "init after the build");
+    esp_config_deinit();
+    nvs_flash_deinit();
+    pthread_barrier_destroy(&start);
+
+    return harness_result();
+}
@@ -0,0 +1,110 @@
+/* @file layers.c
+ * @brief Host check of the layers below the NVS overrides.
+ *
+ * A factory and a site partition are written before esp_config_init().
+ * Checks that the highest layer having a value replaces the default, below
+ * the runtime overrides, that writes and erases of a layer take effect at
+ * once, falling back through the layers below, and the errors of the
+ * layer functions. The stack is then set again with a missing partition
+ * between the two: the other layers must still apply, erases must fall
+ * back through the missing one, and writes to it fail. It exits with 1 if
+ * any check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static void layers_store(const char *partition, const char *key, int32_t value) {
+
+    nvs_handle handle;
+
+    nvs_open_from_partition(partition, "bench0", NVS_READWRITE, &handle);
+    nvs_set_i32(handle, key, value);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void layers_check_stack() {
+
+    const char *partitions[] = {"factory", "site"};
+    int32_t value = 0;
+
+    layers_store("factory", "k0", 10);
+    layers_store("factory", "k1", 11);
+    layers_store("site", "k1", 21);
+
+    harness_check(esp_config_layers_set(partitions, 2) == ESP_OK, "layers set");
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 10, "factory value");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 21, "site value above the factory one");
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 1 && value == 2, "compiled default");
+    harness_check(esp_config_get_i32_default("bench0", "k1", &value) == 0 && value == 21, "layer value as the default");
+
+    harness_check(esp_config_set_i32("bench0", "k1", 31) == ESP_OK, "runtime override");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 0 && value == 31, "runtime override above the layers");
+    harness_check(esp_config_reset_key("bench0", "k1") == ESP_OK, "reset");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 21, "reset to the layer value");
+}
+
+static void layers_check_set() {
+
+    int32_t value = 22;
+
+    harness_check(esp_config_layer_set(0, "bench0", "k1", INT32, &(int32_t){12}, 0) == ESP_OK, "write below");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 21, "hidden by the layer above");
+    harness_check(esp_config_layer_set(1, "bench0", "k0", INT32, &(int32_t){20}, 0) == ESP_OK, "write above");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 20, "written value in effect");
+
+    harness_check(esp_config_layer_set(1, "bench0", "k1", INT32, NULL, 0) == ESP_OK, "erase above");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 12, "back to the layer below");
+    harness_check(esp_config_layer_set(0, "bench0", "k1", INT32, NULL, 0) == ESP_OK, "erase below");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 1, "back to the compiled default");
+
+    harness_check(esp_config_layer_set(2, "bench0", "k1", INT32, &value, 0) == ESP_ERR_INVALID_ARG, "layer out of range");
+    harness_check(esp_config_layer_set(0, "bench0", "nokey", INT32, &value, 0) == ESP_ERR_NOT_FOUND, "key outside the database");
+    harness_check(esp_config_layer_set(0, "bench0", "k1", STRING, "text", 0) == ESP_ERR_NOT_FOUND, "wrong encoding");
+    harness_check(esp_config_layers_set(NULL, 0) == ESP_ERR_INVALID_STATE, "stack set after init");
+    esp_config_deinit();
+    harness_check(esp_config_layer_set(0, "bench0", "k1", INT32, &value, 0) == ESP_ERR_INVALID_STATE, "write before init");
+}
+
+static void layers_check_missing() {
+
+    const char *partitions[] = {"factory", "missing", "site"};
+    int32_t value = 0;
+
+    harness_check(esp_config_layers_set(partitions, 4) == ESP_ERR_INVALID_ARG, "too many layers");
+    harness_check(esp_config_layers_set(partitions, 3) == ESP_OK, "layers set with a missing partition");
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 20, "layer above the missing one");
+    layers_store("factory", "k2", 32);
+    esp_config_layer_set(2, "bench0", "k2", INT32, &(int32_t){42}, 0);
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 1 && value == 42, "written above the missing layer");
+
+    harness_check(esp_config_layer_set(1, "bench0", "k2", INT32, &value, 0) == ESP_ERR_NVS_PART_NOT_FOUND, "write to the missing layer");
+    harness_check(esp_config_layer_set(2, "bench0", "k2", INT32, NULL, 0) == ESP_OK, "erase above the missing layer");
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 1 && value == 32, "back through the missing layer");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    nvs_flash_init_partition("factory");
+    nvs_flash_init_partition("site");
+
+    layers_check_stack();
+    layers_check_set();
+    layers_check_missing();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit_partition("site");
+    nvs_flash_deinit_partition("factory");
+    nvs_flash_deinit();
+
+    return harness_result();
+}
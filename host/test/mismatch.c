@@ -0,0 +1,67 @@
+/* @file mismatch.c
+ * @brief Host check of a database miscounted by ESP_CONFIG_DB_KEYS.
+ *
+ * Checks that esp_config_init() refuses a database holding more keys than
+ * ESP_CONFIG_DB_KEYS, and that the keys of such a database are then
+ * treated as unknown, past the declared count too, instead of reaching
+ * the tables sized by it: reads find no default, writes go to the NVS
+ * alone, and walks over all keys fail. It exits with 1 if any check
+ * failed.
+ *
+ * Built against the 100 keys database declaring 90, with the cache and
+ * the statistics, which keep tables of ESP_CONFIG_DB_KEYS entries, and
+ * with NDEBUG so that reads of unknown keys return instead of asserting,
+ * see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static bool mismatch_item(const esp_config_item_t *item, void *arg) {
+    (void)item;
+    (void)arg;
+    return true;
+}
+
+static void mismatch_check_refused() {
+
+    esp_config_token_t token;
+    esp_config_counters_t counters;
+    esp_config_bulk_item_t item = {.key = "k95", .encoding = INT32};
+    int32_t value = 0;
+    int32_t bulk = 0;
+    char buffer[16];
+
+    item.value = &bulk;
+    harness_check(esp_config_init() == ESP_ERR_INVALID_SIZE, "init refused");
+    harness_check(esp_config_token_resolve("bench0", "k95", INT32, &token) == ESP_ERR_NOT_FOUND, "key past the count not resolved");
+    harness_check(esp_config_token_resolve("bench0", "k5", INT32, &token) == ESP_ERR_NOT_FOUND, "key within the count not resolved");
+    harness_check(esp_config_get_i32("bench0", "k95", &value) == -1, "no default past the count");
+    harness_check(esp_config_get_i32("bench0", "k5", &value) == -1, "no default within the count");
+
+    harness_check(esp_config_set_i32("bench0", "k95", 7) == ESP_OK, "write past the count");
+    harness_check(esp_config_get_i32("bench0", "k95", &value) == 0 && value == 7, "write read back");
+
+    harness_check(esp_config_get_bulk("bench0", &item, 1) == ESP_ERR_INVALID_SIZE, "bulk read refused");
+    harness_check(esp_config_foreach(buffer, sizeof(buffer), mismatch_item, NULL) == ESP_ERR_INVALID_SIZE, "iteration refused");
+    harness_check(esp_config_cache_load() == ESP_ERR_INVALID_SIZE, "cache load refused");
+    harness_check(esp_config_stats_get_namespace("bench0", &counters) == ESP_ERR_INVALID_SIZE, "namespace statistics refused");
+    harness_check(esp_config_stats_get_key("bench0", "k95", &counters) == ESP_ERR_INVALID_SIZE, "key statistics refused");
+    harness_check(esp_config_reset_namespace("bench0") == ESP_ERR_INVALID_SIZE, "namespace reset refused");
+    harness_check(esp_config_reset_all() == ESP_ERR_INVALID_SIZE, "full reset refused");
+    esp_config_cache_clear();
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+
+    mismatch_check_refused();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,75 @@
+/* @file pool.c
+ * @brief Host check of the pool of NVS handles.
+ *
+ * Checks that reads of a namespace never written open it once, reads
+ * falling back to the defaults afterwards opening nothing, that the first
+ * write creates the namespace and its value is read back, and that
+ * esp_config_deinit() forgets the missing namespaces. It exits with 1 if
+ * any check failed.
+ *
+ * Built against the 200 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static uint32_t pool_opens() {
+
+    nvs_host_stats_t stats;
+
+    nvs_host_get_stats(&stats);
+    nvs_host_reset_stats();
+    return stats.open;
+}
+
+static void pool_check_missing() {
+
+    int32_t value = 0;
+
+    esp_config_init();
+    pool_opens();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 0, "default of a missing namespace");
+    harness_check(pool_opens() == 1, "missing namespace opened once");
+    for (int i = 0; i < 10; i++) {
+        esp_config_get_i32("bench0", "k1", &value);
+        esp_config_get_i32("bench1", "k101", &value);
+    }
+    harness_check(value == 101 && pool_opens() == 1, "missing namespaces not opened again");
+
+    harness_check(esp_config_set_i32("bench0", "k0", 7) == ESP_OK, "write creates the namespace");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 7, "override read back");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 1, "other key still at its default");
+    harness_check(esp_config_get_i32("bench1", "k101", &value) == 1 && value == 101, "other namespace still missing");
+}
+
+static void pool_check_deinit() {
+
+    nvs_handle handle;
+    int32_t value = 0;
+
+    esp_config_deinit();
+    nvs_open("bench1", NVS_READWRITE, &handle); // Bypassing the library
+    nvs_set_i32(handle, "k101", 9);
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench1", "k101", &value) == 0 && value == 9, "namespace created meanwhile");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 7, "earlier override");
+    esp_config_reset_all();
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+
+    pool_check_missing();
+    pool_check_deinit();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,78 @@
+/* @file ref.c
+ * @brief Host check of the zero-copy getters.
+ *
+ * Checks that defaults are pointed to in place, at the same address on
+ * every call and across esp_config_deinit(), that overridden values are
+ * reported without touching the output, and that keys missing from the
+ * database or of another encoding are rejected. It exits with 1 if any
+ * check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static void ref_check_defaults() {
+
+    const char *string = NULL;
+    const char *again = NULL;
+    const void *blob = NULL;
+    size_t size = 0;
+
+    harness_check(esp_config_get_str_ref("bench0", "k3", &string, &size) == 1 && size == 6 && memcmp(string, "value3", 6) == 0, "default string");
+    harness_check(string[size] == '\0', "default string terminated");
+    harness_check(esp_config_get_str_ref("bench0", "k3", &again, &size) == 1 && again == string, "same address");
+    harness_check(esp_config_get_blob_ref("bench0", "k4", &blob, &size) == 1 && size == 10 && memcmp(blob, "blob000004", 10) == 0, "default blob");
+
+    esp_config_deinit();
+    esp_config_init();
+    harness_check(esp_config_get_str_ref("bench0", "k3", &again, &size) == 1 && again == string, "same address after deinit");
+}
+
+static void ref_check_overridden() {
+
+    const char *string = NULL;
+    const void *blob = NULL;
+    size_t size = 0;
+
+    esp_config_set_str("bench0", "k3", "override");
+    esp_config_set_blob("bench0", "k4", "0123456789", 10);
+    harness_check(esp_config_get_str_ref("bench0", "k3", &string, &size) == 0 && string == NULL && size == 0, "overridden string untouched");
+    harness_check(esp_config_get_blob_ref("bench0", "k4", &blob, &size) == 0 && blob == NULL && size == 0, "overridden blob untouched");
+
+    esp_config_reset_key("bench0", "k3");
+    harness_check(esp_config_get_str_ref("bench0", "k3", &string, &size) == 1 && size == 6 && memcmp(string, "value3", 6) == 0, "default again after a reset");
+    esp_config_reset_key("bench0", "k4");
+}
+
+static void ref_check_missing() {
+
+    const char *string = NULL;
+    const void *blob = NULL;
+    size_t size = 0;
+
+    harness_check(esp_config_get_str_ref("bench0", "nokey", &string, &size) == -1, "missing key");
+    harness_check(esp_config_get_str_ref("nons", "k3", &string, &size) == -1, "missing namespace");
+    harness_check(esp_config_get_str_ref("bench0", "k2", &string, &size) == -1, "integer key");
+    harness_check(esp_config_get_blob_ref("bench0", "k3", &blob, &size) == -1, "string key as a blob");
+    harness_check(string == NULL && blob == NULL && size == 0, "nothing set");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    ref_check_defaults();
+    ref_check_overridden();
+    ref_check_missing();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
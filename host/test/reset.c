@@ -0,0 +1,114 @@
+/* @file reset.c
+ * @brief Host check of the configuration resets.
+ *
+ * Checks that resetting a key, a namespace or the whole configuration
+ * erases the overrides concerned, including those of keys missing from
+ * the defaults database, and nothing else: other namespaces and NVS
+ * entries foreign to the library are kept, and namespaces never written
+ * are not created. Built with the cache, values read before a reset must
+ * not be served after it. It exits with 1 if any check failed.
+ *
+ * Built against the 200 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+/*
+ * Reads an int32_t as stored in the NVS, bypassing the library.
+ *
+ * @return ESP_OK if found, the NVS error otherwise.
+ */
+static esp_err_t reset_stored(const char *ns, const char *key, int32_t *value) {
+
+    nvs_handle handle;
+    esp_err_t esperr = nvs_open(ns, NVS_READONLY, &handle);
+
+    if (esperr == ESP_OK) {
+        esperr = nvs_get_i32(handle, key, value);
+        nvs_close(handle);
+    }
+    return esperr;
+}
+
+static void reset_store(const char *ns, const char *key, int32_t value) {
+
+    nvs_handle handle;
+
+    nvs_open(ns, NVS_READWRITE, &handle);
+    nvs_set_i32(handle, key, value);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void reset_check_key() {
+
+    int32_t value = 0;
+
+    esp_config_set_i32("bench0", "k0", 10);
+    esp_config_set_i32("bench0", "k1", 11);
+    esp_config_get_i32("bench0", "k0", &value); // Cached
+    reset_store("bench0", "extra", 12);
+
+    harness_check(esp_config_reset_key("bench0", "k0") == ESP_OK, "reset key");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 0, "key back to its default");
+    harness_check(reset_stored("bench0", "k0", &value) == ESP_ERR_NVS_NOT_FOUND, "override erased");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 0 && value == 11, "other key kept");
+    harness_check(esp_config_reset_key("bench0", "k0") == ESP_OK, "reset key again");
+
+    harness_check(esp_config_reset_key("bench0", "extra") == ESP_OK, "reset key outside the database");
+    harness_check(reset_stored("bench0", "extra", &value) == ESP_ERR_NVS_NOT_FOUND, "key outside the database erased");
+    harness_check(esp_config_reset_key("bench1", "k100") == ESP_OK && esp_config_reset_key("nons", "k0") == ESP_OK, "reset keys never written");
+    harness_check(reset_stored("bench1", "k100", &value) == ESP_ERR_NVS_NOT_FOUND
+            && reset_stored("nons", "k0", &value) == ESP_ERR_NVS_NOT_FOUND, "namespaces not created");
+    harness_check(esp_config_reset_key(NULL, "k0") == ESP_ERR_INVALID_ARG, "no namespace");
+}
+
+static void reset_check_namespace() {
+
+    int32_t value = 0;
+
+    esp_config_set_i32("bench0", "k2", 12);
+    esp_config_set_i32("bench1", "k100", 13);
+    esp_config_get_i32("bench0", "k2", &value);
+    reset_store("bench0", "extra", 14);
+
+    harness_check(esp_config_reset_namespace("bench0") == ESP_OK, "reset namespace");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 1 && value == 1, "first key back to its default");
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 1 && value == 2, "second key back to its default");
+    harness_check(reset_stored("bench0", "extra", &value) == ESP_ERR_NVS_NOT_FOUND, "key outside the database erased");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 0 && value == 13, "other namespace kept");
+    harness_check(esp_config_reset_namespace("nons") == ESP_ERR_NOT_FOUND, "namespace outside the database");
+}
+
+static void reset_check_all() {
+
+    int32_t value = 0;
+
+    esp_config_set_i32("bench0", "k0", 15);
+    esp_config_get_i32("bench1", "k100", &value);
+    reset_store("foreign", "key", 16);
+
+    harness_check(esp_config_reset_all() == ESP_OK, "reset all");
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 1 && value == 0, "first namespace reset");
+    harness_check(esp_config_get_i32("bench1", "k100", &value) == 1 && value == 100, "second namespace reset");
+    harness_check(reset_stored("foreign", "key", &value) == ESP_OK && value == 16, "foreign entries kept");
+    harness_check(esp_config_reset_all() == ESP_OK, "reset all again");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    reset_check_key();
+    reset_check_namespace();
+    reset_check_all();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,107 @@
+/* @file set.c
+ * @brief Host check of the writes skipped or turned into erases.
+ *
+ * Checks the action reported by esp_config_set() against the NVS
+ * operations actually done: values already in effect are not written,
+ * values equal to their default erase the override or do nothing, and
+ * values differing only in size, or too large to compare on the stack,
+ * are compared whole. Keys outside the defaults database are always
+ * written, and batches stage defaults as erases. It exits with 1 if any
+ * check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+/*
+ * Sets a value with esp_config_set(), checking the action reported and
+ * the number of NVS writes and erases it cost.
+ */
+static void set_check(const char *key, esp_config_encoding_t encoding, const void *value, size_t valuesize,
+        esp_config_set_action_t expected, uint32_t sets, uint32_t erases, const char *what) {
+
+    nvs_host_stats_t stats;
+    esp_config_set_action_t action = -1;
+
+    nvs_host_reset_stats();
+    harness_check(esp_config_set("bench0", key, encoding, value, valuesize, &action) == ESP_OK && action == expected, what);
+    nvs_host_get_stats(&stats);
+    harness_check(stats.set == sets && stats.erase == erases, what);
+}
+
+static void set_check_scalar() {
+
+    int32_t value = 2;      // Default of k2
+    int32_t other = 20;
+
+    set_check("k2", INT32, &value, 0, ESP_CONFIG_SET_UNCHANGED, 0, 0, "default not written");
+    set_check("k2", INT32, &other, 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "override written");
+    set_check("k2", INT32, &other, 0, ESP_CONFIG_SET_UNCHANGED, 0, 0, "override not written again");
+    set_check("k2", INT32, &value, 0, ESP_CONFIG_SET_ERASED, 0, 1, "back to the default erased");
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 1 && value == 2, "default in effect");
+    set_check("k2", INT32, &value, 0, ESP_CONFIG_SET_UNCHANGED, 0, 0, "erased once");
+}
+
+static void set_check_variable() {
+
+    char large[100];
+
+    set_check("k3", STRING, "value3", 0, ESP_CONFIG_SET_UNCHANGED, 0, 0, "default string not written");
+    set_check("k3", STRING, "value", 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "prefix of the default written");
+    set_check("k3", STRING, "value30", 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "longer string written");
+    set_check("k3", STRING, "value30", 0, ESP_CONFIG_SET_UNCHANGED, 0, 0, "same string not written");
+    set_check("k3", STRING, "value3", 0, ESP_CONFIG_SET_ERASED, 0, 1, "string back to the default");
+
+    set_check("k4", BLOB, "blob000004", 10, ESP_CONFIG_SET_UNCHANGED, 0, 0, "default blob not written");
+    set_check("k4", BLOB, "blob00000", 9, ESP_CONFIG_SET_WRITTEN, 1, 0, "shorter blob written");
+    set_check("k4", BLOB, "blob000004", 10, ESP_CONFIG_SET_ERASED, 0, 1, "blob back to the default");
+
+    memset(large, 'x', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+    set_check("k3", STRING, large, 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "large string written");
+    set_check("k3", STRING, large, 0, ESP_CONFIG_SET_UNCHANGED, 0, 0, "large string not written again");
+    large[50] = 'y';
+    set_check("k3", STRING, large, 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "large string changed");
+    esp_config_reset_key("bench0", "k3");
+}
+
+static void set_check_others() {
+
+    int32_t value = 5;
+    esp_config_batch_t batch;
+    nvs_host_stats_t stats;
+
+    set_check("extra", INT32, &value, 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "key outside the database written");
+    set_check("extra", INT32, &value, 0, ESP_CONFIG_SET_WRITTEN, 1, 0, "key outside the database written again");
+
+    esp_config_set_i32("bench0", "k0", 10);
+    esp_config_batch_begin(&batch);
+    esp_config_batch_set_i32(batch, "bench0", "k0", 0);
+    nvs_host_reset_stats();
+    harness_check(esp_config_batch_commit(batch) == ESP_OK, "batch committed");
+    nvs_host_get_stats(&stats);
+    harness_check(stats.erase >= 1 && esp_config_get_i32("bench0", "k0", &value) == 1 && value == 0, "batch default erased");
+
+    harness_check(esp_config_set("bench0", "k2", INT32, NULL, 0, NULL) == ESP_ERR_INVALID_ARG, "no value");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    set_check_scalar();
+    set_check_variable();
+    set_check_others();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,133 @@
+/* @file snapshot.c
+ * @brief Host check of the boot snapshot.
+ *
+ * The emulated NVS is backed by a file, and a reset is emulated by
+ * detaching it before esp_config_deinit() so that the snapshot it saves is
+ * lost. Checks that writes only cost the per-key entry after the first
+ * one, which marks the blob out of date, that esp_config_snapshot_save()
+ * and esp_config_deinit() write the blob, and that a blob left out of date
+ * by a reset is rebuilt on the next boot rather than served, and that a
+ * write the NVS refused is neither read back nor saved. It exits with 1 if
+ * any check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define SNAPSHOT_FILE "esp_config_check_snapshot.nvs"
+
+/*
+ * Restarts the library and the NVS, reloaded from its file. The snapshot
+ * saved by esp_config_deinit() is lost if reset is true.
+ */
+static void snapshot_reboot(bool reset) {
+    if (reset) {
+        nvs_host_set_file(NULL);
+    }
+    esp_config_deinit();
+    nvs_flash_deinit();
+    nvs_host_set_file(SNAPSHOT_FILE);
+    nvs_flash_init();
+}
+
+static bool snapshot_marked_dirty() {
+
+    nvs_handle handle;
+    uint8_t marker = 0;
+
+    if (nvs_open("esp_config", NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u8(handle, "snapshot_dirty", &marker);
+        nvs_close(handle);
+    }
+    return marker != 0;
+}
+
+static void snapshot_check_writes() {
+
+    nvs_host_stats_t stats;
+    int32_t value = 0;
+
+    esp_config_init();
+    harness_check(!snapshot_marked_dirty(), "clean after init");
+
+    nvs_host_reset_stats();
+    for (int i = 0; i < 10; i++) {
+        esp_config_set_i32("bench0", "k0", i + 1);
+    }
+    nvs_host_get_stats(&stats);
+    harness_check(stats.set == 11 && stats.commit == 11, "one write per set, plus the marker");
+    harness_check(snapshot_marked_dirty(), "marked dirty");
+
+    nvs_host_reset_stats();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 10, "read back");
+    nvs_host_get_stats(&stats);
+    harness_check(stats.get == 0, "read from the snapshot");
+
+    harness_check(esp_config_snapshot_save() == ESP_OK, "save");
+    harness_check(!snapshot_marked_dirty(), "clean after save");
+    nvs_host_reset_stats();
+    harness_check(esp_config_snapshot_save() == ESP_OK, "save again");
+    nvs_host_get_stats(&stats);
+    harness_check(stats.commit == 0, "nothing to save");
+}
+
+static void snapshot_check_reboots() {
+
+    nvs_host_stats_t stats;
+    int32_t value = 0;
+
+    esp_config_set_i32("bench0", "k0", 42);
+    snapshot_reboot(true);
+    harness_check(snapshot_marked_dirty(), "left dirty by the reset");
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 42, "rebuilt after a reset");
+    harness_check(!snapshot_marked_dirty(), "clean after the rebuild");
+
+    esp_config_set_i32("bench0", "k1", 43);
+    snapshot_reboot(false);
+    harness_check(!snapshot_marked_dirty(), "saved by deinit");
+    nvs_host_reset_stats();
+    esp_config_init();
+    nvs_host_get_stats(&stats);
+    harness_check(stats.get <= 3, "loaded without a rebuild"); // Snapshot, marker and journal
+    harness_check(esp_config_get_i32("bench0", "k0", &value) == 0 && value == 42, "first value after a clean reboot");
+    harness_check(esp_config_get_i32("bench0", "k1", &value) == 0 && value == 43, "second value after a clean reboot");
+}
+
+static void snapshot_check_failed_write() {
+
+    int32_t value = 0;
+
+    esp_config_set_i32("bench0", "k2", 3); // Marks the blob dirty, so that the next write only sets the key
+    nvs_host_fail_sets_after(0);
+    harness_check(esp_config_set_i32("bench0", "k2", 77) == ESP_ERR_NVS_NOT_ENOUGH_SPACE, "refused write");
+    nvs_host_fail_sets_after(-1);
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 0 && value == 3, "refused write not read back");
+
+    harness_check(esp_config_snapshot_save() == ESP_OK, "save after a refused write");
+    snapshot_reboot(false);
+    esp_config_init();
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 0 && value == 3, "refused write not saved");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    remove(SNAPSHOT_FILE);
+    nvs_host_set_file(SNAPSHOT_FILE);
+    nvs_flash_init();
+
+    snapshot_check_writes();
+    snapshot_check_reboots();
+    snapshot_check_failed_write();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+    nvs_host_set_file(NULL);
+    remove(SNAPSHOT_FILE);
+
+    return harness_result();
+}
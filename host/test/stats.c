@@ -0,0 +1,95 @@
+/* @file stats.c
+ * @brief Host check of the usage statistics.
+ *
+ * Runs a known sequence of reads and writes, of keys of the database and
+ * of keys outside it, directly and through a batch. Checks the counters of
+ * a key, of a namespace and of the whole library against it, that keys
+ * outside the database are only counted in the library totals, that the
+ * latency histograms count every operation, and that
+ * esp_config_stats_reset() zeroes everything. It exits with 1 if any
+ * check failed.
+ *
+ * Built against the 100 keys database, with NDEBUG so that reads of
+ * missing keys return instead of asserting, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static bool stats_counters(const esp_config_counters_t *counters, uint32_t nvs, uint32_t fallback, uint32_t miss, uint32_t set, uint32_t commit) {
+    return counters->nvs == nvs && counters->fallback == fallback && counters->miss == miss
+            && counters->set == set && counters->commit == commit;
+}
+
+static uint32_t stats_histogram_sum(const esp_config_histogram_t *histogram) {
+
+    uint32_t sum = 0;
+
+    for (int i = 0; i < ESP_CONFIG_HISTOGRAM_BUCKETS; i++) {
+        sum += histogram->buckets[i];
+    }
+    return sum;
+}
+
+static void stats_sequence() {
+
+    esp_config_batch_t batch;
+    int32_t value = 0;
+
+    esp_config_get_i32("bench0", "k0", &value);     // Default
+    esp_config_set_i32("bench0", "k0", 7);          // Written
+    esp_config_get_i32("bench0", "k0", &value);     // Override
+    esp_config_set_i32("bench0", "k0", 7);          // Already in effect, not committed
+    esp_config_set_i32("bench0", "k1", 1);          // Default, not committed
+    esp_config_get_i32("bench0", "nokey", &value);  // Missing
+    esp_config_set_i32("bench0", "other", 5);       // Outside the database
+    esp_config_get_i32("bench0", "other", &value);
+
+    esp_config_batch_begin(&batch);
+    esp_config_batch_set_i32(batch, "bench0", "k2", 20);
+    esp_config_batch_commit(batch);
+}
+
+static void stats_check_counters() {
+
+    esp_config_counters_t counters;
+    esp_config_stats_t stats;
+
+    esp_config_stats_reset();
+    stats_sequence();
+
+    harness_check(esp_config_stats_get_key("bench0", "k0", &counters) == ESP_OK && stats_counters(&counters, 1, 1, 0, 2, 1), "key read and written");
+    harness_check(esp_config_stats_get_key("bench0", "k1", &counters) == ESP_OK && stats_counters(&counters, 0, 0, 0, 1, 0), "key set to its default");
+    harness_check(esp_config_stats_get_key("bench0", "k2", &counters) == ESP_OK && stats_counters(&counters, 0, 0, 0, 1, 1), "key written in a batch");
+    harness_check(esp_config_stats_get_key("bench0", "other", &counters) == ESP_ERR_NOT_FOUND, "key outside the database");
+    harness_check(esp_config_stats_get_namespace("bench0", &counters) == ESP_OK && stats_counters(&counters, 1, 1, 0, 4, 2), "namespace");
+    harness_check(esp_config_stats_get_namespace("nons", &counters) == ESP_ERR_NOT_FOUND, "namespace outside the database");
+
+    esp_config_stats_get(&stats);
+    harness_check(stats_counters(&stats.total, 2, 1, 1, 5, 3), "totals with keys outside the database");
+    harness_check(stats_histogram_sum(&stats.get) == 4, "every read timed");
+    harness_check(stats_histogram_sum(&stats.set) == 4, "every write timed");
+    harness_check(stats_histogram_sum(&stats.commit) >= 3, "every commit timed");
+
+    esp_config_stats_reset();
+    esp_config_stats_get(&stats);
+    harness_check(stats_counters(&stats.total, 0, 0, 0, 0, 0), "totals reset");
+    harness_check(stats_histogram_sum(&stats.get) == 0 && stats_histogram_sum(&stats.set) == 0 && stats_histogram_sum(&stats.commit) == 0, "histograms reset");
+    harness_check(esp_config_stats_get_key("bench0", "k0", &counters) == ESP_OK && stats_counters(&counters, 0, 0, 0, 0, 0), "key reset");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    stats_check_counters();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,131 @@
+/* @file token.c
+ * @brief Host check of pre-resolved keys.
+ *
+ * Checks that keys are resolved only with their encoding, that reads and
+ * writes through a token match the ones by name, and that tokens not set
+ * by esp_config_token_resolve() are rejected without touching the NVS:
+ * namespaces, entries and ids out of range, ids of another key than the
+ * one at their namespace and entry, and encodings not matching the key. It exits with 1 if any check failed.
+ *
+ * Built against the 100 keys database, with NDEBUG so that reads through
+ * an invalid token return instead of asserting, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+static void token_check_resolve() {
+
+    esp_config_token_t token;
+
+    harness_check(esp_config_token_resolve("bench0", "k2", INT32, &token) == ESP_OK && token.encoding == INT32, "resolve");
+    harness_check(esp_config_token_resolve("bench0", "k2", STRING, &token) == ESP_ERR_NOT_FOUND, "wrong encoding");
+    harness_check(esp_config_token_resolve("bench0", "nokey", INT32, &token) == ESP_ERR_NOT_FOUND, "missing key");
+    harness_check(esp_config_token_resolve("nons", "k2", INT32, &token) == ESP_ERR_NOT_FOUND, "missing namespace");
+}
+
+static void token_check_access() {
+
+    esp_config_token_t number;
+    esp_config_token_t string;
+    esp_config_token_t blob;
+    int32_t value = 0;
+    char text[16];
+    uint8_t bytes[10];
+    size_t size = 0;
+    const char *ref = NULL;
+
+    esp_config_token_resolve("bench0", "k2", INT32, &number);
+    esp_config_token_resolve("bench0", "k3", STRING, &string);
+    esp_config_token_resolve("bench0", "k4", BLOB, &blob);
+
+    harness_check(esp_config_token_get_i32(number, &value) == 1 && value == 2, "default through a token");
+    harness_check(esp_config_token_set_i32(number, 20) == ESP_OK, "set through a token");
+    harness_check(esp_config_get_i32("bench0", "k2", &value) == 0 && value == 20, "read back by name");
+    harness_check(esp_config_set_i32("bench0", "k2", 21) == ESP_OK, "set by name");
+    harness_check(esp_config_token_get(number, &value, NULL) == 0 && value == 21, "read back through a token");
+
+    harness_check(esp_config_token_set_str(string, "token") == ESP_OK, "set string through a token");
+    size = sizeof(text);
+    harness_check(esp_config_get_str("bench0", "k3", text, &size) == 2 && strcmp(text, "token") == 0, "string read back by name");
+    size = 2;
+    harness_check(esp_config_token_get_str(string, text, &size) == 0 && size == 6, "string into a short buffer");
+    harness_check(esp_config_token_get_str_ref(string, &ref, &size) == 0, "overridden string not in place");
+
+    harness_check(esp_config_token_get_blob_ref(blob, (const void **)&ref, &size) == 1 && size == 10 && memcmp(ref, "blob000004", 10) == 0, "default blob in place");
+    harness_check(esp_config_token_set(blob, "0123456789", 10) == ESP_OK, "set blob through a token");
+    size = sizeof(bytes);
+    harness_check(esp_config_token_get_blob(blob, bytes, &size) == 2 && size == 10 && memcmp(bytes, "0123456789", 10) == 0, "blob read back");
+}
+
+/*
+ * Checks that a token is rejected by the getters and setters of its
+ * encoding, and that the NVS is left alone.
+ */
+static void token_check_invalid(esp_config_token_t token, const char *what) {
+
+    nvs_host_stats_t stats;
+    int32_t value = 0;
+    size_t size = 0;
+    const void *ref = NULL;
+
+    nvs_host_reset_stats();
+    harness_check(esp_config_token_set(token, "0123456789", 10) == ESP_ERR_INVALID_ARG, what);
+    harness_check(esp_config_token_get(token, &value, &size) == -1, what);
+    if (token.encoding == INT32) {
+        harness_check(esp_config_token_set_i32(token, 5) == ESP_ERR_INVALID_ARG, what);
+        harness_check(esp_config_token_get_i32(token, &value) == -1, what);
+    } else if (token.encoding == BLOB) {
+        harness_check(esp_config_token_set_blob(token, "0123456789", 10) == ESP_ERR_INVALID_ARG, what);
+        harness_check(esp_config_token_get_blob_ref(token, &ref, &size) == -1, what);
+    }
+    nvs_host_get_stats(&stats);
+    harness_check(stats.set == 0 && stats.erase == 0 && stats.get == 0, what);
+}
+
+static void token_check_invalids() {
+
+    esp_config_token_t valid;
+    esp_config_token_t token;
+
+    esp_config_token_resolve("bench0", "k2", INT32, &valid);
+
+    token = valid;
+    token.ns = 1000;
+    token_check_invalid(token, "namespace out of range");
+    token = valid;
+    token.entry = 1000;
+    token_check_invalid(token, "entry out of range");
+    token = valid;
+    token.id = 10000;
+    token_check_invalid(token, "id out of range");
+    token = (esp_config_token_t){.id = 50, .ns = 0, .entry = 0, .encoding = INT32}; // k0 is id 0, k50 an INT32 too
+    token_check_invalid(token, "id of another key");
+    token = valid;
+    token.encoding = BLOB; // k2 is an INT32
+    token_check_invalid(token, "encoding not matching the key");
+    token = valid;
+    token.encoding = 0xff;
+    token_check_invalid(token, "unknown encoding");
+
+    harness_check(esp_config_token_get_i32(valid, &(int32_t){0}) == 0, "valid token still read");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    token_check_resolve();
+    token_check_access();
+    token_check_invalids();
+
+    esp_config_reset_all();
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
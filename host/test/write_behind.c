@@ -0,0 +1,123 @@
+/* @file write_behind.c
+ * @brief Host check of write-behind mode.
+ *
+ * The quiet period is long enough for values to stay pending until the
+ * write-behind mode is stopped. Checks that pending values are read back
+ * whole, into short buffers and by range, that a final flush failing in
+ * esp_config_write_behind_stop() or esp_config_deinit() is reported and
+ * keeps the values staged, and that esp_config_flush() writes them later.
+ * It exits with 1 if any check failed.
+ *
+ * Built against the 100 keys database, see CMakeLists.txt.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_config.h"
+#include "harness.h"
+
+#define WRITE_BEHIND_QUIET_MS 3600000
+
+/*
+ * Reads a string as stored in the NVS, bypassing the library.
+ */
+static bool write_behind_stored(const char *key, const char *expected) {
+
+    nvs_handle handle;
+    char value[32] = "";
+    size_t size = sizeof(value);
+
+    nvs_open("bench0", NVS_READONLY, &handle);
+    nvs_get_str(handle, key, value, &size);
+    nvs_close(handle);
+
+    return strcmp(value, expected) == 0;
+}
+
+static void write_behind_check_reads() {
+
+    char value[32];
+    size_t size = 0;
+    uint8_t blob[10] = {0};
+
+    esp_config_set_str("bench0", "k3", "stored");
+    esp_config_write_behind_start(WRITE_BEHIND_QUIET_MS);
+    esp_config_set_str("bench0", "k3", "pending value");
+    esp_config_set_blob("bench0", "k4", "0123456789", 10);
+    harness_check(write_behind_stored("k3", "stored"), "value deferred");
+
+    size = sizeof(value);
+    harness_check(esp_config_get_str("bench0", "k3", value, &size) == 2 && strcmp(value, "pending value") == 0, "pending string");
+    size = 4;
+    memset(value, 0, sizeof(value));
+    harness_check(esp_config_get_str("bench0", "k3", value, &size) == 0 && size == 14 && value[0] == '\0', "pending string, short buffer");
+    size = 4;
+    harness_check(esp_config_get_str_into("bench0", "k3", value, &size) == 0 && size == 14, "pending string into a short buffer");
+    size = 0;
+    harness_check(esp_config_get_str("bench0", "k3", NULL, &size) == 0 && size == 14, "pending string size");
+    size = 4;
+    harness_check(esp_config_get_blob("bench0", "k4", blob, &size) == 0 && size == 10, "pending blob, short buffer");
+    size = 4;
+    harness_check(esp_config_get_blob_range("bench0", "k4", 8, blob, &size) == 2 && size == 2 && memcmp(blob, "89", 2) == 0, "pending blob range");
+
+    harness_check(esp_config_write_behind_stop() == ESP_OK, "stop");
+    harness_check(write_behind_stored("k3", "pending value"), "flushed when stopping");
+}
+
+static void write_behind_check_failed_stop() {
+
+    char value[32];
+    size_t size = 0;
+    int32_t number = 0;
+
+    esp_config_write_behind_start(WRITE_BEHIND_QUIET_MS);
+    esp_config_set_str("bench0", "k3", "not written");
+    nvs_host_fail_sets_after(0);
+    harness_check(esp_config_write_behind_stop() == ESP_ERR_NVS_NOT_ENOUGH_SPACE, "failed flush reported by stop");
+    harness_check(write_behind_stored("k3", "pending value"), "nothing written");
+
+    size = sizeof(value);
+    harness_check(esp_config_get_str("bench0", "k3", value, &size) == 2 && strcmp(value, "not written") == 0, "value still pending");
+    esp_config_set_i32("bench0", "k0", 7); // Staged behind, not to overtake the pending value
+    harness_check(esp_config_get_i32("bench0", "k0", &number) == 0 && number == 7, "later write read back");
+
+    harness_check(esp_config_flush() != ESP_OK, "retry failing");
+    nvs_host_fail_sets_after(-1);
+    harness_check(esp_config_flush() == ESP_OK, "retry");
+    harness_check(write_behind_stored("k3", "not written"), "written by the retry");
+    harness_check(esp_config_get_i32("bench0", "k0", &number) == 0 && number == 7, "later write kept");
+}
+
+static void write_behind_check_failed_deinit() {
+
+    char value[32];
+    size_t size = sizeof(value);
+
+    esp_config_write_behind_start(WRITE_BEHIND_QUIET_MS);
+    esp_config_set_str("bench0", "k3", "after deinit");
+    nvs_host_fail_sets_after(0);
+    esp_config_deinit();
+    nvs_host_fail_sets_after(-1);
+    harness_check(write_behind_stored("k3", "not written"), "nothing written by deinit");
+
+    esp_config_init();
+    harness_check(esp_config_get_str("bench0", "k3", value, &size) == 2 && strcmp(value, "after deinit") == 0, "value kept across deinit");
+    harness_check(esp_config_flush() == ESP_OK, "flush after deinit");
+    harness_check(write_behind_stored("k3", "after deinit"), "written after deinit");
+}
+
+int main() {
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    nvs_flash_init();
+    esp_config_init();
+
+    write_behind_check_reads();
+    write_behind_check_failed_stop();
+    write_behind_check_failed_deinit();
+
+    esp_config_deinit();
+    nvs_flash_deinit();
+
+    return harness_result();
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Compresses a default value for an ESP_CONFIG_FLAG_COMPRESSED entry.
+
+Reads the value from INPUT and writes a C array named NAME holding it
+compressed, to OUTPUT or to the standard output. Strings (-s) get their
+terminator appended, as esp_config stores them. Use the array as the
+default of the entry:
+
+    {.key = "cert", .encoding = STRING, .value = {.blob = NAME},
+     .value_size = sizeof(NAME), .flags = ESP_CONFIG_FLAG_COMPRESSED}
+
+The format is the one of esp_config.c: a 32-bit little-endian header with
+the size of the value and, in its top bit, whether an LZSS stream follows
+rather than the value itself.
+
+Usage: esp_config_compress.py [-s] NAME INPUT [OUTPUT]
+"""
+
+import sys
+
+HEADER = 4
+LZSS = 0x80000000
+WINDOW = 4096
+MIN_MATCH = 3
+MAX_MATCH = 18
+
+
+def compress(data):
+    """Returns data compressed, or stored as is if that is not smaller."""
+    data = bytes(data)
+    out = bytearray()
+    positions = {}
+    flags_at = 0
+    items = 0
+    i = 0
+    while i < len(data):
+        best, distance = 0, 0
+        limit = min(MAX_MATCH, len(data) - i)
+        if limit >= MIN_MATCH:
+            for start in reversed(positions.get(data[i:i + MIN_MATCH], ())):
+                if i - start > WINDOW:
+                    break
+                length = 0
+                while length < limit and data[start + length] == data[i + length]:
+                    length += 1
+                if length > best:
+                    best, distance = length, i - start
+                    if best == limit:
+                        break
+
+        if items == 0:
+            flags_at = len(out)
+            out.append(0)
+            items = 8
+        if best >= MIN_MATCH:
+            code = (distance - 1) | (best - MIN_MATCH) << 12
+            out += bytes((code & 0xff, code >> 8))
+        else:
+            out[flags_at] |= 1 << (8 - items)
+            out.append(data[i])
+            best = 1
+        items -= 1
+
+        for position in range(i, i + best):
+            positions.setdefault(data[position:position + MIN_MATCH], []).append(position)
+        i += best
+
+    if len(out) >= len(data):
+        return len(data).to_bytes(HEADER, "little") + data
+    return (len(data) | LZSS).to_bytes(HEADER, "little") + bytes(out)
+
+
+def decompress(packed):
+    """Inverse of compress(), for checking."""
+    header = int.from_bytes(packed[:HEADER], "little")
+    size = header & ~LZSS
+    if not header & LZSS:
+        return bytes(packed[HEADER:HEADER + size])
+    out = bytearray()
+    i = HEADER
+    while len(out) < size:
+        flags = packed[i]
+        i += 1
+        for bit in range(8):
+            if len(out) >= size:
+                break
+            if flags >> bit & 1:
+                out.append(packed[i])
+                i += 1
+            else:
+                code = packed[i] | packed[i + 1] << 8
+                i += 2
+                start = len(out) - (code & 0xfff) - 1
+                for offset in range((code >> 12) + MIN_MATCH):
+                    out.append(out[start + offset])
+    return bytes(out)
+
+
+def c_array(name, packed, comment):
+    """Returns the definition of a C array holding packed."""
+    lines = ["/* %s */" % comment, "static const uint8_t %s[%d] = {" % (name, len(packed))]
+    for start in range(0, len(packed), 12):
+        lines.append("    " + " ".join("0x%02x," % byte for byte in packed[start:start + 12]))
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    args = sys.argv[1:]
+    string = bool(args) and args[0] == "-s"
+    if string:
+        args = args[1:]
+    if len(args) not in (2, 3):
+        sys.exit(__doc__)
+
+    with open(args[1], "rb") as source:
+        data = source.read()
+    if string:
+        data += b"\0"
+    packed = compress(data)
+    assert decompress(packed) == data
+    text = c_array(args[0], packed, "Generated by esp_config_compress.py from %s: %d bytes, %d compressed"
+                   % (args[1], len(data), len(packed)))
+
+    if len(args) == 3:
+        with open(args[2], "w") as output:
+            output.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
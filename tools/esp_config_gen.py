@@ -0,0 +1,335 @@
+#!/usr/bin/env python3
+"""Generates the defaults database of esp_config from a schema.
+
+The schema is a JSON object of namespaces, each an object of keys:
+
+    {
+        "example": {
+            "i32": {"type": "i32", "default": 12345},
+            "str": {"type": "string", "default": "abcdef"},
+            "blob": {"type": "blob", "hex": "616263646566", "flags": ["frozen"]},
+            "cert": {"type": "string", "file": "cert.pem", "flags": ["compressed"]}
+        }
+    }
+
+Types are u8, i8, u16, i16, u32, i32, u64, i64, string and blob. Integers
+take a "default" number. Strings and blobs take a "default" text, a "hex"
+string or a "file" path relative to the schema. Flags are "frozen" and
+"compressed", see ESP_CONFIG_FLAG_*; compressed defaults are packed with
+esp_config_compress.py.
+
+Namespaces and keys are sorted by name, every count is computed, string
+sizes are precomputed, and a lookup index sorted by key hash is emitted
+as database_index[], searched in flash instead of a hash table built in
+RAM. Select the output with -DESP_CONFIG_DB_HEADER="OUTPUT".
+
+With --compact, the entries are laid out as arrays of one element per
+key instead of an esp_config_entry_t each: key names in one pool
+addressed by 16-bit offsets, encodings and flags in a byte, integers up
+to 32 bits in place and the other defaults in a payload array, see
+esp_config_db_compact_namespace_t in esp_config_db.h.
+
+Usage: esp_config_gen.py [--compact] SCHEMA OUTPUT
+"""
+
+import json
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import esp_config_compress  # noqa: E402
+
+NVS_NAME_MAX = 15
+
+INTEGERS = {
+    "u8": ("UINT8", "uint8", 0, 2**8 - 1),
+    "i8": ("INT8", "int8", -2**7, 2**7 - 1),
+    "u16": ("UINT16", "uint16", 0, 2**16 - 1),
+    "i16": ("INT16", "int16", -2**15, 2**15 - 1),
+    "u32": ("UINT32", "uint32", 0, 2**32 - 1),
+    "i32": ("INT32", "int32", -2**31, 2**31 - 1),
+    "u64": ("UINT64", "uint64", 0, 2**64 - 1),
+    "i64": ("INT64", "int64", -2**63, 2**63 - 1),
+}
+
+FLAGS = {
+    "frozen": "ESP_CONFIG_FLAG_FROZEN",
+    "compressed": "ESP_CONFIG_FLAG_COMPRESSED",
+}
+
+
+class SchemaError(Exception):
+    pass
+
+
+def key_hash(ns, key):
+    """FNV-1a of namespace and key, as esp_config_index_hash() in esp_config.c."""
+    value = 2166136261
+    for byte in ns.encode() + b"\xff" + key.encode():
+        value = ((value ^ byte) * 16777619) & 0xffffffff
+    return value
+
+
+def c_identifier(name):
+    return re.sub(r"[^0-9A-Za-z_]", "_", name)
+
+
+def c_literal(data):
+    """Returns data as C string literals, split over lines of 64 bytes."""
+    parts = []
+    for start in range(0, len(data), 64) if data else [0]:
+        text = ""
+        for byte in data[start:start + 64]:
+            char = chr(byte)
+            if char in "\\\"?":
+                text += "\\" + char
+            elif 0x20 <= byte < 0x7f:
+                text += char
+            else:
+                text += "\\%03o" % byte
+        parts.append('"%s"' % text)
+    return "\n        ".join(parts)
+
+
+def c_integer(kind, value):
+    encoding, _, low, high = INTEGERS[kind]
+    if value == low and low < 0:
+        return "%s_MIN" % encoding
+    if kind == "u64":
+        return "UINT64_C(%d)" % value
+    if kind == "i64":
+        return "INT64_C(%d)" % value
+    return "%d" % value
+
+
+def read_bytes(ns, key, spec, base):
+    sources = [name for name in ("default", "hex", "file") if name in spec]
+    if len(sources) != 1:
+        raise SchemaError("%s/%s: give exactly one of default, hex or file" % (ns, key))
+    if "default" in spec:
+        if not isinstance(spec["default"], str):
+            raise SchemaError("%s/%s: default must be a string" % (ns, key))
+        return spec["default"].encode()
+    if "hex" in spec:
+        try:
+            return bytes.fromhex(spec["hex"])
+        except (TypeError, ValueError):
+            raise SchemaError("%s/%s: invalid hex" % (ns, key))
+    with open(os.path.join(base, spec["file"]), "rb") as source:
+        return source.read()
+
+
+def parse(ns, key, spec, base):
+    """Returns the encoding, flags and default of one entry, compressed if flagged so."""
+    if not isinstance(spec, dict) or "type" not in spec:
+        raise SchemaError("%s/%s: missing type" % (ns, key))
+    kind = spec["type"]
+    flags = spec.get("flags", [])
+    unknown = [flag for flag in flags if flag not in FLAGS]
+    if unknown:
+        raise SchemaError("%s/%s: unknown flags %s" % (ns, key, ", ".join(unknown)))
+
+    if kind in INTEGERS:
+        encoding, _, low, high = INTEGERS[kind]
+        value = spec.get("default")
+        if isinstance(value, bool) or not isinstance(value, int) or not low <= value <= high:
+            raise SchemaError("%s/%s: default must be an integer in [%d, %d]" % (ns, key, low, high))
+        if "compressed" in flags:
+            raise SchemaError("%s/%s: only strings and blobs can be compressed" % (ns, key))
+        return kind, flags, value
+    if kind in ("string", "blob"):
+        data = read_bytes(ns, key, spec, base)
+        if kind == "string":
+            if b"\0" in data:
+                raise SchemaError("%s/%s: strings cannot hold NUL characters" % (ns, key))
+            data += b"\0"
+        if "compressed" in flags:
+            packed = esp_config_compress.compress(data)
+            return kind, flags, (data, packed)
+        return kind, flags, (data, None)
+    raise SchemaError("%s/%s: unknown type %s" % (ns, key, kind))
+
+
+def flags_expression(flags):
+    return " | ".join(FLAGS[flag] for flag in flags)
+
+
+def entry(ns, key, spec, base, arrays):
+    """Returns the initializer of one entry, adding compressed defaults to arrays.
+    Every member is initialized, so that the header builds without
+    -Wmissing-field-initializers warnings."""
+    kind, flags, value = parse(ns, key, spec, base)
+    fields = [".key = %s" % c_literal(key.encode())]
+
+    if kind in INTEGERS:
+        encoding, member, _, _ = INTEGERS[kind]
+        fields += [".encoding = %s" % encoding, ".value = {.%s = %s}" % (member, c_integer(kind, value)), ".value_size = 0"]
+    else:
+        data, packed = value
+        fields.append(".encoding = %s" % kind.upper())
+        if packed is not None:
+            name = "esp_config_db_packed%d" % len(arrays)
+            arrays.append(esp_config_compress.c_array(name, packed, "%s/%s: %d bytes, %d compressed"
+                                                      % (ns, key, len(data), len(packed))))
+            fields += [".value = {.blob = %s}" % name, ".value_size = %d" % len(packed)]
+        elif kind == "string":
+            fields += [".value = {.string = %s}" % c_literal(data[:-1]), ".value_size = %d" % len(data)]
+        else:
+            fields += [".value = {.blob = %s}" % c_literal(data), ".value_size = %d" % len(data)]
+
+    fields.append(".flags = %s" % (flags_expression(flags) if flags else "0"))
+    return "    {" + ", ".join(fields) + "},"
+
+
+def varint(value):
+    """LEB128, as decoded by esp_config_db_entry() in esp_config.c."""
+    out = b""
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value == 0:
+            return out + bytes([byte])
+        out += bytes([byte | 0x80])
+
+
+def compact_entry(ns, key, spec, base, payload):
+    """Returns the type and value of one entry of a compact database, adding
+    64-bit integers, strings and blobs to payload, a list of (name, bytes)."""
+    kind, flags, value = parse(ns, key, spec, base)
+    encoding = INTEGERS[kind][0] if kind in INTEGERS else kind.upper()
+    if flags:
+        encoding = "%s | (%s) << ESP_CONFIG_DB_FLAGS_SHIFT" % (encoding, flags_expression(flags))
+
+    if kind in ("u64", "i64"):
+        data = (value % 2**64).to_bytes(8, "little")
+    elif kind in INTEGERS:
+        _, _, low, high = INTEGERS[kind]
+        return encoding, "0x%x" % (value % (high - low + 1))  # Two's complement in the width of the type
+    else:
+        data, packed = value
+        data = packed if packed is not None else data
+        data = varint(len(data)) + data
+    offset = payload[-1][2] + len(payload[-1][1]) if payload else 0
+    payload.append(("%s/%s" % (c_identifier(ns), c_identifier(key)), data, offset))
+    return encoding, "%d" % offset
+
+
+def wrap(items, per_line=8):
+    return ["    " + " ".join(item + "," for item in items[start:start + per_line])
+            for start in range(0, len(items), per_line)]
+
+
+def generate(schema, base, source, compact=False):
+    if not isinstance(schema, dict) or not schema:
+        raise SchemaError("the schema must be an object of namespaces")
+
+    arrays = []
+    tables = []
+    namespaces = []
+    index = []
+    identifiers = set()
+    keys = 0
+    pool = {}  # Offset of each key name in database_keys[], names shared by namespaces are pooled once
+    pool_size = 0
+    offsets = []
+    types = []
+    values = []
+    payload = []
+
+    for ns in sorted(schema):
+        entries = schema[ns]
+        if not 0 < len(ns.encode()) <= NVS_NAME_MAX:
+            raise SchemaError("namespace %s: names take 1 to %d characters" % (ns, NVS_NAME_MAX))
+        if not isinstance(entries, dict) or not entries:
+            raise SchemaError("namespace %s: must be a non-empty object of keys" % ns)
+        identifier = c_identifier(ns)
+        if identifier.upper() in identifiers:
+            raise SchemaError("namespace %s: clashes with another one once made a C identifier" % ns)
+        identifiers.add(identifier.upper())
+
+        macro = "ESP_CONFIG_DB_ENTRIES_%s" % identifier.upper()
+        lines = ["#define %s %d" % (macro, len(entries))]
+        if not compact:
+            lines.append("static ESP_CONFIG_DB_CONST esp_config_entry_t esp_config_db_%s[%s] = {" % (identifier, macro))
+        first = keys
+        for position, key in enumerate(sorted(entries)):
+            if not 0 < len(key.encode()) <= NVS_NAME_MAX:
+                raise SchemaError("%s/%s: keys take 1 to %d characters" % (ns, key, NVS_NAME_MAX))
+            if compact:
+                encoding, value = compact_entry(ns, key, entries[key], base, payload)
+                types.append(encoding)
+                values.append(value)
+                if key not in pool:
+                    pool[key] = pool_size
+                    pool_size += len(key.encode()) + 1
+                offsets.append(pool[key])
+            else:
+                lines.append(entry(ns, key, entries[key], base, arrays))
+            index.append((key_hash(ns, key), len(namespaces), position, keys))
+            keys += 1
+        if compact:
+            tables.append(lines[0])
+            namespaces.append("    {.name = %s, .nentries = %s, .first = %d}," % (c_literal(ns.encode()), macro, first))
+        else:
+            lines += ["};", ""]
+            tables.append("\n".join(lines))
+            namespaces.append("    {.name = %s, .nentries = %s, .entries = esp_config_db_%s}," % (c_literal(ns.encode()), macro, identifier))
+
+    index.sort()
+    lines = ["/* Generated by esp_config_gen.py from %s, do not edit. */" % os.path.basename(source), ""]
+    lines += arrays
+    lines += tables
+    if compact:
+        lines += ["", "#define ESP_CONFIG_DB_COMPACT 1", "#define ESP_CONFIG_DB_ENTRIES %d" % len(namespaces),
+                  "static ESP_CONFIG_DB_CONST esp_config_db_compact_namespace_t database[ESP_CONFIG_DB_ENTRIES] = {"]
+    else:
+        lines += ["#define ESP_CONFIG_DB_ENTRIES %d" % len(namespaces),
+                  "static ESP_CONFIG_DB_CONST esp_config_namespace_t database[ESP_CONFIG_DB_ENTRIES] = {"]
+    lines += namespaces
+    lines += ["};", "",
+              "#define ESP_CONFIG_DB_KEYS %d" % keys, ""]
+
+    if compact:
+        if max(offsets) > 0xffff:
+            raise SchemaError("key names take more than 64 KiB")
+        lines += ["static ESP_CONFIG_DB_CONST char database_keys[] ="]
+        lines += ["    %s" % c_literal(name.encode() + b"\0") for name in pool]
+        lines[-1] += ";"
+        lines += ["static ESP_CONFIG_DB_CONST uint16_t database_key[ESP_CONFIG_DB_KEYS] = {"]
+        lines += wrap(["%d" % offset for offset in offsets], 12)
+        lines += ["};", "static ESP_CONFIG_DB_CONST uint8_t database_type[ESP_CONFIG_DB_KEYS] = {"]
+        lines += wrap(types)
+        lines += ["};", "static ESP_CONFIG_DB_CONST uint32_t database_value[ESP_CONFIG_DB_KEYS] = {"]
+        lines += wrap(values)
+        lines += ["};", "static ESP_CONFIG_DB_CONST char database_payload[] ="]
+        lines += ["    /* %s */ %s" % (name, c_literal(data)) for name, data, _ in payload] or ['    ""']
+        lines[-1] += ";"
+        lines.append("")
+
+    lines += ["#define ESP_CONFIG_DB_SORTED 1",
+              "static ESP_CONFIG_DB_CONST esp_config_db_index_t database_index[ESP_CONFIG_DB_KEYS] = {"]
+    lines += ["    {0x%08x, %d, %d, %d}," % item for item in index]
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def main():
+    args = sys.argv[1:]
+    compact = "--compact" in args
+    if compact:
+        args.remove("--compact")
+    if len(args) != 2:
+        sys.exit(__doc__)
+    try:
+        with open(args[0]) as source:
+            schema = json.load(source)
+        text = generate(schema, os.path.dirname(os.path.abspath(args[0])), args[0], compact)
+    except (OSError, ValueError, SchemaError) as error:
+        sys.exit("esp_config_gen.py: %s" % error)
+    with open(args[1], "w") as output:
+        output.write(text)
+
+
+if __name__ == "__main__":
+    main()